@@ -0,0 +1,303 @@
+// Copyright (c) 2015 The Truthcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "ballotcache.h"
+
+#include "linalg/src/tc_mat.h"
+#include "main.h"
+#include "script/standard.h"
+#include "sync.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <set>
+
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+
+using namespace std;
+
+extern CMarketTreeDB *pmarkettree;
+
+CBallotCache *pballotcache = NULL;
+
+bool CBallotState::Init(const uint256 &branchidIn, uint32_t heightIn)
+{
+    branchid = branchidIn;
+    height = heightIn;
+
+    if (!pmarkettree)
+        return false;
+    marketBranch *branch = pmarkettree->GetBranch(branchid);
+    if (!branch)
+        return false;
+    if (!branch->tau || (height % branch->tau != 0)) {
+        delete branch;
+        return false;
+    }
+
+    /* the decisions, chosen as in getOutcomeTx */
+    vector<marketDecision *> decisions = pmarkettree->GetDecisions(branchid);
+    for(size_t i=0; i < decisions.size(); i++) {
+        const marketDecision *decision = decisions[i];
+        uint32_t blocknum = decision->eventOverBy + branch->ballotTime
+            + branch->unsealTime;
+        if ((height - branch->tau <= blocknum) && (blocknum < height)) {
+            mapDecisionIndex[decision->GetHash()] = decisionIDs.size();
+            decisionIDs.push_back(decision->GetHash());
+            isScaled.push_back(decision->isScaled);
+        }
+        delete decision;
+    }
+
+    /* the voters: holders of the branch's votecoins */
+    CTransaction tx;
+    uint256 hashBlock;
+    bool fHaveTx = GetTransaction(branch->txid, tx, hashBlock, true);
+    delete branch;
+    if (!fHaveTx || decisionIDs.empty())
+        return false;
+    BOOST_FOREACH(const CTxOut &txout, tx.vout) {
+        CTxDestination dest;
+        CKeyID keyID;
+        if (ExtractDestination(txout.scriptPubKey, dest)) {
+            if (const CKeyID *pkeyID = boost::get<CKeyID>(&dest))
+                keyID = *pkeyID;
+            else if (const CScriptID *pscriptID = boost::get<CScriptID>(&dest))
+                keyID = CKeyID(*pscriptID);
+        }
+        if (!keyID.IsNull())
+            mapVoterIndex[keyID] = voterIDs.size();
+        voterIDs.push_back(keyID);
+        oldRep.push_back(txout.nValue * 1e-8);
+    }
+    vRows.resize(voterIDs.size());
+    return (voterIDs.size() > 1);
+}
+
+bool CBallotState::AddVote(const marketVote &vote)
+{
+    map<CKeyID, uint32_t>::const_iterator vit = mapVoterIndex.find(vote.keyID);
+    if (vit == mapVoterIndex.end())
+        return false;
+    if (vote.decisionIDs.size() != vote.decisionVotes.size())
+        return false;
+
+    /* the first vote on each decision counts, as in getOutcomeTx */
+    map<uint32_t, double> row;
+    for(size_t k=0; k < vote.decisionIDs.size(); k++) {
+        if (vote.decisionVotes[k] == vote.NA)
+            continue;
+        map<uint256, uint32_t>::const_iterator dit
+            = mapDecisionIndex.find(vote.decisionIDs[k]);
+        if (dit != mapDecisionIndex.end())
+            row.insert(make_pair(dit->second, vote.decisionVotes[k] * 1e-8));
+    }
+
+    vector<pair<uint32_t, double> > &vRow = vRows[vit->second];
+    nVotes -= vRow.size();
+    vRow.assign(row.begin(), row.end());
+    nVotes += vRow.size();
+    fDirty = true;
+    return true;
+}
+
+void CBallotCache::SyncTransaction(const CTransaction &tx, const CBlock *pblock)
+{
+    /* only votes in connected blocks, not those in the mempool */
+    if (!pblock || !pmarkettree)
+        return;
+    AssertLockHeld(cs_main);
+
+    vector<marketVote> vVotes;
+    BOOST_FOREACH(const CTxOut &txout, tx.vout) {
+        const CScript &scriptPubKey = txout.scriptPubKey;
+        size_t script_sz = scriptPubKey.size();
+        if ((script_sz < 2) || (scriptPubKey[script_sz-1] != OP_MARKET))
+            continue;
+        marketObj *obj = marketObjCtr(scriptPubKey);
+        if (!obj)
+            continue;
+        if (obj->marketop == 'V') {
+            obj->txid = tx.GetHash();
+            /* only votes sealed and revealed in time, as in getOutcomeTx */
+            const marketVote *vote = (const marketVote *) obj;
+            marketBranch *branch = pmarkettree->GetBranch(vote->branchid);
+            if (branch && pmarkettree->IsVoteSealed(*branch, *vote))
+                vVotes.push_back(*vote);
+            delete branch;
+        }
+        delete obj;
+    }
+    if (vVotes.empty())
+        return;
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    vPending.insert(vPending.end(), vVotes.begin(), vVotes.end());
+    condPending.notify_one();
+}
+
+void CBallotCache::Refresh(const pair<uint256, uint32_t> &key)
+{
+    struct tc_vote *vote = NULL;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        map<pair<uint256, uint32_t>, CBallotState>::iterator it = mapBallots.find(key);
+        if (it == mapBallots.end())
+            return;
+        CBallotState &state = it->second;
+        state.fDirty = false;
+
+        uint32_t nr = state.voterIDs.size();
+        uint32_t nc = state.decisionIDs.size();
+        struct tc_spmat *S = tc_spmat_ctr(nr, nc, state.nVotes);
+        uint32_t k = 0;
+        for(uint32_t i=0; i < nr; i++) {
+            S->rowp[i] = k;
+            for(size_t p=0; p < state.vRows[i].size(); p++, k++) {
+                S->colidx[k] = state.vRows[i][p].first;
+                S->val[k] = state.vRows[i][p].second;
+            }
+        }
+        S->rowp[nr] = k;
+
+        vote = tc_vote_sparse_ctr(S);
+        /* the rotations of a Jacobi sweep run in parallel */
+        vote->svd = TC_SVD_JACOBI;
+        vote->NA = -1.0;
+        vote->alpha = 0.10;
+        vote->tol = 0.10;
+        for(uint32_t i=0; i < nr; i++)
+            vote->rvecs[TC_VOTE_OLD_REP]->a[i][0] = state.oldRep[i];
+        for(uint32_t j=0; j < nc; j++)
+            vote->cvecs[TC_VOTE_IS_BINARY]->a[0][j] = (state.isScaled[j])? 0.0: 1.0;
+        if (state.loading.size() == nc) {
+            vote->warm = tc_mat_ctr(nc, 1);
+            for(uint32_t j=0; j < nc; j++)
+                vote->warm->a[j][0] = state.loading[j];
+        }
+    }
+
+    /* the computation itself is done without holding the lock */
+    int64_t nStart = GetTimeMicros();
+    int rc = tc_vote_proc(vote);
+    int64_t nTime = GetTimeMicros() - nStart;
+
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        map<pair<uint256, uint32_t>, CBallotState>::iterator it = mapBallots.find(key);
+        if ((it != mapBallots.end()) && (rc == 0)) {
+            CBallotState &state = it->second;
+            const struct tc_mat *firstloading = vote->cvecs[TC_VOTE_FIRST_LOADING];
+            state.loading.assign(firstloading->a[0], firstloading->a[0] + firstloading->nc);
+            LogPrint("market", "%s: ballot %s/%u: %u voters, %u decisions, %u votes, %u power iterations, %.2fms\n",
+                __func__, key.first.ToString(), key.second, vote->nr, vote->nc,
+                state.nVotes, vote->niter, 0.001 * nTime);
+        }
+    }
+    tc_vote_dtr(vote);
+}
+
+void CBallotCache::Thread()
+{
+    while (true) {
+        vector<marketVote> vVotes;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (vPending.empty())
+                condPending.wait(lock);
+            vVotes.swap(vPending);
+        }
+
+        int nHeight;
+        {
+            LOCK(cs_main);
+            nHeight = chainActive.Height();
+        }
+
+        /* ballots decided by now are dropped */
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            map<pair<uint256, uint32_t>, CBallotState>::iterator it = mapBallots.begin();
+            while (it != mapBallots.end()) {
+                if (it->first.second <= (uint32_t) nHeight)
+                    mapBallots.erase(it++);
+                else
+                    it++;
+            }
+        }
+
+        set<pair<uint256, uint32_t> > setDirty;
+        BOOST_FOREACH(const marketVote &vote, vVotes) {
+            if (vote.height <= (uint32_t) nHeight)
+                continue;
+            pair<uint256, uint32_t> key = make_pair(vote.branchid, vote.height);
+
+            bool fHave;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                fHave = mapBallots.count(key);
+            }
+            if (!fHave) {
+                /* reads the market index, so under cs_main rather than
+                 * the lock */
+                CBallotState state;
+                {
+                    LOCK(cs_main);
+                    if (!state.Init(key.first, key.second))
+                        continue;
+                }
+                boost::unique_lock<boost::mutex> lock(mutex);
+                mapBallots.insert(make_pair(key, state));
+            }
+
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (mapBallots[key].AddVote(vote))
+                setDirty.insert(key);
+        }
+
+        BOOST_FOREACH(const PAIRTYPE(uint256, uint32_t) &key, setDirty) {
+            boost::this_thread::interruption_point();
+            Refresh(key);
+        }
+    }
+}
+
+bool CBallotCache::GetLoading(const uint256 &branchid, uint32_t height,
+    const vector<uint256> &decisionIDs, vector<double> &loading)
+{
+    loading.clear();
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    map<pair<uint256, uint32_t>, CBallotState>::const_iterator it
+        = mapBallots.find(make_pair(branchid, height));
+    if ((it == mapBallots.end()) || it->second.loading.empty())
+        return false;
+    const CBallotState &state = it->second;
+
+    /* decisions the cache does not know about start at zero */
+    bool fAny = false;
+    loading.resize(decisionIDs.size(), 0.0);
+    for(size_t j=0; j < decisionIDs.size(); j++) {
+        map<uint256, uint32_t>::const_iterator dit
+            = state.mapDecisionIndex.find(decisionIDs[j]);
+        if (dit != state.mapDecisionIndex.end()) {
+            loading[j] = state.loading[dit->second];
+            fAny = true;
+        }
+    }
+    if (!fAny)
+        loading.clear();
+    return fAny;
+}
+
+void ThreadBallotCache()
+{
+    // Make this thread recognisable as the ballot cache thread
+    RenameThread("truthcoin-ballots");
+
+    if (!pballotcache)
+        return;
+    pballotcache->Thread();
+}
@@ -0,0 +1,94 @@
+// Copyright (c) 2015 The Truthcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef TRUTHCOIN_BALLOTCACHE_H
+#define TRUTHCOIN_BALLOTCACHE_H
+
+#include "main.h"
+#include "primitives/market.h"
+#include "pubkey.h"
+#include "uint256.h"
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/**
+ * The running state of one ballot while its votes are revealed: its
+ * decisions and voters, the votes connected so far as a sparse vote
+ * matrix and the first loading of the last computation on it.
+ */
+class CBallotState
+{
+public:
+    uint256 branchid;
+    uint32_t height;
+
+    std::vector<uint256> decisionIDs;
+    std::vector<uint64_t> isScaled;
+    std::map<uint256, uint32_t> mapDecisionIndex;
+
+    /** voters with their reputation, scaled as in marketOutcome::calc */
+    std::vector<CKeyID> voterIDs;
+    std::vector<double> oldRep;
+    std::map<CKeyID, uint32_t> mapVoterIndex;
+
+    /** row i: voterIDs[i]'s (decision index, vote) pairs, sorted */
+    std::vector<std::vector<std::pair<uint32_t, double> > > vRows;
+    uint32_t nVotes;
+
+    /** first loading in decisionIDs order, empty until computed */
+    std::vector<double> loading;
+    bool fDirty;
+
+    CBallotState() : height(0), nVotes(0), fDirty(false) { }
+
+    /** Look up the ballot's decisions and voters */
+    bool Init(const uint256 &branchidIn, uint32_t heightIn);
+    /** Replace the votes of vote.keyID with vote's */
+    bool AddVote(const marketVote &vote);
+};
+
+/**
+ * Keeps the outcome of every open ballot pre-computed while its votes
+ * are connected, so that the miner only has to refine the first
+ * loading of the final ballot with a few power iterations instead of
+ * starting from scratch.
+ *
+ * Votes are queued by SyncTransaction and applied by a worker thread.
+ * Whether a vote was sealed in time is looked up when it is queued,
+ * under cs_main, as the market index is only whole between blocks.
+ * The loading is only ever used as a starting point, so votes from
+ * blocks that are later disconnected cost iterations, not correctness.
+ */
+class CBallotCache : public CValidationInterface
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable condPending;
+    std::vector<marketVote> vPending;
+    std::map<std::pair<uint256, uint32_t>, CBallotState> mapBallots;
+
+    void Refresh(const std::pair<uint256, uint32_t> &key);
+
+protected:
+    void SyncTransaction(const CTransaction &tx, const CBlock *pblock);
+
+public:
+    /** Apply queued votes and refresh their ballots until interrupted */
+    void Thread();
+    /** The warm start for the outcome of branchid at height, with its
+     *  entries in the order of decisionIDs */
+    bool GetLoading(const uint256 &branchid, uint32_t height,
+        const std::vector<uint256> &decisionIDs, std::vector<double> &loading);
+};
+
+extern CBallotCache *pballotcache;
+
+void ThreadBallotCache();
+
+#endif // TRUTHCOIN_BALLOTCACHE_H
@@ -0,0 +1,174 @@
+// Copyright (c) 2015 The Truthcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/* bench_checkqueue
+ * Times CCheckQueue on rounds of synthetic checks, as ConnectBlock adds
+ * the script checks of a block, over a sweep of thread counts (-par,
+ * the master included). Arguments are name=value pairs:
+ *
+ *    checks=10000    number of checks per round (block)
+ *    per=5           checks per Add, as a transaction's inputs
+ *    batch=128       the queue's batch size, as scriptcheckqueue's
+ *    cost=100        SHA256 compressions per check
+ *    par=1,2,4,8,16  thread counts to sweep
+ *    count=5         number of rounds per thread count
+ */
+
+#include "checkqueue.h"
+#include "crypto/sha256.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+static double
+bench_time(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_usec * 0.000001 + tv.tv_sec;
+}
+
+static int
+bench_arg(const char *arg, const char *name, const char **value)
+{
+    size_t len = strlen(name);
+    if (strncmp(arg, name, len) || (arg[len] != '='))
+        return 0;
+    *value = arg + len + 1;
+    return 1;
+}
+
+/** A check that hashes for a while, standing in for a signature check */
+class CBenchCheck
+{
+private:
+    uint32_t nCost;
+    uint32_t nSeed;
+
+public:
+    CBenchCheck() : nCost(0), nSeed(0) {}
+    CBenchCheck(uint32_t nCostIn, uint32_t nSeedIn) : nCost(nCostIn), nSeed(nSeedIn) {}
+
+    bool operator()()
+    {
+        unsigned char buf[64];
+        memset(buf, 0, sizeof(buf));
+        memcpy(buf, &nSeed, sizeof(nSeed));
+        for (uint32_t i = 0; i < nCost; i++)
+            CSHA256().Write(buf, sizeof(buf)).Finalize(buf);
+        /* never fails, but the compiler cannot know that */
+        return buf[0] != 0 || buf[1] != 0 || buf[2] != 0 || buf[3] != 0 || buf[4] != 0xff;
+    }
+
+    void swap(CBenchCheck &check)
+    {
+        std::swap(nCost, check.nCost);
+        std::swap(nSeed, check.nSeed);
+    }
+};
+
+static void
+bench_thread(CCheckQueue<CBenchCheck> *pqueue)
+{
+    pqueue->Thread();
+}
+
+int
+main(int argc, char **argv)
+{
+    uint32_t checks = 10000, per = 5, batch = 128, cost = 100;
+    int count = 5;
+    std::vector<int> vPar;
+    for (int i = 1; i < argc; i++) {
+        const char *v;
+        if (bench_arg(argv[i], "checks", &v)) checks = atoi(v);
+        else if (bench_arg(argv[i], "per", &v)) per = atoi(v);
+        else if (bench_arg(argv[i], "batch", &v)) batch = atoi(v);
+        else if (bench_arg(argv[i], "cost", &v)) cost = atoi(v);
+        else if (bench_arg(argv[i], "count", &v)) count = atoi(v);
+        else if (bench_arg(argv[i], "par", &v)) {
+            vPar.clear();
+            for (char *end; *v; v = end + (*end == ',')) {
+                vPar.push_back(strtol(v, &end, 10));
+                if (end == v)
+                    break;
+            }
+        }
+        else {
+            fprintf(stderr, "bench_checkqueue: unknown argument %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (vPar.empty())
+        for (int n = 1; n <= 16; n *= 2)
+            vPar.push_back(n);
+    if ((checks < 1) || (per < 1) || (batch < 1) || (count < 1)) {
+        fprintf(stderr, "bench_checkqueue: need checks, per, batch and count >= 1\n");
+        return 1;
+    }
+    for (size_t k = 0; k < vPar.size(); k++) {
+        if ((vPar[k] < 1) || (vPar[k] > 64)) {
+            fprintf(stderr, "bench_checkqueue: par must be in 1..64\n");
+            return 1;
+        }
+    }
+
+    printf("checks %u, %u per Add, batch %u, cost %u, %u hardware threads\n",
+        checks, per, batch, cost, boost::thread::hardware_concurrency());
+
+    /* the checks run in line, as with -par=1 and no queue, for a baseline */
+    double tInline = 1e300;
+    for (int run = 0; run < count; run++) {
+        double t = bench_time();
+        for (uint32_t i = 0; i < checks; i++)
+            CBenchCheck(cost, i)();
+        t = bench_time() - t;
+        if (t < tInline) tInline = t;
+    }
+    printf("%-10s min %10.3fms\n", "inline", tInline * 1000.0);
+
+    for (size_t k = 0; k < vPar.size(); k++) {
+        int nPar = vPar[k];
+        CCheckQueue<CBenchCheck> queue(batch, nPar);
+        boost::thread_group threadGroup;
+        for (int i = 0; i < nPar - 1; i++)
+            threadGroup.create_thread(boost::bind(&bench_thread, &queue));
+
+        double min = 1e300, max = 0.0, sum = 0.0;
+        for (int run = 0; run < count; run++) {
+            double t = bench_time();
+            CCheckQueueControl<CBenchCheck> control(&queue);
+            for (uint32_t i = 0; i < checks; i += per) {
+                std::vector<CBenchCheck> vChecks;
+                for (uint32_t j = i; j < std::min(checks, i + per); j++)
+                    vChecks.push_back(CBenchCheck(cost, j));
+                control.Add(vChecks);
+            }
+            if (!control.Wait()) {
+                fprintf(stderr, "bench_checkqueue: a check failed\n");
+                return 1;
+            }
+            t = bench_time() - t;
+            if (t < min) min = t;
+            if (t > max) max = t;
+            sum += t;
+        }
+        threadGroup.interrupt_all();
+        threadGroup.join_all();
+
+        char name[16];
+        snprintf(name, sizeof(name), "par=%d", nPar);
+        printf("%-10s min %10.3fms / avg %10.3fms / max %10.3fms  (%.2fx inline)\n",
+            name, min * 1000.0, (sum / count) * 1000.0, max * 1000.0, tInline / min);
+    }
+    return 0;
+}
@@ -0,0 +1,166 @@
+// Copyright (c) 2015 The Truthcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/* bench_merkle
+ * Times the hashing of merkle tree nodes: one CHash256 per node, as
+ * BuildMerkleTree used to do it, against SHA256D64 with the portable
+ * code and with the lanes SHA256AutoDetect picks, and BuildMerkleTree
+ * itself on a block of synthetic transactions either way. Arguments
+ * are name=value pairs:
+ *
+ *    leaves=4096     number of transactions in the block
+ *    count=5         number of runs
+ */
+
+#include "crypto/sha256.h"
+#include "hash.h"
+#include "primitives/block.h"
+#include "primitives/transaction.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <vector>
+
+static double
+bench_time(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_usec * 0.000001 + tv.tv_sec;
+}
+
+static int
+bench_arg(const char *arg, const char *name, const char **value)
+{
+    size_t len = strlen(name);
+    if (strncmp(arg, name, len) || (arg[len] != '='))
+        return 0;
+    *value = arg + len + 1;
+    return 1;
+}
+
+struct bench_result {
+    double min, sum, max;
+};
+
+static void
+bench_add(struct bench_result *r, double t)
+{
+    if (t < r->min) r->min = t;
+    if (t > r->max) r->max = t;
+    r->sum += t;
+}
+
+static void
+bench_print(const char *name, const struct bench_result *r, int count, uint32_t nhashes)
+{
+    printf("%-24s min %10.3fms / avg %10.3fms / max %10.3fms  (%.3fus per node)\n",
+        name, r->min * 1000.0, (r->sum / count) * 1000.0, r->max * 1000.0,
+        (r->sum / count) * 1e6 / nhashes);
+}
+
+/* the tree's inner nodes, one at a time */
+static void
+bench_chash256(std::vector<unsigned char> &out, const std::vector<unsigned char> &in, uint32_t nodes)
+{
+    for(uint32_t i=0; i < nodes; i++)
+        CHash256().Write(&in[i * 64], 64).Finalize(&out[i * 32]);
+}
+
+int
+main(int argc, char **argv)
+{
+    uint32_t leaves = 4096;
+    int count = 5;
+    for(int i=1; i < argc; i++) {
+        const char *v;
+        if (bench_arg(argv[i], "leaves", &v)) leaves = atoi(v);
+        else if (bench_arg(argv[i], "count", &v)) count = atoi(v);
+        else {
+            fprintf(stderr, "bench_merkle: unknown argument %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if ((leaves < 2) || (count < 1)) {
+        fprintf(stderr, "bench_merkle: need leaves >= 2, count >= 1\n");
+        return 1;
+    }
+
+    /* a block whose transactions differ only in their lock times */
+    CBlock block;
+    for(uint32_t i=0; i < leaves; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vout.resize(1);
+        tx.nLockTime = i;
+        block.vtx.push_back(CTransaction(tx));
+    }
+    uint32_t nodes = leaves / 2;
+    std::vector<unsigned char> in(nodes * 64), out(nodes * 32), ref(nodes * 32);
+    for(uint32_t i=0; i < nodes * 2; i++)
+        memcpy(&in[i * 32], block.vtx[i].GetHash().begin(), 32);
+
+    /* the inner nodes of the whole tree, for the per node figures */
+    uint32_t ntree = 0;
+    for(uint32_t n=leaves; n > 1; n = (n + 1) / 2)
+        ntree += (n + 1) / 2;
+
+    printf("leaves %u, %u nodes on the lowest level, %u in the tree\n", leaves, nodes, ntree);
+    struct bench_result rs[5];
+    for(int k=0; k < 5; k++) {
+        rs[k].min = 1e300;
+        rs[k].sum = rs[k].max = 0.0;
+    }
+
+    uint256 root;
+    for(int run=0; run < count; run++) {
+        double t = bench_time();
+        bench_chash256(ref, in, nodes);
+        bench_add(&rs[0], bench_time() - t);
+
+        t = bench_time();
+        SHA256D64(&out[0], &in[0], nodes);
+        bench_add(&rs[1], bench_time() - t);
+
+        t = bench_time();
+        root = block.BuildMerkleTree();
+        bench_add(&rs[2], bench_time() - t);
+    }
+    if (out != ref) {
+        fprintf(stderr, "bench_merkle: SHA256D64 disagrees with CHash256\n");
+        return 1;
+    }
+
+    /* the detected lanes stay in place once picked, so they go last */
+    std::string strImpl = SHA256AutoDetect();
+    for(int run=0; run < count; run++) {
+        double t = bench_time();
+        SHA256D64(&out[0], &in[0], nodes);
+        bench_add(&rs[3], bench_time() - t);
+
+        t = bench_time();
+        uint256 rootSIMD = block.BuildMerkleTree();
+        bench_add(&rs[4], bench_time() - t);
+        if (rootSIMD != root) {
+            fprintf(stderr, "bench_merkle: merkle roots differ\n");
+            return 1;
+        }
+    }
+    if (out != ref) {
+        fprintf(stderr, "bench_merkle: SHA256D64 (%s) disagrees with CHash256\n", strImpl.c_str());
+        return 1;
+    }
+
+    bench_print("CHash256 per node", &rs[0], count, nodes);
+    bench_print("SHA256D64 standard", &rs[1], count, nodes);
+    bench_print("BuildMerkleTree standard", &rs[2], count, ntree);
+    printf("detected: %s\n", strImpl.c_str());
+    bench_print("SHA256D64 detected", &rs[3], count, nodes);
+    bench_print("BuildMerkleTree detected", &rs[4], count, ntree);
+    return 0;
+}
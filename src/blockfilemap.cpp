@@ -0,0 +1,89 @@
+// Copyright (c) 2015 The Truthcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+
+#include "compat.h"
+#include "main.h"
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+#include <boost/filesystem.hpp>
+
+CMappedFile::~CMappedFile()
+{
+#ifndef WIN32
+    munmap((void*)pbegin, nSize);
+#endif
+}
+
+/** Map block file nFile as a whole, provided it is at least nEnd bytes long. */
+static CMappedFile* MapBlockFile(int nFile, size_t nEnd)
+{
+#ifdef WIN32
+    return NULL;
+#else
+    boost::filesystem::path path = GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk");
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1)
+        return NULL;
+    struct stat st;
+    void* p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && (uint64_t)st.st_size >= nEnd)
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return NULL;
+    return new CMappedFile((const char*)p, st.st_size);
+#endif
+}
+
+void CBlockFileMap::Erase(int nFile)
+{
+    std::map<int, list_type::iterator>::iterator mi = mapFiles.find(nFile);
+    if (mi == mapFiles.end())
+        return;
+    listFiles.erase(mi->second);
+    mapFiles.erase(mi);
+}
+
+boost::shared_ptr<const CMappedFile> CBlockFileMap::Get(int nFile, size_t nEnd)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    std::map<int, list_type::iterator>::iterator mi = mapFiles.find(nFile);
+    if (mi != mapFiles.end()) {
+        list_type::iterator it = mi->second;
+        if (it->second->size() >= nEnd) {
+            listFiles.splice(listFiles.begin(), listFiles, it);
+            return it->second;
+        }
+        // The file grew since it was mapped
+        Erase(nFile);
+    }
+
+    boost::shared_ptr<const CMappedFile> mapped(MapBlockFile(nFile, nEnd));
+    if (!mapped)
+        return mapped;
+    listFiles.push_front(std::make_pair(nFile, mapped));
+    mapFiles[nFile] = listFiles.begin();
+    while (listFiles.size() > nMaxFiles)
+        Erase(listFiles.back().first);
+    return mapped;
+}
+
+void CBlockFileMap::Forget(int nFile)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    Erase(nFile);
+}
+
+void CBlockFileMap::Clear()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    mapFiles.clear();
+    listFiles.clear();
+}
@@ -0,0 +1,74 @@
+// Copyright (c) 2015 The Truthcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef TRUTHCOIN_BLOCKFILEMAP_H
+#define TRUTHCOIN_BLOCKFILEMAP_H
+
+#include <list>
+#include <map>
+#include <stddef.h>
+#include <utility>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+/** Block files at most kept mapped at once */
+static const size_t MAX_MAPPED_BLOCK_FILES = sizeof(void*) > 4 ? 64 : 8;
+
+/** One block file mapped read-only into memory, unmapped with its last reference */
+class CMappedFile
+{
+private:
+    // Disallow copies
+    CMappedFile(const CMappedFile&);
+    CMappedFile& operator=(const CMappedFile&);
+
+    const char* pbegin;
+    size_t nSize;
+
+public:
+    CMappedFile(const char* pbeginIn, size_t nSizeIn) : pbegin(pbeginIn), nSize(nSizeIn) {}
+    ~CMappedFile();
+
+    const char* begin() const { return pbegin; }
+    size_t size() const { return nSize; }
+};
+
+/**
+ * Keeps the most recently read blk?????.dat files mapped into memory, so
+ * blocks and transactions can be deserialized straight out of them without
+ * opening the file, seeking and copying through stdio buffers every time.
+ *
+ * A file only gets mapped up to its size at the time, so blocks appended
+ * later are covered by mapping it again. Readers hold on to the mapping
+ * they got for as long as they read from it, also when it is replaced or
+ * dropped in the meantime. Files that cannot be mapped (or any file, on
+ * platforms without mmap) are left to be read the ordinary way.
+ */
+class CBlockFileMap
+{
+private:
+    typedef std::list<std::pair<int, boost::shared_ptr<const CMappedFile> > > list_type;
+
+    boost::mutex mutex;
+    size_t nMaxFiles;
+    //! The mapped files, most recently used first
+    list_type listFiles;
+    std::map<int, list_type::iterator> mapFiles;
+
+    void Erase(int nFile);
+
+public:
+    CBlockFileMap(size_t nMaxFilesIn = MAX_MAPPED_BLOCK_FILES) : nMaxFiles(nMaxFilesIn) {}
+
+    /** The mapping of block file nFile, covering at least its first nEnd bytes; NULL if there is none. */
+    boost::shared_ptr<const CMappedFile> Get(int nFile, size_t nEnd);
+
+    /** Drop the mapping of block file nFile, before it is truncated. */
+    void Forget(int nFile);
+
+    void Clear();
+};
+
+#endif // TRUTHCOIN_BLOCKFILEMAP_H
@@ -87,6 +87,8 @@ enum BlockStatus {
     BLOCK_FAILED_VALID       =   32, //! stage after last reached validness failed
     BLOCK_FAILED_CHILD       =   64, //! descends from failed block
     BLOCK_FAILED_MASK        =   BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
+
+    BLOCK_IN_SNAPSHOT        =  128, //! not downloaded: the chainstate was loaded from a snapshot above it
 };
 
 /** The block chain is a tree shaped structure starting with the
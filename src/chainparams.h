@@ -53,6 +53,8 @@ public:
     int EnforceBlockUpgradeMajority() const { return nEnforceBlockUpgradeMajority; }
     int RejectBlockOutdatedMajority() const { return nRejectBlockOutdatedMajority; }
     int ToCheckBlockUpgradeMajority() const { return nToCheckBlockUpgradeMajority; }
+    /** Height from which the outcomes in blocks are checked against their ballots */
+    int OutcomeCheckHeight() const { return nOutcomeCheckHeight; }
 
     /** Used if GenerateTruthcoins is called with a negative number of threads */
     int DefaultMinerThreads() const { return nMinerThreads; }
@@ -95,6 +97,7 @@ protected:
     int nEnforceBlockUpgradeMajority;
     int nRejectBlockOutdatedMajority;
     int nToCheckBlockUpgradeMajority;
+    int nOutcomeCheckHeight;
     int64_t nTargetTimespan;
     int64_t nTargetSpacing;
     int nMinerThreads;
@@ -7,6 +7,8 @@
 #define TRUTHCOIN_CHECKQUEUE_H
 
 #include <algorithm>
+#include <deque>
+#include <stdint.h>
 #include <vector>
 
 #include <boost/foreach.hpp>
@@ -26,11 +28,24 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker has its own deque of verifications, behind its own lock.
+  * Added work is dealt out over the deques; a worker takes batches from
+  * the back of its own and, once that is empty, steals half of what is
+  * left at the front of another's. The shared lock is only taken to add
+  * work, to report a failure, and by a worker that has run out of work,
+  * which is also when it accounts for what it has done.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
+    //! One worker's share of the verifications
+    struct WorkerDeque {
+        boost::mutex mutex;
+        std::deque<T> checks;
+    };
+
     //! Mutex to protect the inner state
     boost::mutex mutex;
 
@@ -40,9 +55,18 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! The deques of the master (the first) and the workers. Fixed in size,
+    //! so they can be searched for work without holding the shared lock.
+    std::vector<WorkerDeque*> vDeques;
+
+    //! The number of worker threads that took a deque, not counting the master.
+    unsigned int nWorkers;
+
+    //! The deque the next added batch goes to.
+    unsigned int nNextDeque;
+
+    //! Bumped whenever work is added, so a worker can tell it missed some.
+    uint64_t nGeneration;
 
     //! The number of workers (including the master) that are idle.
     int nIdle;
@@ -54,9 +78,9 @@ private:
     bool fAllOk;
 
     /**
-     * Number of verifications that haven't completed yet.
-     * This includes elements that are not anymore in queue, but still in
-     * worker's own batches.
+     * Number of verifications that haven't been accounted for yet.
+     * This includes elements that are not anymore in a deque, but still in
+     * worker's own batches, and ones done by workers that did not report yet.
      */
     unsigned int nTodo;
 
@@ -66,100 +90,175 @@ private:
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    /** Take a batch from the back of a worker's own deque. */
+    bool PopOwn(WorkerDeque& own, std::vector<T>& vChecks)
+    {
+        boost::unique_lock<boost::mutex> lock(own.mutex);
+        if (own.checks.empty())
+            return false;
+        // Leave part of a short deque to be stolen by idle workers
+        unsigned int nNow = std::max(1U, std::min(nBatchSize, (unsigned int)own.checks.size() / 2));
+        vChecks.resize(nNow);
+        for (unsigned int i = 0; i < nNow; i++) {
+            vChecks[i].swap(own.checks.back());
+            own.checks.pop_back();
+        }
+        return true;
+    }
+
+    /** Take up to half of the front of another worker's deque. */
+    bool Steal(unsigned int nSelf, std::vector<T>& vChecks)
+    {
+        for (unsigned int n = 1; n < vDeques.size(); n++) {
+            WorkerDeque& victim = *vDeques[(nSelf + n) % vDeques.size()];
+            boost::unique_lock<boost::mutex> lock(victim.mutex);
+            if (victim.checks.empty())
+                continue;
+            unsigned int nNow = std::min(nBatchSize, ((unsigned int)victim.checks.size() + 1) / 2);
+            vChecks.resize(nNow);
+            for (unsigned int i = 0; i < nNow; i++) {
+                vChecks[i].swap(victim.checks.front());
+                victim.checks.pop_front();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    /** Drop whatever is still queued, once the result is known. Needs the shared lock. */
+    unsigned int Drain()
+    {
+        unsigned int nDrained = 0;
+        for (unsigned int n = 0; n < vDeques.size(); n++) {
+            boost::unique_lock<boost::mutex> lock(vDeques[n]->mutex);
+            nDrained += vDeques[n]->checks.size();
+            vDeques[n]->checks.clear();
+        }
+        return nDrained;
+    }
+
+    /** Account for nDone finished verifications. Needs the shared lock. */
+    void Report(unsigned int nDone, bool fOk)
+    {
+        if (!fOk && fAllOk) {
+            fAllOk = false;
+            nDone += Drain();
+        }
+        nTodo -= nDone;
+        if (nTodo == 0 && nDone)
+            condMaster.notify_one();
+    }
+
     /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    bool Loop(unsigned int nSelf, bool fMaster = false)
     {
         boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        WorkerDeque& own = *vDeques[nSelf];
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
+        unsigned int nDone = 0;
+        uint64_t nSeen;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nTotal++;
+            nSeen = nGeneration;
+        }
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master he can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
+            if (PopOwn(own, vChecks) || Steal(nSelf, vChecks)) {
+                // execute work
+                bool fOk = true;
+                BOOST_FOREACH (T& check, vChecks)
+                    if (fOk)
+                        fOk = check();
+                nDone += vChecks.size();
+                vChecks.clear();
+                if (!fOk) {
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    Report(nDone, false);
+                    nDone = 0;
                 }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                continue;
+            }
+
+            // Out of work: account for what was done, and wait unless work
+            // was added while looking for it.
+            boost::unique_lock<boost::mutex> lock(mutex);
+            Report(nDone, true);
+            nDone = 0;
+            if ((fMaster || fQuit) && nTodo == 0) {
+                nTotal--;
+                bool fRet = fAllOk;
+                // reset the status for new work later
+                if (fMaster)
+                    fAllOk = true;
+                // return the current status
+                return fRet;
+            }
+            if (nSeen == nGeneration) {
+                nIdle++;
+                cond.wait(lock); // wait
+                nIdle--;
             }
-            // execute work
-            BOOST_FOREACH (T& check, vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
+            nSeen = nGeneration;
         } while (true);
     }
 
 public:
-    //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    //! Create a new check queue, for at most nMaxWorkersIn threads including the master
+    CCheckQueue(unsigned int nBatchSizeIn, unsigned int nMaxWorkersIn = 16) : nWorkers(0), nNextDeque(0), nGeneration(0), nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn)
+    {
+        for (unsigned int n = 0; n < std::max(1U, nMaxWorkersIn); n++)
+            vDeques.push_back(new WorkerDeque());
+    }
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        unsigned int nSelf = 0;
+        if (vDeques.size() > 1) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            // Workers beyond the number of deques share them
+            nSelf = 1 + nWorkers++ % (vDeques.size() - 1);
+        }
+        Loop(nSelf);
     }
 
     //! Wait until execution finishes, and return whether all evaluations where successful.
     bool Wait()
     {
-        return Loop(true);
+        return Loop(0, true);
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
+        if (vChecks.empty())
+            return;
         boost::unique_lock<boost::mutex> lock(mutex);
-        BOOST_FOREACH (T& check, vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
+        // Nothing more needs checking once one check has failed
+        if (!fAllOk)
+            return;
+        unsigned int nDeques = std::min((unsigned int)vDeques.size(), nWorkers + 1);
+        for (unsigned int i = 0; i < vChecks.size(); i += nBatchSize) {
+            WorkerDeque& deque = *vDeques[nNextDeque++ % nDeques];
+            boost::unique_lock<boost::mutex> lockDeque(deque.mutex);
+            for (unsigned int j = i; j < std::min((unsigned int)vChecks.size(), i + nBatchSize); j++) {
+                deque.checks.push_back(T());
+                vChecks[j].swap(deque.checks.back());
+            }
         }
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
+        nGeneration++;
+        if (vChecks.size() <= nBatchSize)
             condWorker.notify_one();
-        else if (vChecks.size() > 1)
+        else
             condWorker.notify_all();
     }
 
     ~CCheckQueue()
     {
+        BOOST_FOREACH (WorkerDeque* deque, vDeques)
+            delete deque;
     }
 
     friend class CCheckQueueControl<T>;
@@ -181,7 +280,7 @@ public:
     {
         // passed queue is supposed to be unused, or NULL
         if (pqueue != NULL) {
-            assert(pqueue->nTotal == pqueue->nIdle);
+            boost::unique_lock<boost::mutex> lock(pqueue->mutex);
             assert(pqueue->nTodo == 0);
             assert(pqueue->fAllOk == true);
         }
@@ -8,6 +8,8 @@
 #define TRUTHCOIN_COINS_H
 
 #include "compressor.h"
+#include "flatmap.h"
+#include "memusage.h"
 #include "serialize.h"
 #include "uint256.h"
 
@@ -15,7 +17,7 @@
 #include <stdint.h>
 
 #include <boost/foreach.hpp>
-#include <boost/unordered_map.hpp>
+#include <boost/function.hpp>
 
 /** 
  * Pruned version of CTransaction: only retains metadata and unspent transaction outputs
@@ -253,6 +255,14 @@ public:
                 return false;
         return true;
     }
+
+    //! heap memory held by the outputs and their scripts
+    size_t DynamicMemoryUsage() const {
+        size_t ret = memusage::DynamicUsage(vout);
+        BOOST_FOREACH(const CTxOut &out, vout)
+            ret += memusage::DynamicUsage(out.scriptPubKey);
+        return ret;
+    }
 };
 
 class CCoinsKeyHasher
@@ -264,9 +274,9 @@ public:
     CCoinsKeyHasher();
 
     /**
-     * This *must* return size_t. With Boost 1.46 on 32-bit systems the
-     * unordered_map will behave unpredictably if the custom hasher returns a
-     * uint64_t, resulting in failures when syncing the chain (#4634).
+     * This *must* return size_t, the type the map's slots are probed with;
+     * with Boost 1.46 on 32-bit systems a uint64_t hasher broke syncing the
+     * chain (#4634).
      */
     size_t operator()(const uint256& key) const {
         return key.GetHash(salt);
@@ -286,7 +296,12 @@ struct CCoinsCacheEntry
     CCoinsCacheEntry() : coins(), flags(0) {}
 };
 
-typedef boost::unordered_map<uint256, CCoinsCacheEntry, CCoinsKeyHasher> CCoinsMap;
+/**
+ * The entries of a cache live in pooled chunks of an open addressing map:
+ * references to them stay valid while other entries come and go, and
+ * walking the map for a flush reads contiguous memory.
+ */
+typedef flatmap<uint256, CCoinsCacheEntry, CCoinsKeyHasher> CCoinsMap;
 
 struct CCoinsStats
 {
@@ -301,6 +316,11 @@ struct CCoinsStats
     CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
 };
 
+class CHashWriter;
+
+/** Count a transaction's unspent outputs into stats, and hash them into ss as GetStats does */
+void ApplyCoinsStats(CCoinsStats &stats, CHashWriter &ss, const uint256 &txid, const CCoins &coins);
+
 
 /** Abstract view on the open txout dataset. */
 class CCoinsView
@@ -323,6 +343,10 @@ public:
     //! Calculate statistics about the unspent transaction output set
     virtual bool GetStats(CCoinsStats &stats) const;
 
+    //! Call fn with the coins of every transaction with unspent outputs, in the
+    //! order GetStats hashes them. Stops and returns false if fn does.
+    virtual bool ForEachCoins(boost::function<bool (const uint256 &txid, const CCoins &coins)> fn) const;
+
     //! As we use CCoinsViews polymorphically, have a virtual destructor
     virtual ~CCoinsView() {}
 };
@@ -340,8 +364,10 @@ public:
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
     void SetBackend(CCoinsView &viewIn);
+    CCoinsView *GetBackend() const;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
     bool GetStats(CCoinsStats &stats) const;
+    bool ForEachCoins(boost::function<bool (const uint256 &txid, const CCoins &coins)> fn) const;
 };
 
 
@@ -357,7 +383,8 @@ class CCoinsModifier
 private:
     CCoinsViewCache& cache;
     CCoinsMap::iterator it;
-    CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_);
+    size_t cachedCoinUsage; // Cached memory usage of the CCoins object before modification
+    CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_, size_t usage);
 
 public:
     CCoins* operator->() { return &it->second.coins; }
@@ -380,6 +407,9 @@ protected:
     mutable uint256 hashBlock;
     mutable CCoinsMap cacheCoins;
 
+    /* Cached dynamic memory usage for the inner CCoins objects. */
+    mutable size_t cachedCoinsUsage;
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
     ~CCoinsViewCache();
@@ -405,6 +435,16 @@ public:
      */
     CCoinsModifier ModifyCoins(const uint256 &txid);
 
+    //! Check whether the cache holds an entry for txid, without reading the base
+    bool HaveCoinsInCache(const uint256 &txid) const;
+
+    /**
+     * Put coins read from the base into the cache, unless it already holds
+     * an entry for txid, which is then left alone. The coins are swapped
+     * in. Returns whether they were.
+     */
+    bool WarmCoins(const uint256 &txid, CCoins &coins);
+
     /**
      * Push the modifications applied to this cache to its base.
      * Failure to call this method before destruction will cause the changes to be forgotten.
@@ -415,6 +455,9 @@ public:
     //! Calculate the size of the cache (in number of transactions)
     unsigned int GetCacheSize() const;
 
+    //! Calculate the heap memory held by the cache, in bytes
+    size_t DynamicMemoryUsage() const;
+
     /** 
      * Amount of truthcoins coming in to a transaction
      * Note that lightweight clients may not know anything besides the hash of previous transactions,
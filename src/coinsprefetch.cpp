@@ -0,0 +1,153 @@
+// Copyright (c) 2015 The Truthcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinsprefetch.h"
+
+#include "main.h"
+#include "primitives/block.h"
+
+#include <set>
+
+#include <boost/foreach.hpp>
+
+using namespace std;
+
+/** The txids a block spends from, other than those of its own transactions */
+static void GetPrevoutTxids(const CBlock &block, vector<uint256> &vTxid)
+{
+    set<uint256> setInBlock;
+    set<uint256> setSpent;
+    BOOST_FOREACH(const CTransaction &tx, block.vtx) {
+        setInBlock.insert(tx.GetHash());
+        if (tx.IsCoinBase())
+            continue;
+        BOOST_FOREACH(const CTxIn &txin, tx.vin)
+            setSpent.insert(txin.prevout.hash);
+    }
+    vTxid.clear();
+    vTxid.reserve(setSpent.size());
+    BOOST_FOREACH(const uint256 &txid, setSpent) {
+        if (!setInBlock.count(txid))
+            vTxid.push_back(txid);
+    }
+}
+
+void CCoinsPrefetcher::Queue(const vector<uint256> &vTxid)
+{
+    BOOST_FOREACH(const uint256 &txid, vTxid) {
+        if (mapState.size() >= MAX_PREFETCH_COINS)
+            break;
+        if (mapState.insert(make_pair(txid, QUEUED)).second)
+            queueTxids.push_back(txid);
+    }
+    condWorker.notify_all();
+}
+
+void CCoinsPrefetcher::Store(const uint256 &txid, CCoins &coins, bool fFound, uint64_t nGen)
+{
+    if (nGen != nGeneration)
+        return;
+    map<uint256, State>::iterator it = mapState.find(txid);
+    if (it == mapState.end())
+        return;
+    it->second = fFound ? FOUND : MISSING;
+    if (fFound)
+        mapCoins[txid].swap(coins);
+    condMaster.notify_all();
+}
+
+void CCoinsPrefetcher::Thread()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (true) {
+        while (queueTxids.empty() && queueBlocks.empty())
+            condWorker.wait(lock); // interruption point
+        uint64_t nGen = nGeneration;
+        CCoinsView *view = base;
+
+        if (!queueTxids.empty()) {
+            uint256 txid = queueTxids.front();
+            queueTxids.pop_front();
+            map<uint256, State>::iterator it = mapState.find(txid);
+            if (it == mapState.end() || it->second != QUEUED)
+                continue; // taken by the master, or discarded
+            it->second = READING;
+            CCoins coins;
+            lock.unlock();
+            bool fFound = view->GetCoins(txid, coins);
+            lock.lock();
+            Store(txid, coins, fFound, nGen);
+        } else {
+            CDiskBlockPos pos = queueBlocks.front();
+            queueBlocks.pop_front();
+            CBlock block;
+            vector<uint256> vTxid;
+            lock.unlock();
+            if (ReadBlockFromDisk(block, pos))
+                GetPrevoutTxids(block, vTxid);
+            lock.lock();
+            if (nGen == nGeneration)
+                Queue(vTxid);
+        }
+    }
+}
+
+size_t CCoinsPrefetcher::Warm(CCoinsViewCache &cache, const CBlock &block, const CDiskBlockPos *pposNext)
+{
+    vector<uint256> vTxid;
+    GetPrevoutTxids(block, vTxid);
+    vector<uint256> vNeed;
+    vNeed.reserve(vTxid.size());
+    BOOST_FOREACH(const uint256 &txid, vTxid) {
+        if (!cache.HaveCoinsInCache(txid))
+            vNeed.push_back(txid);
+    }
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    base = cache.GetBackend();
+    Queue(vNeed);
+    if (pposNext) {
+        queueBlocks.push_back(*pposNext);
+        condWorker.notify_one();
+    }
+
+    size_t nWarmed = 0;
+    BOOST_FOREACH(const uint256 &txid, vNeed) {
+        map<uint256, State>::iterator it = mapState.find(txid);
+        if (it == mapState.end())
+            continue; // over the limit; ConnectBlock reads it as usual
+        if (it->second == QUEUED) {
+            // Not picked up yet, so read it here rather than wait
+            it->second = READING;
+            uint64_t nGen = nGeneration;
+            CCoins coins;
+            lock.unlock();
+            bool fFound = base->GetCoins(txid, coins);
+            lock.lock();
+            Store(txid, coins, fFound, nGen);
+        }
+        while ((it = mapState.find(txid)) != mapState.end() && it->second == READING)
+            condMaster.wait(lock);
+        if (it == mapState.end())
+            continue;
+        if (it->second == FOUND) {
+            map<uint256, CCoins>::iterator itCoins = mapCoins.find(txid);
+            if (cache.WarmCoins(txid, itCoins->second))
+                nWarmed++;
+            mapCoins.erase(itCoins);
+        }
+        mapState.erase(it);
+    }
+    return nWarmed;
+}
+
+void CCoinsPrefetcher::Discard()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nGeneration++;
+    queueBlocks.clear();
+    queueTxids.clear();
+    mapState.clear();
+    mapCoins.clear();
+}
@@ -0,0 +1,96 @@
+// Copyright (c) 2015 The Truthcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef TRUTHCOIN_COINSPREFETCH_H
+#define TRUTHCOIN_COINSPREFETCH_H
+
+#include "chain.h"
+#include "coins.h"
+#include "uint256.h"
+
+#include <deque>
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+class CBlock;
+
+/** Txids at most waiting to be read or taken, beyond which blocks are not prefetched */
+static const size_t MAX_PREFETCH_COINS = 200000;
+
+/**
+ * Reads the coins a block spends from the database before it is connected.
+ *
+ * The master (the thread connecting blocks) hands each block over as it is
+ * about to connect it, with the position on disk of the block after it.
+ * The workers read the block's prevouts in parallel, the master reading
+ * along with them until all are in; the workers then go on to read the
+ * next block and the coins it spends while the master verifies the first.
+ *
+ * Coins only go into the cache on the master, and only for txids the cache
+ * does not hold, as it is the cache that is right about those it does.
+ * The database only changes when the cache is flushed, so what was read
+ * stays valid until then; Discard must be called before every flush.
+ */
+class CCoinsPrefetcher
+{
+private:
+    enum State {
+        QUEUED,
+        READING,
+        FOUND,
+        MISSING,
+    };
+
+    //! Mutex to protect the inner state
+    boost::mutex mutex;
+
+    //! Worker threads block on this when out of work
+    boost::condition_variable condWorker;
+
+    //! Master thread blocks on this while a coin it needs is being read
+    boost::condition_variable condMaster;
+
+    //! The view the cache reads from, which the workers read too
+    CCoinsView *base;
+
+    //! Blocks whose prevouts are still to be queued
+    std::deque<CDiskBlockPos> queueBlocks;
+
+    //! Txids still to be read, those of the block being connected first
+    std::deque<uint256> queueTxids;
+
+    //! Where every txid handed over stands
+    std::map<uint256, State> mapState;
+
+    //! Coins read and not taken yet
+    std::map<uint256, CCoins> mapCoins;
+
+    //! Bumped by Discard, so that reads in flight at the time are dropped
+    uint64_t nGeneration;
+
+    void Queue(const std::vector<uint256> &vTxid);
+    void Store(const uint256 &txid, CCoins &coins, bool fFound, uint64_t nGen);
+
+public:
+    CCoinsPrefetcher() : base(NULL), nGeneration(0) {}
+
+    //! Worker thread
+    void Thread();
+
+    /**
+     * Bring the coins spent by block into cache, reading those it does not
+     * hold in parallel, and start reading the block at pposNext, if any.
+     * Returns the number of coins put into the cache.
+     */
+    size_t Warm(CCoinsViewCache &cache, const CBlock &block, const CDiskBlockPos *pposNext);
+
+    //! Forget everything read or queued, before the database changes
+    void Discard();
+};
+
+#endif // TRUTHCOIN_COINSPREFETCH_H
@@ -6,9 +6,14 @@
 #include "crypto/sha256.h"
 
 #include "crypto/common.h"
+#include "crypto/sha256_simd.h"
 
 #include <string.h>
 
+#ifdef USE_SHA256_X86_SIMD
+#include <cpuid.h>
+#endif
+
 // Internal implementation code.
 namespace
 {
@@ -128,7 +133,49 @@ void Transform(uint32_t* s, const unsigned char* chunk)
     s[7] += h;
 }
 
+/** Double SHA-256 of a single 64-byte input. */
+void TransformD64(unsigned char* out, const unsigned char* in)
+{
+    static const unsigned char padding[64] = {
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x02, 0x00
+    };
+    uint32_t s[8];
+    unsigned char buf[64] = {0};
+
+    Initialize(s);
+    Transform(s, in);
+    Transform(s, padding);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(buf + 4 * i, s[i]);
+    buf[32] = 0x80;
+    buf[62] = 0x01;
+
+    Initialize(s);
+    Transform(s, buf);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(out + 4 * i, s[i]);
+}
+
 } // namespace sha256
+
+typedef void (*TransformD64Type)(unsigned char*, const unsigned char*);
+
+TransformD64Type TransformD64_4way = NULL;
+TransformD64Type TransformD64_8way = NULL;
+
+#ifdef USE_SHA256_X86_SIMD
+/** Whether the OS saves the AVX registers on a context switch. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
 } // namespace
 
 
@@ -188,3 +235,52 @@ CSHA256& CSHA256::Reset()
     sha256::Initialize(s);
     return *this;
 }
+
+std::string SHA256AutoDetect()
+{
+    std::string ret = "standard";
+#ifdef USE_SHA256_X86_SIMD
+    uint32_t eax, ebx, ecx, edx;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        if ((ecx >> 19) & 1) {
+            TransformD64_4way = sha256d64_sse41::Transform_4way;
+            ret += ",sse41(4way)";
+        }
+        bool fXSave = (ecx >> 27) & 1, fAVX = (ecx >> 28) & 1;
+        if (fXSave && fAVX && AVXEnabled() && __get_cpuid_max(0, NULL) >= 7) {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            if ((ebx >> 5) & 1) {
+                TransformD64_8way = sha256d64_avx2::Transform_8way;
+                ret += ",avx2(8way)";
+            }
+        }
+    }
+#endif
+    return ret;
+}
+
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    if (TransformD64_8way) {
+        while (blocks >= 8) {
+            TransformD64_8way(out, in);
+            out += 256;
+            in += 512;
+            blocks -= 8;
+        }
+    }
+    if (TransformD64_4way) {
+        while (blocks >= 4) {
+            TransformD64_4way(out, in);
+            out += 128;
+            in += 256;
+            blocks -= 4;
+        }
+    }
+    while (blocks) {
+        sha256::TransformD64(out, in);
+        out += 32;
+        in += 64;
+        --blocks;
+    }
+}
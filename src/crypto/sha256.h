@@ -8,6 +8,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
 
 /** A hasher class for SHA-256. */
 class CSHA256
@@ -26,4 +27,18 @@ public:
     CSHA256& Reset();
 };
 
+/**
+ * Pick the fastest SHA256D64 implementation the CPU supports and return
+ * its name. Until this is called the portable code is used.
+ */
+std::string SHA256AutoDetect();
+
+/**
+ * Compute the double SHA-256 of each of blocks 64-byte inputs, as is done
+ * for every node of a merkle tree. Several inputs are hashed at once where
+ * the CPU allows.
+ * output: blocks*32 bytes, input: blocks*64 bytes.
+ */
+void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks);
+
 #endif // TRUTHCOIN_CRYPTO_SHA256_H
@@ -0,0 +1,132 @@
+// Copyright (c) 2015 The Truthcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/sha256_simd.h"
+
+#ifdef USE_SHA256_X86_SIMD
+
+#include "crypto/common.h"
+
+#include <immintrin.h>
+#include <stdint.h>
+
+#define AVX2_INLINE static inline __attribute__((always_inline, target("avx2")))
+
+namespace sha256d64_avx2
+{
+namespace
+{
+static const uint32_t k[64] = {
+    0x428a2f98ul, 0x71374491ul, 0xb5c0fbcful, 0xe9b5dba5ul,
+    0x3956c25bul, 0x59f111f1ul, 0x923f82a4ul, 0xab1c5ed5ul,
+    0xd807aa98ul, 0x12835b01ul, 0x243185beul, 0x550c7dc3ul,
+    0x72be5d74ul, 0x80deb1feul, 0x9bdc06a7ul, 0xc19bf174ul,
+    0xe49b69c1ul, 0xefbe4786ul, 0x0fc19dc6ul, 0x240ca1ccul,
+    0x2de92c6ful, 0x4a7484aaul, 0x5cb0a9dcul, 0x76f988daul,
+    0x983e5152ul, 0xa831c66dul, 0xb00327c8ul, 0xbf597fc7ul,
+    0xc6e00bf3ul, 0xd5a79147ul, 0x06ca6351ul, 0x14292967ul,
+    0x27b70a85ul, 0x2e1b2138ul, 0x4d2c6dfcul, 0x53380d13ul,
+    0x650a7354ul, 0x766a0abbul, 0x81c2c92eul, 0x92722c85ul,
+    0xa2bfe8a1ul, 0xa81a664bul, 0xc24b8b70ul, 0xc76c51a3ul,
+    0xd192e819ul, 0xd6990624ul, 0xf40e3585ul, 0x106aa070ul,
+    0x19a4c116ul, 0x1e376c08ul, 0x2748774cul, 0x34b0bcb5ul,
+    0x391c0cb3ul, 0x4ed8aa4aul, 0x5b9cca4ful, 0x682e6ff3ul,
+    0x748f82eeul, 0x78a5636ful, 0x84c87814ul, 0x8cc70208ul,
+    0x90befffaul, 0xa4506cebul, 0xbef9a3f7ul, 0xc67178f2ul,
+};
+
+static const uint32_t iv[8] = {
+    0x6a09e667ul, 0xbb67ae85ul, 0x3c6ef372ul, 0xa54ff53aul,
+    0x510e527ful, 0x9b05688cul, 0x1f83d9abul, 0x5be0cd19ul,
+};
+
+AVX2_INLINE __m256i K(uint32_t x) { return _mm256_set1_epi32(x); }
+AVX2_INLINE __m256i Add(__m256i x, __m256i y) { return _mm256_add_epi32(x, y); }
+AVX2_INLINE __m256i Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+AVX2_INLINE __m256i Or(__m256i x, __m256i y) { return _mm256_or_si256(x, y); }
+AVX2_INLINE __m256i And(__m256i x, __m256i y) { return _mm256_and_si256(x, y); }
+AVX2_INLINE __m256i ShR(__m256i x, int n) { return _mm256_srli_epi32(x, n); }
+AVX2_INLINE __m256i ShL(__m256i x, int n) { return _mm256_slli_epi32(x, n); }
+AVX2_INLINE __m256i Ror(__m256i x, int n) { return Or(ShR(x, n), ShL(x, 32 - n)); }
+AVX2_INLINE __m256i Ch(__m256i x, __m256i y, __m256i z) { return Xor(z, And(x, Xor(y, z))); }
+AVX2_INLINE __m256i Maj(__m256i x, __m256i y, __m256i z) { return Or(And(x, y), And(z, Or(x, y))); }
+AVX2_INLINE __m256i Sigma0(__m256i x) { return Xor(Xor(Ror(x, 2), Ror(x, 13)), Ror(x, 22)); }
+AVX2_INLINE __m256i Sigma1(__m256i x) { return Xor(Xor(Ror(x, 6), Ror(x, 11)), Ror(x, 25)); }
+AVX2_INLINE __m256i sigma0(__m256i x) { return Xor(Xor(Ror(x, 7), Ror(x, 18)), ShR(x, 3)); }
+AVX2_INLINE __m256i sigma1(__m256i x) { return Xor(Xor(Ror(x, 17), Ror(x, 19)), ShR(x, 10)); }
+
+/** Load a big-endian word from the same offset of each of the eight inputs. */
+AVX2_INLINE __m256i Read(const unsigned char* in, int offset)
+{
+    __m256i ret = _mm256_set_epi32(ReadLE32(in + 448 + offset), ReadLE32(in + 384 + offset), ReadLE32(in + 320 + offset), ReadLE32(in + 256 + offset),
+                                   ReadLE32(in + 192 + offset), ReadLE32(in + 128 + offset), ReadLE32(in + 64 + offset), ReadLE32(in + offset));
+    return _mm256_shuffle_epi8(ret, _mm256_set_epi32(0x0C0D0E0Ful, 0x08090A0Bul, 0x04050607ul, 0x00010203ul, 0x0C0D0E0Ful, 0x08090A0Bul, 0x04050607ul, 0x00010203ul));
+}
+
+/** Store a word of each lane big-endian at the same offset of its output. */
+AVX2_INLINE void Write(unsigned char* out, int offset, __m256i v)
+{
+    v = _mm256_shuffle_epi8(v, _mm256_set_epi32(0x0C0D0E0Ful, 0x08090A0Bul, 0x04050607ul, 0x00010203ul, 0x0C0D0E0Ful, 0x08090A0Bul, 0x04050607ul, 0x00010203ul));
+    WriteLE32(out + offset, _mm256_extract_epi32(v, 0));
+    WriteLE32(out + 32 + offset, _mm256_extract_epi32(v, 1));
+    WriteLE32(out + 64 + offset, _mm256_extract_epi32(v, 2));
+    WriteLE32(out + 96 + offset, _mm256_extract_epi32(v, 3));
+    WriteLE32(out + 128 + offset, _mm256_extract_epi32(v, 4));
+    WriteLE32(out + 160 + offset, _mm256_extract_epi32(v, 5));
+    WriteLE32(out + 192 + offset, _mm256_extract_epi32(v, 6));
+    WriteLE32(out + 224 + offset, _mm256_extract_epi32(v, 7));
+}
+
+/** Perform one SHA-256 transformation on every lane; w is overwritten. */
+AVX2_INLINE void Transform(__m256i* s, __m256i* w)
+{
+    __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int i = 0; i < 64; i++) {
+        if (i >= 16)
+            w[i & 15] = Add(Add(w[i & 15], sigma0(w[(i + 1) & 15])), Add(w[(i + 9) & 15], sigma1(w[(i + 14) & 15])));
+        __m256i t1 = Add(Add(h, Sigma1(e)), Add(Ch(e, f, g), Add(K(k[i]), w[i & 15])));
+        __m256i t2 = Add(Sigma0(a), Maj(a, b, c));
+        h = g; g = f; f = e; e = Add(d, t1);
+        d = c; c = b; b = a; a = Add(t1, t2);
+    }
+    s[0] = Add(s[0], a); s[1] = Add(s[1], b); s[2] = Add(s[2], c); s[3] = Add(s[3], d);
+    s[4] = Add(s[4], e); s[5] = Add(s[5], f); s[6] = Add(s[6], g); s[7] = Add(s[7], h);
+}
+
+} // namespace
+
+__attribute__((target("avx2"))) void Transform_8way(unsigned char* out, const unsigned char* in)
+{
+    __m256i s[8], w[16];
+
+    // The 64-byte inputs, then their padding block
+    for (int i = 0; i < 8; i++)
+        s[i] = K(iv[i]);
+    for (int i = 0; i < 16; i++)
+        w[i] = Read(in, 4 * i);
+    Transform(s, w);
+    w[0] = K(0x80000000ul);
+    for (int i = 1; i < 15; i++)
+        w[i] = K(0);
+    w[15] = K(512);
+    Transform(s, w);
+
+    // The 32-byte digests, padded into a single block
+    for (int i = 0; i < 8; i++)
+        w[i] = s[i];
+    w[8] = K(0x80000000ul);
+    for (int i = 9; i < 15; i++)
+        w[i] = K(0);
+    w[15] = K(256);
+    for (int i = 0; i < 8; i++)
+        s[i] = K(iv[i]);
+    Transform(s, w);
+
+    for (int i = 0; i < 8; i++)
+        Write(out, 4 * i, s[i]);
+}
+
+} // namespace sha256d64_avx2
+
+#endif // USE_SHA256_X86_SIMD
@@ -0,0 +1,32 @@
+// Copyright (c) 2015 The Truthcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef TRUTHCOIN_CRYPTO_SHA256_SIMD_H
+#define TRUTHCOIN_CRYPTO_SHA256_SIMD_H
+
+/**
+ * Multi-lane double-SHA256 of 64-byte inputs, for x86-64 compilers that
+ * accept per-function target attributes. The code is built without any
+ * special compiler flags and only run after SHA256AutoDetect has found
+ * the instructions it needs.
+ */
+#if (defined(__x86_64__) || defined(__amd64__)) && defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__))
+#define USE_SHA256_X86_SIMD 1
+#endif
+
+#ifdef USE_SHA256_X86_SIMD
+namespace sha256d64_sse41
+{
+/** Double SHA-256 of four 64-byte inputs, using SSE4.1 */
+void Transform_4way(unsigned char* out, const unsigned char* in);
+}
+
+namespace sha256d64_avx2
+{
+/** Double SHA-256 of eight 64-byte inputs, using AVX2 */
+void Transform_8way(unsigned char* out, const unsigned char* in);
+}
+#endif
+
+#endif // TRUTHCOIN_CRYPTO_SHA256_SIMD_H
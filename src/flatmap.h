@@ -0,0 +1,289 @@
+// Copyright (c) 2015 The Truthcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef TRUTHCOIN_FLATMAP_H
+#define TRUTHCOIN_FLATMAP_H
+
+#include "memusage.h"
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <new>
+#include <utility>
+#include <vector>
+
+#include <boost/type_traits/aligned_storage.hpp>
+#include <boost/type_traits/alignment_of.hpp>
+
+/**
+ * Hash map with open addressing, for a few large maps such as the coins cache.
+ *
+ * The entries are kept in a pool of fixed-size chunks and never move, so
+ * references to them stay valid until they are erased, as with a node
+ * based map. Erased entries are reused by later inserts. The table itself
+ * is an array of (entry index, hash) slots probed linearly, so a lookup
+ * touches one or two cache lines before reaching the entry. Iteration
+ * walks the pool in order, and erasing does not disturb it.
+ */
+template <typename K, typename V, typename Hasher>
+class flatmap
+{
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<const K, V> value_type;
+    typedef size_t size_type;
+
+private:
+    //! entries per chunk of the pool
+    static const uint32_t CHUNK_BITS = 8;
+    static const uint32_t CHUNK_SIZE = 1 << CHUNK_BITS;
+
+    //! slot markers, never valid entry indexes
+    static const uint32_t SLOT_EMPTY = 0xffffffff;
+    static const uint32_t SLOT_ERASED = 0xfffffffe;
+
+    struct slot {
+        uint32_t nEntry;
+        uint32_t nHash;
+    };
+
+    typedef typename boost::aligned_storage<sizeof(value_type), boost::alignment_of<value_type>::value>::type storage_type;
+
+    Hasher hasher;
+    std::vector<storage_type*> vChunks;
+    std::vector<unsigned char> vLive;
+    std::vector<uint32_t> vFree;
+    std::vector<slot> vSlots;
+    //! entries in use
+    size_t nSize;
+    //! slots that are not empty, erased ones included
+    size_t nSlotsUsed;
+
+    value_type* entry(uint32_t n) const
+    {
+        return reinterpret_cast<value_type*>(&vChunks[n >> CHUNK_BITS][n & (CHUNK_SIZE - 1)]);
+    }
+
+    uint32_t next_live(uint32_t n) const
+    {
+        while (n < vLive.size() && !vLive[n])
+            n++;
+        return n;
+    }
+
+    /** The slot holding key, or the end of the table */
+    size_t find_slot(const K& key, size_t h) const
+    {
+        if (vSlots.empty())
+            return 0;
+        size_t mask = vSlots.size() - 1;
+        for (size_t i = h & mask; ; i = (i + 1) & mask) {
+            const slot& s = vSlots[i];
+            if (s.nEntry == SLOT_EMPTY)
+                return vSlots.size();
+            if (s.nEntry != SLOT_ERASED && s.nHash == (uint32_t)h && entry(s.nEntry)->first == key)
+                return i;
+        }
+    }
+
+    void place(uint32_t n, size_t h)
+    {
+        size_t mask = vSlots.size() - 1;
+        size_t i = h & mask;
+        while (vSlots[i].nEntry != SLOT_EMPTY && vSlots[i].nEntry != SLOT_ERASED)
+            i = (i + 1) & mask;
+        if (vSlots[i].nEntry == SLOT_EMPTY)
+            nSlotsUsed++;
+        vSlots[i].nEntry = n;
+        vSlots[i].nHash = (uint32_t)h;
+    }
+
+    /** Rebuild the table for at least nEntries entries, dropping erased slots */
+    void rehash(size_t nEntries)
+    {
+        size_t nSlots = 16;
+        while (nSlots < nEntries * 2)
+            nSlots *= 2;
+        slot empty = {SLOT_EMPTY, 0};
+        std::vector<slot>(nSlots, empty).swap(vSlots);
+        nSlotsUsed = 0;
+        for (uint32_t n = next_live(0); n < vLive.size(); n = next_live(n + 1))
+            place(n, hasher(entry(n)->first));
+    }
+
+    uint32_t alloc_entry()
+    {
+        if (!vFree.empty()) {
+            uint32_t n = vFree.back();
+            vFree.pop_back();
+            return n;
+        }
+        uint32_t n = vLive.size();
+        if ((n & (CHUNK_SIZE - 1)) == 0)
+            vChunks.push_back(new storage_type[CHUNK_SIZE]);
+        vLive.push_back(0);
+        return n;
+    }
+
+public:
+    class const_iterator;
+
+    class iterator
+    {
+    private:
+        const flatmap* pmap;
+        uint32_t n;
+        friend class flatmap;
+        friend class const_iterator;
+
+    public:
+        iterator() : pmap(NULL), n(0) {}
+        iterator(const flatmap* pmapIn, uint32_t nIn) : pmap(pmapIn), n(nIn) {}
+        value_type& operator*() const { return *pmap->entry(n); }
+        value_type* operator->() const { return pmap->entry(n); }
+        iterator& operator++() { n = pmap->next_live(n + 1); return *this; }
+        iterator operator++(int) { iterator ret = *this; ++(*this); return ret; }
+        bool operator==(const iterator& it) const { return n == it.n; }
+        bool operator!=(const iterator& it) const { return n != it.n; }
+    };
+
+    class const_iterator
+    {
+    private:
+        const flatmap* pmap;
+        uint32_t n;
+        friend class flatmap;
+
+    public:
+        const_iterator() : pmap(NULL), n(0) {}
+        const_iterator(const flatmap* pmapIn, uint32_t nIn) : pmap(pmapIn), n(nIn) {}
+        const_iterator(const iterator& it) : pmap(it.pmap), n(it.n) {}
+        const value_type& operator*() const { return *pmap->entry(n); }
+        const value_type* operator->() const { return pmap->entry(n); }
+        const_iterator& operator++() { n = pmap->next_live(n + 1); return *this; }
+        const_iterator operator++(int) { const_iterator ret = *this; ++(*this); return ret; }
+        bool operator==(const const_iterator& it) const { return n == it.n; }
+        bool operator!=(const const_iterator& it) const { return n != it.n; }
+    };
+
+    flatmap() : nSize(0), nSlotsUsed(0) {}
+
+    flatmap(const flatmap& map) : hasher(map.hasher), nSize(0), nSlotsUsed(0)
+    {
+        for (const_iterator it = map.begin(); it != map.end(); ++it)
+            insert(*it);
+    }
+
+    flatmap& operator=(const flatmap& map)
+    {
+        if (this != &map) {
+            clear();
+            for (const_iterator it = map.begin(); it != map.end(); ++it)
+                insert(*it);
+        }
+        return *this;
+    }
+
+    ~flatmap() { clear(); }
+
+    void swap(flatmap& map)
+    {
+        std::swap(hasher, map.hasher);
+        vChunks.swap(map.vChunks);
+        vLive.swap(map.vLive);
+        vFree.swap(map.vFree);
+        vSlots.swap(map.vSlots);
+        std::swap(nSize, map.nSize);
+        std::swap(nSlotsUsed, map.nSlotsUsed);
+    }
+
+    iterator begin() { return iterator(this, next_live(0)); }
+    const_iterator begin() const { return const_iterator(this, next_live(0)); }
+    iterator end() { return iterator(this, vLive.size()); }
+    const_iterator end() const { return const_iterator(this, vLive.size()); }
+
+    size_type size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+
+    iterator find(const K& key)
+    {
+        size_t i = find_slot(key, hasher(key));
+        return i < vSlots.size() ? iterator(this, vSlots[i].nEntry) : end();
+    }
+
+    const_iterator find(const K& key) const
+    {
+        size_t i = find_slot(key, hasher(key));
+        return i < vSlots.size() ? const_iterator(this, vSlots[i].nEntry) : end();
+    }
+
+    size_type count(const K& key) const { return find(key) != end(); }
+
+    std::pair<iterator, bool> insert(const value_type& value)
+    {
+        size_t h = hasher(value.first);
+        size_t i = find_slot(value.first, h);
+        if (i < vSlots.size())
+            return std::make_pair(iterator(this, vSlots[i].nEntry), false);
+
+        // Keep at least one in eight slots empty, so probes end quickly
+        if ((nSlotsUsed + 1) * 8 > vSlots.size() * 7)
+            rehash(nSize + 1);
+        uint32_t n = alloc_entry();
+        new (entry(n)) value_type(value);
+        vLive[n] = 1;
+        nSize++;
+        place(n, h);
+        return std::make_pair(iterator(this, n), true);
+    }
+
+    V& operator[](const K& key) { return insert(value_type(key, V())).first->second; }
+
+    void erase(iterator it)
+    {
+        size_t i = find_slot(it->first, hasher(it->first));
+        assert(i < vSlots.size() && vSlots[i].nEntry == it.n);
+        vSlots[i].nEntry = SLOT_ERASED;
+        entry(it.n)->~value_type();
+        vLive[it.n] = 0;
+        vFree.push_back(it.n);
+        nSize--;
+    }
+
+    size_type erase(const K& key)
+    {
+        iterator it = find(key);
+        if (it == end())
+            return 0;
+        erase(it);
+        return 1;
+    }
+
+    /** Erase everything and give the memory back. */
+    void clear()
+    {
+        for (uint32_t n = next_live(0); n < vLive.size(); n = next_live(n + 1))
+            entry(n)->~value_type();
+        for (size_t i = 0; i < vChunks.size(); i++)
+            delete[] vChunks[i];
+        std::vector<storage_type*>().swap(vChunks);
+        std::vector<unsigned char>().swap(vLive);
+        std::vector<uint32_t>().swap(vFree);
+        std::vector<slot>().swap(vSlots);
+        nSize = 0;
+        nSlotsUsed = 0;
+    }
+
+    /** Heap memory held by the map itself, not counting what the entries point to. */
+    size_t dynamic_usage() const
+    {
+        return vChunks.size() * memusage::MallocUsage(CHUNK_SIZE * sizeof(storage_type)) +
+               memusage::DynamicUsage(vChunks) + memusage::DynamicUsage(vLive) +
+               memusage::DynamicUsage(vFree) + memusage::DynamicUsage(vSlots);
+    }
+};
+
+#endif // TRUTHCOIN_FLATMAP_H
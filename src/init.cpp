@@ -12,14 +12,17 @@
 
 #include "addrman.h"
 #include "amount.h"
+#include "ballotcache.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
+#include "crypto/sha256.h"
 #include "key.h"
 #include "main.h"
 #include "miner.h"
 #include "net.h"
 #include "rpcserver.h"
 #include "script/standard.h"
+#include "snapshot.h"
 #include "txdb.h"
 #include "ui_interface.h"
 #include "util.h"
@@ -175,6 +178,8 @@ void Shutdown()
         }
         delete pcoinsTip;
         pcoinsTip = NULL;
+        delete pcoinsflusher;
+        pcoinsflusher = NULL;
         delete pcoinscatcher;
         pcoinscatcher = NULL;
         delete pcoinsdbview;
@@ -196,6 +201,8 @@ void Shutdown()
     delete pwalletMain;
     pwalletMain = NULL;
 #endif
+    delete pballotcache;
+    pballotcache = NULL;
     LogPrintf("%s: done\n", __func__);
 }
 
@@ -242,6 +249,7 @@ std::string HelpMessage(HelpMessageMode mode)
     string strUsage = _("Options:") + "\n";
     strUsage += "  -?                     " + _("This help message") + "\n";
     strUsage += "  -alertnotify=<cmd>     " + _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)") + "\n";
+    strUsage += "  -ballotcache           " + strprintf(_("Work out the outcomes of open ballots in the background as their votes arrive (default: %u)"), 1) + "\n";
     strUsage += "  -blocknotify=<cmd>     " + _("Execute command when the best block changes (%s in cmd is replaced by block hash)") + "\n";
     strUsage += "  -checkblocks=<n>       " + strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), 288) + "\n";
     strUsage += "  -checklevel=<n>        " + strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), 3) + "\n";
@@ -255,8 +263,10 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += "  -datadir=<dir>         " + _("Specify data directory") + "\n";
     strUsage += "  -dbcache=<n>           " + strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache) + "\n";
     strUsage += "  -loadblock=<file>      " + _("Imports blocks from external blk000??.dat file") + " " + _("on startup") + "\n";
+    strUsage += "  -loadsnapshot=<file>   " + _("Start a new node from a chainstate snapshot written by dumpchainstate, without the blocks below it") + "\n";
     strUsage += "  -maxorphantx=<n>       " + strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS) + "\n";
-    strUsage += "  -par=<n>               " + strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS) + "\n";
+    strUsage += "  -par=<n>               " + strprintf(_("Set the number of script and startup block verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS) + "\n";
+    strUsage += "  -prefetchthreads=<n>   " + strprintf(_("Set the number of threads reading the coins a block spends ahead of connecting it (0 to %d, default: %d)"), MAX_PREFETCH_THREADS, DEFAULT_PREFETCH_THREADS) + "\n";
 #ifndef WIN32
     strUsage += "  -pid=<file>            " + strprintf(_("Specify pid file (default: %s)"), "truthcoind.pid") + "\n";
 #endif
@@ -334,7 +344,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += "  -debug=<category>      " + strprintf(_("Output debugging information (default: %u, supplying <category> is optional)"), 0) + "\n";
     strUsage += "                         " + _("If <category> is not supplied, output all debugging information.") + "\n";
     strUsage += "                         " + _("<category> can be:");
-    strUsage +=                                 " addrman, alert, bench, coindb, db, lock, rand, rpc, selectcoins, mempool, net"; // Don't translate these and qt below
+    strUsage +=                                 " addrman, alert, bench, coindb, db, lock, market, rand, rpc, selectcoins, mempool, net"; // Don't translate these and qt below
     if (mode == HMM_TRUTHCOIN_QT)
         strUsage += ", qt";
     strUsage += ".\n";
@@ -349,7 +359,7 @@ std::string HelpMessage(HelpMessageMode mode)
     {
         strUsage += "  -limitfreerelay=<n>    " + strprintf(_("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default:%u)"), 15) + "\n";
         strUsage += "  -relaypriority         " + strprintf(_("Require high priority for relaying free or low-fee transactions (default:%u)"), 1) + "\n";
-        strUsage += "  -maxsigcachesize=<n>   " + strprintf(_("Limit size of signature cache to <n> entries (default: %u)"), 50000) + "\n";
+        strUsage += "  -sigcachesize=<n>      " + strprintf(_("Limit size of signature cache to <n> MiB (default: %u, maximum: %u)"), DEFAULT_SIG_CACHE_SIZE, MAX_SIG_CACHE_SIZE) + "\n";
     }
     strUsage += "  -minrelaytxfee=<amt>   " + strprintf(_("Fees (in CSH/Kb) smaller than this are considered zero fee for relaying (default: %s)"), FormatMoney(::minRelayTxFee.GetFeePerK())) + "\n";
     strUsage += "  -printtoconsole        " + _("Send trace/debug info to console instead of debug.log file") + "\n";
@@ -663,6 +673,9 @@ bool AppInit2(boost::thread_group& threadGroup)
     if (GetBoolArg("-benchmark", false))
         InitWarning(_("Warning: Unsupported argument -benchmark ignored, use -debug=bench."));
 
+    if (mapArgs.count("-maxsigcachesize") && !mapArgs.count("-sigcachesize"))
+        InitWarning(_("Warning: Deprecated argument -maxsigcachesize is a number of entries, use -sigcachesize=<n> MiB."));
+
     // Checkmempool defaults to true in regtest mode
     mempool.setSanityCheck(GetBoolArg("-checkmempool", Params().DefaultCheckMemPool()));
     Checkpoints::fEnabled = GetBoolArg("-checkpoints", false);
@@ -676,6 +689,16 @@ bool AppInit2(boost::thread_group& threadGroup)
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    nPrefetchThreads = GetArg("-prefetchthreads", DEFAULT_PREFETCH_THREADS);
+    if (nPrefetchThreads < 0)
+        nPrefetchThreads = 0;
+    else if (nPrefetchThreads > MAX_PREFETCH_THREADS)
+        nPrefetchThreads = MAX_PREFETCH_THREADS;
+
+    // a node started from a snapshot does not have the transactions below it
+    if (mapArgs.count("-loadsnapshot") && GetBoolArg("-txindex", false))
+        return InitError(_("-loadsnapshot is incompatible with -txindex"));
+
     fServer = GetBoolArg("-server", false);
 #ifdef ENABLE_WALLET
     bool fDisableWallet = GetBoolArg("-disablewallet", false);
@@ -791,11 +814,16 @@ bool AppInit2(boost::thread_group& threadGroup)
     LogPrintf("Using at most %i connections (%i file descriptors available)\n", nMaxConnections, nFD);
     std::ostringstream strErrors;
 
+    LogPrintf("Using the '%s' SHA256 implementation\n", SHA256AutoDetect());
+    InitSignatureCache();
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
     }
+    LogPrintf("Using %u threads for prefetching coins\n", nPrefetchThreads);
+    for (int i=0; i<nPrefetchThreads; i++)
+        threadGroup.create_thread(&ThreadCoinsPrefetch);
 
     /* Start the RPC server already.  It will be started in "warmup" mode
      * and not really process calls already (but it will signify connections
@@ -1006,7 +1034,10 @@ bool AppInit2(boost::thread_group& threadGroup)
     nTotalCache -= nMarketTreeDBCache;
     size_t nCoinDBCache = nTotalCache / 2; // use half of the remaining cache for coindb cache
     nTotalCache -= nCoinDBCache;
-    nCoinCacheSize = nTotalCache / 300; // coins in memory require around 300 bytes
+    // The rest is for the coins in memory, counted in bytes. Only half of it
+    // is for pcoinsTip, as the flusher holds the cache it was last handed
+    // while writing it out and the tip fills up again meanwhile.
+    nCoinCacheUsage = nTotalCache / 2;
 
     bool fLoaded = false;
     while (!fLoaded) {
@@ -1020,6 +1051,7 @@ bool AppInit2(boost::thread_group& threadGroup)
             try {
                 UnloadBlockIndex();
                 delete pcoinsTip;
+                delete pcoinsflusher;
                 delete pcoinsdbview;
                 delete pcoinscatcher;
                 delete pblocktree;
@@ -1029,7 +1061,8 @@ bool AppInit2(boost::thread_group& threadGroup)
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
-                pcoinsTip = new CCoinsViewCache(pcoinscatcher);
+                pcoinsflusher = new CCoinsViewFlusher(pcoinscatcher, pblocktree, pmarkettree);
+                pcoinsTip = new CCoinsViewCache(pcoinsflusher);
 
                 if (fReindex) {
                     pblocktree->WriteReindexing(true);
@@ -1058,6 +1091,30 @@ bool AppInit2(boost::thread_group& threadGroup)
                     break;
                 }
 
+                // Start from a chainstate snapshot rather than from genesis, or
+                // redo the load of one that was interrupted
+                bool fLoadingSnapshot = IsLoadingChainstate();
+                if (mapArgs.count("-loadsnapshot") && !fReindex && (chainActive.Height() == 0 || fLoadingSnapshot)) {
+                    uiInterface.InitMessage(_("Loading chainstate snapshot..."));
+                    CSnapshotInfo info;
+                    if (!LoadChainstate(GetArg("-loadsnapshot", ""), info)) {
+                        strLoadError = _("Error loading chainstate snapshot");
+                        break;
+                    }
+
+                    // Load the block index again, now with the snapshot's chain
+                    UnloadBlockIndex();
+                    delete pcoinsTip;
+                    pcoinsTip = new CCoinsViewCache(pcoinsflusher);
+                    if (!LoadBlockIndex()) {
+                        strLoadError = _("Error loading block database");
+                        break;
+                    }
+                } else if (fLoadingSnapshot) {
+                    strLoadError = _("Loading a chainstate snapshot was interrupted, start again with -loadsnapshot");
+                    break;
+                }
+
                 uiInterface.InitMessage(_("Verifying blocks..."));
                 if (!CVerifyDB().VerifyDB(pcoinsdbview, GetArg("-checklevel", 3),
                               GetArg("-checkblocks", 288))) {
@@ -1285,6 +1342,13 @@ bool AppInit2(boost::thread_group& threadGroup)
 
     StartNode(threadGroup);
 
+    // Work out the outcomes of open ballots as their votes arrive
+    if (GetBoolArg("-ballotcache", true)) {
+        pballotcache = new CBallotCache();
+        RegisterValidationInterface(pballotcache);
+        threadGroup.create_thread(&ThreadBallotCache);
+    }
+
 #ifdef ENABLE_WALLET
     // Generate coins in the background
     if (pwalletMain)
@@ -50,6 +50,17 @@ public:
         batch.Put(slKey, slValue);
     }
 
+    //! Write a key and value that are serialized already, such as ones read through an iterator
+    void WriteRaw(const std::string& strKey, const std::string& strValue)
+    {
+        batch.Put(strKey, strValue);
+    }
+
+    void EraseRaw(const std::string& strKey)
+    {
+        batch.Delete(strKey);
+    }
+
     template <typename K>
     void Erase(const K& key)
     {
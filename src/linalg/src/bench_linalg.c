@@ -0,0 +1,334 @@
+/*
+ * Copyright (c) 2015 The Truthcoin Core developers
+ * Distributed under the MIT software license, see the accompanying
+ * file COPYING or http://www.opensource.org/licenses/mit-license.php.
+ */
+
+/* bench_linalg
+ * Times tc_vote_proc on synthetic ballots, stage by stage, and counts
+ * the allocations it makes. Arguments are name=value pairs:
+ *
+ *    voters=1000     number of voters (rows)
+ *    decisions=200   number of decisions (columns)
+ *    na=0.30         fraction of votes left NA
+ *    scaled=0.20     fraction of scaled (non-binary) decisions
+ *    collude=0.10    fraction of voters voting together against the truth
+ *    noise=0.05      chance that an honest voter gets a decision wrong
+ *    sparse=0        1 to use the sparse vote matrix (as marketOutcome does)
+ *    svd=gk          gk (tc_mat_svd) or jacobi (tc_mat_svd_jacobi)
+ *    warm=0          1 to warm start from the loading of the same ballot
+ *                    with a tenth of its votes still missing (untimed)
+ *    cert=0          1 to time the check of a published outcome, given
+ *                    its first loading rounded to 1e-8 (worked out untimed)
+ *    count=3         number of runs
+ *    seed=1          seed for the ballot generator
+ */
+
+#include <float.h>
+#include <malloc.h>
+#include <math.h>
+#include <memory.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+static uint64_t bench_nallocs;
+static uint64_t bench_nbytes;
+static uint64_t bench_nfrees;
+
+static void *
+bench_malloc(size_t size)
+{
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+    bench_nallocs++;
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+    bench_nbytes += size;
+    return malloc(size);
+}
+
+static void
+bench_free(void *ptr)
+{
+    if (ptr) {
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+        bench_nfrees++;
+    }
+    free(ptr);
+}
+
+static double
+bench_time(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_usec * 0.000001 + tv.tv_sec;
+}
+
+static double bench_last;
+static double bench_stage[6]; /* TC_VOTE_NSTAGES */
+
+static void
+bench_mark(int stage)
+{
+    double now = bench_time();
+    bench_stage[stage] += now - bench_last;
+    bench_last = now;
+}
+
+#define malloc(size) bench_malloc(size)
+#define free(ptr) bench_free(ptr)
+#define TC_VOTE_STAGE(s) bench_mark(s)
+#include "tc_mat.c"
+#undef malloc
+#undef free
+
+static const char *bench_stage_names[TC_VOTE_NSTAGES] = {
+    "fill", "covariance", "svd", "scoring", "smoothing", "outcomes" };
+
+/* xorshift64*, so that ballots do not depend on the C library */
+static uint64_t bench_rng;
+
+static double
+bench_rand(void)
+{
+    bench_rng ^= bench_rng >> 12;
+    bench_rng ^= bench_rng << 25;
+    bench_rng ^= bench_rng >> 27;
+    return (double)((bench_rng * 2685821657736338717ULL) >> 11) / 9007199254740992.0;
+}
+
+struct bench_params {
+    uint32_t voters;
+    uint32_t decisions;
+    double na;
+    double scaled;
+    double collude;
+    double noise;
+    int sparse;
+    int svd;
+    int warm;
+    int cert;
+    int count;
+    uint64_t seed;
+};
+
+/* bench_ballot
+ * The first collude*voters voters all vote the opposite of the truth
+ * (or one shared wrong value on scaled decisions). The others vote the
+ * truth, missing by noise. Any vote is NA with probability na.
+ */
+static struct tc_mat *
+bench_ballot(const struct bench_params *p, double NA, struct tc_mat *isbin)
+{
+    struct tc_mat *M = tc_mat_ctr(p->voters, p->decisions);
+    double *truth = (double *) malloc(sizeof(double) * (p->decisions + 1));
+    double *lie = (double *) malloc(sizeof(double) * (p->decisions + 1));
+    for(uint32_t j=0; j < p->decisions; j++) {
+        int binary = (bench_rand() >= p->scaled);
+        isbin->a[0][j] = (binary)? 1.0: 0.0;
+        truth[j] = (binary)? (double)(bench_rand() < 0.5): bench_rand();
+        lie[j] = (binary)? 1.0 - truth[j]: fmod(truth[j] + 0.5, 1.0);
+    }
+    uint32_t ncolluders = (uint32_t)(p->collude * p->voters);
+    for(uint32_t i=0; i < p->voters; i++) {
+        for(uint32_t j=0; j < p->decisions; j++) {
+            double x = (i < ncolluders)? lie[j]: truth[j];
+            if ((i >= ncolluders) && (bench_rand() < p->noise))
+                x = (isbin->a[0][j] > 0.0)? 1.0 - x: bench_rand();
+            M->a[i][j] = (bench_rand() < p->na)? NA: x;
+        }
+    }
+    free(lie);
+    free(truth);
+    return M;
+}
+
+static int
+bench_arg(const char *arg, const char *name, const char **value)
+{
+    size_t len = strlen(name);
+    if (strncmp(arg, name, len) || (arg[len] != '='))
+        return 0;
+    *value = arg + len + 1;
+    return 1;
+}
+
+int
+main(int argc, char **argv)
+{
+    struct bench_params p;
+    p.voters = 1000;
+    p.decisions = 200;
+    p.na = 0.30;
+    p.scaled = 0.20;
+    p.collude = 0.10;
+    p.noise = 0.05;
+    p.sparse = 0;
+    p.svd = TC_SVD_GOLUB_KAHAN;
+    p.warm = 0;
+    p.cert = 0;
+    p.count = 3;
+    p.seed = 1;
+    for(int i=1; i < argc; i++) {
+        const char *v;
+        if (bench_arg(argv[i], "voters", &v)) p.voters = atoi(v);
+        else if (bench_arg(argv[i], "decisions", &v)) p.decisions = atoi(v);
+        else if (bench_arg(argv[i], "na", &v)) p.na = atof(v);
+        else if (bench_arg(argv[i], "scaled", &v)) p.scaled = atof(v);
+        else if (bench_arg(argv[i], "collude", &v)) p.collude = atof(v);
+        else if (bench_arg(argv[i], "noise", &v)) p.noise = atof(v);
+        else if (bench_arg(argv[i], "sparse", &v)) p.sparse = atoi(v);
+        else if (bench_arg(argv[i], "svd", &v))
+            p.svd = (strcmp(v, "jacobi") == 0)? TC_SVD_JACOBI: TC_SVD_GOLUB_KAHAN;
+        else if (bench_arg(argv[i], "warm", &v)) p.warm = atoi(v);
+        else if (bench_arg(argv[i], "cert", &v)) p.cert = atoi(v);
+        else if (bench_arg(argv[i], "count", &v)) p.count = atoi(v);
+        else if (bench_arg(argv[i], "seed", &v)) p.seed = strtoull(v, NULL, 10);
+        else {
+            fprintf(stderr, "bench_linalg: unknown argument %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if ((p.voters < 2) || (p.decisions < 1) || (p.count < 1)) {
+        fprintf(stderr, "bench_linalg: need voters >= 2, decisions >= 1, count >= 1\n");
+        return 1;
+    }
+
+    const double NA = -1.0;
+    printf("voters %u decisions %u na %.2f scaled %.2f collude %.2f %s %s%s%s\n",
+        p.voters, p.decisions, p.na, p.scaled, p.collude,
+        (p.sparse)? "sparse": "dense",
+        (p.svd == TC_SVD_JACOBI)? "jacobi": "golub-kahan",
+        (p.warm)? " warm": "", (p.cert)? " cert": "");
+
+    double min[TC_VOTE_NSTAGES + 1];
+    double sum[TC_VOTE_NSTAGES + 1];
+    double max[TC_VOTE_NSTAGES + 1];
+    for(int k=0; k <= TC_VOTE_NSTAGES; k++) {
+        min[k] = HUGE_VAL;
+        sum[k] = 0.0;
+        max[k] = 0.0;
+    }
+    uint64_t nallocs = 0;
+    uint64_t nbytes = 0;
+    uint64_t nlive = 0;
+    double colluder_rep = 0.0;
+    uint32_t niter = 0;
+    int ncertified = 0;
+    for(int run=0; run < p.count; run++) {
+        bench_rng = p.seed * 0x9E3779B97F4A7C15ULL + run + 1;
+        struct tc_vote *vote;
+        struct tc_mat *isbin = tc_mat_ctr(1, p.decisions);
+        struct tc_mat *M = bench_ballot(&p, NA, isbin);
+        struct tc_mat *warm = NULL;
+        if (p.warm) {
+            struct tc_vote *early = tc_vote_ctr(p.voters, p.decisions);
+            tc_mat_copy(early->M, M);
+            for(uint32_t i=0; i < p.voters; i++) {
+                for(uint32_t j=0; j < p.decisions; j++)
+                    if (bench_rand() < 0.10)
+                        early->M->a[i][j] = NA;
+                early->rvecs[TC_VOTE_OLD_REP]->a[i][0] = 1.0 / p.voters;
+            }
+            tc_mat_copy(early->cvecs[TC_VOTE_IS_BINARY], isbin);
+            early->NA = NA;
+            early->alpha = 0.10;
+            early->tol = 0.10;
+            early->svd = p.svd;
+            if (tc_vote_proc(early) == 0) {
+                warm = tc_mat_ctr(0, 0);
+                tc_mat_transpose(warm, early->cvecs[TC_VOTE_FIRST_LOADING]);
+            }
+            tc_vote_dtr(early);
+        }
+        struct tc_mat *cert = NULL;
+        if (p.cert) {
+            struct tc_vote *miner = tc_vote_ctr(p.voters, p.decisions);
+            tc_mat_copy(miner->M, M);
+            for(uint32_t i=0; i < p.voters; i++)
+                miner->rvecs[TC_VOTE_OLD_REP]->a[i][0] = 1.0 / p.voters;
+            tc_mat_copy(miner->cvecs[TC_VOTE_IS_BINARY], isbin);
+            miner->NA = NA;
+            miner->alpha = 0.10;
+            miner->tol = 0.10;
+            miner->svd = TC_SVD_JACOBI;
+            if (tc_vote_proc(miner) == 0) {
+                cert = tc_mat_ctr(p.decisions, 1);
+                for(uint32_t j=0; j < p.decisions; j++)
+                    cert->a[j][0] = (int64_t)(miner->cvecs[TC_VOTE_FIRST_LOADING]->a[0][j] * 1e8) * 1e-8;
+            }
+            tc_vote_dtr(miner);
+        }
+        if (p.sparse) {
+            vote = tc_vote_sparse_ctr(tc_spmat_from_mat(M, NA));
+            tc_mat_dtr(M);
+        } else {
+            vote = tc_vote_ctr(p.voters, p.decisions);
+            tc_mat_copy(vote->M, M);
+            tc_mat_dtr(M);
+        }
+        tc_mat_copy(vote->cvecs[TC_VOTE_IS_BINARY], isbin);
+        tc_mat_dtr(isbin);
+        vote->NA = NA;
+        vote->alpha = 0.10;
+        vote->tol = 0.10;
+        vote->svd = p.svd;
+        vote->warm = warm;
+        vote->cert = cert;
+        for(uint32_t i=0; i < p.voters; i++)
+            vote->rvecs[TC_VOTE_OLD_REP]->a[i][0] = 1.0 / p.voters;
+
+        for(int k=0; k < TC_VOTE_NSTAGES; k++)
+            bench_stage[k] = 0.0;
+        uint64_t allocs0 = bench_nallocs;
+        uint64_t bytes0 = bench_nbytes;
+        uint64_t frees0 = bench_nfrees;
+        double begin = bench_time();
+        bench_last = begin;
+        int rc = tc_vote_proc(vote);
+        double total = bench_time() - begin;
+        if (rc) {
+            fprintf(stderr, "bench_linalg: tc_vote_proc returned %d\n", rc);
+            tc_vote_dtr(vote);
+            return 1;
+        }
+        nallocs = bench_nallocs - allocs0;
+        nbytes = bench_nbytes - bytes0;
+        nlive = nallocs - (bench_nfrees - frees0);
+
+        for(int k=0; k <= TC_VOTE_NSTAGES; k++) {
+            double t = (k < TC_VOTE_NSTAGES)? bench_stage[k]: total;
+            if (t < min[k]) min[k] = t;
+            if (t > max[k]) max[k] = t;
+            sum[k] += t;
+        }
+        niter = vote->niter;
+        ncertified += vote->certified;
+        colluder_rep = 0.0;
+        for(uint32_t i=0; i < (uint32_t)(p.collude * p.voters); i++)
+            colluder_rep += vote->rvecs[TC_VOTE_SMOOTHED_REP]->a[i][0];
+        tc_vote_dtr(vote);
+    }
+
+    for(int k=0; k <= TC_VOTE_NSTAGES; k++)
+        printf("%-12s min %10.3fms / avg %10.3fms / max %10.3fms\n",
+            (k < TC_VOTE_NSTAGES)? bench_stage_names[k]: "total",
+            min[k] * 1000.0, (sum[k] / p.count) * 1000.0, max[k] * 1000.0);
+    printf("allocations %llu (%llu bytes), %llu still live on return\n",
+        (unsigned long long)nallocs, (unsigned long long)nbytes,
+        (unsigned long long)nlive);
+    if (p.warm)
+        printf("power iterations %u\n", niter);
+    if (p.cert)
+        printf("certified %d of %d\n", ncertified, p.count);
+    printf("colluders' smoothed reputation %.6f\n", colluder_rep);
+    return 0;
+}
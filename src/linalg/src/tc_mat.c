@@ -4,6 +4,7 @@
  * file COPYING or http://www.opensource.org/licenses/mit-license.php.
  */
 
+#include <float.h>
 #include <malloc.h>
 #include <math.h>
 #include <memory.h>
@@ -12,6 +13,21 @@
 #include <string.h>
 #include "tc_mat.h"
 
+/* Stages of tc_vote_proc. bench_linalg defines TC_VOTE_STAGE before
+ * including this file to time each one; TC_VOTE_STAGE(s) marks the
+ * end of stage s.
+ */
+#define TC_VOTE_STAGE_FILL          0
+#define TC_VOTE_STAGE_COVARIANCE    1
+#define TC_VOTE_STAGE_SVD           2
+#define TC_VOTE_STAGE_SCORING       3
+#define TC_VOTE_STAGE_SMOOTHING     4
+#define TC_VOTE_STAGE_OUTCOMES      5
+#define TC_VOTE_NSTAGES             6
+#ifndef TC_VOTE_STAGE
+#define TC_VOTE_STAGE(s)
+#endif
+
 /****************************************************************************
  * tc_mat                                                                   *
  ****************************************************************************/
@@ -550,14 +566,15 @@ tc_mat_svd(
                 U->a[j][i0] = tmp;
             }
             double tmp = D->a[i1][i1];
-            double tmp1 = D->a[i1][i1+1];
+            double tmp1 = (i1+1 < D->nc)? D->a[i1][i1+1]: 0.0;
             for(uint32_t k=i1; k > i0; k--) {
                 D->a[k][k] = D->a[k-1][k-1];
                 if (k+1 < D->nc)
                     D->a[k][k+1] = D->a[k-1][k];
             }
             D->a[i0][i0] = tmp;
-            D->a[i0][i0+1] = tmp1;
+            if (i0+1 < D->nc)
+                D->a[i0][i0+1] = tmp1;
             i0++;
         }
         /* For any zeros on the superdiagonal, move the
@@ -712,6 +729,239 @@ tc_mat_svd(
     return 0;
 }
 
+/* tc_mat_jacobi_rotate
+ * Rotate rows p and q of W so that they are orthogonal and apply the
+ * same rotation to rows p and q of Z.
+ * Output: 1 if a rotation was applied, 0 if the rows were already
+ *         orthogonal (or q is past the last row).
+ */
+static int
+tc_mat_jacobi_rotate(struct tc_mat *W, struct tc_mat *Z, uint32_t p, uint32_t q)
+{
+    if ((p >= W->nr) || (q >= W->nr))
+        return 0;
+    double *wp = W->a[p];
+    double *wq = W->a[q];
+    double alpha = 0.0;
+    double beta = 0.0;
+    double gamma = 0.0;
+    for(uint32_t i=0; i < W->nc; i++) {
+        alpha += wp[i] * wp[i];
+        beta += wq[i] * wq[i];
+        gamma += wp[i] * wq[i];
+    }
+    if (fabs(gamma) <= DBL_EPSILON * sqrt(alpha) * sqrt(beta))
+        return 0;
+    /* t = tan(theta) is the smaller root of t^2 + 2 zeta t - 1 = 0 */
+    double zeta = (beta - alpha) / (2.0 * gamma);
+    double t = ((zeta < 0.0)? -1.0: 1.0) / (fabs(zeta) + sqrt(1.0 + zeta * zeta));
+    double c = 1.0 / sqrt(1.0 + t * t);
+    double s = c * t;
+    for(uint32_t i=0; i < W->nc; i++) {
+        double x = wp[i];
+        double y = wq[i];
+        wp[i] = c * x - s * y;
+        wq[i] = s * x + c * y;
+    }
+    double *zp = Z->a[p];
+    double *zq = Z->a[q];
+    for(uint32_t i=0; i < Z->nc; i++) {
+        double x = zp[i];
+        double y = zq[i];
+        zp[i] = c * x - s * y;
+        zq[i] = s * x + c * y;
+    }
+    return 1;
+}
+
+/* tc_mat_svd_jacobi
+ * One-sided (Hestenes) Jacobi SVD, A = U D V^T with the same shapes
+ * as tc_mat_svd. Pairs of columns of A are rotated until all columns
+ * are orthogonal; their norms are then the singular values.
+ *
+ * Each sweep visits every pair once in a fixed round-robin order
+ * (column 0 stays put and the others rotate one place per round), so
+ * the pairs within a round are disjoint and are rotated in parallel.
+ * A rotation only reads and writes its own two columns, so the result
+ * is the same for any number of threads.
+ *
+ * Columns of U for zero singular values are left zero.
+ */
+int
+tc_mat_svd_jacobi(
+    const struct tc_mat *A,
+    struct tc_mat *U,
+    struct tc_mat *D,
+    struct tc_mat *V)
+{
+    if (!U || !D || !V || !A)
+        return -1;
+    if ((U->nr != A->nr) || (U->nc != A->nc))
+        tc_mat_resize(U, A->nr, A->nc);
+    if ((V->nr != A->nc) || (V->nc != A->nc))
+        tc_mat_resize(V, A->nc, A->nc);
+    if ((D->nr != A->nc) || (D->nc != A->nc))
+        tc_mat_resize(D, A->nc, A->nc);
+    if (A->nr < A->nc)
+        return -2;
+
+    const uint32_t nr = A->nr;
+    const uint32_t nc = A->nc;
+
+    /* work on the transposes so that columns are contiguous */
+    struct tc_mat *W = tc_mat_ctr(nc, nr);
+    tc_mat_transpose(W, A);
+    struct tc_mat *Z = tc_mat_ctr(nc, nc);
+    tc_mat_identity(Z);
+
+    /* with an odd number of columns, index nc is a dummy and its
+     * partner sits out the round */
+    const uint32_t n = nc + (nc & 1);
+    const uint32_t npairs = n / 2;
+    uint32_t *p = (uint32_t *) malloc(sizeof(uint32_t) * (npairs + 1));
+    uint32_t *q = (uint32_t *) malloc(sizeof(uint32_t) * (npairs + 1));
+    for(uint32_t sweep=0; sweep < TC_SVD_JACOBI_MAX_SWEEPS; sweep++) {
+        uint32_t nrot = 0;
+        for(uint32_t r=0; r+1 < n; r++) {
+            for(uint32_t k=0; k < npairs; k++) {
+                uint32_t a = (k == 0)? 0: 1 + (k - 1 + r) % (n - 1);
+                uint32_t b = 1 + (n - 2 - k + r) % (n - 1);
+                p[k] = (a < b)? a: b;
+                q[k] = (a < b)? b: a;
+            }
+            uint32_t rot = 0;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) reduction(+:rot) if ((uint64_t)nr * npairs > 16384)
+#endif
+            for(int64_t k=0; k < (int64_t)npairs; k++)
+                rot += tc_mat_jacobi_rotate(W, Z, p[k], q[k]);
+            nrot += rot;
+        }
+        if (!nrot)
+            break;
+    }
+    free(q);
+    free(p);
+
+    /* singular values, sorted in decreasing order (ties by index) */
+    double *sigma = (double *) malloc(sizeof(double) * (nc + 1));
+    uint32_t *idx = (uint32_t *) malloc(sizeof(uint32_t) * (nc + 1));
+    for(uint32_t j=0; j < nc; j++) {
+        double normsq = 0.0;
+        for(uint32_t i=0; i < nr; i++)
+            normsq += W->a[j][i] * W->a[j][i];
+        sigma[j] = sqrt(normsq);
+        uint32_t k = j;
+        for(; (k > 0) && (sigma[idx[k-1]] < sigma[j]); k--)
+            idx[k] = idx[k-1];
+        idx[k] = j;
+    }
+    for(uint32_t k=0; k < nc; k++) {
+        uint32_t j = idx[k];
+        double inv = (sigma[j] > 0.0)? 1.0 / sigma[j]: 0.0;
+        for(uint32_t i=0; i < nr; i++)
+            U->a[i][k] = W->a[j][i] * inv;
+        for(uint32_t i=0; i < nc; i++) {
+            V->a[i][k] = Z->a[j][i];
+            D->a[k][i] = (i == k)? sigma[j]: 0.0;
+        }
+    }
+
+    free(idx);
+    free(sigma);
+    tc_mat_dtr(Z);
+    tc_mat_dtr(W);
+    return 0;
+}
+
+/****************************************************************************
+ * tc_spmat                                                                 *
+ ****************************************************************************/
+
+struct tc_spmat *
+tc_spmat_ctr(uint32_t nr_, uint32_t nc_, uint32_t nnz_)
+{
+    struct tc_spmat *S = (struct tc_spmat *) malloc(sizeof(struct tc_spmat));
+    S->nr = nr_;
+    S->nc = nc_;
+    S->nnz = nnz_;
+    S->rowp = (uint32_t *) malloc(sizeof(uint32_t) * (nr_ + 1));
+    S->colidx = (uint32_t *) malloc(sizeof(uint32_t) * (nnz_ + 1));
+    S->val = (double *) malloc(sizeof(double) * (nnz_ + 1));
+    memset(S->rowp, 0, sizeof(uint32_t) * (nr_ + 1));
+    return S;
+}
+
+void
+tc_spmat_dtr(struct tc_spmat *S)
+{
+    if (!S)
+        return;
+    free(S->rowp);
+    free(S->colidx);
+    free(S->val);
+    free(S);
+}
+
+/* tc_spmat_from_mat
+ * Input: A N x M matrix
+ * Return: A as a sparse matrix, skipping the NA values
+ */
+struct tc_spmat *
+tc_spmat_from_mat(const struct tc_mat *A, double NA)
+{
+    if (!A)
+        return NULL;
+    uint32_t nnz = 0;
+    for(uint32_t i=0; i < A->nr; i++)
+        for(uint32_t j=0; j < A->nc; j++)
+            if (A->a[i][j] != NA)
+                nnz++;
+    struct tc_spmat *S = tc_spmat_ctr(A->nr, A->nc, nnz);
+    uint32_t k = 0;
+    for(uint32_t i=0; i < A->nr; i++) {
+        S->rowp[i] = k;
+        for(uint32_t j=0; j < A->nc; j++) {
+            if (A->a[i][j] == NA)
+                continue;
+            S->colidx[k] = j;
+            S->val[k] = A->a[i][j];
+            k++;
+        }
+    }
+    S->rowp[A->nr] = k;
+    return S;
+}
+
+/* tc_spmat_transpose
+ * Input: S N x M sparse matrix
+ * Return: S^T, i.e. S in compressed column form. The entries of each
+ *         row of S^T are in increasing column order.
+ */
+struct tc_spmat *
+tc_spmat_transpose(const struct tc_spmat *S)
+{
+    if (!S)
+        return NULL;
+    struct tc_spmat *T = tc_spmat_ctr(S->nc, S->nr, S->nnz);
+    /* counting sort on the column index */
+    for(uint32_t k=0; k < S->nnz; k++)
+        T->rowp[S->colidx[k] + 1]++;
+    for(uint32_t j=0; j < S->nc; j++)
+        T->rowp[j+1] += T->rowp[j];
+    uint32_t *next = (uint32_t *) malloc(sizeof(uint32_t) * (S->nc + 1));
+    memcpy(next, T->rowp, sizeof(uint32_t) * (S->nc + 1));
+    for(uint32_t i=0; i < S->nr; i++) {
+        for(uint32_t k=S->rowp[i]; k < S->rowp[i+1]; k++) {
+            uint32_t dst = next[S->colidx[k]]++;
+            T->colidx[dst] = i;
+            T->val[dst] = S->val[k];
+        }
+    }
+    free(next);
+    return T;
+}
+
 /****************************************************************************
  * tc_wgt                                                                   *
  ****************************************************************************/
@@ -771,28 +1021,84 @@ tc_wgt_mean(const struct tc_mat *wgt, const struct tc_mat *A, uint32_t j,
 /* tc_wgt_median
  * Input: wgt N x 1 matrix
  * Input: A N x M matrix
+ * Input: v scratch buffer of at least N entries
  * Return: weighed median of the j-th column of A, skipping NA values
  * The weighted median is where the sum of the weights for the values below
  * is equal to the sum of the weights above, and if there is no exact midpoint
  * a weighted average of the two closest values.
+ *
+ * Rather than sorting the column, the median is found via a weighted
+ * quickselect: the values are partitioned about a pivot into the parts
+ * below, equal to and above it, and only the part holding the midpoint
+ * weight is kept. The expected cost is linear in the number of non-NA
+ * values. The pivot is the median of three so that the result does not
+ * depend on any random state.
  */
 struct vecdouble { double wgt; double value; };
-int vecdouble_cmp(const void *a, const void *b) {
-    if (!a || !b) return 0;
-    const struct vecdouble *aptr = (const struct vecdouble *) a;
-    const struct vecdouble *bptr = (const struct vecdouble *) b;
-    return (aptr->value < bptr->value)? -1: 1;
+
+static double
+tc_wgt_select(struct vecdouble *v, uint32_t n, double mid_wgts)
+{
+    /* the median lies in v[lo,hi) and acc is the sum of the weights of
+     * all values to the left of v[lo,hi)
+     */
+    uint32_t lo = 0;
+    uint32_t hi = n;
+    double acc = 0.0;
+    while (hi - lo > 1) {
+        double a = v[lo].value;
+        double b = v[lo + (hi - lo)/2].value;
+        double c = v[hi-1].value;
+        double pivot = (a < b)? ((b < c)? b: ((a < c)? c: a))
+                              : ((a < c)? a: ((b < c)? c: b));
+        /* [lo,lt) < pivot, [lt,gt) == pivot, [gt,hi) > pivot */
+        uint32_t lt = lo;
+        uint32_t gt = hi;
+        double wlt = 0.0;
+        double weq = 0.0;
+        for(uint32_t i=lo; i < gt; ) {
+            struct vecdouble tmp = v[i];
+            if (tmp.value < pivot) {
+                v[i] = v[lt];
+                v[lt] = tmp;
+                wlt += tmp.wgt;
+                lt++;
+                i++;
+            }
+            else
+            if (tmp.value > pivot) {
+                gt--;
+                v[i] = v[gt];
+                v[gt] = tmp;
+            }
+            else {
+                weq += tmp.wgt;
+                i++;
+            }
+        }
+        if ((lt > lo) && (acc + wlt >= mid_wgts)) {
+            hi = lt;
+            continue;
+        }
+        /* the midpoint is on the pivot or, if the weights never reach
+         * the midpoint, the pivot is the largest value
+         */
+        if ((gt == hi) || (acc + wlt + weq >= mid_wgts))
+            return pivot;
+        acc += wlt + weq;
+        lo = gt;
+    }
+    return v[lo].value;
 }
+
 static double
 tc_wgt_median(const struct tc_mat *wgt, const struct tc_mat *A, uint32_t j,
-    double NA)
+    double NA, struct vecdouble *v)
 {
     if (!wgt || !A || !A->nr || !A->nc
             || (wgt->nr != A->nr) || (j >= A->nc))
         return 0.0;
 
-    struct vecdouble *v = (struct vecdouble *)
-        malloc(sizeof(struct vecdouble) * A->nr);
     uint32_t nwgts = 0;
     double sum_wgts = 0.0;
     for(uint32_t i=0; i < A->nr; i++) {
@@ -803,20 +1109,344 @@ tc_wgt_median(const struct tc_mat *wgt, const struct tc_mat *A, uint32_t j,
         sum_wgts += wgt->a[i][0];
         nwgts++;
     }
-	double mid_wgts = sum_wgts / 2.0;
     if (nwgts == 0) 
         return 0.0;
+    return tc_wgt_select(v, nwgts, sum_wgts / 2.0);
+}
 
-    /* iterate throught the sorted values until mid_wgts is passed */
-    qsort(v, nwgts, sizeof(struct vecdouble), vecdouble_cmp);
-    double median = v[0].value;
-    double sum = v[0].wgt;
-    for(uint32_t i=1; (i < nwgts) && (sum < mid_wgts); i++) {
-        median = v[i].value;
-        sum += v[i].wgt;
+/* tc_wgt_outcomes
+ * Input: wgt N x 1 matrix
+ * Input: A N x M matrix
+ * Input: isbin 1 x M matrix, or NULL if all columns are scaled
+ * Output: out M values, the weighted mean of the binary columns and the
+ *         weighted median of the scaled columns, skipping NA values
+ *
+ * A single scratch buffer is shared by all the columns of a thread. The
+ * columns are independent, so with OpenMP they are split across threads
+ * and the result is the same for any number of threads.
+ */
+static void
+tc_wgt_outcomes(const struct tc_mat *wgt, const struct tc_mat *A,
+    const struct tc_mat *isbin, double NA, double *out)
+{
+    const int64_t nc = A->nc;
+#ifdef _OPENMP
+#pragma omp parallel if (A->nr * nc > 4096)
+#endif
+    {
+        struct vecdouble *v = (struct vecdouble *)
+            malloc(sizeof(struct vecdouble) * (A->nr + 1));
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 8)
+#endif
+        for(int64_t j=0; j < nc; j++)
+            out[j] = (isbin && (isbin->a[0][j] > 0.0))?
+                tc_wgt_mean(wgt, A, (uint32_t) j, NA):
+                tc_wgt_median(wgt, A, (uint32_t) j, NA, v);
+        free(v);
     }
-    free(v);
-    return median;
+}
+
+int
+tc_wgt_col_medians(
+    const struct tc_mat *wgt,
+    const struct tc_mat *A,
+    double NA,
+    struct tc_mat *medians)
+{
+    if (!wgt || !A || !medians || (wgt->nr != A->nr))
+        return -1;
+    if ((medians->nr != 1) || (medians->nc != A->nc))
+        tc_mat_resize(medians, 1, A->nc);
+    if (A->nc)
+        tc_wgt_outcomes(wgt, A, NULL, NA, medians->a[0]);
+    return 0;
+}
+
+/* tc_spwgt_outcomes
+ * Input: wgt N x 1 matrix
+ * Input: T M x N sparse matrix, the transpose of the vote matrix
+ * Input: isbin 1 x M matrix
+ * Input: fill M values standing in for the NA entries, or NULL
+ * Output: out M values, as tc_wgt_outcomes on the vote matrix with its
+ *         NA entries replaced by fill (or skipped if fill is NULL)
+ *
+ * All the NA entries of a column share one value, so they enter the
+ * mean as one term and the median as one entry carrying their combined
+ * weight. Only the votes cast are visited.
+ */
+static void
+tc_spwgt_outcomes(const struct tc_mat *wgt, const struct tc_spmat *T,
+    const struct tc_mat *isbin, const double *fill, double *out)
+{
+    double wtot = 0.0; /* sum of all the weights */
+    double wpos = 0.0; /* sum of the weights counted by the mean */
+    for(uint32_t i=0; i < wgt->nr; i++) {
+        wtot += wgt->a[i][0];
+        if (wgt->a[i][0] > 0.0)
+            wpos += wgt->a[i][0];
+    }
+    uint32_t maxcol = 0;
+    for(uint32_t j=0; j < T->nr; j++)
+        if (T->rowp[j+1] - T->rowp[j] > maxcol)
+            maxcol = T->rowp[j+1] - T->rowp[j];
+
+    const int64_t nc = T->nr;
+#ifdef _OPENMP
+#pragma omp parallel if (T->nnz > 4096)
+#endif
+    {
+        struct vecdouble *v = (struct vecdouble *)
+            malloc(sizeof(struct vecdouble) * (maxcol + 1));
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 8)
+#endif
+        for(int64_t j=0; j < nc; j++) {
+            uint32_t k0 = T->rowp[j];
+            uint32_t k1 = T->rowp[j+1];
+            int has_na = (fill) && (k1 - k0 < T->nc);
+            if (isbin->a[0][j] > 0.0) {
+                double sum = 0.0;
+                double sum_wgts = 0.0;
+                for(uint32_t k=k0; k < k1; k++) {
+                    double w = wgt->a[T->colidx[k]][0];
+                    if (w <= 0.0)
+                        continue;
+                    sum += w * T->val[k];
+                    sum_wgts += w;
+                }
+                if (has_na && (wpos - sum_wgts > 0.0)) {
+                    sum += (wpos - sum_wgts) * fill[j];
+                    sum_wgts = wpos;
+                }
+                out[j] = (sum_wgts > 0.0)? sum / sum_wgts: 0.0;
+            }
+            else {
+                uint32_t n = 0;
+                double sum_wgts = 0.0;
+                for(uint32_t k=k0; k < k1; k++) {
+                    v[n].value = T->val[k];
+                    v[n].wgt = wgt->a[T->colidx[k]][0];
+                    sum_wgts += v[n].wgt;
+                    n++;
+                }
+                if (has_na) {
+                    v[n].value = fill[j];
+                    v[n].wgt = wtot - sum_wgts;
+                    if (v[n].wgt < 0.0)
+                        v[n].wgt = 0.0;
+                    sum_wgts += v[n].wgt;
+                    n++;
+                }
+                out[j] = (n)? tc_wgt_select(v, n, sum_wgts / 2.0): 0.0;
+            }
+        }
+        free(v);
+    }
+}
+
+/* tc_power_iter
+ * Refine v (n x 1) towards the leading eigenvector of a symmetric
+ * positive semi-definite matrix C, given only out = C v by mult.
+ * Stops when ||C v - lambda v|| <= TC_POWER_TOL * lambda with
+ * lambda = v^T C v.
+ * Output: 0 and v, a unit vector, on convergence; -1 if v is zero, C v
+ *         is zero or there is no convergence in TC_POWER_MAX_ITER steps.
+ *         niter is the number of products taken.
+ */
+static int
+tc_power_iter(
+    uint32_t n,
+    void (*mult)(const void *ctx, const double *v, double *out),
+    const void *ctx,
+    double *v,
+    uint32_t *niter)
+{
+    double norm = 0.0;
+    for(uint32_t i=0; i < n; i++)
+        norm += v[i] * v[i];
+    norm = sqrt(norm);
+    *niter = 0;
+    if (norm == 0.0)
+        return -1;
+    for(uint32_t i=0; i < n; i++)
+        v[i] /= norm;
+
+    int rc = -1;
+    double *w = (double *) malloc(sizeof(double) * (n + 1));
+    for(uint32_t it=0; it < TC_POWER_MAX_ITER; it++) {
+        mult(ctx, v, w);
+        *niter = it + 1;
+        double lambda = 0.0;
+        for(uint32_t i=0; i < n; i++)
+            lambda += v[i] * w[i];
+        if (lambda <= 0.0)
+            break;
+        double r2 = 0.0;
+        norm = 0.0;
+        for(uint32_t i=0; i < n; i++) {
+            double r = w[i] - lambda * v[i];
+            r2 += r * r;
+            norm += w[i] * w[i];
+        }
+        if (sqrt(r2) <= TC_POWER_TOL * lambda) {
+            rc = 0;
+            break;
+        }
+        norm = sqrt(norm);
+        for(uint32_t i=0; i < n; i++)
+            v[i] = w[i] / norm;
+    }
+    free(w);
+    return rc;
+}
+
+/* tc_power_cert
+ * Check that v (n x 1) is the leading eigenvector of a symmetric
+ * positive semi-definite matrix C, given out = C v by mult and the
+ * trace of C. For unit v let lambda = v^T C v and r = ||C v - lambda v||.
+ * C has an eigenvalue mu >= lambda - r. With P = I - v v^T, the second
+ * largest eigenvalue of C is at most the largest of P C P, which is at
+ * most trace(P C P) = trace - lambda and, if C itself is given, at most
+ *    ||P C P||_F = sqrt(||C||_F^2 - 2 ||C v||^2 + lambda^2),
+ * so mu is the largest if lambda - r exceeds either bound.
+ * Output: 0 and v, normalized, if r <= TC_CERT_TOL * sqrt(n) * lambda
+ *         and mu is shown to be the largest; -1 otherwise.
+ */
+static int
+tc_power_cert(
+    uint32_t n,
+    void (*mult)(const void *ctx, const double *v, double *out),
+    const void *ctx,
+    double trace,
+    const struct tc_mat *C,
+    double *v)
+{
+    double norm = 0.0;
+    for(uint32_t i=0; i < n; i++)
+        norm += v[i] * v[i];
+    norm = sqrt(norm);
+    if (norm == 0.0)
+        return -1;
+    for(uint32_t i=0; i < n; i++)
+        v[i] /= norm;
+
+    double *w = (double *) malloc(sizeof(double) * (n + 1));
+    mult(ctx, v, w);
+    double lambda = 0.0;
+    double w2 = 0.0;
+    for(uint32_t i=0; i < n; i++) {
+        lambda += v[i] * w[i];
+        w2 += w[i] * w[i];
+    }
+    double r2 = 0.0;
+    for(uint32_t i=0; i < n; i++) {
+        double r = w[i] - lambda * v[i];
+        r2 += r * r;
+    }
+    free(w);
+
+    double r = sqrt(r2);
+    if ((lambda <= 0.0) || (r > TC_CERT_TOL * sqrt((double) n) * lambda))
+        return -1;
+    if (lambda - r > trace - lambda)
+        return 0;
+    if (C) {
+        double frob2 = 0.0;
+        for(uint32_t i=0; i < C->nr; i++)
+            for(uint32_t j=0; j < C->nc; j++)
+                frob2 += C->a[i][j] * C->a[i][j];
+        double pcp2 = frob2 - 2.0 * w2 + lambda * lambda;
+        if (lambda - r > sqrt((pcp2 > 0.0)? pcp2: 0.0))
+            return 0;
+    }
+    return -1;
+}
+
+/* tc_cert_agrees
+ * Whether the loading cert (n x 1), normalized, agrees entry by entry
+ * with unit v to within TC_CERT_TOL, either of them negated.
+ * Output: 0 and v the normalized cert if so; -1 otherwise.
+ */
+static int
+tc_cert_agrees(uint32_t n, const struct tc_mat *cert, double *v)
+{
+    double norm = 0.0;
+    double dot = 0.0;
+    for(uint32_t i=0; i < n; i++) {
+        norm += cert->a[i][0] * cert->a[i][0];
+        dot += cert->a[i][0] * v[i];
+    }
+    norm = sqrt(norm);
+    if (norm == 0.0)
+        return -1;
+    double sign = (dot < 0.0)? -1.0: 1.0;
+    for(uint32_t i=0; i < n; i++)
+        if (fabs(v[i] - sign * cert->a[i][0] / norm) > TC_CERT_TOL)
+            return -1;
+    for(uint32_t i=0; i < n; i++)
+        v[i] = cert->a[i][0] / norm;
+    return 0;
+}
+
+/* tc_mat_svd_by
+ * SVD of A by the TC_SVD_* method svd
+ */
+static int
+tc_mat_svd_by(int svd, const struct tc_mat *A, struct tc_mat *U,
+    struct tc_mat *D, struct tc_mat *V)
+{
+    if (svd == TC_SVD_JACOBI)
+        return tc_mat_svd_jacobi(A, U, D, V);
+    return tc_mat_svd(A, U, D, V);
+}
+
+/* tc_wgt_cov_mult
+ * out = wCVM v, for wCVM = factor * X^T diag(wgt) X, without forming wCVM
+ */
+struct tc_wgt_cov {
+    const struct tc_mat *wgt;
+    const struct tc_mat *X;
+    double factor;
+};
+
+static void
+tc_wgt_cov_mult(const void *ctx, const double *v, double *out)
+{
+    const struct tc_wgt_cov *cov = (const struct tc_wgt_cov *) ctx;
+    const struct tc_mat *X = cov->X;
+    for(uint32_t j=0; j < X->nc; j++)
+        out[j] = 0.0;
+    for(uint32_t k=0; k < X->nr; k++) {
+        double s = 0.0;
+        for(uint32_t j=0; j < X->nc; j++)
+            s += X->a[k][j] * v[j];
+        s *= cov->wgt->a[k][0];
+        for(uint32_t j=0; j < X->nc; j++)
+            out[j] += s * X->a[k][j];
+    }
+    for(uint32_t j=0; j < X->nc; j++)
+        out[j] *= cov->factor;
+}
+
+/* tc_wgt_cov_form
+ * wCVM = factor * X^T diag(wgt) X
+ */
+static struct tc_mat *
+tc_wgt_cov_form(const struct tc_wgt_cov *cov)
+{
+    const struct tc_mat *X = cov->X;
+    struct tc_mat *wCVM = tc_mat_ctr(X->nc, X->nc);
+    for(uint32_t i=0; i < X->nc; i++) {
+        for(uint32_t j=0; j <= i; j++) {
+            double sum = 0.0;
+            for(uint32_t k=0; k < X->nr; k++)
+                sum += cov->wgt->a[k][0] * X->a[k][i] * X->a[k][j];
+            wCVM->a[i][j] =
+            wCVM->a[j][i] = cov->factor * sum;
+        }
+    }
+    return wCVM;
 }
 
 /* tc_wgt_prin_comp
@@ -824,11 +1454,19 @@ tc_wgt_median(const struct tc_mat *wgt, const struct tc_mat *A, uint32_t j,
  * U D V^T = singular value decomposition of wCVM
  * loadings = first column of U
  * scores = (M-colavgs(M)) * loadings
+ * A loading cert which passes tc_power_cert, or agrees with a known
+ * loading, is taken as it is, and certified is set.
  */
-int
-tc_wgt_prin_comp(
+static int
+tc_wgt_prin_comp_svd(
     const struct tc_mat *wgt /* Reputation Vector */,
     const struct tc_mat *M /* Vote Matrix*/,
+    int svd,
+    const struct tc_mat *cert,
+    const struct tc_mat *warm,
+    const struct tc_mat *known,
+    uint32_t *niter,
+    int *certified,
     struct tc_mat *loadings,
     struct tc_mat *scores)
 {
@@ -837,8 +1475,6 @@ tc_wgt_prin_comp(
     if ((M->nr <= 1) || (wgt->nr != M->nr))
         return -1;
 
-    int rc = 0;
-
     /* X = M minus its column weighted averages */
     struct tc_mat *x_mat = tc_mat_ctr(M->nr, M->nc);
     double **x = (double **) x_mat->a;
@@ -849,41 +1485,418 @@ tc_wgt_prin_comp(
         for(uint32_t i=0; i < M->nr; i++)
             x[i][j] = M->a[i][j] - avg;
     }
-    /* wCMV = weighted covariance matrix of M */
     double wgts2 = 0.0;
     for(uint32_t i=0; i < M->nr; i++)
         wgts2 += wgt->a[i][0] * wgt->a[i][0];
     double factor = 1.0/(1.0 - wgts2);
-    struct tc_mat *wCVM = tc_mat_ctr(M->nc, M->nc);
-    for(uint32_t i=0; i < M->nc; i++) {
-        for(uint32_t j=0; j <= i; j++) {
-            double sum = 0.0;
-            for(uint32_t k=0; k < M->nr; k++)
-                sum += wgt->a[k][0] * x[k][i] * x[k][j];
-            wCVM->a[i][j] =
-            wCVM->a[j][i] = factor * sum;
+
+    int rc = -1;
+    *niter = 0;
+    *certified = 0;
+    struct tc_wgt_cov cov = { wgt, x_mat, factor };
+    struct tc_mat *wCVM = NULL;
+    double *L = (double *) malloc(sizeof(double) * (M->nc + 1));
+
+    /* the trace of wCVM, which a loading is checked against */
+    double trace = 0.0;
+    for(uint32_t k=0; k < M->nr; k++) {
+        double sum = 0.0;
+        for(uint32_t j=0; j < M->nc; j++)
+            sum += x[k][j] * x[k][j];
+        trace += wgt->a[k][0] * sum;
+    }
+    trace *= factor;
+
+    /* a loading already worked out is not worked out again; the cert
+     * is taken if it agrees with it */
+    if (cert && known && (cert->nr == M->nc) && (cert->nc == 1)
+        && (known->nr == M->nc) && (known->nc == 1)) {
+        for(uint32_t j=0; j < M->nc; j++)
+            L[j] = known->a[j][0];
+        if (!tc_cert_agrees(M->nc, cert, L)) {
+            rc = 0;
+            *certified = 1;
+        }
+    }
+
+    /* a certified loading is taken as it is. It is checked against the
+     * trace of wCVM first and only against wCVM itself if that fails. */
+    if (rc && cert && (cert->nr == M->nc) && (cert->nc == 1)) {
+        for(uint32_t j=0; j < M->nc; j++)
+            L[j] = cert->a[j][0];
+        TC_VOTE_STAGE(TC_VOTE_STAGE_COVARIANCE);
+        rc = tc_power_cert(M->nc, tc_wgt_cov_mult, &cov, trace, NULL, L);
+        if (rc) {
+            wCVM = tc_wgt_cov_form(&cov);
+            TC_VOTE_STAGE(TC_VOTE_STAGE_COVARIANCE);
+            rc = tc_power_cert(M->nc, tc_wgt_cov_mult, &cov, trace, wCVM, L);
         }
+        TC_VOTE_STAGE(TC_VOTE_STAGE_SVD);
+        if (!rc)
+            *certified = 1;
+        /* otherwise it is still a good place to start */
+        else if (!warm)
+            warm = cert;
+    }
+
+    /* with a warm start, power iteration on wCVM without forming it.
+     * Started near another eigenvector it can stop there, so what it
+     * finds is put to the same check as a loading cert. */
+    if (rc && warm && (warm->nr == M->nc) && (warm->nc == 1)) {
+        for(uint32_t j=0; j < M->nc; j++)
+            L[j] = warm->a[j][0];
+        TC_VOTE_STAGE(TC_VOTE_STAGE_COVARIANCE);
+        rc = tc_power_iter(M->nc, tc_wgt_cov_mult, &cov, L, niter);
+        if (!rc && tc_power_cert(M->nc, tc_wgt_cov_mult, &cov, trace, NULL, L)) {
+            if (!wCVM)
+                wCVM = tc_wgt_cov_form(&cov);
+            TC_VOTE_STAGE(TC_VOTE_STAGE_COVARIANCE);
+            rc = tc_power_cert(M->nc, tc_wgt_cov_mult, &cov, trace, wCVM, L);
+        }
+        TC_VOTE_STAGE(TC_VOTE_STAGE_SVD);
+    }
+
+    if (rc) {
+        /* wCMV = weighted covariance matrix of M */
+        if (!wCVM)
+            wCVM = tc_wgt_cov_form(&cov);
+        TC_VOTE_STAGE(TC_VOTE_STAGE_COVARIANCE);
+
+        /* SVD of wCVM */
+        struct tc_mat *U = tc_mat_ctr(0, 0);
+        struct tc_mat *D = tc_mat_ctr(0, 0);
+        struct tc_mat *V = tc_mat_ctr(0, 0);
+        rc = tc_mat_svd_by(svd, wCVM, U, D, V);
+        TC_VOTE_STAGE(TC_VOTE_STAGE_SVD);
+        if (!rc)
+            for(uint32_t j=0; j < M->nc; j++)
+                L[j] = U->a[j][0];
+        tc_mat_dtr(U);
+        tc_mat_dtr(D);
+        tc_mat_dtr(V);
     }
-    /* SVD of wCVM */
-    struct tc_mat *U = tc_mat_ctr(0, 0);
-    struct tc_mat *D = tc_mat_ctr(0, 0);
-    struct tc_mat *V = tc_mat_ctr(0, 0);
-    rc = tc_mat_svd(wCVM, U, D, V);
+
+    /* a loading which failed the check is still taken if it agrees with
+     * the one worked out, so that the outputs follow from it alone */
+    if (!rc && !*certified && cert && (cert->nr == M->nc) && (cert->nc == 1)
+        && !tc_cert_agrees(M->nc, cert, L))
+        *certified = 1;
+
     if (!rc) {
         tc_mat_resize(loadings, M->nc, 1);
-        for(uint32_t i=0; i < M->nc; i++)
-            loadings->a[i][0] = U->a[i][0];
+        for(uint32_t j=0; j < M->nc; j++)
+            loadings->a[j][0] = L[j];
         tc_mat_mult(scores, x_mat, loadings);
     }
 
+    free(L);
     tc_mat_dtr(wCVM);
-    tc_mat_dtr(U);
-    tc_mat_dtr(D);
-    tc_mat_dtr(V);
     tc_mat_dtr(x_mat);
     return rc;
 }
 
+int
+tc_wgt_prin_comp(
+    const struct tc_mat *wgt /* Reputation Vector */,
+    const struct tc_mat *M /* Vote Matrix*/,
+    struct tc_mat *loadings,
+    struct tc_mat *scores)
+{
+    uint32_t niter;
+    int certified;
+    return tc_wgt_prin_comp_svd(wgt, M, TC_SVD_GOLUB_KAHAN, NULL, NULL, NULL,
+        &niter, &certified, loadings, scores);
+}
+
+/* tc_spwgt_cov_mult
+ * out = wCVM v for the weighted covariance matrix of tc_spwgt_prin_comp.
+ * With x = y + c as below and s_k = w_k x_k^T v,
+ *    wCVM v = factor * (Sum_k s_k y_k + c Sum_k s_k)
+ * which only takes a pass over the votes.
+ */
+struct tc_spwgt_cov {
+    const struct tc_mat *wgt;
+    const struct tc_spmat *S;
+    const double *fill;
+    const double *c;
+    const double *sy;
+    double W;
+    double factor;
+};
+
+static void
+tc_spwgt_cov_mult(const void *ctx, const double *v, double *out)
+{
+    const struct tc_spwgt_cov *cov = (const struct tc_spwgt_cov *) ctx;
+    const struct tc_spmat *S = cov->S;
+    double cv = 0.0;
+    for(uint32_t j=0; j < S->nc; j++) {
+        cv += cov->c[j] * v[j];
+        out[j] = 0.0;
+    }
+    double sum_s = 0.0;
+    for(uint32_t i=0; i < S->nr; i++) {
+        double s = cv;
+        for(uint32_t k=S->rowp[i]; k < S->rowp[i+1]; k++) {
+            uint32_t j = S->colidx[k];
+            s += (S->val[k] - cov->fill[j]) * v[j];
+        }
+        s *= cov->wgt->a[i][0];
+        sum_s += s;
+        for(uint32_t k=S->rowp[i]; k < S->rowp[i+1]; k++) {
+            uint32_t j = S->colidx[k];
+            out[j] += s * (S->val[k] - cov->fill[j]);
+        }
+    }
+    for(uint32_t j=0; j < S->nc; j++)
+        out[j] = cov->factor * (out[j] + cov->c[j] * sum_s);
+}
+
+/* tc_spwgt_cov_form
+ * wCVM itself, see tc_spwgt_prin_comp
+ */
+static struct tc_mat *
+tc_spwgt_cov_form(const struct tc_spwgt_cov *cov)
+{
+    const struct tc_spmat *S = cov->S;
+    const double *fill = cov->fill;
+    const double *c = cov->c;
+    const double *sy = cov->sy;
+    const uint32_t nc = S->nc;
+    struct tc_mat *wCVM = tc_mat_ctr(nc, nc);
+    for(uint32_t a=0; a < nc; a++)
+        for(uint32_t b=0; b <= a; b++)
+            wCVM->a[a][b] = 0.0;
+    for(uint32_t i=0; i < S->nr; i++) {
+        double w = cov->wgt->a[i][0];
+        for(uint32_t p=S->rowp[i]; p < S->rowp[i+1]; p++) {
+            uint32_t a = S->colidx[p];
+            double ya = w * (S->val[p] - fill[a]);
+            for(uint32_t q=S->rowp[i]; q <= p; q++) {
+                uint32_t b = S->colidx[q];
+                double yb = S->val[q] - fill[b];
+                if (a >= b)
+                    wCVM->a[a][b] += ya * yb;
+                else
+                    wCVM->a[b][a] += ya * yb;
+            }
+        }
+    }
+    for(uint32_t a=0; a < nc; a++) {
+        for(uint32_t b=0; b <= a; b++) {
+            double sum = wCVM->a[a][b] + c[b] * sy[a] + c[a] * sy[b]
+                + c[a] * c[b] * cov->W;
+            wCVM->a[a][b] =
+            wCVM->a[b][a] = cov->factor * sum;
+        }
+    }
+    return wCVM;
+}
+
+/* tc_spwgt_prin_comp
+ * tc_wgt_prin_comp on fM, the sparse vote matrix S with its NA entries
+ * in column j replaced by fill[j]. T is S^T.
+ * Output: loadings M x 1, scores N x 1 and avg, the M weighted column
+ *         sums wgt^T fM.
+ *
+ * Let x = fM - colavgs(fM). On the NA entries of column j x is the
+ * constant c_j = fill_j - avg_j, so x = y + c where y is zero except
+ * on the votes. Then with s_a = Sum_k w_k y_ka and W = Sum_k w_k,
+ *    Sum_k w_k x_ka x_kb = Sum_k w_k y_ka y_kb + c_b s_a + c_a s_b + c_a c_b W
+ * and the first term only gets contributions from pairs of votes by the
+ * same voter, so nothing of size N x M is ever formed. With a warm
+ * start even wCVM is skipped, see tc_spwgt_cov_mult. Its trace, which
+ * a certified loading is checked against, is
+ *    factor * Sum_a (Sum_k w_k y_ka^2 + 2 c_a s_a + c_a^2 W).
+ */
+static int
+tc_spwgt_prin_comp(
+    const struct tc_mat *wgt /* Reputation Vector */,
+    const struct tc_spmat *S /* Vote Matrix */,
+    const struct tc_spmat *T /* its transpose */,
+    const double *fill,
+    int svd,
+    const struct tc_mat *cert,
+    const struct tc_mat *warm,
+    const struct tc_mat *known,
+    uint32_t *niter,
+    int *certified,
+    struct tc_mat *loadings,
+    struct tc_mat *scores,
+    double *avg)
+{
+    if ((S->nr <= 1) || (wgt->nr != S->nr))
+        return -1;
+
+    const uint32_t nr = S->nr;
+    const uint32_t nc = S->nc;
+    double W = 0.0;
+    double wgts2 = 0.0;
+    for(uint32_t i=0; i < nr; i++) {
+        W += wgt->a[i][0];
+        wgts2 += wgt->a[i][0] * wgt->a[i][0];
+    }
+    double factor = 1.0/(1.0 - wgts2);
+
+    /* avg, c, s and the trace of wCVM */
+    double *c = (double *) malloc(sizeof(double) * (nc + 1));
+    double *sy = (double *) malloc(sizeof(double) * (nc + 1));
+    double trace = 0.0;
+    for(uint32_t j=0; j < nc; j++) {
+        double sum = 0.0;
+        double sum_wgts = 0.0;
+        double sum_y = 0.0;
+        double sum_y2 = 0.0;
+        for(uint32_t k=T->rowp[j]; k < T->rowp[j+1]; k++) {
+            double w = wgt->a[T->colidx[k]][0];
+            double y = T->val[k] - fill[j];
+            sum += w * T->val[k];
+            sum_wgts += w;
+            sum_y += w * y;
+            sum_y2 += w * y * y;
+        }
+        if (T->rowp[j+1] - T->rowp[j] < nr)
+            sum += (W - sum_wgts) * fill[j];
+        avg[j] = sum;
+        c[j] = fill[j] - sum;
+        sy[j] = sum_y;
+        trace += sum_y2 + 2.0 * c[j] * sum_y + c[j] * c[j] * W;
+    }
+    trace *= factor;
+
+    int rc = -1;
+    *niter = 0;
+    *certified = 0;
+    struct tc_spwgt_cov cov = { wgt, S, fill, c, sy, W, factor };
+    struct tc_mat *wCVM = NULL;
+    double *L = (double *) malloc(sizeof(double) * (nc + 1));
+
+    /* a loading already worked out is not worked out again; the cert
+     * is taken if it agrees with it */
+    if (cert && known && (cert->nr == nc) && (cert->nc == 1)
+        && (known->nr == nc) && (known->nc == 1)) {
+        for(uint32_t j=0; j < nc; j++)
+            L[j] = known->a[j][0];
+        if (!tc_cert_agrees(nc, cert, L)) {
+            rc = 0;
+            *certified = 1;
+        }
+    }
+
+    /* a certified loading is taken as it is. It is checked against the
+     * trace of wCVM first and only against wCVM itself if that fails. */
+    if (rc && cert && (cert->nr == nc) && (cert->nc == 1)) {
+        for(uint32_t j=0; j < nc; j++)
+            L[j] = cert->a[j][0];
+        TC_VOTE_STAGE(TC_VOTE_STAGE_COVARIANCE);
+        rc = tc_power_cert(nc, tc_spwgt_cov_mult, &cov, trace, NULL, L);
+        if (rc) {
+            wCVM = tc_spwgt_cov_form(&cov);
+            TC_VOTE_STAGE(TC_VOTE_STAGE_COVARIANCE);
+            rc = tc_power_cert(nc, tc_spwgt_cov_mult, &cov, trace, wCVM, L);
+        }
+        TC_VOTE_STAGE(TC_VOTE_STAGE_SVD);
+        if (!rc)
+            *certified = 1;
+        /* otherwise it is still a good place to start */
+        else if (!warm)
+            warm = cert;
+    }
+
+    /* with a warm start, power iteration on wCVM without forming it.
+     * Started near another eigenvector it can stop there, so what it
+     * finds is put to the same check as a loading cert. */
+    if (rc && warm && (warm->nr == nc) && (warm->nc == 1)) {
+        for(uint32_t j=0; j < nc; j++)
+            L[j] = warm->a[j][0];
+        TC_VOTE_STAGE(TC_VOTE_STAGE_COVARIANCE);
+        rc = tc_power_iter(nc, tc_spwgt_cov_mult, &cov, L, niter);
+        if (!rc && tc_power_cert(nc, tc_spwgt_cov_mult, &cov, trace, NULL, L)) {
+            if (!wCVM)
+                wCVM = tc_spwgt_cov_form(&cov);
+            TC_VOTE_STAGE(TC_VOTE_STAGE_COVARIANCE);
+            rc = tc_power_cert(nc, tc_spwgt_cov_mult, &cov, trace, wCVM, L);
+        }
+        TC_VOTE_STAGE(TC_VOTE_STAGE_SVD);
+    }
+
+    if (rc) {
+        /* wCVM = weighted covariance matrix of fM */
+        if (!wCVM)
+            wCVM = tc_spwgt_cov_form(&cov);
+        TC_VOTE_STAGE(TC_VOTE_STAGE_COVARIANCE);
+
+        /* SVD of wCVM */
+        struct tc_mat *U = tc_mat_ctr(0, 0);
+        struct tc_mat *D = tc_mat_ctr(0, 0);
+        struct tc_mat *V = tc_mat_ctr(0, 0);
+        rc = tc_mat_svd_by(svd, wCVM, U, D, V);
+        TC_VOTE_STAGE(TC_VOTE_STAGE_SVD);
+        if (!rc)
+            for(uint32_t j=0; j < nc; j++)
+                L[j] = U->a[j][0];
+        tc_mat_dtr(U);
+        tc_mat_dtr(D);
+        tc_mat_dtr(V);
+    }
+    tc_mat_dtr(wCVM);
+
+    /* a loading which failed the check is still taken if it agrees with
+     * the one worked out, so that the outputs follow from it alone */
+    if (!rc && !*certified && cert && (cert->nr == nc) && (cert->nc == 1)
+        && !tc_cert_agrees(nc, cert, L))
+        *certified = 1;
+
+    if (!rc) {
+        tc_mat_resize(loadings, nc, 1);
+        double cL = 0.0;
+        for(uint32_t j=0; j < nc; j++) {
+            loadings->a[j][0] = L[j];
+            cL += c[j] * L[j];
+        }
+        /* scores = x * loadings */
+        tc_mat_resize(scores, nr, 1);
+        for(uint32_t i=0; i < nr; i++) {
+            double sum = cL;
+            for(uint32_t k=S->rowp[i]; k < S->rowp[i+1]; k++) {
+                uint32_t j = S->colidx[k];
+                sum += (S->val[k] - fill[j]) * L[j];
+            }
+            scores->a[i][0] = sum;
+        }
+    }
+
+    free(L);
+    free(sy);
+    free(c);
+    return rc;
+}
+
+/* tc_spwgt_mult_fill
+ * Output: out 1 x M matrix, s^T fM where fM is the sparse vote matrix S
+ *         with its NA entries replaced by fill
+ */
+static void
+tc_spwgt_mult_fill(struct tc_mat *out, const struct tc_mat *s,
+    const struct tc_spmat *T, const double *fill)
+{
+    double stot = 0.0;
+    for(uint32_t i=0; i < s->nr; i++)
+        stot += s->a[i][0];
+    tc_mat_resize(out, 1, T->nr);
+    for(uint32_t j=0; j < T->nr; j++) {
+        double sum = 0.0;
+        double sum_s = 0.0;
+        for(uint32_t k=T->rowp[j]; k < T->rowp[j+1]; k++) {
+            sum += s->a[T->colidx[k]][0] * T->val[k];
+            sum_s += s->a[T->colidx[k]][0];
+        }
+        if (T->rowp[j+1] - T->rowp[j] < T->nc)
+            sum += (stot - sum_s) * fill[j];
+        out->a[0][j] = sum;
+    }
+}
+
 /****************************************************************************
  * tc_vote                                                                  *
  ****************************************************************************/
@@ -895,6 +1908,13 @@ tc_vote_ctr(uint32_t nr, uint32_t nc)
     ptr->nr = nr;
     ptr->nc = nc;
 	ptr->M = tc_mat_ctr(nr, nc);
+    ptr->S = NULL;
+    ptr->svd = TC_SVD_GOLUB_KAHAN;
+    ptr->cert = NULL;
+    ptr->warm = NULL;
+    ptr->known = NULL;
+    ptr->niter = 0;
+    ptr->certified = 0;
     for(uint32_t i=0; i < TC_VOTE_NCOLS; i++)
         ptr->cvecs[i] = tc_mat_ctr(1, nc);
     for(uint32_t i=0; i < TC_VOTE_NROWS; i++)
@@ -902,12 +1922,32 @@ tc_vote_ctr(uint32_t nr, uint32_t nc)
 	return ptr;
 }
 
+/* tc_vote_sparse_ctr
+ * The vote takes ownership of S, and M is left empty.
+ */
+struct tc_vote *
+tc_vote_sparse_ctr(struct tc_spmat *S)
+{
+    if (!S)
+        return NULL;
+    struct tc_vote *ptr = tc_vote_ctr(0, S->nc);
+    ptr->nr = S->nr;
+    ptr->S = S;
+    for(uint32_t i=0; i < TC_VOTE_NROWS; i++)
+        tc_mat_resize(ptr->rvecs[i], S->nr, 1);
+    return ptr;
+}
+
 void
 tc_vote_dtr(struct tc_vote *ptr)
 {
     if (!ptr)
         return;
     tc_mat_dtr(ptr->M);
+    tc_spmat_dtr(ptr->S);
+    tc_mat_dtr(ptr->cert);
+    tc_mat_dtr(ptr->warm);
+    tc_mat_dtr(ptr->known);
     for(uint32_t i=0; i < TC_VOTE_NCOLS; i++)
         tc_mat_dtr(ptr->cvecs[i]);
     for(uint32_t i=0; i < TC_VOTE_NROWS; i++)
@@ -922,14 +1962,16 @@ tc_vote_notvalid(const struct tc_vote *ptr)
         return -1;
     if (!ptr->M)
         return -1;
+    uint32_t nr = (ptr->S)? ptr->S->nr: ptr->M->nr;
+    uint32_t nc = (ptr->S)? ptr->S->nc: ptr->M->nc;
     for(uint32_t i=0; i < TC_VOTE_NCOLS; i++)
         if ((!ptr->cvecs[i])
             || (ptr->cvecs[i]->nr != 1)
-            || (ptr->cvecs[i]->nc != ptr->M->nc))
+            || (ptr->cvecs[i]->nc != nc))
                 return -1;
     for(uint32_t i=0; i < TC_VOTE_NROWS; i++)
         if ((!ptr->rvecs[i])
-            || (ptr->rvecs[i]->nr != ptr->M->nr)
+            || (ptr->rvecs[i]->nr != nr)
             || (ptr->rvecs[i]->nc != 1))
                 return -1;
     return 0;
@@ -938,6 +1980,20 @@ tc_vote_notvalid(const struct tc_vote *ptr)
 static int
 tc_vote_print_M(const struct tc_vote *ptr)
 {
+    if (ptr->S) {
+        const struct tc_spmat *S = ptr->S;
+        for(uint32_t i=0; i < S->nr; i++) {
+            uint32_t k = S->rowp[i];
+            for(uint32_t j=0; j < S->nc; j++)
+                if ((k < S->rowp[i+1]) && (S->colidx[k] == j))
+                    printf(" %12.8f", S->val[k++]);
+                else
+                    printf(" %12s", "NA");
+            printf("\n");
+        }
+        return 0;
+    }
+
     const double **M = (const double **) ptr->M->a;
     for(uint32_t i=0; i < ptr->nr; i++) {
         for(uint32_t j=0; j < ptr->nc; j++)
@@ -1007,11 +2063,199 @@ tc_vote_print(const struct tc_vote *ptr)
     return 0;
 }
 
+/* tc_vote_proc_sparse
+ * tc_vote_proc for a sparse vote matrix. The steps are those of the
+ * dense version, but every pass over fM is rewritten in terms of the
+ * votes cast and the per-column fill value of the NA entries, so the
+ * memory and time scale with the number of votes (apart from the
+ * M x M covariance matrix and its SVD).
+ */
+static int
+tc_vote_proc_sparse(struct tc_vote *vote)
+{
+    const struct tc_spmat *S = vote->S;
+    struct tc_mat *wgt = vote->rvecs[TC_VOTE_OLD_REP];
+    struct tc_mat *twgt = vote->rvecs[TC_VOTE_THIS_REP];
+    struct tc_mat *nwgt = vote->rvecs[TC_VOTE_SMOOTHED_REP];
+    struct tc_mat *isbin = vote->cvecs[TC_VOTE_IS_BINARY];
+    struct tc_mat *firstloading = vote->cvecs[TC_VOTE_FIRST_LOADING];
+
+    double wgtavg = 0.0;
+    for(uint32_t i=0; i < wgt->nr; i++)
+        wgtavg += wgt->a[i][0];
+    wgtavg /= wgt->nr;
+    if (wgtavg == 0.0)
+        return -1;
+
+    /* T: S in compressed column form */
+    struct tc_spmat *T = tc_spmat_transpose(S);
+
+    /* prelim: the preliminary outcomes, which fill in the NAs */
+    double *prelim = (double *) malloc(sizeof(double) * (S->nc + 1));
+    tc_spwgt_outcomes(wgt, T, isbin, NULL, prelim);
+    TC_VOTE_STAGE(TC_VOTE_STAGE_FILL);
+
+    /* loadings, scores and wgtT_fM = wgt^T * fM */
+    struct tc_mat *scores = tc_mat_ctr(0, 0);
+    struct tc_mat *wgtT_fM = tc_mat_ctr(1, S->nc);
+    int rc = tc_spwgt_prin_comp(wgt, S, T, prelim, vote->svd, vote->cert,
+        vote->warm, vote->known, &vote->niter, &vote->certified, firstloading, scores,
+        wgtT_fM->a[0]);
+    if (rc < 0) {
+        tc_mat_dtr(wgtT_fM);
+        tc_mat_dtr(scores);
+        free(prelim);
+        tc_spmat_dtr(T);
+        return rc;
+    }
+    tc_mat_transpose(firstloading, firstloading);
+
+    /* scores1: scores adjusted by adding min{scores} */
+    double min_score = scores->a[0][0];
+    for(uint32_t i=1; i < scores->nr; i++)
+        if (min_score > scores->a[i][0])
+            min_score = scores->a[i][0];
+    if (min_score < 0.0)
+        min_score = -min_score;
+    struct tc_mat *scores1 = tc_mat_ctr(0, 0);
+    tc_mat_copy(scores1, scores);
+    for(uint32_t i=0; i < scores1->nr; i++)
+        scores1->a[i][0] += min_score;
+    struct tc_mat *v1 = tc_mat_ctr(0, 0);
+    tc_spwgt_mult_fill(v1, scores1, T, prelim);
+    tc_wgt_normalize(v1);
+    tc_mat_sub(v1, v1, wgtT_fM);
+
+    /* scores2: scores adjusted by subtracting max{scores} */
+    double max_score = scores->a[0][0];
+    for(uint32_t i=1; i < scores->nr; i++)
+        if (max_score < scores->a[i][0])
+            max_score = scores->a[i][0];
+    struct tc_mat *scores2 = tc_mat_ctr(0, 0);
+    tc_mat_copy(scores2, scores);
+    for(uint32_t i=0; i < scores2->nr; i++)
+        scores2->a[i][0] -= max_score;
+    struct tc_mat *v2 = tc_mat_ctr(0, 0);
+    tc_spwgt_mult_fill(v2, scores2, T, prelim);
+    tc_wgt_normalize(v2);
+    tc_mat_sub(v2, v2, wgtT_fM);
+
+    /* twgt: reputation vector of this round of votes  */
+    if (tc_mat_norm(v1) <= tc_mat_norm(v2))
+        tc_mat_copy(twgt, scores1);
+    else
+        tc_mat_copy(twgt, scores2); 
+    for(uint32_t i=0; i < wgt->nr; i++)
+        twgt->a[i][0] *= wgt->a[i][0] / wgtavg;
+    tc_wgt_normalize(twgt);
+    TC_VOTE_STAGE(TC_VOTE_STAGE_SCORING);
+
+    /* smoothedrep: (1-alpha) oldrep + alpha * smoothedrep */
+    for(uint32_t i=0; i < wgt->nr; i++)
+        nwgt->a[i][0] = (1.0 - vote->alpha) * wgt->a[i][0] 
+                         + vote->alpha * twgt->a[i][0];
+    TC_VOTE_STAGE(TC_VOTE_STAGE_SMOOTHING);
+
+    /* outcome (raw) */
+    struct tc_mat *decraw = vote->cvecs[TC_VOTE_DECISIONS_RAW];
+    if (S->nc)
+        tc_spwgt_outcomes(nwgt, T, isbin, prelim, decraw->a[0]);
+
+    /* outcome (final) */
+    struct tc_mat *decfin = vote->cvecs[TC_VOTE_DECISIONS_FINAL];
+    for(uint32_t j=0; j < S->nc; j++) {
+        if (isbin->a[0][j] > 0.0) {
+            if (decraw->a[0][j] > 0.50 + 0.50*vote->tol)
+                decfin->a[0][j] = 1.0;
+            else
+            if (decraw->a[0][j] < 0.50 - 0.50*vote->tol)
+                decfin->a[0][j] = 0.0;
+            else
+                decfin->a[0][j] = 0.50;
+        }
+        else
+            decfin->a[0][j] = decraw->a[0][j];
+    }
+
+    /* row stats */
+    struct tc_mat *narow = vote->rvecs[TC_VOTE_NA_ROW];
+    struct tc_mat *partrow = vote->rvecs[TC_VOTE_PARTIC_ROW];
+    for(uint32_t i=0; i < S->nr; i++) {
+        narow->a[i][0] = S->nc - (S->rowp[i+1] - S->rowp[i]);
+        partrow->a[i][0] = 1.0 - narow->a[i][0] /  S->nc;
+    }
+
+    /* col stats and certainty */
+    double nwgt_tot = 0.0;
+    for(uint32_t i=0; i < S->nr; i++)
+        nwgt_tot += nwgt->a[i][0];
+    struct tc_mat *nacol = vote->cvecs[TC_VOTE_NA_COL];
+    struct tc_mat *partcol = vote->cvecs[TC_VOTE_PARTIC_COL];
+    struct tc_mat *certainty = vote->cvecs[TC_VOTE_CERTAINTY];
+    for(uint32_t j=0; j < S->nc; j++) {
+        uint32_t nvotes = T->rowp[j+1] - T->rowp[j];
+        double value = 0.0;
+        double sum = 0.0;
+        for(uint32_t k=T->rowp[j]; k < T->rowp[j+1]; k++) {
+            double w = nwgt->a[T->colidx[k]][0];
+            value += w;
+            if (fabs(T->val[k] - decfin->a[0][j]) < 1e-5)
+                sum += w;
+        }
+        value = (nvotes < S->nr)? nwgt_tot - value: 0.0;
+        if ((nvotes < S->nr) && (fabs(prelim[j] - decfin->a[0][j]) < 1e-5))
+            sum += value;
+        nacol->a[0][j] = S->nr - nvotes;
+        partcol->a[0][j] = 1.0 - value;
+        certainty->a[0][j] = sum;
+    }
+
+    /* fracNA */
+    double x = 0.0;
+    for(uint32_t j=0; j < S->nc; j++)
+        x += partcol->a[0][j];
+    double fracNA = 1.0 - x / S->nc;
+
+    /* row bonus */
+    struct tc_mat *partic_rel = vote->rvecs[TC_VOTE_PARTIC_REL];
+    tc_mat_copy(partic_rel, partrow);
+    tc_wgt_normalize(partic_rel);
+    struct tc_mat *rowbonus = vote->rvecs[TC_VOTE_ROW_BONUS];
+    for(uint32_t i=0; i < S->nr; i++)
+        rowbonus->a[i][0] = fracNA * partic_rel->a[i][0] + (1.0 - fracNA) * nwgt->a[i][0];
+
+    /* col bonus */
+    struct tc_mat *conreward = vote->cvecs[TC_VOTE_CONSENSUS_REW];
+    struct tc_mat *partic_rel_col = tc_mat_ctr(0, 0);
+    tc_mat_copy(partic_rel_col, partcol);
+    tc_wgt_normalize(partic_rel_col);
+    tc_mat_copy(conreward, certainty);
+    tc_wgt_normalize(conreward);
+    struct tc_mat *colbonus = vote->cvecs[TC_VOTE_AUTHOR_BONUS];
+    for(uint32_t j=0; j < S->nc; j++)
+        colbonus->a[0][j] = fracNA * partic_rel_col->a[0][j] + (1.0 - fracNA) * conreward->a[0][j];
+    tc_mat_dtr(partic_rel_col);
+
+    tc_mat_dtr(v2);
+    tc_mat_dtr(scores2);
+    tc_mat_dtr(v1);
+    tc_mat_dtr(scores1);
+    tc_mat_dtr(wgtT_fM);
+    tc_mat_dtr(scores);
+    free(prelim);
+    tc_spmat_dtr(T);
+    TC_VOTE_STAGE(TC_VOTE_STAGE_OUTCOMES);
+
+    return rc;
+}
+
 int
 tc_vote_proc(struct tc_vote *vote)
 {
     if (!vote || tc_vote_notvalid(vote))
         return -1;
+    if (vote->S)
+        return tc_vote_proc_sparse(vote);
 
     struct tc_mat *M = vote->M;
     struct tc_mat *wgt = vote->rvecs[TC_VOTE_OLD_REP];
@@ -1030,20 +2274,21 @@ tc_vote_proc(struct tc_vote *vote)
     /* fM: M with NAs filled in with the preliminary outcomes */
     struct tc_mat *fM = tc_mat_ctr(M->nr, M->nc);
     tc_mat_copy(fM, M);
-    for(uint32_t j=0; j < M->nc; j++) {
-        double prelim_outcome = (isbin->a[0][j] > 0.0)?
-            tc_wgt_mean(wgt, M, j, vote->NA):
-            tc_wgt_median(wgt, M, j, vote->NA);
-        for(uint32_t i=0; i < M->nr; i++)
+    double *prelim = (double *) malloc(sizeof(double) * (M->nc + 1));
+    tc_wgt_outcomes(wgt, M, isbin, vote->NA, prelim);
+    for(uint32_t i=0; i < M->nr; i++)
+        for(uint32_t j=0; j < M->nc; j++)
             if (fM->a[i][j] == vote->NA)
-                fM->a[i][j] = prelim_outcome;
-    }
+                fM->a[i][j] = prelim[j];
+    free(prelim);
+    TC_VOTE_STAGE(TC_VOTE_STAGE_FILL);
 
     /* loadings: 
      * scores: 
      */
     struct tc_mat *scores = tc_mat_ctr(0, 0);
-    int rc = tc_wgt_prin_comp(wgt, fM, firstloading, scores);
+    int rc = tc_wgt_prin_comp_svd(wgt, fM, vote->svd, vote->cert,
+        vote->warm, vote->known, &vote->niter, &vote->certified, firstloading, scores);
     if (rc < 0) {
         tc_mat_dtr(scores);
         tc_mat_dtr(fM);
@@ -1103,20 +2348,19 @@ tc_vote_proc(struct tc_vote *vote)
     for(uint32_t i=0; i < wgt->nr; i++)
         twgt->a[i][0] *= wgt->a[i][0] / wgtavg;
     tc_wgt_normalize(twgt);
+    TC_VOTE_STAGE(TC_VOTE_STAGE_SCORING);
 
     /* smoothedrep: smoothed with previous oldrep   */
     /* smoothedrep: (1-alpha) oldrep + alpha * smoothedrep */
     for(uint32_t i=0; i < wgt->nr; i++)
         nwgt->a[i][0] = (1.0 - vote->alpha) * wgt->a[i][0] 
                          + vote->alpha * twgt->a[i][0];
+    TC_VOTE_STAGE(TC_VOTE_STAGE_SMOOTHING);
 
     /* outcome (raw) */
     struct tc_mat *decraw = vote->cvecs[TC_VOTE_DECISIONS_RAW];
-    for(uint32_t j=0; j < fM->nc; j++) {
-        decraw->a[0][j] = (isbin->a[0][j] > 0.0)?
-            tc_wgt_mean(nwgt, fM, j, vote->NA):
-            tc_wgt_median(nwgt, fM, j, vote->NA);
-    }
+    if (fM->nc)
+        tc_wgt_outcomes(nwgt, fM, isbin, vote->NA, decraw->a[0]);
 
     /* outcome (final) */
     struct tc_mat *decfin = vote->cvecs[TC_VOTE_DECISIONS_FINAL];
@@ -1205,6 +2449,7 @@ tc_vote_proc(struct tc_vote *vote)
     tc_mat_dtr(wgtT);
     tc_mat_dtr(scores);
     tc_mat_dtr(fM);
+    TC_VOTE_STAGE(TC_VOTE_STAGE_OUTCOMES);
 
     return rc;
 }
@@ -28,8 +28,51 @@ int tc_mat_mult(struct tc_mat *, const struct tc_mat *A, const struct tc_mat *B)
 int tc_mat_mult_scalar(struct tc_mat *, double a, const struct tc_mat *B);
 int tc_mat_bidiag_decomp(const struct tc_mat *A, struct tc_mat *U, struct tc_mat *B, struct tc_mat *V);
 int tc_mat_svd(const struct tc_mat *A, struct tc_mat *U, struct tc_mat *D, struct tc_mat *V);
+int tc_mat_svd_jacobi(const struct tc_mat *A, struct tc_mat *U, struct tc_mat *D, struct tc_mat *V);
+
+#define TC_SVD_GOLUB_KAHAN      0 /* tc_mat_svd */
+#define TC_SVD_JACOBI           1 /* tc_mat_svd_jacobi */
+
+#define TC_SVD_JACOBI_MAX_SWEEPS 60
+
+/* With a warm start the first loading is refined by power iteration on
+ * the covariance matrix, falling back to the SVD if that does not
+ * converge. The vote owns warm and frees it in tc_vote_dtr.
+ */
+#define TC_POWER_MAX_ITER       1000
+#define TC_POWER_TOL            1e-12
+
+/* A first loading given as cert (say, the one published with an outcome)
+ * is used without the SVD if it checks out as the leading eigenvector of
+ * the covariance matrix, see tc_power_cert. The tolerance allows for the
+ * loading having been rounded to 1e-8. If the check fails, cert is used
+ * as a warm start, and is still taken if the loading worked out agrees
+ * with it to within the tolerance, so that the outputs depend on cert
+ * alone either way. A cert which agrees with the known loading, worked
+ * out by the caller before, is taken without any of this. The vote owns
+ * cert and known and frees them in tc_vote_dtr.
+ */
+#define TC_CERT_TOL             4e-8
+
+/* Sparse matrix in compressed row form. Entries which are not stored
+ * are NA, so only the votes actually cast take up memory. The row i
+ * entries are colidx[rowp[i]..rowp[i+1]) and val[rowp[i]..rowp[i+1]).
+ * The transpose is the same matrix in compressed column form.
+ */
+struct tc_spmat {
+    uint32_t *rowp;
+    uint32_t *colidx;
+    double *val;
+    uint32_t nr, nc, nnz;
+};
+struct tc_spmat *tc_spmat_ctr(uint32_t nr_, uint32_t nc_, uint32_t nnz_);
+void tc_spmat_dtr(struct tc_spmat *);
+struct tc_spmat *tc_spmat_from_mat(const struct tc_mat *A, double NA);
+struct tc_spmat *tc_spmat_transpose(const struct tc_spmat *);
 
 void tc_wgt_normalize(struct tc_mat *wgt);
+int tc_wgt_col_medians(const struct tc_mat *wgt, const struct tc_mat *A,
+    double NA, struct tc_mat *medians);
 int tc_wgt_prin_comp(const struct tc_mat *wgt, const struct tc_mat *M,
     struct tc_mat *loadings, struct tc_mat *scores);
 
@@ -56,14 +99,22 @@ int tc_wgt_prin_comp(const struct tc_mat *wgt, const struct tc_mat *M,
 
 struct tc_vote {
     struct tc_mat *M; /* Vote Matrix */
+    struct tc_spmat *S; /* Sparse Vote Matrix (used in place of M if set) */
     struct tc_mat *cvecs[TC_VOTE_NCOLS]; /* column (Decision) vectors */
     struct tc_mat *rvecs[TC_VOTE_NROWS]; /* row (Voter) vectors */
     double NA;
     double alpha;
     double tol;
+    int svd; /* TC_SVD_GOLUB_KAHAN (default) or TC_SVD_JACOBI */
+    struct tc_mat *cert; /* M x 1 claimed first loading, or NULL */
+    struct tc_mat *warm; /* M x 1 estimate of the first loading, or NULL */
+    struct tc_mat *known; /* M x 1 first loading worked out before, or NULL */
+    uint32_t niter; /* power iterations used to refine warm (output) */
+    int certified; /* 1 if cert was taken as the first loading (output) */
     uint32_t nr, nc;
 };
 struct tc_vote *tc_vote_ctr(uint32_t nr, uint32_t nc);
+struct tc_vote *tc_vote_sparse_ctr(struct tc_spmat *S);
 void tc_vote_dtr(struct tc_vote *);
 int tc_vote_notvalid(const struct tc_vote *);
 int tc_vote_print(const struct tc_vote *);
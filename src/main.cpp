@@ -10,13 +10,16 @@
 #include "addrman.h"
 #include "alert.h"
 #include "base58.h"
+#include "blockfilemap.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
+#include "coinsprefetch.h"
 #include "init.h"
 #include "merkleblock.h"
 #include "net.h"
 #include "pow.h"
+#include "script/standard.h"
 #include "txdb.h"
 #include "txmempool.h"
 #include "ui_interface.h"
@@ -49,12 +52,13 @@ int64_t nTimeBestReceived = 0;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+int nPrefetchThreads = 0;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = false;
 bool fMarketIndex = true;
 bool fIsBareMultisigStd = true;
-unsigned int nCoinCacheSize = 5000;
+size_t nCoinCacheUsage = 5000 * 300;
 
 // fill obj->nHeight if recorded
 // TODO: logic needs to be better.
@@ -484,7 +488,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
                 // We consider the chain that this peer is on invalid.
                 return;
             }
-            if (pindex->nStatus & BLOCK_HAVE_DATA) {
+            if (pindex->nStatus & (BLOCK_HAVE_DATA | BLOCK_IN_SNAPSHOT)) {
                 if (pindex->nChainTx)
                     state->pindexLastCommonBlock = pindex;
             } else if (mapBlocksInFlight.count(pindex->GetBlockHash()) == 0) {
@@ -563,6 +567,7 @@ CCoinsViewCache *pcoinsTip = NULL;
 CBlockTreeDB *pblocktree = NULL;
 CMarketTreeDB *pmarkettree = NULL;
 CCoinsViewDB *pcoinsdbview = NULL;
+CCoinsViewFlusher *pcoinsflusher = NULL;
 
 
 //////////////////////////////////////////////////////////////////////////////
@@ -990,6 +995,20 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     }
     }
 
+    // Reject market objects already in the pool or in the market index
+    {
+    std::vector<std::pair<uint256, char> > vMarketObjIds;
+    GetMarketObjIds(tx, vMarketObjIds);
+    for (unsigned int i = 0; i < vMarketObjIds.size(); i++)
+    {
+        const uint256& objid = vMarketObjIds[i].first;
+        if (pool.existsMarketObj(objid) ||
+            (fMarketIndex && pmarkettree && pmarkettree->IsMarketObjDuplicate(vMarketObjIds[i].second, objid, hash)))
+            return state.Invalid(error("AcceptToMemoryPool : market object %s already exists", objid.ToString()),
+                                 REJECT_DUPLICATE, "market-duplicate");
+    }
+    }
+
     {
         CCoinsView dummy;
         CCoinsViewCache view(&dummy);
@@ -1124,6 +1143,34 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     return true;
 }
 
+static CBlockFileMap blockfilemap;
+
+/**
+ * Find the block stored at pos in the mapping of its file, by the size
+ * written ahead of it. Returns false if the file cannot be mapped, in which
+ * case it is to be read through OpenBlockFile instead.
+ */
+static bool GetMappedBlock(const CDiskBlockPos &pos, boost::shared_ptr<const CMappedFile> &mapped, const char *&pbegin, const char *&pend)
+{
+    if (pos.IsNull() || pos.nPos < 4)
+        return false;
+    mapped = blockfilemap.Get(pos.nFile, pos.nPos);
+    if (!mapped)
+        return false;
+    unsigned int nSize;
+    CSpanReader(mapped->begin() + pos.nPos - 4, mapped->begin() + pos.nPos, SER_DISK, CLIENT_VERSION) >> nSize;
+    if (nSize > MAX_BLOCK_SIZE)
+        return false;
+    if (pos.nPos + nSize > mapped->size()) {
+        mapped = blockfilemap.Get(pos.nFile, pos.nPos + nSize);
+        if (!mapped)
+            return false;
+    }
+    pbegin = mapped->begin() + pos.nPos;
+    pend = pbegin + nSize;
+    return true;
+}
+
 /** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock, bool fAllowSlow)
 {
@@ -1140,16 +1187,29 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock
         if (fTxIndex) {
             CDiskTxPos postx;
             if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                if (file.IsNull())
-                    return error("%s: OpenBlockFile failed", __func__);
                 CBlockHeader header;
-                try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
-                } catch (const std::exception& e) {
-                    return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+                boost::shared_ptr<const CMappedFile> mapped;
+                const char *pbegin, *pend;
+                if (GetMappedBlock(postx, mapped, pbegin, pend)) {
+                    try {
+                        CSpanReader spanin(pbegin, pend, SER_DISK, CLIENT_VERSION);
+                        spanin >> header;
+                        spanin.ignore(postx.nTxOffset);
+                        spanin >> txOut;
+                    } catch (const std::exception& e) {
+                        return error("%s : Deserialize error - %s", __func__, e.what());
+                    }
+                } else {
+                    CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+                    if (file.IsNull())
+                        return error("%s: OpenBlockFile failed", __func__);
+                    try {
+                        file >> header;
+                        fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+                        file >> txOut;
+                    } catch (const std::exception& e) {
+                        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+                    }
                 }
                 hashBlock = header.GetHash();
                 if (txOut.GetHash() != hash)
@@ -1222,17 +1282,30 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk : OpenBlockFile failed");
+    // Read block from the mapping of its file, if there is one
+    boost::shared_ptr<const CMappedFile> mapped;
+    const char *pbegin, *pend;
+    if (GetMappedBlock(pos, mapped, pbegin, pend)) {
+        try {
+            CSpanReader spanin(pbegin, pend, SER_DISK, CLIENT_VERSION);
+            spanin >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s : Deserialize error - %s", __func__, e.what());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockFromDisk : OpenBlockFile failed");
 
-    // Read block
-    try {
-        filein >> block;
-    }
-    catch (const std::exception& e) {
-        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        // Read block
+        try {
+            filein >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
     }
 
     // Check the header
@@ -1448,7 +1521,7 @@ void UpdateCoins(const CTransaction& tx, CValidationState &state, CCoinsViewCach
 
 bool CScriptCheck::operator()() {
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
-    if (!VerifyScript(scriptSig, scriptPubKey, nFlags, CachingSignatureChecker(*ptxTo, nIn, cacheStore), &error)) {
+    if (!VerifyScript(scriptSig, scriptPubKey, nFlags, CachingSignatureChecker(*ptxTo, nIn, cacheStore, precomputed.get()), &error)) {
         return ::error("CScriptCheck() : %s:%d VerifySignature failed: %s", ptxTo->GetHash().ToString(), nIn, ScriptErrorString(error));
     }
     return true;
@@ -1517,13 +1590,18 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
         // before the last block chain checkpoint. This is safe because block merkle hashes are
         // still computed and checked, and any change will be caught at the next checkpoint.
         if (fScriptChecks) {
+            // A single input gains nothing from sharing its serialization
+            boost::shared_ptr<const CPrecomputedSigHash> precomputed;
+            if (tx.vin.size() > 1)
+                precomputed.reset(new CPrecomputedSigHash(tx));
+
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint &prevout = tx.vin[i].prevout;
                 const CCoins* coins = inputs.AccessCoins(prevout.hash);
                 assert(coins);
 
                 // Verify signature
-                CScriptCheck check(*coins, tx, i, flags, cacheStore);
+                CScriptCheck check(*coins, tx, i, flags, cacheStore, precomputed);
                 if (pvChecks) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
@@ -1536,7 +1614,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
                         CScriptCheck check(*coins, tx, i,
-                                flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore);
+                                flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, precomputed);
                         if (check())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
                     }
@@ -1709,8 +1787,10 @@ void static FlushBlockFile(bool fFinalize = false)
 
     FILE *fileOld = OpenBlockFile(posOld);
     if (fileOld) {
-        if (fFinalize)
+        if (fFinalize) {
+            blockfilemap.Forget(nLastBlockFile);
             TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
+        }
         FileCommit(fileOld);
         fclose(fileOld);
     }
@@ -1726,13 +1806,175 @@ void static FlushBlockFile(bool fFinalize = false)
 
 bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128, MAX_SCRIPTCHECK_THREADS);
 
 void ThreadScriptCheck() {
     RenameThread("truthcoin-scriptch");
     scriptcheckqueue.Thread();
 }
 
+static CCoinsPrefetcher coinsprefetcher;
+
+void ThreadCoinsPrefetch() {
+    RenameThread("truthcoin-prefetch");
+    coinsprefetcher.Thread();
+}
+
+/* the market objects in the block, paired with their ids. The caller deletes them. */
+static void GetMarketObjs(const CBlock& block, std::vector<std::pair<uint256, const marketObj *> >& vMarketObj)
+{
+    for (unsigned int i=0; i < block.vtx.size(); i++) {
+        const CTransaction &tx = block.vtx[i];
+        BOOST_FOREACH(const CTxOut& txout, tx.vout) {
+            const CScript& scriptPubKey = txout.scriptPubKey;
+            size_t script_sz = scriptPubKey.size();
+            if ((script_sz < 2) ||
+               (scriptPubKey[script_sz-1] != OP_MARKET))
+                   continue;
+            marketObj *obj = marketObjCtr(scriptPubKey);
+            if (!obj)
+               continue;
+            obj->txid = tx.GetHash();
+            vMarketObj.push_back(std::make_pair(obj->GetHash(), obj));
+        }
+    }
+}
+
+/**
+ * The inputs of the branch's outcome at height as the market index has them,
+ * chosen as in getOutcomeTx: the ballot's decisions, the holders of the
+ * branch's votecoins with their reputation, and the matrix of their votes
+ * sealed and revealed in time.
+ */
+static bool GetOutcomeInputs(const marketBranch& branch, uint32_t height, marketOutcome& inputs)
+{
+    if (!branch.tau || (height % branch.tau != 0))
+        return false;
+
+    inputs.branchid = branch.GetHash();
+    inputs.NA = 2016;
+    inputs.alpha = 0.10;
+    inputs.tol = 0.10;
+
+    inputs.nDecisions = 0;
+    std::vector<marketDecision *> decisions = pmarkettree->GetDecisions(inputs.branchid);
+    for (size_t i=0; i < decisions.size(); i++) {
+        const marketDecision *decision = decisions[i];
+        uint32_t blocknum = decision->eventOverBy + branch.ballotTime + branch.unsealTime;
+        if ((height - branch.tau <= blocknum) && (blocknum < height)) {
+            inputs.nDecisions++;
+            inputs.decisionIDs.push_back(decision->GetHash());
+            inputs.isScaled.push_back(decision->isScaled);
+        }
+        delete decision;
+    }
+
+    std::vector<marketVote *> vVotes = pmarkettree->GetVotes(inputs.branchid, height);
+    std::map<CKeyID, const marketVote *> votes;
+    for (size_t i=0; i < vVotes.size(); i++)
+        if (pmarkettree->IsVoteSealed(branch, *vVotes[i]))
+            votes[vVotes[i]->keyID] = vVotes[i];
+
+    CTransaction tx;
+    uint256 hashBlock;
+    bool fHaveTx = GetTransaction(branch.txid, tx, hashBlock, true);
+    inputs.nVoters = 0;
+    BOOST_FOREACH(const CTxOut& txout, tx.vout) {
+        CTxDestination dest;
+        CKeyID keyID;
+        if (ExtractDestination(txout.scriptPubKey, dest)) {
+            if (const CKeyID *pkeyID = boost::get<CKeyID>(&dest))
+                keyID = *pkeyID;
+            else if (const CScriptID *pscriptID = boost::get<CScriptID>(&dest))
+                keyID = CKeyID(*pscriptID);
+        }
+        inputs.voterIDs.push_back(keyID);
+        inputs.oldRep.push_back(txout.nValue);
+
+        /* the voter's response on each decision, the first if more than one */
+        std::vector<uint64_t> row(inputs.nDecisions, inputs.NA);
+        std::map<CKeyID, const marketVote *>::const_iterator it = votes.find(keyID);
+        if (!keyID.IsNull() && (it != votes.end())
+            && (it->second->decisionIDs.size() == it->second->decisionVotes.size())) {
+            const marketVote *vote = it->second;
+            for (uint32_t j=0; j < inputs.nDecisions; j++)
+                for (size_t k=0; k < vote->decisionIDs.size(); k++)
+                    if (vote->decisionIDs[k] == inputs.decisionIDs[j]) {
+                        if (vote->decisionVotes[k] != vote->NA)
+                            row[j] = vote->decisionVotes[k];
+                        break;
+                    }
+        }
+        inputs.voteMatrix.insert(inputs.voteMatrix.end(), row.begin(), row.end());
+        inputs.nVoters++;
+    }
+
+    for (size_t i=0; i < vVotes.size(); i++)
+        delete vVotes[i];
+    return fHaveTx;
+}
+
+bool CheckOutcomeInputs(const marketOutcome& outcome, uint32_t nHeight)
+{
+    if (!pmarkettree)
+        return false;
+    marketBranch *branch = pmarkettree->GetBranch(outcome.branchid);
+    if (!branch)
+        return false;
+    marketOutcome inputs;
+    bool fOk = GetOutcomeInputs(*branch, nHeight, inputs);
+    delete branch;
+    return fOk
+        && (outcome.nDecisions == inputs.nDecisions)
+        && (outcome.decisionIDs == inputs.decisionIDs)
+        && (outcome.isScaled == inputs.isScaled)
+        && (outcome.nVoters == inputs.nVoters)
+        && (outcome.voterIDs == inputs.voterIDs)
+        && (outcome.oldRep == inputs.oldRep)
+        && (outcome.voteMatrix == inputs.voteMatrix)
+        && (outcome.NA == inputs.NA)
+        && (outcome.alpha == inputs.alpha)
+        && (outcome.tol == inputs.tol);
+}
+
+/**
+ * Check every outcome in the block against its own ballot. Its inputs must
+ * be the ballot's as the market index has them, where there is one. It
+ * publishes its first loading, which must check out as the leading
+ * eigenvector of the covariance matrix of those inputs, or agree with the
+ * one worked out when it does not; the other outputs must be the ones
+ * worked out from that loading.
+ */
+static bool CheckOutcomes(const CBlock& block, CValidationState& state, uint32_t nHeight)
+{
+    unsigned int nOutcomes = 0;
+    int64_t nTimeStart = GetTimeMicros();
+    std::vector<std::pair<uint256, const marketObj *> > vMarketObj;
+    GetMarketObjs(block, vMarketObj);
+    bool fOk = true;
+    for (unsigned int i=0; i < vMarketObj.size(); i++) {
+        const marketObj *obj = vMarketObj[i].second;
+        if (fOk && (obj->marketop == 'O')) {
+            if (fMarketIndex && !CheckOutcomeInputs(*(const marketOutcome *) obj, nHeight))
+                fOk = state.DoS(100, error("CheckOutcomes() : outcome in %s is not of its ballot's votes", obj->txid.ToString()),
+                                REJECT_INVALID, "bad-outcome-inputs");
+            else if (((const marketOutcome *) obj)->verify())
+                fOk = state.DoS(100, error("CheckOutcomes() : outcome in %s does not match its ballot", obj->txid.ToString()),
+                                REJECT_INVALID, "bad-outcome");
+            else
+                nOutcomes++;
+        }
+        delete obj;
+    }
+    if (!fOk)
+        return false;
+    if (nOutcomes) {
+        int64_t nTime = GetTimeMicros() - nTimeStart;
+        LogPrint("bench", "      - Verify %u outcomes: %.2fms\n", nOutcomes, 0.001 * nTime);
+    }
+    return true;
+}
+
 static int64_t nTimeVerify = 0;
 static int64_t nTimeConnect = 0;
 static int64_t nTimeIndex = 0;
@@ -1841,6 +2083,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     int64_t nTime1 = GetTimeMicros(); nTimeConnect += nTime1 - nTimeStart;
     LogPrint("bench", "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs]\n", (unsigned)block.vtx.size(), 0.001 * (nTime1 - nTimeStart), 0.001 * (nTime1 - nTimeStart) / block.vtx.size(), nInputs <= 1 ? 0 : 0.001 * (nTime1 - nTimeStart) / (nInputs-1), nTimeConnect * 0.000001);
 
+    if (fScriptChecks && pindex->nHeight >= Params().OutcomeCheckHeight() && !CheckOutcomes(block, state, pindex->nHeight))
+        return false;
+
 #if 0
  /* TODO: Fix for marketOutcomes */
     if (block.vtx[0].GetValueOut() > GetBlockValue(pindex->nHeight, nFees))
@@ -1887,30 +2132,21 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     {
         /* vMarketObj is a vector of all market objects in the block */
         std::vector<std::pair<uint256, const marketObj *> > vMarketObj;
-        for (unsigned int i=0; i < block.vtx.size(); i++) {
-            const CTransaction &tx = block.vtx[i];
-            BOOST_FOREACH(const CTxOut& txout, tx.vout) {
-                const CScript& scriptPubKey = txout.scriptPubKey;
-                size_t script_sz = scriptPubKey.size();
-                if ((script_sz < 2) ||
-                   (scriptPubKey[script_sz-1] != OP_MARKET))
-                       continue;
-                marketObj *obj = marketObjCtr(scriptPubKey);
-                if (!obj)
-                   continue;
-                obj->txid = tx.GetHash();
-                vMarketObj.push_back(std::make_pair(obj->GetHash(), obj));
-            }
-        }
-        /* write vMarketObj to tx db */
-        if (vMarketObj.size()) {
-            bool ret = pmarkettree->WriteMarketIndex(vMarketObj);
-            if (!ret)
-                return state.Abort("Failed to write market index");
-            for (size_t i=0; i < vMarketObj.size(); i++) {
-                delete vMarketObj[i].second;
-            }
+        GetMarketObjs(block, vMarketObj);
+        /* write vMarketObj to tx db, even if empty, for the markets
+         * maturing at this block */
+        bool ret = pmarkettree->WriteMarketIndex(vMarketObj, pindex->nHeight);
+        for (size_t i=0; i < vMarketObj.size(); i++) {
+            delete vMarketObj[i].second;
         }
+        if (!ret)
+            return state.Abort("Failed to write market index");
+
+        /* the transitions scheduled for this block */
+        std::vector<marketEvent> vEvents = pmarkettree->GetEvents(pindex->nHeight, pindex->nHeight);
+        BOOST_FOREACH(const marketEvent& event, vEvents)
+            LogPrint("market", "ConnectBlock() : height %u: %s %s\n", event.nHeight,
+                marketEventTypeToString(event.type), event.objid.ToString());
     }
 
     // add this block to the view's block chain
@@ -1946,7 +2182,7 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
     static int64_t nLastWrite = 0;
     try {
     if ((mode == FLUSH_STATE_ALWAYS) ||
-        ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->GetCacheSize() > nCoinCacheSize) ||
+        ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->DynamicMemoryUsage() > nCoinCacheUsage) ||
         (mode == FLUSH_STATE_PERIODIC && GetTimeMicros() > nLastWrite + DATABASE_WRITE_INTERVAL * 1000000)) {
         // Typical CCoins structures on disk are around 100 bytes in size.
         // Pushing a new one to the database can cause it to be written
@@ -1958,29 +2194,30 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
         // First make sure all block and undo data is flushed to disk.
         FlushBlockFile();
         // Then update all block file information (which may refer to block and undo files).
+        // It is copied, as it is written by the flusher's thread while blocks are connected.
         {
-            std::vector<std::pair<int, const CBlockFileInfo*> > vFiles;
+            std::vector<std::pair<int, CBlockFileInfo> > vFiles;
             vFiles.reserve(setDirtyFileInfo.size());
             for (set<int>::iterator it = setDirtyFileInfo.begin(); it != setDirtyFileInfo.end(); ) {
-                vFiles.push_back(make_pair(*it, &vinfoBlockFile[*it]));
+                vFiles.push_back(make_pair(*it, vinfoBlockFile[*it]));
                 setDirtyFileInfo.erase(it++);
             }
-            std::vector<const CBlockIndex*> vBlocks;
+            std::vector<CDiskBlockIndex> vBlocks;
             vBlocks.reserve(setDirtyBlockIndex.size());
             for (set<CBlockIndex*>::iterator it = setDirtyBlockIndex.begin(); it != setDirtyBlockIndex.end(); ) {
-                vBlocks.push_back(*it);
+                vBlocks.push_back(CDiskBlockIndex(*it));
                 setDirtyBlockIndex.erase(it++);
             }
-            if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
-                return state.Abort("Files to write to block index database");
-            }
-            if (!pmarkettree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
-                return state.Abort("Files to write to block market database");
-            }
+            pcoinsflusher->QueueBlockIndex(vFiles, nLastBlockFile, vBlocks);
         }
         // Finally flush the chainstate (which may refer to block index entries).
+        // This hands it to the flusher, which writes it all in the background.
+        // Coins read ahead from the database may be out of date once it is written.
+        coinsprefetcher.Discard();
         if (!pcoinsTip->Flush())
             return state.Abort("Failed to write to coin database");
+        if (mode == FLUSH_STATE_ALWAYS && !pcoinsflusher->Wait())
+            return state.Abort("Failed to write to coin database");
         // Update best block in wallet (so we can detect restored wallets).
         if (mode != FLUSH_STATE_IF_NEEDED) {
             g_signals.SetBestChain(chainActive.GetLocator());
@@ -2041,6 +2278,9 @@ void static UpdateTip(CBlockIndex *pindexNew) {
 bool static DisconnectTip(CValidationState &state) {
     CBlockIndex *pindexDelete = chainActive.Tip();
     assert(pindexDelete);
+    // Blocks of a chainstate snapshot have neither block nor undo data
+    if (pindexDelete->nStatus & BLOCK_IN_SNAPSHOT)
+        return error("DisconnectTip() : %s was loaded from a snapshot and cannot be disconnected", pindexDelete->GetBlockHash().ToString());
     mempool.check(pcoinsTip);
     // Read block from disk.
     CBlock block;
@@ -2054,6 +2294,15 @@ bool static DisconnectTip(CValidationState &state) {
             return error("DisconnectTip() : DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         assert(view.Flush());
     }
+    if (fMarketIndex) {
+        std::vector<std::pair<uint256, const marketObj *> > vMarketObj;
+        GetMarketObjs(block, vMarketObj);
+        bool ret = pmarkettree->DisconnectMarketIndex(vMarketObj, pindexDelete->nHeight);
+        for (size_t i=0; i < vMarketObj.size(); i++)
+            delete vMarketObj[i].second;
+        if (!ret)
+            return state.Abort("Failed to update market index");
+    }
     LogPrint("bench", "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
@@ -2079,6 +2328,7 @@ bool static DisconnectTip(CValidationState &state) {
 }
 
 static int64_t nTimeReadFromDisk = 0;
+static int64_t nTimePrefetchTotal = 0;
 static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
@@ -2086,9 +2336,10 @@ static int64_t nTimePostConnect = 0;
 
 /** 
  * Connect a new block to chainActive. pblock is either NULL or a pointer to a CBlock
- * corresponding to pindexNew, to bypass loading it again from disk.
+ * corresponding to pindexNew, to bypass loading it again from disk. pindexNext is
+ * either NULL or the block to be connected after it, whose coins are read ahead.
  */
-bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *pblock) {
+bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *pblock, CBlockIndex *pindexNext) {
     assert(pindexNew->pprev == chainActive.Tip());
     mempool.check(pcoinsTip);
     // Read block from disk.
@@ -2103,6 +2354,16 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+    if (nPrefetchThreads) {
+        // Read the coins the block spends in parallel, and start on the next block's.
+        CDiskBlockPos posNext;
+        if (pindexNext && (pindexNext->nStatus & BLOCK_HAVE_DATA))
+            posNext = pindexNext->GetBlockPos();
+        size_t nWarmed = coinsprefetcher.Warm(*pcoinsTip, *pblock, posNext.IsNull() ? NULL : &posNext);
+        int64_t nTimePrefetch = GetTimeMicros(); nTimePrefetchTotal += nTimePrefetch - nTime2;
+        LogPrint("bench", "  - Prefetch %u coins: %.2fms [%.2fs]\n", (unsigned)nWarmed, (nTimePrefetch - nTime2) * 0.001, nTimePrefetchTotal * 0.000001);
+        nTime2 = nTimePrefetch;
+    }
     {
         CCoinsViewCache view(pcoinsTip);
         CInv inv(MSG_BLOCK, pindexNew->GetBlockHash());
@@ -2186,6 +2447,24 @@ static CBlockIndex* FindMostWorkChain() {
             }
             pindexTest = pindexTest->pprev;
         }
+        // Forking off below the block of a chainstate snapshot would mean
+        // disconnecting blocks that were never downloaded, so such forks
+        // are taken as invalid
+        CBlockIndex *pindexNext = pindexTest && pindexTest != pindexNew && !fInvalidAncestor ? chainActive.Next(pindexTest) : NULL;
+        if (pindexNext && (pindexNext->nStatus & BLOCK_IN_SNAPSHOT)) {
+            CBlockIndex *pindexFailed = pindexNew;
+            while (pindexFailed->pprev != pindexTest) {
+                pindexFailed->nStatus |= BLOCK_FAILED_CHILD;
+                setDirtyBlockIndex.insert(pindexFailed);
+                setBlockIndexCandidates.erase(pindexFailed);
+                pindexFailed = pindexFailed->pprev;
+            }
+            pindexFailed->nStatus |= BLOCK_FAILED_VALID;
+            setDirtyBlockIndex.insert(pindexFailed);
+            setBlockIndexCandidates.erase(pindexFailed);
+            LogPrintf("%s: fork at %s is below the chainstate snapshot, ignoring it\n", __func__, pindexFailed->GetBlockHash().ToString());
+            fInvalidAncestor = true;
+        }
         if (!fInvalidAncestor)
             return pindexNew;
     } while(true);
@@ -2238,7 +2517,8 @@ static bool ActivateBestChainStep(CValidationState &state, CBlockIndex *pindexMo
 
     // Connect new blocks.
     BOOST_REVERSE_FOREACH(CBlockIndex *pindexConnect, vpindexToConnect) {
-        if (!ConnectTip(state, pindexConnect, pindexConnect == pindexMostWork ? pblock : NULL)) {
+        CBlockIndex *pindexNext = pindexConnect == pindexMostWork ? NULL : pindexMostWork->GetAncestor(pindexConnect->nHeight + 1);
+        if (!ConnectTip(state, pindexConnect, pindexConnect == pindexMostWork ? pblock : NULL, pindexNext)) {
             if (state.IsInvalid()) {
                 // The block violates a consensus rule.
                 if (!state.CorruptionPossible())
@@ -2942,7 +3222,8 @@ bool static LoadBlockIndexDB()
     {
         CBlockIndex* pindex = item.second;
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
-        if (pindex->nStatus & BLOCK_HAVE_DATA) {
+        // Blocks in a snapshot count as linked, their transactions being in the chainstate
+        if (pindex->nStatus & (BLOCK_HAVE_DATA | BLOCK_IN_SNAPSHOT)) {
             if (pindex->pprev) {
                 if (pindex->pprev->nChainTx) {
                     pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
@@ -3028,6 +3309,85 @@ bool static LoadBlockIndexDB()
     return true;
 }
 
+/** What the checks of one block found, for VerifyDB to act on in chain order */
+struct CBlockVerifyResult
+{
+    CBlock block;
+    //! The check level that failed, or -1 if none did
+    int nFailedLevel;
+
+    CBlockVerifyResult() : nFailedLevel(-1) {}
+};
+
+/**
+ * Closure for the checks of VerifyDB that do not depend on other blocks:
+ * reading the block (level 0), checking it (level 1) and reading its undo
+ * data (level 2).
+ */
+class CBlockVerifyCheck
+{
+private:
+    CBlockIndex *pindex;
+    int nCheckLevel;
+    CBlockVerifyResult *presult;
+
+public:
+    CBlockVerifyCheck() : pindex(NULL), nCheckLevel(0), presult(NULL) {}
+    CBlockVerifyCheck(CBlockIndex *pindexIn, int nCheckLevelIn, CBlockVerifyResult *presultIn) :
+        pindex(pindexIn), nCheckLevel(nCheckLevelIn), presult(presultIn) {}
+
+    bool operator()()
+    {
+        CValidationState state;
+        CBlockUndo undo;
+        CDiskBlockPos pos = pindex->GetUndoPos();
+        if (!ReadBlockFromDisk(presult->block, pindex))
+            presult->nFailedLevel = 0;
+        else if (nCheckLevel >= 1 && !CheckBlock(presult->block, state))
+            presult->nFailedLevel = 1;
+        else if (nCheckLevel >= 2 && !pos.IsNull() && !UndoReadFromDisk(undo, pos, pindex->pprev->GetBlockHash()))
+            presult->nFailedLevel = 2;
+        else
+            presult->nFailedLevel = -1;
+        // VerifyDB reports the failure nearest to the tip, so a failure
+        // must not cut the checks of the other blocks short
+        return true;
+    }
+
+    void swap(CBlockVerifyCheck &check)
+    {
+        std::swap(pindex, check.pindex);
+        std::swap(nCheckLevel, check.nCheckLevel);
+        std::swap(presult, check.presult);
+    }
+};
+
+static void ThreadBlockVerifyCheck(CCheckQueue<CBlockVerifyCheck> *pqueue)
+{
+    RenameThread("truthcoin-verify");
+    pqueue->Thread();
+}
+
+/** Worker threads for the checks of VerifyDB, stopped when it returns */
+class CBlockVerifyThreads
+{
+private:
+    boost::thread_group threadGroup;
+
+public:
+    CBlockVerifyThreads(CCheckQueue<CBlockVerifyCheck> &queue, int nThreads)
+    {
+        for (int i = 0; i < nThreads; i++)
+            threadGroup.create_thread(boost::bind(&ThreadBlockVerifyCheck, &queue));
+    }
+
+    ~CBlockVerifyThreads()
+    {
+        threadGroup.interrupt_all();
+        threadGroup.join_all();
+    }
+};
+
 CVerifyDB::CVerifyDB()
 {
     uiInterface.ShowProgress(_("Verifying blocks..."), 0);
@@ -3056,42 +3416,69 @@ bool CVerifyDB::VerifyDB(CCoinsView *coinsview, int nCheckLevel, int nCheckDepth
     CBlockIndex* pindexFailure = NULL;
     int nGoodTransactions = 0;
     CValidationState state;
+
+    // The blocks to check, from the tip down
+    std::vector<CBlockIndex*> vIndex;
     for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev)
     {
-        boost::this_thread::interruption_point();
-        uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100)))));
         if (pindex->nHeight < chainActive.Height()-nCheckDepth)
             break;
-        CBlock block;
-        // check level 0: read from disk
-        if (!ReadBlockFromDisk(block, pindex))
-            return error("VerifyDB() : *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-        // check level 1: verify block validity
-        if (nCheckLevel >= 1 && !CheckBlock(block, state))
-            return error("VerifyDB() : *** found bad block at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
-        // check level 2: verify undo validity
-        if (nCheckLevel >= 2 && pindex) {
-            CBlockUndo undo;
-            CDiskBlockPos pos = pindex->GetUndoPos();
-            if (!pos.IsNull()) {
-                if (!UndoReadFromDisk(undo, pos, pindex->pprev->GetBlockHash()))
-                    return error("VerifyDB() : *** found bad undo data at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+        // Nothing below a loaded snapshot was downloaded
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+            break;
+        vIndex.push_back(pindex);
+    }
+
+    // Levels 0 to 2 are checked a window of blocks at a time on the script
+    // verification threads, with this thread joining in; what they found is
+    // then gone through in order, as disconnecting needs that.
+    CCheckQueue<CBlockVerifyCheck> queue(1, MAX_SCRIPTCHECK_THREADS);
+    CBlockVerifyThreads threads(queue, std::max(0, nScriptCheckThreads - 1));
+    std::vector<CBlockVerifyResult> vResults(std::min(vIndex.size(), (size_t)MAX_VERIFY_BLOCKS_AHEAD));
+    for (size_t nStart = 0; nStart < vIndex.size(); nStart += vResults.size())
+    {
+        size_t nEnd = std::min(vIndex.size(), nStart + vResults.size());
+        std::vector<CBlockVerifyCheck> vChecks;
+        vChecks.reserve(nEnd - nStart);
+        for (size_t i = nStart; i < nEnd; i++)
+            vChecks.push_back(CBlockVerifyCheck(vIndex[i], nCheckLevel, &vResults[i - nStart]));
+        {
+            CCheckQueueControl<CBlockVerifyCheck> control(&queue);
+            control.Add(vChecks);
+            control.Wait();
+        }
+
+        for (size_t i = nStart; i < nEnd; i++)
+        {
+            boost::this_thread::interruption_point();
+            CBlockIndex* pindex = vIndex[i];
+            uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100)))));
+            CBlockVerifyResult& result = vResults[i - nStart];
+            // check level 0: read from disk
+            if (result.nFailedLevel == 0)
+                return error("VerifyDB() : *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+            // check level 1: verify block validity
+            if (result.nFailedLevel == 1)
+                return error("VerifyDB() : *** found bad block at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+            // check level 2: verify undo validity
+            if (result.nFailedLevel == 2)
+                return error("VerifyDB() : *** found bad undo data at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+            // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
+            if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
+                bool fClean = true;
+                if (!DisconnectBlock(result.block, state, pindex, coins, &fClean))
+                    return error("VerifyDB() : *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+                pindexState = pindex->pprev;
+                if (!fClean) {
+                    nGoodTransactions = 0;
+                    pindexFailure = pindex;
+                } else
+                    nGoodTransactions += result.block.vtx.size();
             }
+            result.block.SetNull();
+            if (ShutdownRequested())
+                return true;
         }
-        // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
-        if (nCheckLevel >= 3 && pindex == pindexState && (coins.GetCacheSize() + pcoinsTip->GetCacheSize()) <= nCoinCacheSize) {
-            bool fClean = true;
-            if (!DisconnectBlock(block, state, pindex, coins, &fClean))
-                return error("VerifyDB() : *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-            pindexState = pindex->pprev;
-            if (!fClean) {
-                nGoodTransactions = 0;
-                pindexFailure = pindex;
-            } else
-                nGoodTransactions += block.vtx.size();
-        }
-        if (ShutdownRequested())
-            return true;
     }
     if (pindexFailure)
         return error("VerifyDB() : *** coin database inconsistencies found (last %i blocks, %i good transactions before that)\n", chainActive.Height() - pindexFailure->nHeight + 1, nGoodTransactions);
@@ -3166,7 +3553,7 @@ bool InitBlockIndex() {
             const marketBranch *obj = &Params().GenesisBranch();
             std::vector<std::pair<uint256, const marketObj *> > vMarketObj;
             vMarketObj.push_back(std::make_pair(obj->GetHash(), obj));
-            if (!pmarkettree->WriteMarketIndex(vMarketObj))
+            if (!pmarkettree->WriteMarketIndex(vMarketObj, 0))
                 return error("LoadBlockIndex() : genesis branch cannot be written.");
 
             // Write Genesis TXID to DB
@@ -3423,6 +3810,9 @@ void static ProcessGetData(CNode* pfrom)
                         send = true;
                     }
                 }
+                // Blocks below a loaded snapshot cannot be served
+                if (send && !(mi->second->nStatus & BLOCK_HAVE_DATA))
+                    send = false;
                 if (send)
                 {
                     // Send block from disk
@@ -37,6 +37,7 @@
 #include <utility>
 #include <vector>
 
+#include <boost/shared_ptr.hpp>
 #include <boost/unordered_map.hpp>
 
 class CBlockIndex;
@@ -81,6 +82,12 @@ static const unsigned int LOCKTIME_THRESHOLD = 500000000; // Tue Nov  5 00:53:20
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Maximum number of coins prefetching threads allowed */
+static const int MAX_PREFETCH_THREADS = 16;
+/** -prefetchthreads default (number of threads reading coins ahead of block connection, 0 = none) */
+static const int DEFAULT_PREFETCH_THREADS = 4;
+/** Number of blocks VerifyDB reads and checks in parallel ahead of disconnecting them */
+static const unsigned int MAX_VERIFY_BLOCKS_AHEAD = 64;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -127,9 +134,11 @@ extern CConditionVariable cvBlockChange;
 extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
+extern int nPrefetchThreads;
 extern bool fTxIndex;
+extern bool fMarketIndex;
 extern bool fIsBareMultisigStd;
-extern unsigned int nCoinCacheSize;
+extern size_t nCoinCacheUsage;
 extern CFeeRate minRelayTxFee;
 
 /** Best header we've seen so far (used for getheaders queries' starting points). */
@@ -139,6 +148,8 @@ extern CBlockIndex *pindexBestHeader;
 static const uint64_t nMinDiskSpace = 52428800;
 
 void InsertMarketObjectHeight(marketObj *);
+/** Whether the outcome's inputs are the ones the market index has for its ballot at nHeight */
+bool CheckOutcomeInputs(const marketOutcome& outcome, uint32_t nHeight);
 
 /** Register a wallet to receive updates from core */
 void RegisterValidationInterface(CValidationInterface* pwalletIn);
@@ -188,6 +199,8 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the coins prefetching thread */
+void ThreadCoinsPrefetch();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Format a string that describes several potential problems detected by the core */
@@ -319,12 +332,16 @@ private:
     unsigned int nFlags;
     bool cacheStore;
     ScriptError error;
+    //! shared by the checks of one transaction's inputs
+    boost::shared_ptr<const CPrecomputedSigHash> precomputed;
 
 public:
     CScriptCheck(): ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
-    CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn) :
+    CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn,
+                 const boost::shared_ptr<const CPrecomputedSigHash> &precomputedIn = boost::shared_ptr<const CPrecomputedSigHash>()) :
         scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey),
-        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR) { }
+        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR),
+        precomputed(precomputedIn) { }
 
     bool operator()();
 
@@ -335,6 +352,7 @@ public:
         std::swap(nFlags, check.nFlags);
         std::swap(cacheStore, check.cacheStore);
         std::swap(error, check.error);
+        precomputed.swap(check.precomputed);
     }
 
     ScriptError GetScriptError() const { return error; }
@@ -525,6 +543,10 @@ extern CMarketTreeDB *pmarkettree;
 class CCoinsViewDB;
 extern CCoinsViewDB *pcoinsdbview;
 
+/** Global variable that points to the view writing the chainstate in the background, below pcoinsTip */
+class CCoinsViewFlusher;
+extern CCoinsViewFlusher *pcoinsflusher;
+
 
 struct CBlockTemplate
 {
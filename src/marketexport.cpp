@@ -0,0 +1,275 @@
+// Copyright (c) 2015 The Truthcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "marketexport.h"
+
+#include "base58.h"
+#include "clientversion.h"
+#include "primitives/market.h"
+#include "rpcprotocol.h"
+#include "streams.h"
+#include "tinyformat.h"
+#include "txdb.h"
+#include "utilstrencodings.h"
+
+#include <boost/bind.hpp>
+
+using namespace std;
+
+extern CMarketTreeDB *pmarkettree;
+
+/** Pieces are gathered into chunks of about this many bytes */
+static const size_t EXPORT_CHUNK_SIZE = 65536;
+
+bool CStreamExportSink::Write(const string &str)
+{
+    stream << str;
+    return stream.good();
+}
+
+bool CStreamExportSink::Finish()
+{
+    stream << std::flush;
+    return stream.good();
+}
+
+bool CChunkedHTTPExportSink::WriteChunk()
+{
+    if (!fStarted) {
+        stream << HTTPReplyChunkedHeader(HTTP_OK, fKeepAlive, contentType);
+        fStarted = true;
+    }
+    if (strBuffer.size()) {
+        stream << strprintf("%x\r\n", strBuffer.size()) << strBuffer << "\r\n";
+        strBuffer.clear();
+    }
+    return stream.good();
+}
+
+bool CChunkedHTTPExportSink::Write(const string &str)
+{
+    strBuffer += str;
+    if (strBuffer.size() < EXPORT_CHUNK_SIZE)
+        return true;
+    return WriteChunk();
+}
+
+bool CChunkedHTTPExportSink::Finish()
+{
+    if (!WriteChunk())
+        return false;
+    stream << "0\r\n\r\n" << std::flush;
+    return stream.good();
+}
+
+static uint64_t VecAt(const vector<uint64_t> &vec, size_t i)
+{
+    return (i < vec.size())? vec[i]: 0;
+}
+
+static string FormatValue(uint64_t value, uint64_t NA)
+{
+    if (value == NA)
+        return "NA";
+    return strprintf("%.8f", value * 1e-8);
+}
+
+template <typename T>
+static string SerializeRow(const T &obj)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << obj;
+    return ss.str();
+}
+
+/* one vote of the ballot: a row of the decisions' columns. fWriteFailed
+ * tells a failed write apart from the cursor failing */
+static bool ExportBallotVote(const marketBranch &branch, const map<uint256, uint32_t> &mapDecisionIndex,
+    ExportFormat format, CExportSink &sink, bool &fWriteFailed, const marketVote &vote)
+{
+    if (!pmarkettree->IsVoteSealed(branch, vote))
+        return true;
+    if (vote.decisionIDs.size() != vote.decisionVotes.size())
+        return true;
+
+    vector<uint64_t> row(mapDecisionIndex.size(), EXPORT_NA);
+    for(size_t k=0; k < vote.decisionIDs.size(); k++) {
+        map<uint256, uint32_t>::const_iterator it = mapDecisionIndex.find(vote.decisionIDs[k]);
+        if ((it != mapDecisionIndex.end()) && (vote.decisionVotes[k] != vote.NA))
+            row[it->second] = vote.decisionVotes[k];
+    }
+
+    bool ret;
+    if (format == EXPORT_BINARY)
+        ret = sink.Write(SerializeRow(make_pair(make_pair(vote.GetHash(), vote.keyID), row)));
+    else {
+        string str = vote.GetHash().ToString() + "," + CTruthcoinAddress(vote.keyID).ToString();
+        for(size_t j=0; j < row.size(); j++)
+            str += "," + FormatValue(row[j], EXPORT_NA);
+        ret = sink.Write(str + "\n");
+    }
+    if (!ret)
+        fWriteFailed = true;
+    return ret;
+}
+
+bool ExportBallot(const uint256 &branchid, uint32_t height, ExportFormat format, CExportSink &sink, string &strError)
+{
+    if (!pmarkettree) {
+        strError = "NULL pmarkettree";
+        return false;
+    }
+
+    marketBranch *branch = pmarkettree->GetBranch(branchid);
+    if (!branch) {
+        strError = "branchid " + branchid.ToString() + " does not exist";
+        return false;
+    }
+    if (!branch->tau || (height % branch->tau != 0)) {
+        delete branch;
+        strError = strprintf("height %u is not a ballot of the branch", height);
+        return false;
+    }
+
+    /* the decisions, chosen as in getOutcomeTx */
+    vector<uint256> decisionIDs;
+    map<uint256, uint32_t> mapDecisionIndex;
+    vector<marketDecision *> decisions = pmarkettree->GetDecisions(branchid);
+    for(size_t i=0; i < decisions.size(); i++) {
+        const marketDecision *decision = decisions[i];
+        uint32_t blocknum = decision->eventOverBy + branch->ballotTime
+            + branch->unsealTime;
+        if ((height - branch->tau <= blocknum) && (blocknum < height)) {
+            mapDecisionIndex[decision->GetHash()] = decisionIDs.size();
+            decisionIDs.push_back(decision->GetHash());
+        }
+        delete decision;
+    }
+
+    bool ret;
+    if (format == EXPORT_BINARY)
+        ret = sink.Write(SerializeRow(make_pair(make_pair(string("ballot"), make_pair(branchid, height)), decisionIDs)));
+    else {
+        string str = "voteid,address";
+        for(size_t j=0; j < decisionIDs.size(); j++)
+            str += "," + decisionIDs[j].ToString();
+        ret = sink.Write(str + "\n");
+    }
+    if (!ret) {
+        delete branch;
+        strError = "write failed";
+        return false;
+    }
+
+    /* the rows go out as the cursor reaches them */
+    bool fWriteFailed = false;
+    ret = pmarkettree->ScanVotes(branchid, height,
+        boost::bind(&ExportBallotVote, boost::cref(*branch), boost::cref(mapDecisionIndex),
+            format, boost::ref(sink), boost::ref(fWriteFailed), _1));
+    delete branch;
+    if (!ret) {
+        strError = (fWriteFailed)? "write failed": "reading the ballot's votes failed";
+        return false;
+    }
+
+    if (!sink.Finish()) {
+        strError = "write failed";
+        return false;
+    }
+    return true;
+}
+
+bool ExportOutcome(const uint256 &outcomeid, ExportFormat format, CExportSink &sink, string &strError)
+{
+    if (!pmarkettree) {
+        strError = "NULL pmarkettree";
+        return false;
+    }
+
+    marketOutcome *outcome = pmarkettree->GetOutcome(outcomeid);
+    if (!outcome) {
+        strError = "outcomeid " + outcomeid.ToString() + " does not exist";
+        return false;
+    }
+
+    const vector<uint64_t> *cVecs[] = {
+        &outcome->isScaled, &outcome->firstLoading, &outcome->decisionsRaw,
+        &outcome->consensusReward, &outcome->certainty, &outcome->NACol,
+        &outcome->particCol, &outcome->authorBonus, &outcome->decisionsFinal,
+    };
+    const char *cNames[] = {
+        "isScaled", "firstLoading", "decisionsRaw", "consensusReward",
+        "certainty", "NACol", "particCol", "authorBonus", "decisionsFinal",
+    };
+    const vector<uint64_t> *rVecs[] = {
+        &outcome->oldRep, &outcome->thisRep, &outcome->smoothedRep,
+        &outcome->NARow, &outcome->particRow, &outcome->particRel,
+        &outcome->rowBonus,
+    };
+    const char *rNames[] = {
+        "oldRep", "thisRep", "smoothedRep", "NARow", "particRow",
+        "particRel", "rowBonus",
+    };
+    uint32_t nr = outcome->voterIDs.size();
+    uint32_t nc = outcome->decisionIDs.size();
+    bool ret = true;
+
+    /* the decisions first, then a row per voter */
+    if (format == EXPORT_BINARY) {
+        ret = sink.Write(SerializeRow(make_pair(make_pair(string("outcome"), outcomeid), outcome->decisionIDs)));
+        for(size_t k=0; ret && (k < ARRAYLEN(cVecs)); k++)
+            ret = sink.Write(SerializeRow(*cVecs[k]));
+    }
+    else {
+        string str = "decisionid";
+        for(size_t k=0; k < ARRAYLEN(cNames); k++)
+            str += string(",") + cNames[k];
+        ret = sink.Write(str + "\n");
+        for(uint32_t j=0; ret && (j < nc); j++) {
+            str = outcome->decisionIDs[j].ToString();
+            str += strprintf(",%d", (int)VecAt(outcome->isScaled, j));
+            str += strprintf(",%.8f", (int64_t)VecAt(outcome->firstLoading, j) * 1e-8);
+            for(size_t k=2; k < ARRAYLEN(cVecs); k++)
+                str += strprintf(",%.8f", VecAt(*cVecs[k], j) * 1e-8);
+            ret = sink.Write(str + "\n");
+        }
+        str = "\naddress";
+        for(size_t k=0; k < ARRAYLEN(rNames); k++)
+            str += string(",") + rNames[k];
+        for(uint32_t j=0; j < nc; j++)
+            str += "," + outcome->decisionIDs[j].ToString();
+        if (ret)
+            ret = sink.Write(str + "\n");
+    }
+
+    for(uint32_t i=0; ret && (i < nr); i++) {
+        vector<uint64_t> row(nc, EXPORT_NA);
+        for(uint32_t j=0; j < nc; j++) {
+            uint64_t value = VecAt(outcome->voteMatrix, (size_t)i*nc + j);
+            if (value != outcome->NA)
+                row[j] = value;
+        }
+        if (format == EXPORT_BINARY) {
+            vector<uint64_t> values;
+            for(size_t k=0; k < ARRAYLEN(rVecs); k++)
+                values.push_back(VecAt(*rVecs[k], i));
+            ret = sink.Write(SerializeRow(make_pair(outcome->voterIDs[i], make_pair(values, row))));
+        }
+        else {
+            string str = CTruthcoinAddress(outcome->voterIDs[i]).ToString();
+            for(size_t k=0; k < ARRAYLEN(rVecs); k++)
+                str += strprintf(",%.8f", VecAt(*rVecs[k], i) * 1e-8);
+            for(uint32_t j=0; j < nc; j++)
+                str += "," + FormatValue(row[j], EXPORT_NA);
+            ret = sink.Write(str + "\n");
+        }
+    }
+    delete outcome;
+
+    if (ret)
+        ret = sink.Finish();
+    if (!ret)
+        strError = "write failed";
+    return ret;
+}
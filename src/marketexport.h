@@ -0,0 +1,80 @@
+// Copyright (c) 2015 The Truthcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef TRUTHCOIN_MARKETEXPORT_H
+#define TRUTHCOIN_MARKETEXPORT_H
+
+#include "uint256.h"
+
+#include <stdint.h>
+#include <ostream>
+#include <string>
+
+/** A missing vote, in the binary format */
+static const uint64_t EXPORT_NA = ~(uint64_t)0;
+
+enum ExportFormat {
+    EXPORT_CSV,
+    EXPORT_BINARY,
+};
+
+/** Where an export is written to, a piece at a time */
+class CExportSink
+{
+public:
+    virtual ~CExportSink() { }
+    virtual bool Write(const std::string &str) = 0;
+    /** Called once after the last piece */
+    virtual bool Finish() { return true; }
+};
+
+/** A plain stream, such as the file of dumpwallet */
+class CStreamExportSink : public CExportSink
+{
+private:
+    std::ostream &stream;
+
+public:
+    CStreamExportSink(std::ostream &streamIn) : stream(streamIn) { }
+    bool Write(const std::string &str);
+    bool Finish();
+};
+
+/**
+ * An HTTP reply in chunked transfer encoding. The headers go out with
+ * the first chunk, so an export that fails before writing anything can
+ * still be answered with an error.
+ */
+class CChunkedHTTPExportSink : public CExportSink
+{
+private:
+    std::ostream &stream;
+    bool fKeepAlive;
+    const char *contentType;
+    bool fStarted;
+    std::string strBuffer;
+
+    bool WriteChunk();
+
+public:
+    CChunkedHTTPExportSink(std::ostream &streamIn, bool fKeepAliveIn, const char *contentTypeIn)
+        : stream(streamIn), fKeepAlive(fKeepAliveIn), contentType(contentTypeIn), fStarted(false) { }
+    bool Started() const { return fStarted; }
+    bool Write(const std::string &str);
+    bool Finish();
+};
+
+/**
+ * Write a ballot's vote matrix, one row per revealed vote counted as in
+ * getOutcomeTx, straight from the market tree cursor.
+ */
+bool ExportBallot(const uint256 &branchid, uint32_t height, ExportFormat format, CExportSink &sink, std::string &strError);
+
+/**
+ * Write an outcome's per-decision vectors and then one row per voter
+ * with its per-voter vectors and votes.
+ */
+bool ExportOutcome(const uint256 &outcomeid, ExportFormat format, CExportSink &sink, std::string &strError);
+
+#endif // TRUTHCOIN_MARKETEXPORT_H
@@ -0,0 +1,39 @@
+// Copyright (c) 2015 The Truthcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef TRUTHCOIN_MEMUSAGE_H
+#define TRUTHCOIN_MEMUSAGE_H
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include <vector>
+
+namespace memusage
+{
+
+/** Compute the total memory used by allocating alloc bytes, with the malloc overhead. */
+static inline size_t MallocUsage(size_t alloc)
+{
+    // Measured on libc6 2.19 on Linux.
+    if (alloc == 0)
+        return 0;
+    if (sizeof(void*) == 8)
+        return ((alloc + 31) >> 4) << 4;
+    if (sizeof(void*) == 4)
+        return ((alloc + 15) >> 3) << 3;
+    assert(0);
+    return 0;
+}
+
+/** The heap memory of a vector's buffer, not counting what its elements point to. */
+template<typename X>
+static inline size_t DynamicUsage(const std::vector<X>& v)
+{
+    return MallocUsage(v.capacity() * sizeof(X));
+}
+
+}
+
+#endif // TRUTHCOIN_MEMUSAGE_H
@@ -7,6 +7,7 @@
 #include "miner.h"
 
 #include "amount.h"
+#include "ballotcache.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "hash.h"
@@ -45,10 +46,12 @@ CTransaction getOutcomeTx(marketBranch *branch, uint32_t height)
     /* retrieve the votes for this height */
     vector<marketVote *> vec = pmarkettree->GetVotes(branch->GetHash(), height);
 
-    /* index the ballot's votes via their keyIDs */
+    /* index the ballot's votes via their keyIDs, skipping those not
+     * sealed and revealed in time */
     std::map<CKeyID, const marketVote *> votes;
     for(size_t i=0; i < vec.size(); i++)
-       votes[vec[i]->keyID] = vec[i];
+       if (pmarkettree->IsVoteSealed(*branch, *vec[i]))
+           votes[vec[i]->keyID] = vec[i];
 
     /* create new outcome */
     struct marketOutcome *outcome = new marketOutcome;
@@ -135,8 +138,11 @@ CTransaction getOutcomeTx(marketBranch *branch, uint32_t height)
     if (outcome->nVoters)
         return CTransaction();
 
-    /* calculate the result */
-    int rc = outcome->calc();
+    /* calculate the result, starting from the ballot cache's loading */
+    vector<double> warm;
+    if (pballotcache)
+        pballotcache->GetLoading(branch->GetHash(), height, outcome->decisionIDs, warm);
+    int rc = outcome->calc((warm.size())? &warm: NULL);
     if (rc < 0) /* something is wrong */
         return CTransaction();
 
@@ -242,6 +242,74 @@ double marketAccountValue(double B, uint32_t nstates)
     return B * FDLIBM_log((double)nstates);
 }
 
+/* split text into search tokens: lowercased runs of letters and
+ * digits. Single characters are dropped. */
+vector<string> marketTokenize(const string &text)
+{
+    vector<string> tokens;
+    string token;
+    for(size_t i=0; i <= text.size(); i++) {
+        char c = (i < text.size())? text[i]: ' ';
+        if (((c >= 'a') && (c <= 'z')) || ((c >= '0') && (c <= '9'))) {
+            token += c;
+            continue;
+        }
+        if ((c >= 'A') && (c <= 'Z')) {
+            token += c - 'A' + 'a';
+            continue;
+        }
+        if (token.size() > 1)
+            tokens.push_back(token);
+        token.clear();
+    }
+    return tokens;
+}
+
+/* the tokens a market is found by: those of its title and tags */
+set<string> marketTokens(const marketMarket &market)
+{
+    vector<string> title = marketTokenize(market.title);
+    vector<string> tags = marketTokenize(market.tags);
+    set<string> tokens(title.begin(), title.end());
+    tokens.insert(tags.begin(), tags.end());
+    return tokens;
+}
+
+/* the value of a decision function at the final value x of its
+ * decision, both in [0,1]. LNX1 is ln(1+x)/ln(2). */
+double marketDecisionFunction(int decisionFunctionID, double x)
+{
+    if (x < 0.0) x = 0.0;
+    if (x > 1.0) x = 1.0;
+    if (decisionFunctionID == DFID_X2)
+        return x * x;
+    if (decisionFunctionID == DFID_X3)
+        return x * x * x;
+    if (decisionFunctionID == DFID_LNX1)
+        return FDLIBM_log(1.0 + x) / FDLIBM_log(2.0);
+    return x;
+}
+
+/* the value of one share of a market state, bit k of which is the
+ * state of decision k. A decision whose function comes to f pays f
+ * to its state 1 and 1 - f to its state 0, so the values of all the
+ * states add up to 1.
+ */
+double marketStateValue(const marketMarket &market, const vector<double> &decisionsFinal, uint32_t state)
+{
+    double value = 1.0;
+    for(uint32_t k=0; k < market.decisionIDs.size(); k++) {
+        if (k >= decisionsFinal.size())
+            return 0.0;
+        int dfid = DFID_X1;
+        if (k < market.decisionFunctionIDs.size())
+            dfid = market.decisionFunctionIDs[k];
+        double f = marketDecisionFunction(dfid, decisionsFinal[k]);
+        value *= ((state >> k) & 1)? f: 1.0 - f;
+    }
+    return value;
+}
+
 string marketOutcome::ToString(void) const
 {
     char err[64];
@@ -336,33 +404,63 @@ string marketOutcome::ToString(void) const
     return str.str();
 }
 
-int marketOutcome::calc(void)
+/* the tc_vote for the outcome's inputs, or NULL if they do not fit */
+static struct tc_vote *outcomeVoteCtr(const marketOutcome &outcome)
 {
-    struct tc_vote *vote = tc_vote_ctr(nVoters, nDecisions);
-    vote->NA = NA;
-    vote->alpha = alpha;
-    vote->tol = tol;
+    const uint32_t nVoters = outcome.nVoters;
+    const uint32_t nDecisions = outcome.nDecisions;
+    const uint64_t NA = outcome.NA;
+    const vector<uint64_t> &voteMatrix = outcome.voteMatrix;
+    if ((voteMatrix.size() != (size_t) nVoters * nDecisions)
+        || (outcome.oldRep.size() != nVoters)
+        || (outcome.isScaled.size() != nDecisions))
+        return NULL;
+
+    /* most voters answer only part of the ballot, so the votes are
+     * passed as a sparse matrix with the NA entries left out.
+     */
+    uint32_t nnz = 0;
+    for(size_t k=0; k < voteMatrix.size(); k++)
+        if (voteMatrix[k] != NA)
+            nnz++;
+    struct tc_spmat *S = tc_spmat_ctr(nVoters, nDecisions, nnz);
+    uint32_t k = 0;
+    for(uint32_t i=0; i < nVoters; i++) {
+        S->rowp[i] = k;
+        for(uint32_t j=0; j < nDecisions; j++) {
+            uint64_t v = voteMatrix[i*nDecisions + j];
+            if (v == NA)
+                continue;
+            S->colidx[k] = j;
+            S->val[k] = v * 1e-8;
+            k++;
+        }
+    }
+    S->rowp[nVoters] = k;
+
+    struct tc_vote *vote = tc_vote_sparse_ctr(S);
+    /* the outputs follow from the first loading alone, so which SVD
+     * finds it is up to the node; the rotations of a Jacobi sweep run
+     * in parallel */
+    vote->svd = TC_SVD_JACOBI;
+    vote->NA = NA * 1e-8;
+    vote->alpha = outcome.alpha;
+    vote->tol = outcome.tol;
 
     double **oldrep = vote->rvecs[TC_VOTE_OLD_REP]->a;
     for(uint32_t i=0; i < nVoters; i++)
-        oldrep[i][0] = oldRep[i] * 1e-8;
+        oldrep[i][0] = outcome.oldRep[i] * 1e-8;
 
     double **isbin = vote->cvecs[TC_VOTE_IS_BINARY]->a;
     for(uint32_t j=0; j < nDecisions; j++)
-        isbin[0][j] = (isScaled[j])? 0.0: 1.0;
+        isbin[0][j] = (outcome.isScaled[j])? 0.0: 1.0;
 
-    double **m = vote->M->a;
-    for(uint32_t i=0; i < nVoters; i++) 
-        for(uint32_t j=0; j < nDecisions; j++) 
-            m[i][j] = voteMatrix[i*nDecisions + j] * 1e-8;
-
-    int rc = tc_vote_proc(vote);
-    if (rc < 0) {
-        /* something is wrong. */
-        tc_vote_dtr(vote);
-        return -1;
-    }
+    return vote;
+}
 
+/* copy the outputs of a processed vote into the outcome */
+static void outcomeSetOutputs(marketOutcome &outcome, const struct tc_vote *vote)
+{
     /* row (voters) outputs */
     double **thisrep = vote->rvecs[TC_VOTE_THIS_REP]->a;
     double **smoothedrep = vote->rvecs[TC_VOTE_SMOOTHED_REP]->a;
@@ -370,19 +468,19 @@ int marketOutcome::calc(void)
     double **particrow = vote->rvecs[TC_VOTE_PARTIC_ROW]->a;
     double **particrel = vote->rvecs[TC_VOTE_PARTIC_REL]->a;
     double **rowbonus = vote->rvecs[TC_VOTE_ROW_BONUS]->a;
-    thisRep.clear();
-    smoothedRep.clear();
-    NARow.clear();
-    particRow.clear();
-    particRel.clear();
-    rowBonus.clear();
-    for(uint32_t i=0; i < nVoters; i++) {
-       thisRep.push_back( (uint64_t) (thisrep[0][i] * 1e8) );
-       smoothedRep.push_back( (uint64_t) (smoothedrep[0][i] * 1e8) );
-       NARow.push_back( (uint64_t) (narow[0][i] * 1e8) );
-       particRow.push_back( (uint64_t) (particrow[0][i] * 1e8) );
-       particRel.push_back( (uint64_t) (particrel[0][i] * 1e8) );
-       rowBonus.push_back( (uint64_t) (rowbonus[0][i] * 1e8) );
+    outcome.thisRep.clear();
+    outcome.smoothedRep.clear();
+    outcome.NARow.clear();
+    outcome.particRow.clear();
+    outcome.particRel.clear();
+    outcome.rowBonus.clear();
+    for(uint32_t i=0; i < outcome.nVoters; i++) {
+       outcome.thisRep.push_back( (uint64_t) (thisrep[i][0] * 1e8) );
+       outcome.smoothedRep.push_back( (uint64_t) (smoothedrep[i][0] * 1e8) );
+       outcome.NARow.push_back( (uint64_t) (narow[i][0] * 1e8) );
+       outcome.particRow.push_back( (uint64_t) (particrow[i][0] * 1e8) );
+       outcome.particRel.push_back( (uint64_t) (particrel[i][0] * 1e8) );
+       outcome.rowBonus.push_back( (uint64_t) (rowbonus[i][0] * 1e8) );
     }
 
     /* column (decisions) outputs */
@@ -394,29 +492,147 @@ int marketOutcome::calc(void)
     double **particcol = vote->cvecs[TC_VOTE_PARTIC_COL]->a;
     double **authorbonus = vote->cvecs[TC_VOTE_AUTHOR_BONUS]->a;
     double **decisionsfinal = vote->cvecs[TC_VOTE_DECISIONS_FINAL]->a;
-    firstLoading.clear();
-    decisionsRaw.clear();
-    consensusReward.clear();
-    certainty.clear();
-    NACol.clear();
-    particCol.clear();
-    authorBonus.clear();
-    decisionsFinal.clear();
-    for(uint32_t i=0; i < nDecisions; i++) {
-        firstLoading.push_back( (uint64_t) (firstloading[i][0] * 1e8) );
-        decisionsRaw.push_back( (uint64_t) (decisionsraw[i][0] * 1e8) );
-        consensusReward.push_back( (uint64_t) (consensusrew[i][0] * 1e8) );
-        certainty.push_back( (uint64_t) (certain[i][0] * 1e8) );
-        NACol.push_back( (uint64_t) (nacol[i][0] * 1e8) );
-        particCol.push_back( (uint64_t) (particcol[i][0] * 1e8) );
-        authorBonus.push_back( (uint64_t) (authorbonus[i][0] * 1e8) );
-        decisionsFinal.push_back( (uint64_t) (decisionsfinal[i][0] * 1e8) );
+    outcome.firstLoading.clear();
+    outcome.decisionsRaw.clear();
+    outcome.consensusReward.clear();
+    outcome.certainty.clear();
+    outcome.NACol.clear();
+    outcome.particCol.clear();
+    outcome.authorBonus.clear();
+    outcome.decisionsFinal.clear();
+    for(uint32_t i=0; i < outcome.nDecisions; i++) {
+        /* the loadings have either sign */
+        outcome.firstLoading.push_back( (uint64_t) (int64_t) (firstloading[0][i] * 1e8) );
+        outcome.decisionsRaw.push_back( (uint64_t) (decisionsraw[0][i] * 1e8) );
+        outcome.consensusReward.push_back( (uint64_t) (consensusrew[0][i] * 1e8) );
+        outcome.certainty.push_back( (uint64_t) (certain[0][i] * 1e8) );
+        outcome.NACol.push_back( (uint64_t) (nacol[0][i] * 1e8) );
+        outcome.particCol.push_back( (uint64_t) (particcol[0][i] * 1e8) );
+        outcome.authorBonus.push_back( (uint64_t) (authorbonus[0][i] * 1e8) );
+        outcome.decisionsFinal.push_back( (uint64_t) (decisionsfinal[0][i] * 1e8) );
     }
+}
 
+/* whether a and b agree to within OUTCOME_VERIFY_SLACK, or to within
+ * it after negating b if fSigned */
+static bool outcomeVecsMatch(const vector<uint64_t> &a, const vector<uint64_t> &b,
+    bool fSigned = false)
+{
+    if (a.size() != b.size())
+        return false;
+    for(int sign=1; sign >= ((fSigned)? -1: 1); sign -= 2) {
+        size_t i = 0;
+        for( ; i < a.size(); i++) {
+            int64_t diff = (int64_t) a[i] - sign * (int64_t) b[i];
+            if ((diff > OUTCOME_VERIFY_SLACK) || (diff < -OUTCOME_VERIFY_SLACK))
+                break;
+        }
+        if (i == a.size())
+            return true;
+    }
+    return false;
+}
+
+/* the outcome's tc_vote processed with its published first loading as
+ * the cert, or NULL if the inputs do not fit or the loading is not the
+ * ballot's. The outputs then depend on the published loading alone. A
+ * known loading, which the vote takes over, is one already worked out
+ * from the same inputs, and the cert need only agree with it. */
+static struct tc_vote *outcomeCertVote(const marketOutcome &outcome,
+    struct tc_mat *known = NULL)
+{
+    if (outcome.firstLoading.size() != outcome.nDecisions) {
+        tc_mat_dtr(known);
+        return NULL;
+    }
+    struct tc_vote *vote = outcomeVoteCtr(outcome);
+    if (!vote) {
+        tc_mat_dtr(known);
+        return NULL;
+    }
+
+    vote->known = known;
+    vote->cert = tc_mat_ctr(outcome.nDecisions, 1);
+    for(uint32_t j=0; j < outcome.nDecisions; j++)
+        vote->cert->a[j][0] = (int64_t) outcome.firstLoading[j] * 1e-8;
+
+    int rc = tc_vote_proc(vote);
+    if ((rc < 0) || !vote->certified) {
+        tc_vote_dtr(vote);
+        return NULL;
+    }
+    return vote;
+}
+
+int marketOutcome::calc(const vector<double> *warm)
+{
+    struct tc_vote *vote = outcomeVoteCtr(*this);
+    if (!vote)
+        return -1;
+
+    /* a first loading worked out in advance, only to be refined */
+    if (warm && (warm->size() == nDecisions)) {
+        vote->warm = tc_mat_ctr(nDecisions, 1);
+        for(uint32_t j=0; j < nDecisions; j++)
+            vote->warm->a[j][0] = (*warm)[j];
+    }
+
+    int rc = tc_vote_proc(vote);
+    if (rc < 0) {
+        /* something is wrong. */
+        tc_vote_dtr(vote);
+        return -1;
+    }
+
+    outcomeSetOutputs(*this, vote);
+    struct tc_mat *known = tc_mat_ctr(0, 0);
+    tc_mat_transpose(known, vote->cvecs[TC_VOTE_FIRST_LOADING]);
+    tc_vote_dtr(vote);
+
+    /* the other outputs are worked out again from the first loading as
+     * published, rounded to 1e-8, which is what verify works from. The
+     * loading itself is not worked out again. */
+    vector<uint64_t> loading = firstLoading;
+    vote = outcomeCertVote(*this, known);
+    if (!vote)
+        return -1;
+    outcomeSetOutputs(*this, vote);
+    firstLoading.swap(loading);
     tc_vote_dtr(vote);
     return 0;
 }
 
+int marketOutcome::verify(void) const
+{
+    /* the published first loading must be the ballot's; every other
+     * output is worked out from it */
+    struct tc_vote *vote = outcomeCertVote(*this);
+    if (!vote)
+        return -1;
+
+    marketOutcome check;
+    check.nVoters = nVoters;
+    check.nDecisions = nDecisions;
+    outcomeSetOutputs(check, vote);
+    tc_vote_dtr(vote);
+
+    if (!outcomeVecsMatch(thisRep, check.thisRep)
+        || !outcomeVecsMatch(smoothedRep, check.smoothedRep)
+        || !outcomeVecsMatch(NARow, check.NARow)
+        || !outcomeVecsMatch(particRow, check.particRow)
+        || !outcomeVecsMatch(particRel, check.particRel)
+        || !outcomeVecsMatch(rowBonus, check.rowBonus)
+        || !outcomeVecsMatch(decisionsRaw, check.decisionsRaw)
+        || !outcomeVecsMatch(consensusReward, check.consensusReward)
+        || !outcomeVecsMatch(certainty, check.certainty)
+        || !outcomeVecsMatch(NACol, check.NACol)
+        || !outcomeVecsMatch(particCol, check.particCol)
+        || !outcomeVecsMatch(authorBonus, check.authorBonus)
+        || !outcomeVecsMatch(decisionsFinal, check.decisionsFinal))
+        return -1;
+    return 0;
+}
+
 string marketSealedVote::ToString(void) const
 {
     stringstream str;
@@ -430,6 +646,33 @@ string marketSealedVote::ToString(void) const
     return str.str();
 }
 
+/* whether a vote counts in the branch's ballot decided at height. The
+ * ballot's decisions end in blocks [height-tau-ballotTime-unsealTime,
+ * height-ballotTime-unsealTime), so the vote is to be sealed after the
+ * first of them ends and within ballotTime of the last, and revealed
+ * in a later block before the ballot is decided.
+ */
+bool marketVoteInTime(const marketBranch &branch, uint32_t height, const marketVoteSeal &seal)
+{
+    if (seal.nSealHeight + branch.tau + branch.ballotTime + branch.unsealTime < height)
+        return false;
+    if (seal.nSealHeight + branch.unsealTime >= height)
+        return false;
+    if (!seal.nRevealHeight || (seal.nRevealHeight <= seal.nSealHeight))
+        return false;
+    return (seal.nRevealHeight < height);
+}
+
+/* the height of the ballot deciding a decision whose event is over by
+ * eventOverBy, as chosen in getOutcomeTx */
+uint32_t marketBallotHeight(const marketBranch &branch, uint32_t eventOverBy)
+{
+    if (!branch.tau)
+        return 0;
+    uint32_t blocknum = eventOverBy + branch.ballotTime + branch.unsealTime;
+    return (blocknum / branch.tau + 1) * branch.tau;
+}
+
 string marketVote::ToString(void) const
 {
     stringstream str;
@@ -160,6 +160,61 @@ struct marketMarket : public marketObj {
 void marketNShares(const vector<marketTrade *> &trades, double &nShares0, double &nShares1);
 double marketAccountValue(double B, double nShares0, double nShares1);
 double marketAccountValue(double B, uint32_t nstates);
+double marketDecisionFunction(int decisionFunctionID, double x);
+double marketStateValue(const marketMarket &market, const vector<double> &decisionsFinal, uint32_t state);
+
+/** Search tokens are lowercased runs of two or more letters and digits,
+ *  indexed at their full length whatever it is */
+vector<string> marketTokenize(const string &text);
+set<string> marketTokens(const marketMarket &market);
+
+/* a holder's settlement of a market, once all its decisions are final */
+struct marketPayout {
+    uint256 marketid;
+    CKeyID keyID;
+    uint32_t nHeight; /* of the block with the outcome settling it */
+    uint256 outcomeid;
+    map<uint32_t, int64_t> nShares; /* net shares held, by state */
+    int64_t payout;
+
+    marketPayout(void) : nHeight(0), payout(0) { }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(marketid);
+        READWRITE(keyID);
+        READWRITE(nHeight);
+        READWRITE(outcomeid);
+        READWRITE(nShares);
+        READWRITE(payout);
+    }
+};
+
+/* an address's net holding of one state of a market */
+struct marketPosition {
+    CKeyID keyID;
+    uint256 marketid;
+    uint32_t decisionState;
+    int64_t nShares; /* bought less sold */
+    int64_t cost; /* paid less received, at the trades' prices */
+    uint32_t nTrades;
+
+    marketPosition(void) : decisionState(0), nShares(0), cost(0), nTrades(0) { }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(keyID);
+        READWRITE(marketid);
+        READWRITE(decisionState);
+        READWRITE(nShares);
+        READWRITE(cost);
+        READWRITE(nTrades);
+    }
+};
 
 struct marketSealedVote : public marketObj {
     uint256 branchid;
@@ -209,6 +264,28 @@ struct marketVote : public marketObj {
     string ToString(void) const;
 };
 
+/* a sealed vote joined with the vote that reveals it, by voteid */
+struct marketVoteSeal {
+    uint256 sealid; /* the sealed vote's id */
+    uint32_t nSealHeight; /* the blocks the two are in */
+    uint32_t nRevealHeight; /* 0 until revealed */
+
+    marketVoteSeal(void) : nSealHeight(0), nRevealHeight(0) { }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(sealid);
+        READWRITE(nSealHeight);
+        READWRITE(nRevealHeight);
+    }
+};
+
+/** The outputs of an outcome may differ from those worked out by a
+ *  validating node by this many 1e-8 units, to allow for rounding. */
+static const int64_t OUTCOME_VERIFY_SLACK = 100;
+
 struct marketOutcome : public marketObj {
     uint256 branchid;
     /* size() == nVoters */
@@ -225,7 +302,7 @@ struct marketOutcome : public marketObj {
     uint32_t nDecisions;
     vector<uint256> decisionIDs;
     vector<uint64_t> isScaled;
-    vector<uint64_t> firstLoading; /* output */
+    vector<uint64_t> firstLoading; /* output, signed */
     vector<uint64_t> decisionsRaw; /* output */
     vector<uint64_t> consensusReward; /* output */
     vector<uint64_t> certainty; /* output */
@@ -276,7 +353,64 @@ struct marketOutcome : public marketObj {
         READWRITE(tol);
     }
     string ToString(void) const;
-    int calc(void);
+    int calc(const vector<double> *warm = NULL);
+    /* check firstLoading is the principal component of the inputs and
+     * the other outputs are the ones worked out from it */
+    int verify(void) const;
+};
+
+/* running totals of a branch, kept as its objects connect and disconnect */
+struct marketBranchStats {
+    uint32_t nDecisions;
+    uint32_t nPendingDecisions; /* not yet in an outcome */
+    uint32_t nMarkets;
+    uint32_t nOpenMarkets; /* not yet matured */
+    uint32_t nTrades;
+    int64_t volume; /* at the trades' prices */
+    int64_t openInterest; /* shares bought less sold */
+    uint32_t nOutcomes;
+    uint32_t nVoters; /* in the latest outcome */
+
+    marketBranchStats(void) : nDecisions(0), nPendingDecisions(0), nMarkets(0),
+        nOpenMarkets(0), nTrades(0), volume(0), openInterest(0), nOutcomes(0),
+        nVoters(0) { }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(nDecisions);
+        READWRITE(nPendingDecisions);
+        READWRITE(nMarkets);
+        READWRITE(nOpenMarkets);
+        READWRITE(nTrades);
+        READWRITE(volume);
+        READWRITE(openInterest);
+        READWRITE(nOutcomes);
+        READWRITE(nVoters);
+    }
+};
+
+/* a voter's reputation on a branch as left by one outcome */
+struct marketReputation {
+    uint32_t nHeight; /* of the block with the outcome */
+    uint256 outcomeid;
+    uint64_t oldRep;
+    uint64_t thisRep;
+    uint64_t smoothedRep; /* the reputation from then on */
+
+    marketReputation(void) : nHeight(0), oldRep(0), thisRep(0), smoothedRep(0) { }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(nHeight);
+        READWRITE(outcomeid);
+        READWRITE(oldRep);
+        READWRITE(thisRep);
+        READWRITE(smoothedRep);
+    }
 };
 
 struct marketBallot : public marketObj {
@@ -334,5 +468,41 @@ struct marketBranch : public marketObj {
     string ToString(void) const;
 };
 
+bool marketVoteInTime(const marketBranch &branch, uint32_t height, const marketVoteSeal &seal);
+uint32_t marketBallotHeight(const marketBranch &branch, uint32_t eventOverBy);
+
+enum marketeventtype {
+	MEVT_DECISION_BALLOT = 'b', /* a decision's event is over, so it goes to ballot */
+	MEVT_MARKET_MATURE = 'm', /* a market stops trading */
+	MEVT_BALLOT_CLOSE = 'c', /* a branch's ballot is decided */
+};
+
+inline string marketEventTypeToString(int i) {
+    if (i == MEVT_DECISION_BALLOT) return "decision entering ballot";
+    if (i == MEVT_MARKET_MATURE) return "market maturing";
+    if (i == MEVT_BALLOT_CLOSE) return "ballot closing";
+    return "";
+}
+
+/* a transition scheduled for a block height */
+struct marketEvent {
+    uint32_t nHeight;
+    char type;
+    uint256 objid; /* the decision, market or (closing ballot) branch */
+    uint256 branchid;
+
+    marketEvent(void) : nHeight(0), type(0) { }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(nHeight);
+        READWRITE(type);
+        READWRITE(objid);
+        READWRITE(branchid);
+    }
+};
+
 
 #endif // TRUTHCOIN_PRIMITIVES_MARKET_H
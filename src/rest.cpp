@@ -7,6 +7,7 @@
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "main.h"
+#include "marketexport.h"
 #include "rpcserver.h"
 #include "streams.h"
 #include "sync.h"
@@ -14,6 +15,8 @@
 #include "version.h"
 
 #include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
 
 using namespace std;
 using namespace json_spirit;
@@ -23,6 +26,7 @@ enum RetFormat {
     RF_BINARY,
     RF_HEX,
     RF_JSON,
+    RF_CSV,
 };
 
 static const struct {
@@ -33,6 +37,7 @@ static const struct {
       {RF_BINARY, "bin"},
       {RF_HEX, "hex"},
       {RF_JSON, "json"},
+      {RF_CSV, "csv"},
 };
 
 class RestErr
@@ -278,6 +283,75 @@ static bool rest_tx(AcceptedConnection* conn,
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+/* the sink's headers go out with the first chunk, so an export that
+ * fails before then is still answered with an error */
+static bool rest_export(AcceptedConnection* conn, enum RetFormat rf, bool fRun,
+                        boost::function<bool (ExportFormat, CExportSink&, std::string&)> exporter)
+{
+    ExportFormat format;
+    const char* contentType;
+    switch (rf) {
+    case RF_BINARY:
+        format = EXPORT_BINARY;
+        contentType = "application/octet-stream";
+        break;
+    case RF_CSV:
+        format = EXPORT_CSV;
+        contentType = "text/csv";
+        break;
+    default:
+        throw RESTERR(HTTP_NOT_FOUND, "output format not found (available: .bin, .csv)");
+    }
+
+    CChunkedHTTPExportSink sink(conn->stream(), fRun, contentType);
+    string strError;
+    if (!exporter(format, sink, strError)) {
+        if (!sink.Started())
+            throw RESTERR(HTTP_NOT_FOUND, strError);
+        return false;
+    }
+    return true;
+}
+
+static bool rest_ballot(AcceptedConnection* conn,
+                        const std::string& strReq,
+                        const std::map<std::string, std::string>& mapHeaders,
+                        bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+    vector<string> path;
+    boost::split(path, params[0], boost::is_any_of("/"));
+
+    if (path.size() != 2)
+        throw RESTERR(HTTP_BAD_REQUEST, "No ballot height specified. Use /rest/ballot/<branchid>/<height>.<ext>.");
+
+    uint256 branchid;
+    if (!ParseHashStr(path[0], branchid))
+        throw RESTERR(HTTP_BAD_REQUEST, "Invalid hash: " + path[0]);
+
+    long height = strtol(path[1].c_str(), NULL, 10);
+    if (height < 1)
+        throw RESTERR(HTTP_BAD_REQUEST, "Ballot height out of range: " + path[1]);
+
+    return rest_export(conn, rf, fRun, boost::bind(ExportBallot, branchid, (uint32_t)height, _1, _2, _3));
+}
+
+static bool rest_outcome(AcceptedConnection* conn,
+                         const std::string& strReq,
+                         const std::map<std::string, std::string>& mapHeaders,
+                         bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+
+    uint256 outcomeid;
+    if (!ParseHashStr(params[0], outcomeid))
+        throw RESTERR(HTTP_BAD_REQUEST, "Invalid hash: " + params[0]);
+
+    return rest_export(conn, rf, fRun, boost::bind(ExportOutcome, outcomeid, _1, _2, _3));
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(AcceptedConnection* conn,
@@ -289,6 +363,8 @@ static const struct {
       {"/rest/block/notxdetails/", rest_block_notxdetails},
       {"/rest/block/", rest_block_extended},
       {"/rest/headers/", rest_headers},
+      {"/rest/ballot/", rest_ballot},
+      {"/rest/outcome/", rest_outcome},
 };
 
 bool HTTPReq_REST(AcceptedConnection* conn,
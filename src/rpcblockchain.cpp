@@ -7,6 +7,7 @@
 #include "checkpoints.h"
 #include "main.h"
 #include "rpcserver.h"
+#include "snapshot.h"
 #include "sync.h"
 #include "util.h"
 
@@ -219,6 +220,48 @@ Value getrawmempool(const Array& params, bool fHelp)
     }
 }
 
+Value getmarketmempool(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getmarketmempool ( marketop )\n"
+            "\nReturns the market objects in memory pool transactions.\n"
+            "\nArguments:\n"
+            "1. marketop          (string, optional) only objects of this type: B, D, M, O, S, T or V\n"
+            "\nResult:\n"
+            "[                     (json array of objects)\n"
+            "  {\n"
+            "    \"objid\" : \"id\",     (string) the market object id\n"
+            "    \"txid\" : \"id\"       (string) the transaction carrying it\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples\n"
+            + HelpExampleCli("getmarketmempool", "T")
+            + HelpExampleRpc("getmarketmempool", "\"T\"")
+        );
+
+    char marketop = 0;
+    if (params.size() > 0) {
+        string strOp = params[0].get_str();
+        if (strOp.size() != 1)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid marketop");
+        marketop = strOp[0];
+    }
+
+    vector<pair<uint256, uint256> > vobj;
+    mempool.queryMarketObjs(marketop, vobj);
+
+    Array a;
+    for (unsigned int i = 0; i < vobj.size(); i++)
+    {
+        Object item;
+        item.push_back(Pair("objid", vobj[i].first.ToString()));
+        item.push_back(Pair("txid", vobj[i].second.ToString()));
+        a.push_back(item);
+    }
+    return a;
+}
+
 Value getblockhash(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -320,7 +363,8 @@ Value gettxoutsetinfo(const Array& params, bool fHelp)
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
             "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
             "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
-            "  \"total_amount\": x.xxx          (numeric) The total amount\n"
+            "  \"total_amount\": x.xxx,         (numeric) The total amount\n"
+            "  \"hash_market\": \"hash\"        (string) The hash of the market index, as a chainstate snapshot commits to it\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
@@ -329,6 +373,9 @@ Value gettxoutsetinfo(const Array& params, bool fHelp)
 
     Object ret;
 
+    // The market index is written as blocks are connected, so cs_main is
+    // held for it to be of the same block as the flushed coins
+    LOCK(cs_main);
     CCoinsStats stats;
     FlushStateToDisk();
     if (pcoinsTip->GetStats(stats)) {
@@ -339,10 +386,55 @@ Value gettxoutsetinfo(const Array& params, bool fHelp)
         ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
         ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
         ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+        uint256 hashMarket;
+        uint64_t nMarketRecords;
+        if (GetMarketIndexHash(stats.hashBlock, hashMarket, nMarketRecords))
+            ret.push_back(Pair("hash_market", hashMarket.GetHex()));
     }
     return ret;
 }
 
+Value dumpchainstate(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "dumpchainstate \"filename\"\n"
+            "\nWrites the chainstate at the tip to a snapshot, from which a new node can start with -loadsnapshot.\n"
+            "The snapshot holds the headers of the active chain, the unspent transaction output set and the market index.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"filename\"    (string, required) The filename\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"height\":n,     (numeric) The height of the snapshot's block\n"
+            "  \"bestblock\": \"hex\",   (string) the snapshot's block hash hex\n"
+            "  \"transactions\": n,      (numeric) The number of transactions with unspent outputs\n"
+            "  \"marketrecords\": n,     (numeric) The number of records of the market index\n"
+            "  \"hash_serialized\": \"hash\",   (string) The serialized hash, as gettxoutsetinfo reports it\n"
+            "  \"hash_market\": \"hash\",       (string) The hash of the market index, as gettxoutsetinfo reports it\n"
+            "  \"hash_file\": \"hash\"          (string) The hash of the snapshot file\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumpchainstate", "\"snapshot.dat\"")
+            + HelpExampleRpc("dumpchainstate", "\"snapshot.dat\"")
+        );
+
+    LOCK(cs_main);
+    CSnapshotInfo info;
+    if (!DumpChainstate(params[0].get_str(), info))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Cannot write chainstate snapshot");
+
+    Object ret;
+    ret.push_back(Pair("height", (int64_t)info.nHeight));
+    ret.push_back(Pair("bestblock", info.hashBlock.GetHex()));
+    ret.push_back(Pair("transactions", (int64_t)info.nTransactions));
+    ret.push_back(Pair("marketrecords", (int64_t)info.nMarketRecords));
+    ret.push_back(Pair("hash_serialized", info.hashSerialized.GetHex()));
+    ret.push_back(Pair("hash_market", info.hashMarket.GetHex()));
+    ret.push_back(Pair("hash_file", info.hashFile.GetHex()));
+    return ret;
+}
+
 Value gettxout(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 3)
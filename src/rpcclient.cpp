@@ -114,6 +114,12 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "createvote", 1 },
     { "createvote", 2 },
     { "getballot", 1 },
+    { "getvoterreputation", 2 },
+    { "getposition", 2 },
+    { "listupcomingevents", 0 },
+    { "searchmarkets", 1 },
+    { "searchmarkets", 2 },
+    { "exportballot", 1 },
     { "getcreatemarketcapitalrequired", 0 },
     { "getcreatemarketcapitalrequired", 1 },
     { "getcreatetradecapitalrequired", 2 },
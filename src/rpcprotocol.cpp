@@ -116,6 +116,24 @@ string HTTPReplyHeader(int nStatus, bool keepalive, size_t contentLength, const
         FormatFullVersion());
 }
 
+string HTTPReplyChunkedHeader(int nStatus, bool keepalive, const char *contentType)
+{
+    return strprintf(
+            "HTTP/1.1 %d %s\r\n"
+            "Date: %s\r\n"
+            "Connection: %s\r\n"
+            "Transfer-Encoding: chunked\r\n"
+            "Content-Type: %s\r\n"
+            "Server: truthcoin-json-rpc/%s\r\n"
+            "\r\n",
+        nStatus,
+        httpStatusDescription(nStatus),
+        rfc1123Time(),
+        keepalive ? "keep-alive" : "close",
+        contentType,
+        FormatFullVersion());
+}
+
 string HTTPReply(int nStatus, const string& strMsg, bool keepalive,
                  bool headersOnly, const char *contentType)
 {
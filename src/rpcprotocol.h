@@ -155,6 +155,8 @@ std::string HTTPReplyHeader(int nStatus, bool keepalive, size_t contentLength,
 std::string HTTPReply(int nStatus, const std::string& strMsg, bool keepalive,
                       bool headerOnly = false,
                       const char *contentType = "application/json");
+std::string HTTPReplyChunkedHeader(int nStatus, bool keepalive,
+                      const char *contentType = "application/json");
 bool ReadHTTPRequestLine(std::basic_istream<char>& stream, int &proto,
                          std::string& http_method, std::string& http_uri);
 int ReadHTTPStatus(std::basic_istream<char>& stream, int &proto);
@@ -266,8 +266,10 @@ static const CRPCCommand vRPCCommands[] =
     { "blockchain",         "getdifficulty",          &getdifficulty,          true,      false,      false },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,      true,       false },
     { "blockchain",         "getrawmempool",          &getrawmempool,          true,      false,      false },
+    { "blockchain",         "getmarketmempool",       &getmarketmempool,       true,      false,      false },
     { "blockchain",         "gettxout",               &gettxout,               true,      false,      false },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,      false,      false },
+    { "blockchain",         "dumpchainstate",         &dumpchainstate,         true,      false,      false },
     { "blockchain",         "verifychain",            &verifychain,            true,      false,      false },
     { "blockchain",         "invalidateblock",        &invalidateblock,        true,      true,       false },
     { "blockchain",         "reconsiderblock",        &reconsiderblock,        true,      true,       false },
@@ -364,6 +366,16 @@ static const CRPCCommand vRPCCommands[] =
     { "market",             "gettrade",               &gettrade,               false,     false,      true },
     { "market",             "getvote",                &getvote,                false,     false,      true },
     { "market",             "getballot",              &getballot,              false,     false,      true },
+    { "market",             "getbranchstats",         &getbranchstats,         false,     false,      true },
+    { "market",             "getvoterreputation",     &getvoterreputation,     false,     false,      true },
+    { "market",             "getpayout",              &getpayout,              false,     false,      true },
+    { "market",             "listpayouts",            &listpayouts,            false,     false,      true },
+    { "market",             "getposition",            &getposition,            false,     false,      true },
+    { "market",             "listpositions",          &listpositions,          false,     false,      true },
+    { "market",             "listupcomingevents",     &listupcomingevents,     false,     false,      true },
+    { "market",             "searchmarkets",          &searchmarkets,          false,     false,      true },
+    { "market",             "exportballot",           &exportballot,           false,     false,      true },
+    { "market",             "exportoutcome",          &exportoutcome,          false,     false,      true },
 
     { "market",             "createbranch",           &createbranch,           false,     false,      true },
     { "market",             "createdecision",         &createdecision,         false,     false,      true },
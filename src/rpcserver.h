@@ -217,9 +217,11 @@ extern json_spirit::Value getdifficulty(const json_spirit::Array& params, bool f
 extern json_spirit::Value settxfee(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getmempoolinfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getrawmempool(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getmarketmempool(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblockhash(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblock(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value gettxoutsetinfo(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value dumpchainstate(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value gettxout(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value verifychain(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getchaintips(const json_spirit::Array& params, bool fHelp);
@@ -240,6 +242,16 @@ extern json_spirit::Value getoutcome(const json_spirit::Array& params, bool fHel
 extern json_spirit::Value gettrade(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getvote(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getballot(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getbranchstats(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getvoterreputation(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getpayout(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value listpayouts(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getposition(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value listpositions(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value listupcomingevents(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value searchmarkets(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value exportballot(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value exportoutcome(const json_spirit::Array& params, bool fHelp);
 
 extern json_spirit::Value createbranch(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value createdecision(const json_spirit::Array& params, bool fHelp);
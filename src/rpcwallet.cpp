@@ -9,6 +9,7 @@
 #include "core_io.h"
 #include "rpcserver.h"
 #include "init.h"
+#include "marketexport.h"
 #include "net.h"
 #include "netbase.h"
 #include "primitives/market.h"
@@ -19,11 +20,13 @@
 #include "wallet.h"
 #include "walletdb.h"
 
+#include <fstream>
 #include <stdint.h>
 
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/assign/list_of.hpp>
+#include <boost/filesystem.hpp>
 #include "json/json_spirit_utils.h"
 #include "json/json_spirit_value.h"
 
@@ -3417,6 +3420,520 @@ Value getballot(const Array &params, bool fHelp)
     return entry;
 }
 
+static Object ReputationToJSON(const marketReputation &rep)
+{
+    Object item;
+    item.push_back(Pair("height", (int)rep.nHeight));
+    item.push_back(Pair("outcomeid", rep.outcomeid.ToString()));
+    item.push_back(Pair("oldRep", ValueFromAmount(rep.oldRep)));
+    item.push_back(Pair("thisRep", ValueFromAmount(rep.thisRep)));
+    item.push_back(Pair("smoothedRep", ValueFromAmount(rep.smoothedRep)));
+    return item;
+}
+
+Value getbranchstats(const Array &params, bool fHelp)
+{
+    string strHelp = 
+        "getbranchstats branchid"
+        "\nReturns the running totals of the branch's decisions, markets,"
+        "\ntrades and outcomes."
+        "\nArguments:"
+        "\n1. branchid     (uint256 string)";
+
+    if (fHelp || (params.size() != 1))
+        throw runtime_error(strHelp);
+
+    if (!pmarkettree) {
+        string strError = std::string("Error: NULL pmarkettree!");
+        throw JSONRPCError(RPC_WALLET_ERROR, strError.c_str());
+    }
+
+    uint256 branchid;
+    branchid.SetHex(params[0].get_str());
+
+    marketBranchStats stats;
+    if (!pmarkettree->GetBranchStats(branchid, stats)) {
+        string strError = std::string("Error: no stats for branchid ")
+            + branchid.ToString() + "!";
+        throw JSONRPCError(RPC_WALLET_ERROR, strError.c_str());
+    }
+
+    Object entry;
+    entry.push_back(Pair("branchid", branchid.ToString()));
+    entry.push_back(Pair("decisions", (int)stats.nDecisions));
+    entry.push_back(Pair("pendingdecisions", (int)stats.nPendingDecisions));
+    entry.push_back(Pair("markets", (int)stats.nMarkets));
+    entry.push_back(Pair("openmarkets", (int)stats.nOpenMarkets));
+    entry.push_back(Pair("trades", (int)stats.nTrades));
+    entry.push_back(Pair("volume", ValueFromAmount(stats.volume)));
+    entry.push_back(Pair("openinterest", ValueFromAmount(stats.openInterest)));
+    entry.push_back(Pair("outcomes", (int)stats.nOutcomes));
+    entry.push_back(Pair("voters", (int)stats.nVoters));
+    return entry;
+}
+
+Value getvoterreputation(const Array &params, bool fHelp)
+{
+    string strHelp = 
+        "getvoterreputation branchid address [history]"
+        "\nReturns the voter's reputation in the branch as of the latest outcome,"
+        "\nand with history, as of every outcome the voter took part in."
+        "\nArguments:"
+        "\n1. branchid     (uint256 string)"
+        "\n2. address      (base58 address)"
+        "\n3. history      (optional, boolean, default=false)";
+
+    if (fHelp || ((params.size() != 2) && (params.size() != 3)))
+        throw runtime_error(strHelp);
+
+    if (!pmarkettree) {
+        string strError = std::string("Error: NULL pmarkettree!");
+        throw JSONRPCError(RPC_WALLET_ERROR, strError.c_str());
+    }
+
+    uint256 branchid;
+    branchid.SetHex(params[0].get_str());
+
+    CTruthcoinAddress address(params[1].get_str());
+    CKeyID keyID;
+    if (!address.IsValid() || !address.GetKeyID(keyID))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid Truthcoin address");
+
+    bool fHistory = false;
+    if (params.size() == 3)
+        fHistory = params[2].get_bool();
+
+    marketReputation rep;
+    if (!pmarkettree->GetReputation(branchid, keyID, rep)) {
+        string strError = std::string("Error: no reputation for ")
+            + address.ToString() + " in branchid " + branchid.ToString() + "!";
+        throw JSONRPCError(RPC_WALLET_ERROR, strError.c_str());
+    }
+
+    Object entry;
+    entry.push_back(Pair("branchid", branchid.ToString()));
+    entry.push_back(Pair("address", address.ToString()));
+    entry.push_back(Pair("reputation", ValueFromAmount(rep.smoothedRep)));
+    entry.push_back(Pair("latest", ReputationToJSON(rep)));
+
+    if (fHistory) {
+        Array array;
+        vector<marketReputation> vec = pmarkettree->GetReputationHistory(branchid, keyID);
+        for(size_t i=0; i < vec.size(); i++)
+            array.push_back(ReputationToJSON(vec[i]));
+        entry.push_back(Pair("history", array));
+    }
+
+    return entry;
+}
+
+static Object PayoutToJSON(const marketPayout &payout)
+{
+    Object item;
+    CTruthcoinAddress address(payout.keyID);
+    item.push_back(Pair("address", address.ToString()));
+    item.push_back(Pair("height", (int)payout.nHeight));
+    item.push_back(Pair("outcomeid", payout.outcomeid.ToString()));
+    Array array;
+    map<uint32_t, int64_t>::const_iterator it;
+    for(it=payout.nShares.begin(); it != payout.nShares.end(); it++) {
+        Object state;
+        state.push_back(Pair("state", (int)it->first));
+        state.push_back(Pair("nShares", ValueFromAmount(it->second)));
+        array.push_back(state);
+    }
+    item.push_back(Pair("shares", array));
+    item.push_back(Pair("payout", ValueFromAmount(payout.payout)));
+    return item;
+}
+
+Value getpayout(const Array &params, bool fHelp)
+{
+    string strHelp = 
+        "getpayout marketid address"
+        "\nReturns what the address holds in the market and is paid for it"
+        "\nonce the market has settled."
+        "\nArguments:"
+        "\n1. marketid     (uint256 string)"
+        "\n2. address      (base58 address)";
+
+    if (fHelp || (params.size() != 2))
+        throw runtime_error(strHelp);
+
+    if (!pmarkettree) {
+        string strError = std::string("Error: NULL pmarkettree!");
+        throw JSONRPCError(RPC_WALLET_ERROR, strError.c_str());
+    }
+
+    uint256 marketid;
+    marketid.SetHex(params[0].get_str());
+
+    CTruthcoinAddress address(params[1].get_str());
+    CKeyID keyID;
+    if (!address.IsValid() || !address.GetKeyID(keyID))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid Truthcoin address");
+
+    marketPayout payout;
+    if (!pmarkettree->GetPayout(marketid, keyID, payout)) {
+        string strError = std::string("Error: no payout for ")
+            + address.ToString() + " in marketid " + marketid.ToString() + "!";
+        throw JSONRPCError(RPC_WALLET_ERROR, strError.c_str());
+    }
+
+    Object entry = PayoutToJSON(payout);
+    entry.insert(entry.begin(), Pair("marketid", marketid.ToString()));
+    return entry;
+}
+
+Value listpayouts(const Array &params, bool fHelp)
+{
+    string strHelp = 
+        "listpayouts marketid"
+        "\nReturns the payouts of every holder of a settled market."
+        "\nArguments:"
+        "\n1. marketid     (uint256 string)";
+
+    if (fHelp || (params.size() != 1))
+        throw runtime_error(strHelp);
+
+    if (!pmarkettree) {
+        string strError = std::string("Error: NULL pmarkettree!");
+        throw JSONRPCError(RPC_WALLET_ERROR, strError.c_str());
+    }
+
+    uint256 marketid;
+    marketid.SetHex(params[0].get_str());
+
+    vector<marketPayout> vec = pmarkettree->GetPayouts(marketid);
+
+    int64_t total = 0;
+    Array array;
+    for(size_t i=0; i < vec.size(); i++) {
+        total += vec[i].payout;
+        array.push_back(PayoutToJSON(vec[i]));
+    }
+
+    Object entry;
+    entry.push_back(Pair("marketid", marketid.ToString()));
+    entry.push_back(Pair("total", ValueFromAmount(total)));
+    entry.push_back(Pair("payouts", array));
+    return entry;
+}
+
+static Object PositionToJSON(const marketPosition &pos)
+{
+    Object item;
+    item.push_back(Pair("marketid", pos.marketid.ToString()));
+    item.push_back(Pair("decisionState", (int)pos.decisionState));
+    item.push_back(Pair("nShares", ValueFromAmount(pos.nShares)));
+    item.push_back(Pair("cost", ValueFromAmount(pos.cost)));
+    item.push_back(Pair("nTrades", (int)pos.nTrades));
+    return item;
+}
+
+Value getposition(const Array &params, bool fHelp)
+{
+    string strHelp = 
+        "getposition marketid address [decision_state]"
+        "\nReturns the address's net shares in the market, in one state"
+        "\nor in each state it has traded."
+        "\nArguments:"
+        "\n1. marketid          (uint256 string)"
+        "\n2. address           (base58 address)"
+        "\n3. decision_state    (optional, numeric)";
+
+    if (fHelp || ((params.size() != 2) && (params.size() != 3)))
+        throw runtime_error(strHelp);
+
+    if (!pmarkettree) {
+        string strError = std::string("Error: NULL pmarkettree!");
+        throw JSONRPCError(RPC_WALLET_ERROR, strError.c_str());
+    }
+
+    uint256 marketid;
+    marketid.SetHex(params[0].get_str());
+
+    CTruthcoinAddress address(params[1].get_str());
+    CKeyID keyID;
+    if (!address.IsValid() || !address.GetKeyID(keyID))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid Truthcoin address");
+
+    vector<marketPosition> vec;
+    if (params.size() == 3) {
+        marketPosition pos;
+        if (pmarkettree->GetPosition(keyID, marketid, params[2].get_int(), pos))
+            vec.push_back(pos);
+    }
+    else
+        vec = pmarkettree->GetPositions(keyID, marketid);
+
+    Array array;
+    for(size_t i=0; i < vec.size(); i++)
+        array.push_back(PositionToJSON(vec[i]));
+
+    Object entry;
+    entry.push_back(Pair("address", address.ToString()));
+    entry.push_back(Pair("marketid", marketid.ToString()));
+    entry.push_back(Pair("positions", array));
+    return entry;
+}
+
+Value listpositions(const Array &params, bool fHelp)
+{
+    string strHelp = 
+        "listpositions address"
+        "\nReturns the address's net shares in every market state it has traded."
+        "\nArguments:"
+        "\n1. address      (base58 address)";
+
+    if (fHelp || (params.size() != 1))
+        throw runtime_error(strHelp);
+
+    if (!pmarkettree) {
+        string strError = std::string("Error: NULL pmarkettree!");
+        throw JSONRPCError(RPC_WALLET_ERROR, strError.c_str());
+    }
+
+    CTruthcoinAddress address(params[0].get_str());
+    CKeyID keyID;
+    if (!address.IsValid() || !address.GetKeyID(keyID))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid Truthcoin address");
+
+    vector<marketPosition> vec = pmarkettree->GetPositions(keyID);
+
+    Array array;
+    for(size_t i=0; i < vec.size(); i++)
+        array.push_back(PositionToJSON(vec[i]));
+
+    Object entry;
+    entry.push_back(Pair("address", address.ToString()));
+    entry.push_back(Pair("positions", array));
+    return entry;
+}
+
+Value listupcomingevents(const Array &params, bool fHelp)
+{
+    string strHelp = 
+        "listupcomingevents [blocks] [branchid]"
+        "\nReturns the decisions entering ballot, markets maturing and"
+        "\nballots closing in the next blocks."
+        "\nArguments:"
+        "\n1. blocks       (optional, numeric, default=144)"
+        "\n2. branchid     (optional, uint256 string)";
+
+    if (fHelp || (params.size() > 2))
+        throw runtime_error(strHelp);
+
+    if (!pmarkettree) {
+        string strError = std::string("Error: NULL pmarkettree!");
+        throw JSONRPCError(RPC_WALLET_ERROR, strError.c_str());
+    }
+
+    uint32_t nBlocks = 144;
+    if (params.size() > 0)
+        nBlocks = (uint32_t) params[0].get_int();
+
+    uint256 branchid;
+    if (params.size() > 1)
+        branchid.SetHex(params[1].get_str());
+
+    uint32_t block_num = 0;
+    {
+        LOCK(cs_main);
+        block_num = chainActive.Height();
+    }
+
+    vector<marketEvent> vec = pmarkettree->GetEvents(block_num + 1, block_num + nBlocks);
+
+    Array array;
+    for(size_t i=0; i < vec.size(); i++) {
+        const marketEvent &event = vec[i];
+        if (!branchid.IsNull() && (event.branchid != branchid))
+            continue;
+        Object item;
+        item.push_back(Pair("height", (int)event.nHeight));
+        item.push_back(Pair("event", marketEventTypeToString(event.type)));
+        item.push_back(Pair("objid", event.objid.ToString()));
+        item.push_back(Pair("branchid", event.branchid.ToString()));
+        array.push_back(item);
+    }
+
+    Object entry;
+    entry.push_back(Pair("height", (int)block_num));
+    entry.push_back(Pair("events", array));
+    return entry;
+}
+
+Value searchmarkets(const Array &params, bool fHelp)
+{
+    string strHelp = 
+        "searchmarkets query [from] [count]"
+        "\nReturns the markets whose title and tags have every word of the"
+        "\nquery. A word ending in '*' matches the words starting with it."
+        "\nArguments:"
+        "\n1. query        (string)"
+        "\n2. from         (optional, numeric, default=0)"
+        "\n3. count        (optional, numeric, default=20)";
+
+    if (fHelp || (params.size() < 1) || (params.size() > 3))
+        throw runtime_error(strHelp);
+
+    if (!pmarkettree) {
+        string strError = std::string("Error: NULL pmarkettree!");
+        throw JSONRPCError(RPC_WALLET_ERROR, strError.c_str());
+    }
+
+    vector<string> words;
+    string query = params[0].get_str();
+    boost::split(words, query, boost::algorithm::is_any_of(" \t"));
+    vector<string> terms;
+    for(size_t i=0; i < words.size(); i++) {
+        const string &word = words[i];
+        bool fPrefix = (word.size() && (word[word.size()-1] == '*'));
+        vector<string> tokens = marketTokenize(word);
+        if (!tokens.size())
+            continue;
+        if (fPrefix)
+            tokens.back() += '*';
+        terms.insert(terms.end(), tokens.begin(), tokens.end());
+    }
+    if (!terms.size())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Error: empty query");
+
+    size_t from = 0;
+    if (params.size() > 1)
+        from = (size_t) params[1].get_int();
+    size_t count = 20;
+    if (params.size() > 2)
+        count = (size_t) params[2].get_int();
+
+    vector<uint256> ids = pmarkettree->SearchMarkets(terms);
+
+    /* only the markets on the page are read */
+    Array array;
+    for(size_t i=from; (i < ids.size()) && (i < from + count); i++) {
+        marketMarket *obj = pmarkettree->GetMarket(ids[i]);
+        if (!obj)
+            continue;
+        Object item;
+        item.push_back(Pair("marketid", ids[i].ToString()));
+        item.push_back(Pair("title", obj->title));
+        item.push_back(Pair("tags", obj->tags));
+        item.push_back(Pair("branchid", obj->branchid.ToString()));
+        item.push_back(Pair("maturation", (int)obj->maturation));
+        array.push_back(item);
+        delete obj;
+    }
+
+    Object entry;
+    entry.push_back(Pair("total", (int)ids.size()));
+    entry.push_back(Pair("from", (int)from));
+    entry.push_back(Pair("markets", array));
+    return entry;
+}
+
+static ExportFormat ExportFormatFromValue(const Array &params, size_t i)
+{
+    if (params.size() <= i)
+        return EXPORT_CSV;
+    string strFormat = params[i].get_str();
+    if (strFormat == "csv")
+        return EXPORT_CSV;
+    if (strFormat == "bin")
+        return EXPORT_BINARY;
+    throw JSONRPCError(RPC_INVALID_PARAMETER, "Error: format is csv or bin");
+}
+
+/* Exports only go to <datadir>/exports, by plain file name, so that an
+ * RPC caller cannot have the node write over files elsewhere. */
+static boost::filesystem::path GetExportPath(const string &strName)
+{
+    boost::filesystem::path name(strName);
+    if (strName.empty() || (name.filename() != name)
+        || (strName == ".") || (strName == ".."))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Error: filename must be a plain file name");
+
+    boost::filesystem::path path = GetDataDir() / "exports";
+    TryCreateDirectory(path);
+    return path / name;
+}
+
+Value exportballot(const Array &params, bool fHelp)
+{
+    string strHelp = 
+        "exportballot branchid height filename [format]"
+        "\nWrites the ballot's vote matrix to a file on the node, a row"
+        "\nper vote as read, without building it in memory."
+        "\nArguments:"
+        "\n1. branchid     (uint256 string)"
+        "\n2. height       (numeric)"
+        "\n3. filename     (string) name of the file in <datadir>/exports"
+        "\n4. format       (optional, csv or bin, default=csv)";
+
+    if (fHelp || (params.size() < 3) || (params.size() > 4))
+        throw runtime_error(strHelp);
+
+    uint256 branchid;
+    branchid.SetHex(params[0].get_str());
+    uint32_t height = (uint32_t) params[1].get_int();
+    ExportFormat format = ExportFormatFromValue(params, 3);
+
+    if (!pmarkettree) {
+        string strError = std::string("Error: NULL pmarkettree!");
+        throw JSONRPCError(RPC_WALLET_ERROR, strError.c_str());
+    }
+
+    boost::filesystem::path path = GetExportPath(params[2].get_str());
+    ofstream file;
+    file.open(path.string().c_str(), std::ios::out | std::ios::binary);
+    if (!file.is_open())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot open export file");
+
+    CStreamExportSink sink(file);
+    string strError;
+    if (!ExportBallot(branchid, height, format, sink, strError))
+        throw JSONRPCError(RPC_WALLET_ERROR, "Error: " + strError);
+    file.close();
+    return Value::null;
+}
+
+Value exportoutcome(const Array &params, bool fHelp)
+{
+    string strHelp = 
+        "exportoutcome outcomeid filename [format]"
+        "\nWrites the outcome's per-decision vectors and a row per voter"
+        "\nto a file on the node."
+        "\nArguments:"
+        "\n1. outcomeid    (uint256 string)"
+        "\n2. filename     (string) name of the file in <datadir>/exports"
+        "\n3. format       (optional, csv or bin, default=csv)";
+
+    if (fHelp || (params.size() < 2) || (params.size() > 3))
+        throw runtime_error(strHelp);
+
+    uint256 outcomeid;
+    outcomeid.SetHex(params[0].get_str());
+    ExportFormat format = ExportFormatFromValue(params, 2);
+
+    if (!pmarkettree) {
+        string strError = std::string("Error: NULL pmarkettree!");
+        throw JSONRPCError(RPC_WALLET_ERROR, strError.c_str());
+    }
+
+    boost::filesystem::path path = GetExportPath(params[1].get_str());
+    ofstream file;
+    file.open(path.string().c_str(), std::ios::out | std::ios::binary);
+    if (!file.is_open())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot open export file");
+
+    CStreamExportSink sink(file);
+    string strError;
+    if (!ExportOutcome(outcomeid, format, sink, strError))
+        throw JSONRPCError(RPC_WALLET_ERROR, "Error: " + strError);
+    file.close();
+    return Value::null;
+}
+
 Value getcreatemarketcapitalrequired(const Array& params, bool fHelp)
 {
     string strHelp = 
@@ -1027,9 +1027,80 @@ public:
     }
 };
 
+/** Stream that hashes what is written to it and/or keeps the bytes */
+class CSigHashWriter
+{
+private:
+    CSHA256 *pctx;
+    std::vector<unsigned char> *pvch;
+
+public:
+    CSigHashWriter(CSHA256 *pctxIn, std::vector<unsigned char> *pvchIn) : pctx(pctxIn), pvch(pvchIn) {}
+
+    CSigHashWriter& write(const char *pch, size_t size) {
+        if (pctx)
+            pctx->Write((const unsigned char*)pch, size);
+        if (pvch)
+            pvch->insert(pvch->end(), pch, pch + size);
+        return (*this);
+    }
+};
+
 } // anon namespace
 
-uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType)
+CPrecomputedSigHash::CPrecomputedSigHash(const CTransaction& txTo)
+{
+    // With nIn past the last input every input is serialized blanked
+    CScript scriptEmpty;
+    CTransactionSignatureSerializer txTmp(txTo, scriptEmpty, txTo.vin.size(), SIGHASH_ALL);
+
+    CSHA256 ctx;
+    CSigHashWriter ssPrefix(&ctx, NULL);
+    ::Serialize(ssPrefix, txTo.nVersion, SER_GETHASH, 0);
+    ::WriteCompactSize(ssPrefix, txTo.vin.size());
+
+    vMidstate.reserve(txTo.vin.size());
+    vInputEnd.reserve(txTo.vin.size());
+    CSigHashWriter ssInputs(&ctx, &vchInputs);
+    for (unsigned int nInput = 0; nInput < txTo.vin.size(); nInput++) {
+        vMidstate.push_back(ctx);
+        txTmp.SerializeInput(ssInputs, nInput, SER_GETHASH, 0);
+        vInputEnd.push_back(vchInputs.size());
+    }
+
+    CSigHashWriter ssTail(NULL, &vchTail);
+    ::WriteCompactSize(ssTail, txTo.vout.size());
+    for (unsigned int nOutput = 0; nOutput < txTo.vout.size(); nOutput++)
+        txTmp.SerializeOutput(ssTail, nOutput, SER_GETHASH, 0);
+    ::Serialize(ssTail, txTo.nLockTime, SER_GETHASH, 0);
+}
+
+bool CPrecomputedSigHash::SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, uint256 &hash) const
+{
+    if ((nHashType & SIGHASH_ANYONECANPAY) || (nHashType & 0x1f) == SIGHASH_SINGLE || (nHashType & 0x1f) == SIGHASH_NONE)
+        return false;
+    if (nIn >= vMidstate.size() || vMidstate.size() != txTo.vin.size())
+        return false;
+
+    // The inputs before nIn are in the midstate; serialize nIn itself
+    CSHA256 ctx(vMidstate[nIn]);
+    CSigHashWriter ss(&ctx, NULL);
+    CTransactionSignatureSerializer txTmp(txTo, scriptCode, nIn, nHashType);
+    txTmp.SerializeInput(ss, nIn, SER_GETHASH, 0);
+
+    // and the bytes after it are the same as for every other input
+    if (vInputEnd[nIn] < vchInputs.size())
+        ctx.Write(&vchInputs[vInputEnd[nIn]], vchInputs.size() - vInputEnd[nIn]);
+    ctx.Write(&vchTail[0], vchTail.size());
+    ::Serialize(ss, nHashType, SER_GETHASH, 0);
+
+    unsigned char buf[CSHA256::OUTPUT_SIZE];
+    ctx.Finalize(buf);
+    CSHA256().Write(buf, CSHA256::OUTPUT_SIZE).Finalize(hash.begin());
+    return true;
+}
+
+uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const CPrecomputedSigHash *precomputed)
 {
     static const uint256 one(uint256S("0000000000000000000000000000000000000000000000000000000000000001"));
     if (nIn >= txTo.vin.size()) {
@@ -1045,6 +1116,10 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
         }
     }
 
+    uint256 hash;
+    if (precomputed && precomputed->SignatureHash(scriptCode, txTo, nIn, nHashType, hash))
+        return hash;
+
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer txTmp(txTo, scriptCode, nIn, nHashType);
 
@@ -1072,7 +1147,7 @@ bool SignatureChecker::CheckSig(const vector<unsigned char>& vchSigIn, const vec
     int nHashType = vchSig.back();
     vchSig.pop_back();
 
-    uint256 sighash = SignatureHash(scriptCode, txTo, nIn, nHashType);
+    uint256 sighash = SignatureHash(scriptCode, txTo, nIn, nHashType, precomputed);
 
     if (!VerifySignature(vchSig, pubkey, sighash))
         return false;
@@ -7,6 +7,7 @@
 #ifndef TRUTHCOIN_SCRIPT_INTERPRETER_H
 #define TRUTHCOIN_SCRIPT_INTERPRETER_H
 
+#include "crypto/sha256.h"
 #include "script_error.h"
 
 #include <vector>
@@ -78,7 +79,30 @@ enum
     SCRIPT_VERIFY_CLEANSTACK = (1U << 8),
 };
 
-uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
+/**
+ * The parts of a transaction's serialization that are the same in the
+ * signature hash of every input: the SHA256 state up to each input, the
+ * inputs with their scripts blanked, and the outputs and nLockTime. Built
+ * once per transaction, it turns each SIGHASH_ALL hash into hashing the
+ * input's own script and the bytes after it, with nothing reserialized.
+ * Read-only once built, so the script check threads can share it.
+ */
+class CPrecomputedSigHash
+{
+private:
+    std::vector<CSHA256> vMidstate;           //! SHA256 state before each input
+    std::vector<unsigned char> vchInputs;     //! every input, script blanked
+    std::vector<size_t> vInputEnd;            //! where each input ends in vchInputs
+    std::vector<unsigned char> vchTail;       //! the outputs and nLockTime
+
+public:
+    CPrecomputedSigHash(const CTransaction& txTo);
+
+    /** False when nHashType does not serialize as SIGHASH_ALL */
+    bool SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, uint256 &hash) const;
+};
+
+uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const CPrecomputedSigHash *precomputed = NULL);
 
 class BaseSignatureChecker
 {
@@ -96,12 +120,13 @@ class SignatureChecker : public BaseSignatureChecker
 private:
     const CTransaction& txTo;
     unsigned int nIn;
+    const CPrecomputedSigHash *precomputed;
 
 protected:
     virtual bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 
 public:
-    SignatureChecker(const CTransaction& txToIn, unsigned int nInIn) : txTo(txToIn), nIn(nInIn) {}
+    SignatureChecker(const CTransaction& txToIn, unsigned int nInIn, const CPrecomputedSigHash *precomputedIn = NULL) : txTo(txToIn), nIn(nInIn), precomputed(precomputedIn) {}
     bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const;
 };
 
@@ -6,79 +6,126 @@
 
 #include "sigcache.h"
 
+#include "crypto/sha256.h"
 #include "pubkey.h"
 #include "random.h"
 #include "uint256.h"
 #include "util.h"
 
-#include <boost/thread.hpp>
-#include <boost/tuple/tuple_comparison.hpp>
+#include <string.h>
+
+#include <algorithm>
+
+#include <boost/thread/locks.hpp>
 
 namespace {
 
-/**
- * Valid signature cache, to avoid doing expensive ECDSA signature checking
- * twice for every transaction (once when accepted into memory pool, and
- * again when accepted into the block chain)
- */
-class CSignatureCache
+/* Some bits of the (already salted) entry, as a number */
+uint64_t EntryBits(const uint256 &entry, size_t pos)
 {
-private:
-     //! sigdata_type is (signature hash, signature, public key):
-    typedef boost::tuple<uint256, std::vector<unsigned char>, CPubKey> sigdata_type;
-    std::set< sigdata_type> setValid;
-    boost::shared_mutex cs_sigcache;
-
-public:
-    bool
-    Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
-    {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
-
-        sigdata_type k(hash, vchSig, pubKey);
-        std::set<sigdata_type>::iterator mi = setValid.find(k);
-        if (mi != setValid.end())
-            return true;
-        return false;
+    uint64_t n;
+    memcpy(&n, entry.begin() + pos, sizeof(n));
+    return n;
+}
+
+CSignatureCache signatureCache;
+
+}
+
+void CSignatureCache::ComputeEntry(uint256 &entry, const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey) const
+{
+    CSHA256 hasher;
+    hasher.Write(nonce.begin(), 32).Write(hash.begin(), 32).Write(pubKey.begin(), pubKey.size());
+    if (!vchSig.empty())
+        hasher.Write(&vchSig[0], vchSig.size());
+    hasher.Finalize(entry.begin());
+}
+
+size_t CSignatureCache::Setup(size_t nMaxBytes)
+{
+    size_t nBuckets = 1;
+    while (nBuckets * 2 * SIGCACHE_BUCKET_SIZE * sizeof(uint256) <= nMaxBytes)
+        nBuckets *= 2;
+
+    for(size_t i=0; i < SIGCACHE_SHARDS; i++)
+        cs_shard[i].lock();
+    nonce = GetRandHash();
+    vEntries.clear();
+    nBucketMask = 0;
+    if (nBuckets * SIGCACHE_BUCKET_SIZE * sizeof(uint256) <= nMaxBytes) {
+        vEntries.resize(nBuckets * SIGCACHE_BUCKET_SIZE);
+        nBucketMask = nBuckets - 1;
     }
+    for(size_t i=0; i < SIGCACHE_SHARDS; i++)
+        cs_shard[i].unlock();
+    return vEntries.size() * sizeof(uint256);
+}
 
-    void Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
-    {
-        // DoS prevention: limit cache size to less than 10MB
-        // (~200 bytes per cache entry times 50,000 entries)
-        // Since there are a maximum of 20,000 signature operations per block
-        // 50,000 is a reasonable default.
-        int64_t nMaxCacheSize = GetArg("-maxsigcachesize", 50000);
-        if (nMaxCacheSize <= 0) return;
-
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-
-        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
-        {
-            // Evict a random entry. Random because that helps
-            // foil would-be DoS attackers who might try to pre-generate
-            // and re-use a set of valid signatures just-slightly-greater
-            // than our cache size.
-            uint256 randomHash = GetRandHash();
-            std::vector<unsigned char> unused;
-            std::set<sigdata_type>::iterator it =
-                setValid.lower_bound(sigdata_type(randomHash, unused, unused));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
-        }
+bool CSignatureCache::Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+{
+    if (vEntries.empty())
+        return false;
+
+    uint256 entry;
+    ComputeEntry(entry, hash, vchSig, pubKey);
+    size_t nBucket = EntryBits(entry, 0) & nBucketMask;
+    boost::shared_lock<boost::shared_mutex> lock(cs_shard[nBucket % SIGCACHE_SHARDS]);
+
+    const uint256 *bucket = &vEntries[nBucket * SIGCACHE_BUCKET_SIZE];
+    for(size_t i=0; i < SIGCACHE_BUCKET_SIZE; i++)
+        if (bucket[i] == entry)
+            return true;
+    return false;
+}
 
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
+void CSignatureCache::Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+{
+    if (vEntries.empty())
+        return;
+
+    uint256 entry;
+    ComputeEntry(entry, hash, vchSig, pubKey);
+    size_t nBucket = EntryBits(entry, 0) & nBucketMask;
+    boost::unique_lock<boost::shared_mutex> lock(cs_shard[nBucket % SIGCACHE_SHARDS]);
+
+    uint256 *bucket = &vEntries[nBucket * SIGCACHE_BUCKET_SIZE];
+    for(size_t i=0; i < SIGCACHE_BUCKET_SIZE; i++) {
+        if (bucket[i] == entry)
+            return;
+        if (bucket[i].IsNull()) {
+            bucket[i] = entry;
+            return;
+        }
     }
-};
+    // Evict an entry picked by other bits of the salted entry, which
+    // is as good as random for anyone who does not know the salt and
+    // foils would-be DoS attackers who might try to pre-generate and
+    // re-use a set of valid signatures.
+    bucket[EntryBits(entry, 8) % SIGCACHE_BUCKET_SIZE] = entry;
+}
 
+size_t InitSignatureCache()
+{
+    int64_t nMaxCacheSize = GetArg("-sigcachesize", DEFAULT_SIG_CACHE_SIZE);
+    size_t nMaxBytes;
+    if (!mapArgs.count("-sigcachesize") && mapArgs.count("-maxsigcachesize")) {
+        /* the older option counted entries, each an entry of the table */
+        int64_t nEntries = std::max(GetArg("-maxsigcachesize", 0), (int64_t)0);
+        nMaxBytes = (size_t)std::min(nEntries, (MAX_SIG_CACHE_SIZE << 20) / (int64_t)sizeof(uint256)) * sizeof(uint256);
+    } else {
+        if (nMaxCacheSize < 0)
+            nMaxCacheSize = 0;
+        else if (nMaxCacheSize > MAX_SIG_CACHE_SIZE)
+            nMaxCacheSize = MAX_SIG_CACHE_SIZE;
+        nMaxBytes = (size_t)nMaxCacheSize << 20;
+    }
+    size_t nBytes = signatureCache.Setup(nMaxBytes);
+    LogPrintf("Using %u kiB of %u kiB for the signature cache\n", nBytes >> 10, nMaxBytes >> 10);
+    return nBytes;
 }
 
 bool CachingSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
-    static CSignatureCache signatureCache;
-
     if (signatureCache.Get(sighash, vchSig, pubkey))
         return true;
 
@@ -8,20 +8,71 @@
 #define TRUTHCOIN_SCRIPT_SIGCACHE_H
 
 #include "script/interpreter.h"
+#include "uint256.h"
 
+#include <stdint.h>
 #include <vector>
 
+#include <boost/thread/shared_mutex.hpp>
+
 class CPubKey;
 
+/** Default for -sigcachesize, in MiB */
+static const unsigned int DEFAULT_SIG_CACHE_SIZE = 32;
+/** Largest -sigcachesize honoured, in MiB */
+static const int64_t MAX_SIG_CACHE_SIZE = 1024;
+
+/** Entries per bucket; a lookup reads one bucket only */
+static const size_t SIGCACHE_BUCKET_SIZE = 4;
+/** Independently locked parts of the table */
+static const size_t SIGCACHE_SHARDS = 64;
+
+/**
+ * Valid signature cache, to avoid doing expensive ECDSA signature checking
+ * twice for every transaction (once when accepted into memory pool, and
+ * again when accepted into the block chain)
+ *
+ * An entry is a salted SHA256 of (signature hash, public key, signature),
+ * 32 bytes, kept in a fixed table of power-of-two many buckets. The salt
+ * is chosen at startup, so nobody can aim entries at one bucket. The
+ * buckets are spread over shards, each behind its own lock, so the script
+ * check threads rarely wait on each other.
+ */
+class CSignatureCache
+{
+private:
+    uint256 nonce;
+    std::vector<uint256> vEntries;
+    size_t nBucketMask;
+    boost::shared_mutex cs_shard[SIGCACHE_SHARDS];
+
+    void ComputeEntry(uint256 &entry, const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey) const;
+
+public:
+    CSignatureCache() : nBucketMask(0) { }
+
+    /** Size the table to at most nMaxBytes, dropping every entry */
+    size_t Setup(size_t nMaxBytes);
+    bool Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey);
+    void Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey);
+};
+
 class CachingSignatureChecker : public SignatureChecker
 {
 private:
     bool store;
 
 public:
-    CachingSignatureChecker(const CTransaction& txToIn, unsigned int nInIn, bool storeIn=true) : SignatureChecker(txToIn, nInIn), store(storeIn) {}
+    CachingSignatureChecker(const CTransaction& txToIn, unsigned int nInIn, bool storeIn=true, const CPrecomputedSigHash *precomputedIn=NULL) : SignatureChecker(txToIn, nInIn, precomputedIn), store(storeIn) {}
 
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 };
 
+/**
+ * Size the signature cache from -sigcachesize, emptying it, and return
+ * its size in bytes. The older -maxsigcachesize, a number of entries,
+ * is still taken if -sigcachesize is not given.
+ */
+size_t InitSignatureCache();
+
 #endif // TRUTHCOIN_SCRIPT_SIGCACHE_H
@@ -0,0 +1,348 @@
+// Copyright (c) 2015 The Truthcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "snapshot.h"
+
+#include "chainparams.h"
+#include "clientversion.h"
+#include "coins.h"
+#include "hash.h"
+#include "main.h"
+#include "streams.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <deque>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <boost/ref.hpp>
+#include <boost/scoped_ptr.hpp>
+
+/** Reads or writes a file, hashing everything that passes through */
+class CHashedFile
+{
+private:
+    CAutoFile &file;
+    CHashWriter hasher;
+
+public:
+    CHashedFile(CAutoFile &fileIn) : file(fileIn), hasher(SER_GETHASH, 0) {}
+
+    int GetType()                { return file.GetType(); }
+    int GetVersion()             { return file.GetVersion(); }
+
+    CHashedFile& read(char* pch, size_t nSize)
+    {
+        file.read(pch, nSize);
+        hasher.write(pch, nSize);
+        return (*this);
+    }
+
+    CHashedFile& write(const char* pch, size_t nSize)
+    {
+        file.write(pch, nSize);
+        hasher.write(pch, nSize);
+        return (*this);
+    }
+
+    //! The hash of what passed through so far; invalidates the object
+    uint256 GetHash() { return hasher.GetHash(); }
+
+    template<typename T>
+    CHashedFile& operator<<(const T& obj)
+    {
+        ::Serialize(*this, obj, GetType(), GetVersion());
+        return (*this);
+    }
+
+    template<typename T>
+    CHashedFile& operator>>(T& obj)
+    {
+        ::Unserialize(*this, obj, GetType(), GetVersion());
+        return (*this);
+    }
+};
+
+/** Writes the coins handed to it by ForEachCoins to a snapshot */
+class CSnapshotCoinsWriter
+{
+private:
+    CHashedFile &file;
+
+public:
+    uint64_t nWritten;
+
+    CSnapshotCoinsWriter(CHashedFile &fileIn) : file(fileIn), nWritten(0) {}
+
+    bool operator()(const uint256 &txid, const CCoins &coins)
+    {
+        file << txid << coins;
+        nWritten++;
+        return true;
+    }
+};
+
+/** Erases the coins handed to it by ForEachCoins from the coin database, a batch at a time */
+class CSnapshotCoinsEraser
+{
+private:
+    CCoinsMap mapCoins;
+
+public:
+    bool operator()(const uint256 &txid, const CCoins &coins)
+    {
+        // An entry left pruned is erased when written
+        mapCoins[txid].flags = CCoinsCacheEntry::DIRTY;
+        if (mapCoins.size() >= SNAPSHOT_BATCH_SIZE)
+            return Flush();
+        return true;
+    }
+
+    bool Flush()
+    {
+        bool fOk = pcoinsdbview->BatchWrite(mapCoins, uint256());
+        mapCoins.clear();
+        return fOk;
+    }
+};
+
+/** Whether a market database key is part of the chainstate, rather than the block file bookkeeping or a flag */
+static bool IsMarketRecord(const leveldb::Slice &slKey)
+{
+    if (slKey.empty())
+        return false;
+    char chType = slKey[0];
+    return chType != 'f' && chType != 'l' && chType != 'R' && chType != 'F';
+}
+
+bool GetMarketIndexHash(const uint256 &hashBlock, uint256 &hash, uint64_t &nRecords)
+{
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << hashBlock;
+    nRecords = 0;
+    try {
+        boost::scoped_ptr<leveldb::Iterator> pcursor(pmarkettree->NewIterator());
+        for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
+            if (IsMarketRecord(pcursor->key())) {
+                ss << pcursor->key().ToString() << pcursor->value().ToString();
+                nRecords++;
+            }
+        }
+    } catch (const std::exception& e) {
+        return error("%s : failed to read the market database - %s", __func__, e.what());
+    }
+    hash = ss.GetHash();
+    return true;
+}
+
+bool DumpChainstate(const boost::filesystem::path &path, CSnapshotInfo &info)
+{
+    AssertLockHeld(cs_main);
+
+    // Bring the coins database up to the tip, where the market index is kept
+    FlushStateToDisk();
+    CCoinsStats stats;
+    if (!pcoinsTip->GetStats(stats))
+        return error("%s : cannot read the coin database", __func__);
+    if (stats.hashBlock != chainActive.Tip()->GetBlockHash())
+        return error("%s : coin database is not at the tip", __func__);
+
+    uint256 hashMarket;
+    uint64_t nMarketRecords;
+    if (!GetMarketIndexHash(stats.hashBlock, hashMarket, nMarketRecords))
+        return false;
+
+    CAutoFile fileout(fopen(path.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return error("%s : cannot open %s", __func__, path.string());
+    CHashedFile hashout(fileout);
+    try {
+        hashout << FLATDATA(Params().MessageStart()) << SNAPSHOT_VERSION;
+        hashout << stats.hashBlock << chainActive.Height() << fMarketIndex;
+
+        // The headers above genesis, each with the number of its transactions
+        hashout << (uint64_t)chainActive.Height();
+        for (CBlockIndex *pindex = chainActive[1]; pindex; pindex = chainActive.Next(pindex))
+            hashout << pindex->GetBlockHeader() << VARINT(pindex->nTx);
+
+        hashout << stats.nTransactions;
+        CSnapshotCoinsWriter writer(hashout);
+        if (!pcoinsTip->ForEachCoins(boost::ref(writer)) || writer.nWritten != stats.nTransactions)
+            return error("%s : cannot read the coin database", __func__);
+
+        hashout << nMarketRecords;
+        boost::scoped_ptr<leveldb::Iterator> pcursor(pmarkettree->NewIterator());
+        for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next())
+            if (IsMarketRecord(pcursor->key()))
+                hashout << pcursor->key().ToString() << pcursor->value().ToString();
+
+        hashout << stats.hashSerialized << hashMarket;
+        info.hashFile = hashout.GetHash();
+        fileout << info.hashFile;
+    } catch (const std::exception& e) {
+        return error("%s : I/O error - %s", __func__, e.what());
+    }
+    FileCommit(fileout.Get());
+
+    info.hashBlock = stats.hashBlock;
+    info.nHeight = chainActive.Height();
+    info.nTransactions = stats.nTransactions;
+    info.nMarketRecords = nMarketRecords;
+    info.hashSerialized = stats.hashSerialized;
+    info.hashMarket = hashMarket;
+    LogPrintf("%s: wrote snapshot of block %s at height %d to %s\n", __func__, info.hashBlock.ToString(), info.nHeight, path.string());
+    return true;
+}
+
+bool LoadChainstate(const boost::filesystem::path &path, CSnapshotInfo &info)
+{
+    LOCK(cs_main);
+    assert(chainActive.Genesis() != NULL);
+
+    CAutoFile filein(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s : cannot open %s", __func__, path.string());
+    CHashedFile hashin(filein);
+
+    // Until the load is complete, the databases are of neither chainstate
+    pblocktree->WriteFlag("loadingsnapshot", true);
+
+    // Clear out the coins and market records there are: those of the
+    // genesis block, or what an interrupted load left
+    CSnapshotCoinsEraser eraser;
+    if (!pcoinsdbview->ForEachCoins(boost::ref(eraser)) || !eraser.Flush())
+        return error("%s : failed to clear the coin database", __func__);
+    try {
+        boost::scoped_ptr<leveldb::Iterator> pcursor(pmarkettree->NewIterator());
+        CLevelDBBatch batch;
+        for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next())
+            if (IsMarketRecord(pcursor->key()))
+                batch.EraseRaw(pcursor->key().ToString());
+        pmarkettree->WriteBatch(batch);
+    } catch (const std::exception& e) {
+        return error("%s : failed to clear the market database - %s", __func__, e.what());
+    }
+
+    bool fMarket;
+    std::vector<CDiskBlockIndex> vBlocks;
+    std::deque<uint256> vHashes;
+    std::deque<CBlockIndex> vIndex;
+    CCoinsMap mapCoins;
+    try {
+        unsigned char pchMessageStart[MESSAGE_START_SIZE];
+        int nVersion;
+        hashin >> FLATDATA(pchMessageStart) >> nVersion;
+        if (memcmp(pchMessageStart, Params().MessageStart(), MESSAGE_START_SIZE))
+            return error("%s : snapshot is of another network", __func__);
+        if (nVersion != SNAPSHOT_VERSION)
+            return error("%s : unknown snapshot version %d", __func__, nVersion);
+        hashin >> info.hashBlock >> info.nHeight >> fMarket;
+
+        // The headers, which must extend our genesis block up to the
+        // snapshot's and pass the checks AcceptBlockHeader makes, against
+        // an index of their own
+        uint64_t nHeaders;
+        hashin >> nHeaders;
+        if (nHeaders != (uint64_t)info.nHeight || info.nHeight <= 0)
+            return error("%s : snapshot has %u headers for height %d", __func__, (unsigned int)nHeaders, info.nHeight);
+        vBlocks.reserve(nHeaders);
+        CBlockIndex *pindexPrev = chainActive.Genesis();
+        for (int nHeight = 1; nHeight <= info.nHeight; nHeight++) {
+            CBlockHeader header;
+            unsigned int nTx;
+            hashin >> header >> VARINT(nTx);
+            if (header.hashPrevBlock != pindexPrev->GetBlockHash())
+                return error("%s : headers do not connect at height %d", __func__, nHeight);
+            CValidationState state;
+            if (!CheckBlockHeader(header, state) || !ContextualCheckBlockHeader(header, state, pindexPrev))
+                return error("%s : invalid header at height %d", __func__, nHeight);
+            vHashes.push_back(header.GetHash());
+            vIndex.push_back(CBlockIndex(header));
+            CBlockIndex &index = vIndex.back();
+            index.phashBlock = &vHashes.back();
+            index.pprev = pindexPrev;
+            index.nHeight = nHeight;
+            index.nTx = nTx;
+            index.nStatus = BLOCK_VALID_SCRIPTS | BLOCK_IN_SNAPSHOT;
+            vBlocks.push_back(CDiskBlockIndex(&index));
+            pindexPrev = &index;
+        }
+        if (pindexPrev->GetBlockHash() != info.hashBlock)
+            return error("%s : headers do not end in the snapshot's block", __func__);
+
+        // The coins, hashed as GetStats does. The last batch is kept back, to
+        // be written along with the best block once all is checked.
+        CCoinsStats stats;
+        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        ss << info.hashBlock;
+        hashin >> info.nTransactions;
+        for (uint64_t n = 0; n < info.nTransactions; n++) {
+            uint256 txid;
+            CCoins coins;
+            hashin >> txid >> coins;
+            ApplyCoinsStats(stats, ss, txid, coins);
+            CCoinsCacheEntry &entry = mapCoins[txid];
+            entry.coins.swap(coins);
+            entry.flags = CCoinsCacheEntry::DIRTY;
+            if (mapCoins.size() >= SNAPSHOT_BATCH_SIZE) {
+                if (!pcoinsdbview->BatchWrite(mapCoins, uint256()))
+                    return error("%s : failed to write to coin database", __func__);
+                mapCoins.clear();
+            }
+        }
+
+        // The market records, hashed as GetMarketIndexHash does
+        CHashWriter ssMarket(SER_GETHASH, PROTOCOL_VERSION);
+        ssMarket << info.hashBlock;
+        hashin >> info.nMarketRecords;
+        for (uint64_t n = 0; n < info.nMarketRecords; ) {
+            CLevelDBBatch batch;
+            for (unsigned int i = 0; i < SNAPSHOT_BATCH_SIZE && n < info.nMarketRecords; i++, n++) {
+                std::string strKey, strValue;
+                hashin >> strKey >> strValue;
+                if (!IsMarketRecord(strKey))
+                    return error("%s : snapshot has a market record with an invalid key", __func__);
+                ssMarket << strKey << strValue;
+                batch.WriteRaw(strKey, strValue);
+            }
+            pmarkettree->WriteBatch(batch);
+        }
+
+        hashin >> info.hashSerialized >> info.hashMarket;
+        uint256 hashFile = hashin.GetHash();
+        filein >> info.hashFile;
+        if (hashFile != info.hashFile)
+            return error("%s : snapshot file is corrupt", __func__);
+        if (ss.GetHash() != info.hashSerialized)
+            return error("%s : snapshot coins do not match their hash", __func__);
+        if (ssMarket.GetHash() != info.hashMarket)
+            return error("%s : snapshot market records do not match their hash", __func__);
+    } catch (const std::exception& e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+
+    // Make the snapshot's chain current: its headers first, then its coins
+    // along with their best block
+    int nLastFile = 0;
+    pblocktree->ReadLastBlockFile(nLastFile);
+    if (!pblocktree->WriteBatchSync(std::vector<std::pair<int, CBlockFileInfo> >(), nLastFile, vBlocks))
+        return error("%s : failed to write to block index database", __func__);
+    pmarkettree->WriteFlag("market", fMarket);
+    if (!pcoinsdbview->BatchWrite(mapCoins, info.hashBlock))
+        return error("%s : failed to write to coin database", __func__);
+    pblocktree->WriteFlag("loadingsnapshot", false);
+
+    LogPrintf("%s: loaded snapshot of block %s at height %d, %u transactions, hash_serialized %s, hash_market %s\n", __func__,
+        info.hashBlock.ToString(), info.nHeight, (unsigned int)info.nTransactions, info.hashSerialized.ToString(), info.hashMarket.ToString());
+    return true;
+}
+
+bool IsLoadingChainstate()
+{
+    bool fLoading = false;
+    pblocktree->ReadFlag("loadingsnapshot", fLoading);
+    return fLoading;
+}
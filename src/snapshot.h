@@ -0,0 +1,70 @@
+// Copyright (c) 2015 The Truthcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef TRUTHCOIN_SNAPSHOT_H
+#define TRUTHCOIN_SNAPSHOT_H
+
+#include "uint256.h"
+
+#include <stdint.h>
+
+#include <boost/filesystem/path.hpp>
+
+/** Version of the chainstate snapshot format */
+static const int SNAPSHOT_VERSION = 1;
+
+/** Coins or market records at most written to a database in one batch while loading */
+static const unsigned int SNAPSHOT_BATCH_SIZE = 100000;
+
+/** What a chainstate snapshot holds, as reported by dumpchainstate */
+struct CSnapshotInfo
+{
+    uint256 hashBlock;
+    int nHeight;
+    uint64_t nTransactions;
+    uint64_t nMarketRecords;
+    //! The hash of the unspent outputs, as gettxoutsetinfo reports it
+    uint256 hashSerialized;
+    //! The hash of the market records, as gettxoutsetinfo reports it
+    uint256 hashMarket;
+    uint256 hashFile;
+
+    CSnapshotInfo() : nHeight(0), nTransactions(0), nMarketRecords(0) {}
+};
+
+/**
+ * Chainstate snapshots let a new node start at a recent block instead of
+ * downloading and connecting the whole chain: a snapshot holds the headers
+ * of the active chain, every transaction with unspent outputs and the
+ * market index, and closes with the gettxoutsetinfo hashes of the coins
+ * and of the market records, and a hash of the whole file.
+ *
+ * The blocks below the snapshot's are never downloaded; they are marked
+ * BLOCK_IN_SNAPSHOT, cannot be served to peers, and the chain cannot be
+ * reorganized below the snapshot's block, forks from there on being taken
+ * as invalid. Whoever loads a snapshot should compare the hash_serialized
+ * and hash_market it logs with gettxoutsetinfo on a node they trust, as
+ * both cover the block hash and so the whole header chain.
+ */
+
+/**
+ * The hash of the market records at hashBlock, in key order, and how many
+ * there are. The market database must be flushed up to hashBlock.
+ */
+bool GetMarketIndexHash(const uint256 &hashBlock, uint256 &hash, uint64_t &nRecords);
+
+/** Write the chainstate at the tip to a snapshot. Needs cs_main. */
+bool DumpChainstate(const boost::filesystem::path &path, CSnapshotInfo &info);
+
+/**
+ * Load a snapshot into the databases of a node that has not gone beyond
+ * genesis, replacing the coins and market records they hold. The block
+ * index must be loaded again after.
+ */
+bool LoadChainstate(const boost::filesystem::path &path, CSnapshotInfo &info);
+
+/** Whether a snapshot load was interrupted, the databases being unusable until it is done again */
+bool IsLoadingChainstate();
+
+#endif // TRUTHCOIN_SNAPSHOT_H
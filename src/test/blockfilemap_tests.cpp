@@ -0,0 +1,169 @@
+// Copyright (c) 2015 The Truthcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+
+#include "main.h"
+#include "streams.h"
+#include "test/test_truthcoin.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+/** A block file of its own, far above the ones the chain writes */
+static const int nScratchFile = 99990;
+
+static void AppendScratch(const std::string &str, int nFile = nScratchFile)
+{
+    FILE *file = OpenBlockFile(CDiskBlockPos(nFile, 0));
+    BOOST_REQUIRE(file);
+    fseek(file, 0, SEEK_END);
+    BOOST_REQUIRE_EQUAL(fwrite(str.data(), 1, str.size(), file), str.size());
+    fclose(file);
+}
+
+static std::string MappedString(const boost::shared_ptr<const CMappedFile> &mapped)
+{
+    return std::string(mapped->begin(), mapped->begin() + mapped->size());
+}
+
+BOOST_AUTO_TEST_SUITE(blockfilemap_tests)
+
+BOOST_AUTO_TEST_CASE(blockfilemap_read)
+{
+    CTestChainstate chainstate;
+
+    /* blocks are read back as they are mined, so that the file has grown
+     * past the mapping made for the earlier ones every time */
+    for (int n = 0; n < 10; n++) {
+        MineBlocks(1);
+        for (CBlockIndex *pindex = chainActive.Genesis(); pindex; pindex = chainActive.Next(pindex)) {
+            CBlock blockMapped;
+            BOOST_REQUIRE(ReadBlockFromDisk(blockMapped, pindex));
+
+            CBlock blockFile;
+            CAutoFile filein(OpenBlockFile(pindex->GetBlockPos(), true), SER_DISK, CLIENT_VERSION);
+            BOOST_REQUIRE(!filein.IsNull());
+            filein >> blockFile;
+
+            BOOST_CHECK(blockMapped.GetHash() == pindex->GetBlockHash());
+            CDataStream ssMapped(SER_DISK, CLIENT_VERSION);
+            CDataStream ssFile(SER_DISK, CLIENT_VERSION);
+            ssMapped << blockMapped;
+            ssFile << blockFile;
+            BOOST_CHECK(ssMapped.str() == ssFile.str());
+        }
+    }
+
+    /* positions past the end of the file are not found in it */
+    CBlock block;
+    CDiskBlockPos pos = chainActive.Tip()->GetBlockPos();
+    pos.nPos += 1 << 20;
+    BOOST_CHECK(!ReadBlockFromDisk(block, pos));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilemap_grow)
+{
+    boost::filesystem::path path = GetBlockPosFilename(CDiskBlockPos(nScratchFile, 0), "blk");
+    TryCreateDirectory(path.parent_path());
+    boost::filesystem::remove(path);
+
+    CBlockFileMap map;
+    BOOST_CHECK(!map.Get(nScratchFile, 1));
+
+    AppendScratch("first");
+    boost::shared_ptr<const CMappedFile> mapped = map.Get(nScratchFile, 5);
+    BOOST_REQUIRE(mapped);
+    BOOST_CHECK_EQUAL(MappedString(mapped), "first");
+
+    /* as long as it covers what is asked for, the mapping is kept */
+    AppendScratch("second");
+    BOOST_CHECK(map.Get(nScratchFile, 3) == mapped);
+    BOOST_CHECK(map.Get(nScratchFile, 5) == mapped);
+
+    /* past it, the grown file is mapped again, and the old mapping stays
+     * readable for whoever still holds it */
+    boost::shared_ptr<const CMappedFile> grown = map.Get(nScratchFile, 11);
+    BOOST_REQUIRE(grown);
+    BOOST_CHECK(grown != mapped);
+    BOOST_CHECK_EQUAL(MappedString(grown), "firstsecond");
+    BOOST_CHECK_EQUAL(MappedString(mapped), "first");
+    BOOST_CHECK(map.Get(nScratchFile, 11) == grown);
+
+    /* nor is more mapped than the file holds */
+    BOOST_CHECK(!map.Get(nScratchFile, 12));
+
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilemap_forget)
+{
+    boost::filesystem::path path = GetBlockPosFilename(CDiskBlockPos(nScratchFile, 0), "blk");
+    TryCreateDirectory(path.parent_path());
+    boost::filesystem::remove(path);
+
+    CBlockFileMap map;
+    AppendScratch("firstsecond");
+    boost::shared_ptr<const CMappedFile> mapped = map.Get(nScratchFile, 11);
+    BOOST_REQUIRE(mapped);
+
+    /* truncated as FlushBlockFile finalizes a file: without Forget, the
+     * map would keep handing out the mapping past the new end */
+    map.Forget(nScratchFile);
+    FILE *file = OpenBlockFile(CDiskBlockPos(nScratchFile, 0));
+    BOOST_REQUIRE(file);
+    BOOST_CHECK(TruncateFile(file, 5));
+    fclose(file);
+
+    boost::shared_ptr<const CMappedFile> truncated = map.Get(nScratchFile, 5);
+    BOOST_REQUIRE(truncated);
+    BOOST_CHECK(truncated != mapped);
+    BOOST_CHECK_EQUAL(truncated->size(), 5U);
+    BOOST_CHECK_EQUAL(MappedString(truncated), "first");
+
+    /* forgetting a file that is not mapped does nothing */
+    map.Forget(nScratchFile + 1);
+    BOOST_CHECK(map.Get(nScratchFile, 5) == truncated);
+
+    /* and Clear drops them all */
+    map.Clear();
+    BOOST_CHECK(map.Get(nScratchFile, 5) != truncated);
+
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilemap_evict)
+{
+    boost::filesystem::path path = GetBlockPosFilename(CDiskBlockPos(nScratchFile, 0), "blk");
+    boost::filesystem::path pathNext = GetBlockPosFilename(CDiskBlockPos(nScratchFile + 1, 0), "blk");
+    TryCreateDirectory(path.parent_path());
+    boost::filesystem::remove(path);
+    boost::filesystem::remove(pathNext);
+    AppendScratch("first");
+    AppendScratch("next", nScratchFile + 1);
+
+    /* with room for a single file, mapping another drops the first, which
+     * stays readable for as long as it is held */
+    CBlockFileMap map(1);
+    boost::shared_ptr<const CMappedFile> mapped = map.Get(nScratchFile, 5);
+    BOOST_REQUIRE(mapped);
+    BOOST_REQUIRE(map.Get(nScratchFile + 1, 1));
+    boost::shared_ptr<const CMappedFile> again = map.Get(nScratchFile, 5);
+    BOOST_REQUIRE(again);
+    BOOST_CHECK(again != mapped);
+    BOOST_CHECK_EQUAL(MappedString(mapped), "first");
+    BOOST_CHECK_EQUAL(MappedString(again), "first");
+
+    boost::filesystem::remove(path);
+    boost::filesystem::remove(pathNext);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
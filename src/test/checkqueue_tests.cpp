@@ -0,0 +1,97 @@
+// Copyright (c) 2015 The Truthcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+
+#include "random.h"
+
+#include <vector>
+
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+/** A check that counts how often it ran and fails when told to */
+class CCountingCheck
+{
+private:
+    boost::mutex *pmutex;
+    unsigned int *pnCount;
+    bool fOk;
+
+public:
+    CCountingCheck() : pmutex(NULL), pnCount(NULL), fOk(true) {}
+    CCountingCheck(boost::mutex *pmutexIn, unsigned int *pnCountIn, bool fOkIn) : pmutex(pmutexIn), pnCount(pnCountIn), fOk(fOkIn) {}
+
+    bool operator()()
+    {
+        boost::unique_lock<boost::mutex> lock(*pmutex);
+        (*pnCount)++;
+        return fOk;
+    }
+
+    void swap(CCountingCheck &check)
+    {
+        std::swap(pmutex, check.pmutex);
+        std::swap(pnCount, check.pnCount);
+        std::swap(fOk, check.fOk);
+    }
+};
+
+static CCheckQueue<CCountingCheck> queue(8, 5);
+
+static void QueueThread()
+{
+    queue.Thread();
+}
+
+BOOST_AUTO_TEST_SUITE(checkqueue_tests)
+
+BOOST_AUTO_TEST_CASE(checkqueue_all_checks_run)
+{
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 4; i++)
+        threadGroup.create_thread(&QueueThread);
+
+    boost::mutex mutex;
+    for (int nRound = 0; nRound < 50; nRound++) {
+        unsigned int nCount = 0, nAdded = 0;
+        {
+            CCheckQueueControl<CCountingCheck> control(&queue);
+            for (int nBatch = insecure_rand() % 20; nBatch >= 0; nBatch--) {
+                std::vector<CCountingCheck> vChecks(insecure_rand() % 100, CCountingCheck(&mutex, &nCount, true));
+                nAdded += vChecks.size();
+                control.Add(vChecks);
+            }
+            BOOST_CHECK(control.Wait());
+        }
+        BOOST_CHECK_EQUAL(nCount, nAdded);
+    }
+
+    // A failure is reported, and does not leak into the next round
+    for (int nRound = 0; nRound < 50; nRound++) {
+        unsigned int nCount = 0, nAdded = 0;
+        {
+            CCheckQueueControl<CCountingCheck> control(&queue);
+            for (int nBatch = 0; nBatch < 10; nBatch++) {
+                std::vector<CCountingCheck> vChecks(50, CCountingCheck(&mutex, &nCount, true));
+                if (nBatch == nRound % 10)
+                    vChecks[insecure_rand() % 50] = CCountingCheck(&mutex, &nCount, false);
+                nAdded += vChecks.size();
+                control.Add(vChecks);
+            }
+            BOOST_CHECK(!control.Wait());
+        }
+        BOOST_CHECK(nCount <= nAdded);
+
+        CCheckQueueControl<CCountingCheck> control(&queue);
+        std::vector<CCountingCheck> vChecks(10, CCountingCheck(&mutex, &nCount, true));
+        control.Add(vChecks);
+        BOOST_CHECK(control.Wait());
+    }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
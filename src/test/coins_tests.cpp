@@ -4,13 +4,18 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "coins.h"
+#include "coinsprefetch.h"
+#include "primitives/block.h"
 #include "random.h"
+#include "txdb.h"
 #include "uint256.h"
 
 #include <vector>
 #include <map>
 
+#include <boost/bind.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 namespace
 {
@@ -59,6 +64,22 @@ public:
 
     bool GetStats(CCoinsStats& stats) const { return false; }
 };
+
+class CCoinsViewCacheTest : public CCoinsViewCache
+{
+public:
+    CCoinsViewCacheTest(CCoinsView* base) : CCoinsViewCache(base) {}
+
+    void SelfTest() const
+    {
+        // Manually recompute the dynamic usage of the whole data, and compare it.
+        size_t ret = cacheCoins.dynamic_usage();
+        for (CCoinsMap::const_iterator it = cacheCoins.begin(); it != cacheCoins.end(); it++) {
+            ret += it->second.coins.DynamicMemoryUsage();
+        }
+        BOOST_CHECK_EQUAL(DynamicMemoryUsage(), ret);
+    }
+};
 }
 
 BOOST_AUTO_TEST_SUITE(coins_tests)
@@ -90,8 +111,8 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
 
     // The cache stack.
     CCoinsViewTest base; // A CCoinsViewTest at the bottom.
-    std::vector<CCoinsViewCache*> stack; // A stack of CCoinsViewCaches on top.
-    stack.push_back(new CCoinsViewCache(&base)); // Start with one cache.
+    std::vector<CCoinsViewCacheTest*> stack; // A stack of CCoinsViewCaches on top.
+    stack.push_back(new CCoinsViewCacheTest(&base)); // Start with one cache.
 
     // Use a limited set of random transaction ids, so we do test overwriting entries.
     std::vector<uint256> txids;
@@ -136,6 +157,9 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
                     missed_an_entry = true;
                 }
             }
+            BOOST_FOREACH(const CCoinsViewCacheTest *test, stack) {
+                test->SelfTest();
+            }
         }
 
         if (insecure_rand() % 100 == 0) {
@@ -152,7 +176,7 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
                 } else {
                     removed_all_caches = true;
                 }
-                stack.push_back(new CCoinsViewCache(tip));
+                stack.push_back(new CCoinsViewCacheTest(tip));
                 if (stack.size() == 4) {
                     reached_4_caches = true;
                 }
@@ -176,4 +200,97 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(missed_an_entry);
 }
 
+// Test that the prefetcher brings the coins a block spends into the cache,
+// leaving alone those the cache holds and those the block creates itself.
+BOOST_AUTO_TEST_CASE(coins_prefetch_test)
+{
+    CCoinsViewTest base;
+    std::vector<uint256> txids(100);
+    {
+        CCoinsViewCache cache(&base);
+        for (unsigned int i = 0; i < txids.size(); i++) {
+            txids[i] = GetRandHash();
+            CCoinsModifier coins = cache.ModifyCoins(txids[i]);
+            coins->vout.resize(2);
+            coins->vout[0].nValue = i + 1;
+            coins->vout[1].nValue = i + 1;
+        }
+        cache.Flush();
+    }
+
+    CCoinsPrefetcher prefetcher;
+    boost::thread_group threads;
+    for (int i = 0; i < 3; i++)
+        threads.create_thread(boost::bind(&CCoinsPrefetcher::Thread, &prefetcher));
+
+    CCoinsViewCacheTest cache(&base);
+    cache.ModifyCoins(txids[0])->vout[0].nValue = 1000;
+
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.resize(1);
+    block.vtx.push_back(coinbase);
+    CMutableTransaction tx;
+    for (unsigned int i = 0; i < txids.size(); i++)
+        tx.vin.push_back(CTxIn(COutPoint(txids[i], i % 2)));
+    tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+    block.vtx.push_back(tx);
+    CMutableTransaction txChild;
+    txChild.vin.push_back(CTxIn(COutPoint(block.vtx[1].GetHash(), 0)));
+    block.vtx.push_back(txChild);
+
+    BOOST_CHECK_EQUAL(prefetcher.Warm(cache, block, NULL), txids.size() - 1);
+    for (unsigned int i = 0; i < txids.size(); i++) {
+        BOOST_CHECK(cache.HaveCoinsInCache(txids[i]));
+        BOOST_CHECK_EQUAL(cache.AccessCoins(txids[i])->vout[0].nValue, i ? i + 1 : 1000);
+    }
+    BOOST_CHECK(!cache.HaveCoinsInCache(block.vtx[1].GetHash()));
+    cache.SelfTest();
+
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+// Test that flushed coins read back right while the flusher writes them,
+// and that they are all in the database once it is done.
+BOOST_AUTO_TEST_CASE(coins_flusher_test)
+{
+    CCoinsViewDB db(1 << 20, true);
+    CCoinsViewFlusher flusher(&db, NULL, NULL);
+    std::vector<uint256> txids(1000);
+    uint256 hashBlock = GetRandHash();
+    {
+        CCoinsViewCache cache(&flusher);
+        for (unsigned int i = 0; i < txids.size(); i++) {
+            txids[i] = GetRandHash();
+            CCoinsModifier coins = cache.ModifyCoins(txids[i]);
+            coins->vout.resize(1);
+            coins->vout[0].nValue = i + 1;
+        }
+        cache.SetBestBlock(hashBlock);
+        BOOST_CHECK(cache.Flush());
+    }
+
+    // Spend half of them, whether or not the first flush is written yet
+    CCoinsViewCache cache(&flusher);
+    BOOST_CHECK(cache.GetBestBlock() == hashBlock);
+    for (unsigned int i = 0; i < txids.size(); i++) {
+        const CCoins* coins = cache.AccessCoins(txids[i]);
+        BOOST_CHECK(coins && coins->vout[0].nValue == i + 1);
+        if (i % 2 == 0)
+            cache.ModifyCoins(txids[i])->Spend(0);
+    }
+    uint256 hashBlock2 = GetRandHash();
+    cache.SetBestBlock(hashBlock2);
+    BOOST_CHECK(cache.Flush());
+
+    BOOST_CHECK(flusher.Wait());
+    BOOST_CHECK(db.GetBestBlock() == hashBlock2);
+    for (unsigned int i = 0; i < txids.size(); i++) {
+        CCoins coins;
+        BOOST_CHECK_EQUAL(db.GetCoins(txids[i], coins), i % 2 == 1);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
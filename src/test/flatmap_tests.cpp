@@ -0,0 +1,125 @@
+// Copyright (c) 2015 The Truthcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "flatmap.h"
+
+#include "random.h"
+#include "util.h"
+
+#include <map>
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+#define NUM_TESTS 16
+#define NUM_KEYS 2000
+
+using namespace std;
+
+namespace
+{
+struct IntHasher
+{
+    // Few distinct hashes, so probes run into each other
+    size_t operator()(int n) const { return (size_t)(n % 97); }
+};
+
+typedef flatmap<int, string, IntHasher> testmap;
+
+bool SameAs(const testmap& fm, const map<int, string>& m)
+{
+    if (fm.size() != m.size())
+        return false;
+    size_t n = 0;
+    for (testmap::const_iterator it = fm.begin(); it != fm.end(); ++it, n++) {
+        map<int, string>::const_iterator mit = m.find(it->first);
+        if (mit == m.end() || mit->second != it->second)
+            return false;
+    }
+    return n == m.size();
+}
+}
+
+BOOST_AUTO_TEST_SUITE(flatmap_tests)
+
+// Test that a flatmap behaves like a map under random inserts and erases
+BOOST_AUTO_TEST_CASE(flatmap_like_map)
+{
+    for (int nTest=0; nTest<NUM_TESTS; nTest++)
+    {
+        testmap fm;
+        map<int, string> m;
+        for (int nAction=0; nAction<4*NUM_KEYS; nAction++)
+        {
+            int key = insecure_rand() % NUM_KEYS;
+            switch (insecure_rand() % 4) {
+            case 0:
+                BOOST_CHECK_EQUAL(fm.erase(key), m.erase(key));
+                break;
+            case 1: {
+                testmap::iterator it = fm.find(key);
+                BOOST_CHECK_EQUAL(it != fm.end(), m.count(key) == 1);
+                if (it != fm.end())
+                    BOOST_CHECK(it->second == m[key]);
+                break;
+            }
+            default: {
+                string value = strprintf("%d", insecure_rand());
+                bool fNew = fm.insert(make_pair(key, value)).second;
+                BOOST_CHECK_EQUAL(fNew, m.insert(make_pair(key, value)).second);
+                if (!fNew && insecure_rand() % 2) {
+                    fm[key] = value;
+                    m[key] = value;
+                }
+            }
+            }
+        }
+        BOOST_CHECK(SameAs(fm, m));
+
+        testmap copy(fm);
+        BOOST_CHECK(SameAs(copy, m));
+    }
+}
+
+// Test that entries do not move while others are inserted and erased
+BOOST_AUTO_TEST_CASE(flatmap_stable_references)
+{
+    testmap fm;
+    map<int, string*> refs;
+    for (int i=0; i<NUM_KEYS; i++)
+        refs[i] = &fm[i];
+    for (int i=0; i<NUM_KEYS; i+=2)
+        fm.erase(i);
+    for (int i=NUM_KEYS; i<2*NUM_KEYS; i++)
+        fm[i] = "new";
+    for (int i=1; i<NUM_KEYS; i+=2)
+        BOOST_CHECK(&fm.find(i)->second == refs[i]);
+}
+
+// Test erasing entries while walking the map
+BOOST_AUTO_TEST_CASE(flatmap_erase_walking)
+{
+    testmap fm;
+    for (int i=0; i<NUM_KEYS; i++)
+        fm[i] = "x";
+    size_t nSeen = 0;
+    for (testmap::iterator it = fm.begin(); it != fm.end(); nSeen++) {
+        if (it->first % 3)
+            fm.erase(it++);
+        else
+            ++it;
+    }
+    BOOST_CHECK_EQUAL(nSeen, (size_t)NUM_KEYS);
+    BOOST_CHECK_EQUAL(fm.size(), (size_t)(NUM_KEYS + 2) / 3);
+    for (testmap::iterator it = fm.begin(); it != fm.end(); ++it)
+        BOOST_CHECK(it->first % 3 == 0);
+
+    BOOST_CHECK(fm.dynamic_usage() > 0);
+    fm.clear();
+    BOOST_CHECK(fm.empty());
+    BOOST_CHECK(fm.begin() == fm.end());
+    BOOST_CHECK_EQUAL(fm.dynamic_usage(), (size_t)0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,471 @@
+// Copyright (c) 2015 The Truthcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "linalg/src/tc_mat.h"
+
+#include "random.h"
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include <utility>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+/* reference weighted median: sort and walk the cumulative weights */
+static double RefWgtMedian(const struct tc_mat *wgt, const struct tc_mat *A,
+    uint32_t j, double NA)
+{
+    vector<pair<double, double> > v;
+    double sum = 0.0;
+    for (uint32_t i = 0; i < A->nr; i++) {
+        if (A->a[i][j] == NA)
+            continue;
+        v.push_back(make_pair(A->a[i][j], wgt->a[i][0]));
+        sum += wgt->a[i][0];
+    }
+    if (v.empty())
+        return 0.0;
+    sort(v.begin(), v.end());
+    double median = v[0].first;
+    double cum = v[0].second;
+    for (size_t i = 1; (i < v.size()) && (cum < sum / 2.0); i++) {
+        median = v[i].first;
+        cum += v[i].second;
+    }
+    return median;
+}
+
+BOOST_AUTO_TEST_SUITE(linalg_tests)
+
+BOOST_AUTO_TEST_CASE(wgt_col_medians)
+{
+    const double NA = -1.0;
+    const uint32_t nr = 57;
+    const uint32_t nc = 40;
+    struct tc_mat *wgt = tc_mat_ctr(nr, 1);
+    struct tc_mat *A = tc_mat_ctr(nr, nc);
+    struct tc_mat *med = tc_mat_ctr(0, 0);
+
+    for (uint32_t i = 0; i < nr; i++)
+        wgt->a[i][0] = 1 + GetRand(1000);
+    tc_wgt_normalize(wgt);
+    for (uint32_t i = 0; i < nr; i++) {
+        for (uint32_t j = 0; j < nc; j++) {
+            /* few distinct values so that ties are common */
+            double x = 0.125 * GetRand(9);
+            A->a[i][j] = (GetRand(4) == 0)? NA: x;
+        }
+    }
+    /* an all-NA column and a single-vote column */
+    for (uint32_t i = 0; i < nr; i++) {
+        A->a[i][0] = NA;
+        A->a[i][1] = (i == 3)? 0.75: NA;
+    }
+
+    BOOST_CHECK(tc_wgt_col_medians(wgt, A, NA, med) == 0);
+    BOOST_CHECK(med->nr == 1 && med->nc == nc);
+    BOOST_CHECK(med->a[0][0] == 0.0);
+    BOOST_CHECK(med->a[0][1] == 0.75);
+    for (uint32_t j = 0; j < nc; j++)
+        BOOST_CHECK(med->a[0][j] == RefWgtMedian(wgt, A, j, NA));
+
+    /* equal weights on an odd number of values is the usual median */
+    struct tc_mat *one = tc_mat_ctr(5, 1);
+    struct tc_mat *B = tc_mat_ctr(5, 1);
+    const double vals[5] = { 3.0, 1.0, 5.0, 4.0, 2.0 };
+    for (uint32_t i = 0; i < 5; i++) {
+        one->a[i][0] = 0.2;
+        B->a[i][0] = vals[i];
+    }
+    BOOST_CHECK(tc_wgt_col_medians(one, B, NA, med) == 0);
+    BOOST_CHECK(med->a[0][0] == 3.0);
+
+    tc_mat_dtr(B);
+    tc_mat_dtr(one);
+    tc_mat_dtr(med);
+    tc_mat_dtr(A);
+    tc_mat_dtr(wgt);
+}
+
+BOOST_AUTO_TEST_CASE(svd_jacobi)
+{
+    const uint32_t nr = 23;
+    const uint32_t nc = 9;
+    struct tc_mat *A = tc_mat_ctr(nr, nc);
+    for (uint32_t i = 0; i < nr; i++)
+        for (uint32_t j = 0; j < nc; j++)
+            A->a[i][j] = 0.001 * GetRand(2000) - 1.0;
+    /* a repeated column, so one singular value is zero */
+    for (uint32_t i = 0; i < nr; i++)
+        A->a[i][nc - 1] = A->a[i][2];
+
+    struct tc_mat *U = tc_mat_ctr(0, 0);
+    struct tc_mat *D = tc_mat_ctr(0, 0);
+    struct tc_mat *V = tc_mat_ctr(0, 0);
+    struct tc_mat *U0 = tc_mat_ctr(0, 0);
+    struct tc_mat *D0 = tc_mat_ctr(0, 0);
+    struct tc_mat *V0 = tc_mat_ctr(0, 0);
+    BOOST_CHECK(tc_mat_svd(A, U0, D0, V0) == 0);
+    BOOST_CHECK(tc_mat_svd_jacobi(A, U, D, V) == 0);
+    BOOST_CHECK(U->nr == nr && U->nc == nc);
+    BOOST_CHECK(D->nr == nc && D->nc == nc);
+    BOOST_CHECK(V->nr == nc && V->nc == nc);
+
+    /* same singular values, in decreasing order */
+    for (uint32_t k = 0; k < nc; k++) {
+        BOOST_CHECK_SMALL(D->a[k][k] - D0->a[k][k], 1e-10);
+        if (k > 0)
+            BOOST_CHECK(D->a[k][k] <= D->a[k - 1][k - 1]);
+    }
+    BOOST_CHECK_SMALL(D->a[nc - 1][nc - 1], 1e-10);
+
+    /* A = U D V^T and V is orthogonal */
+    for (uint32_t i = 0; i < nr; i++) {
+        for (uint32_t j = 0; j < nc; j++) {
+            double sum = 0.0;
+            for (uint32_t k = 0; k < nc; k++)
+                sum += U->a[i][k] * D->a[k][k] * V->a[j][k];
+            BOOST_CHECK_SMALL(sum - A->a[i][j], 1e-10);
+        }
+    }
+    for (uint32_t a = 0; a < nc; a++) {
+        for (uint32_t b = 0; b < nc; b++) {
+            double sum = 0.0;
+            for (uint32_t k = 0; k < nc; k++)
+                sum += V->a[k][a] * V->a[k][b];
+            BOOST_CHECK_SMALL(sum - ((a == b)? 1.0: 0.0), 1e-10);
+        }
+    }
+
+    /* bit-identical when repeated */
+    struct tc_mat *U1 = tc_mat_ctr(0, 0);
+    BOOST_CHECK(tc_mat_svd_jacobi(A, U1, D0, V0) == 0);
+    for (uint32_t i = 0; i < nr; i++)
+        BOOST_CHECK(memcmp(U->a[i], U1->a[i], sizeof(double) * nc) == 0);
+
+    /* all zero */
+    struct tc_mat *Z = tc_mat_ctr(4, 3);
+    for (uint32_t i = 0; i < 4; i++)
+        for (uint32_t j = 0; j < 3; j++)
+            Z->a[i][j] = 0.0;
+    BOOST_CHECK(tc_mat_svd_jacobi(Z, U, D, V) == 0);
+    BOOST_CHECK(tc_mat_svd(Z, U0, D0, V0) == 0);
+    for (uint32_t k = 0; k < 3; k++)
+        BOOST_CHECK(D->a[k][k] == 0.0 && D0->a[k][k] == 0.0);
+
+    tc_mat_dtr(Z);
+    tc_mat_dtr(U1);
+    tc_mat_dtr(V0);
+    tc_mat_dtr(D0);
+    tc_mat_dtr(U0);
+    tc_mat_dtr(V);
+    tc_mat_dtr(D);
+    tc_mat_dtr(U);
+    tc_mat_dtr(A);
+}
+
+static void SetupVote(struct tc_vote *vote, uint32_t nr, uint32_t nc)
+{
+    vote->NA = -1.0;
+    vote->alpha = 0.10;
+    vote->tol = 0.10;
+    for (uint32_t i = 0; i < nr; i++)
+        vote->rvecs[TC_VOTE_OLD_REP]->a[i][0] = (1.0 + i % 5) / (3.0 * nr);
+    for (uint32_t j = 0; j < nc; j++)
+        vote->cvecs[TC_VOTE_IS_BINARY]->a[0][j] = (j % 3)? 1.0: 0.0;
+}
+
+BOOST_AUTO_TEST_CASE(vote_proc_sparse)
+{
+    const double NA = -1.0;
+    const uint32_t nr = 40;
+    const uint32_t nc = 15;
+    struct tc_mat *M = tc_mat_ctr(nr, nc);
+    for (uint32_t i = 0; i < nr; i++) {
+        for (uint32_t j = 0; j < nc; j++) {
+            double x = (j % 3)? GetRand(2): 0.01 * GetRand(100);
+            if (i < nr / 3)
+                x = (j % 3)? 1.0: 0.70; /* a block voting together */
+            M->a[i][j] = (GetRand(10) < 6)? NA: x;
+        }
+    }
+
+    struct tc_vote *dense = tc_vote_ctr(nr, nc);
+    SetupVote(dense, nr, nc);
+    tc_mat_copy(dense->M, M);
+    struct tc_vote *sparse = tc_vote_sparse_ctr(tc_spmat_from_mat(M, NA));
+    SetupVote(sparse, nr, nc);
+    BOOST_CHECK(sparse->S->nnz < nr * nc);
+
+    BOOST_CHECK(tc_vote_proc(dense) == 0);
+    BOOST_CHECK(tc_vote_proc(sparse) == 0);
+    for (uint32_t k = 0; k < TC_VOTE_NROWS; k++)
+        for (uint32_t i = 0; i < nr; i++)
+            BOOST_CHECK_SMALL(dense->rvecs[k]->a[i][0] - sparse->rvecs[k]->a[i][0], 1e-12);
+    for (uint32_t k = 0; k < TC_VOTE_NCOLS; k++)
+        for (uint32_t j = 0; j < nc; j++)
+            BOOST_CHECK_SMALL(dense->cvecs[k]->a[0][j] - sparse->cvecs[k]->a[0][j], 1e-12);
+
+    /* the Jacobi SVD gives the same outcome */
+    struct tc_vote *jacobi = tc_vote_ctr(nr, nc);
+    SetupVote(jacobi, nr, nc);
+    tc_mat_copy(jacobi->M, M);
+    jacobi->svd = TC_SVD_JACOBI;
+    BOOST_CHECK(tc_vote_proc(jacobi) == 0);
+    for (uint32_t j = 0; j < nc; j++)
+        BOOST_CHECK_SMALL(dense->cvecs[TC_VOTE_DECISIONS_FINAL]->a[0][j]
+            - jacobi->cvecs[TC_VOTE_DECISIONS_FINAL]->a[0][j], 1e-10);
+    for (uint32_t i = 0; i < nr; i++)
+        BOOST_CHECK_SMALL(dense->rvecs[TC_VOTE_SMOOTHED_REP]->a[i][0]
+            - jacobi->rvecs[TC_VOTE_SMOOTHED_REP]->a[i][0], 1e-10);
+
+    tc_vote_dtr(jacobi);
+    tc_vote_dtr(sparse);
+    tc_vote_dtr(dense);
+    tc_mat_dtr(M);
+}
+
+BOOST_AUTO_TEST_CASE(vote_proc_warm)
+{
+    const double NA = -1.0;
+    const uint32_t nr = 60;
+    const uint32_t nc = 12;
+    struct tc_mat *M = tc_mat_ctr(nr, nc);
+    for (uint32_t i = 0; i < nr; i++) {
+        for (uint32_t j = 0; j < nc; j++) {
+            double x = (j % 3)? GetRand(2): 0.01 * GetRand(100);
+            if (i < nr / 4)
+                x = (j % 3)? 0.0: 0.10;
+            M->a[i][j] = (GetRand(10) < 3)? NA: x;
+        }
+    }
+
+    for (int sparse = 0; sparse < 2; sparse++) {
+        struct tc_vote *cold = (sparse)? tc_vote_sparse_ctr(tc_spmat_from_mat(M, NA)): tc_vote_ctr(nr, nc);
+        struct tc_vote *warm = (sparse)? tc_vote_sparse_ctr(tc_spmat_from_mat(M, NA)): tc_vote_ctr(nr, nc);
+        if (!sparse) {
+            tc_mat_copy(cold->M, M);
+            tc_mat_copy(warm->M, M);
+        }
+        SetupVote(cold, nr, nc);
+        SetupVote(warm, nr, nc);
+        BOOST_CHECK(tc_vote_proc(cold) == 0);
+        BOOST_CHECK(cold->niter == 0);
+
+        /* start from the cold loading, disturbed as if some votes were
+         * still missing */
+        warm->warm = tc_mat_ctr(nc, 1);
+        for (uint32_t j = 0; j < nc; j++)
+            warm->warm->a[j][0] = cold->cvecs[TC_VOTE_FIRST_LOADING]->a[0][j]
+                + 0.05 * ((j % 2)? 1.0: -1.0);
+        BOOST_CHECK(tc_vote_proc(warm) == 0);
+        BOOST_CHECK(warm->niter > 0 && warm->niter < TC_POWER_MAX_ITER);
+
+        /* the loading may come out with the other sign */
+        double dot = 0.0;
+        for (uint32_t j = 0; j < nc; j++)
+            dot += cold->cvecs[TC_VOTE_FIRST_LOADING]->a[0][j] * warm->cvecs[TC_VOTE_FIRST_LOADING]->a[0][j];
+        BOOST_CHECK_SMALL(fabs(dot) - 1.0, 1e-9);
+        for (uint32_t j = 0; j < nc; j++)
+            BOOST_CHECK_SMALL(cold->cvecs[TC_VOTE_DECISIONS_FINAL]->a[0][j]
+                - warm->cvecs[TC_VOTE_DECISIONS_FINAL]->a[0][j], 1e-9);
+        for (uint32_t i = 0; i < nr; i++)
+            BOOST_CHECK_SMALL(cold->rvecs[TC_VOTE_SMOOTHED_REP]->a[i][0]
+                - warm->rvecs[TC_VOTE_SMOOTHED_REP]->a[i][0], 1e-9);
+
+        /* a zero warm start falls back to the SVD */
+        for (uint32_t j = 0; j < nc; j++)
+            warm->warm->a[j][0] = 0.0;
+        BOOST_CHECK(tc_vote_proc(warm) == 0);
+        BOOST_CHECK(warm->niter == 0);
+        for (uint32_t i = 0; i < nr; i++)
+            BOOST_CHECK(cold->rvecs[TC_VOTE_SMOOTHED_REP]->a[i][0]
+                == warm->rvecs[TC_VOTE_SMOOTHED_REP]->a[i][0]);
+
+        tc_vote_dtr(warm);
+        tc_vote_dtr(cold);
+    }
+    tc_mat_dtr(M);
+}
+
+BOOST_AUTO_TEST_CASE(vote_proc_warm_second)
+{
+    const uint32_t nr = 60;
+    const uint32_t nc = 12;
+    struct tc_mat *M = tc_mat_ctr(nr, nc);
+    for (uint32_t i = 0; i < nr; i++)
+        for (uint32_t j = 0; j < nc; j++)
+            M->a[i][j] = (i < nr / 4)? ((j % 3)? 0.0: 0.10): ((j % 3)? GetRand(2): 0.01 * GetRand(100));
+
+    struct tc_vote *cold = tc_vote_ctr(nr, nc);
+    struct tc_vote *warm = tc_vote_ctr(nr, nc);
+    tc_mat_copy(cold->M, M);
+    tc_mat_copy(warm->M, M);
+    SetupVote(cold, nr, nc);
+    SetupVote(warm, nr, nc);
+    BOOST_CHECK(tc_vote_proc(cold) == 0);
+
+    /* wCVM of M, which has no NAs to fill, and its eigenvectors */
+    const struct tc_mat *wgt = cold->rvecs[TC_VOTE_OLD_REP];
+    double wgts2 = 0.0;
+    for (uint32_t i = 0; i < nr; i++)
+        wgts2 += wgt->a[i][0] * wgt->a[i][0];
+    struct tc_mat *X = tc_mat_ctr(nr, nc);
+    for (uint32_t j = 0; j < nc; j++) {
+        double avg = 0.0;
+        for (uint32_t i = 0; i < nr; i++)
+            avg += wgt->a[i][0] * M->a[i][j];
+        for (uint32_t i = 0; i < nr; i++)
+            X->a[i][j] = M->a[i][j] - avg;
+    }
+    struct tc_mat *C = tc_mat_ctr(nc, nc);
+    for (uint32_t a = 0; a < nc; a++) {
+        for (uint32_t b = 0; b < nc; b++) {
+            double sum = 0.0;
+            for (uint32_t i = 0; i < nr; i++)
+                sum += wgt->a[i][0] * X->a[i][a] * X->a[i][b];
+            C->a[a][b] = sum / (1.0 - wgts2);
+        }
+    }
+    struct tc_mat *U = tc_mat_ctr(0, 0);
+    struct tc_mat *D = tc_mat_ctr(0, 0);
+    struct tc_mat *V = tc_mat_ctr(0, 0);
+    BOOST_REQUIRE(tc_mat_svd(C, U, D, V) == 0);
+    BOOST_REQUIRE(D->a[0][0] > D->a[1][1]);
+
+    /* started on the second eigenvector, power iteration stops at once
+     * on it. That is turned down and the SVD is used instead. */
+    warm->warm = tc_mat_ctr(nc, 1);
+    for (uint32_t j = 0; j < nc; j++)
+        warm->warm->a[j][0] = U->a[j][1];
+    BOOST_CHECK(tc_vote_proc(warm) == 0);
+    BOOST_CHECK(warm->niter > 0);
+    for (uint32_t j = 0; j < nc; j++)
+        BOOST_CHECK(cold->cvecs[TC_VOTE_FIRST_LOADING]->a[0][j]
+            == warm->cvecs[TC_VOTE_FIRST_LOADING]->a[0][j]);
+    for (uint32_t i = 0; i < nr; i++)
+        BOOST_CHECK(cold->rvecs[TC_VOTE_SMOOTHED_REP]->a[i][0]
+            == warm->rvecs[TC_VOTE_SMOOTHED_REP]->a[i][0]);
+
+    /* as it is for the sparse vote matrix */
+    struct tc_vote *sparse = tc_vote_sparse_ctr(tc_spmat_from_mat(M, -1.0));
+    SetupVote(sparse, nr, nc);
+    sparse->warm = tc_mat_ctr(0, 0);
+    tc_mat_copy(sparse->warm, warm->warm);
+    BOOST_CHECK(tc_vote_proc(sparse) == 0);
+    BOOST_CHECK(sparse->niter > 0);
+    for (uint32_t i = 0; i < nr; i++)
+        BOOST_CHECK_SMALL(cold->rvecs[TC_VOTE_SMOOTHED_REP]->a[i][0]
+            - sparse->rvecs[TC_VOTE_SMOOTHED_REP]->a[i][0], 1e-12);
+
+    tc_vote_dtr(sparse);
+    tc_mat_dtr(V);
+    tc_mat_dtr(D);
+    tc_mat_dtr(U);
+    tc_mat_dtr(C);
+    tc_mat_dtr(X);
+    tc_vote_dtr(warm);
+    tc_vote_dtr(cold);
+    tc_mat_dtr(M);
+}
+
+BOOST_AUTO_TEST_CASE(vote_proc_cert)
+{
+    const double NA = -1.0;
+    const uint32_t nr = 60;
+    const uint32_t nc = 12;
+    /* a quarter of the voters against the truth, the others mostly
+     * with it, so the first component dominates */
+    struct tc_mat *M = tc_mat_ctr(nr, nc);
+    for (uint32_t j = 0; j < nc; j++) {
+        double truth = (j % 3)? GetRand(2): 0.01 * GetRand(100);
+        for (uint32_t i = 0; i < nr; i++) {
+            double x = truth;
+            if (i < nr / 4)
+                x = 1.0 - truth;
+            else if (GetRand(10) == 0)
+                x = (j % 3)? 1.0 - truth: 0.01 * GetRand(100);
+            M->a[i][j] = (GetRand(10) < 3)? NA: x;
+        }
+    }
+
+    for (int sparse = 0; sparse < 2; sparse++) {
+        struct tc_vote *cold = (sparse)? tc_vote_sparse_ctr(tc_spmat_from_mat(M, NA)): tc_vote_ctr(nr, nc);
+        struct tc_vote *cert = (sparse)? tc_vote_sparse_ctr(tc_spmat_from_mat(M, NA)): tc_vote_ctr(nr, nc);
+        if (!sparse) {
+            tc_mat_copy(cold->M, M);
+            tc_mat_copy(cert->M, M);
+        }
+        SetupVote(cold, nr, nc);
+        SetupVote(cert, nr, nc);
+        BOOST_CHECK(tc_vote_proc(cold) == 0);
+        BOOST_CHECK(cold->certified == 0);
+
+        /* the cold loading, rounded as it is published, checks out */
+        cert->cert = tc_mat_ctr(nc, 1);
+        for (uint32_t j = 0; j < nc; j++)
+            cert->cert->a[j][0] = (int64_t) (cold->cvecs[TC_VOTE_FIRST_LOADING]->a[0][j] * 1e8) * 1e-8;
+        BOOST_CHECK(tc_vote_proc(cert) == 0);
+        BOOST_CHECK(cert->certified == 1);
+        BOOST_CHECK(cert->niter == 0);
+        for (uint32_t j = 0; j < nc; j++)
+            BOOST_CHECK_SMALL(cold->cvecs[TC_VOTE_DECISIONS_FINAL]->a[0][j]
+                - cert->cvecs[TC_VOTE_DECISIONS_FINAL]->a[0][j], 1e-7);
+        for (uint32_t i = 0; i < nr; i++)
+            BOOST_CHECK_SMALL(cold->rvecs[TC_VOTE_THIS_REP]->a[i][0]
+                - cert->rvecs[TC_VOTE_THIS_REP]->a[i][0], 1e-7);
+
+        /* as does one a unit off in the last place, by the check or by
+         * agreeing with the loading worked out, and it is the one used */
+        cert->cert->a[0][0] += 1e-8;
+        BOOST_CHECK(tc_vote_proc(cert) == 0);
+        BOOST_CHECK(cert->certified == 1);
+        double norm = 0.0;
+        for (uint32_t j = 0; j < nc; j++)
+            norm += cert->cert->a[j][0] * cert->cert->a[j][0];
+        norm = sqrt(norm);
+        double sign = (cert->cvecs[TC_VOTE_FIRST_LOADING]->a[0][0] * cert->cert->a[0][0] < 0.0)? -1.0: 1.0;
+        for (uint32_t j = 0; j < nc; j++)
+            BOOST_CHECK_SMALL(cert->cvecs[TC_VOTE_FIRST_LOADING]->a[0][j]
+                - sign * cert->cert->a[j][0] / norm, 1e-12);
+
+        /* a loading which is off does not, and is only a warm start */
+        for (uint32_t j = 0; j < nc; j++)
+            cert->cert->a[j][0] = cold->cvecs[TC_VOTE_FIRST_LOADING]->a[0][j]
+                + 0.05 * ((j % 2)? 1.0: -1.0);
+        BOOST_CHECK(tc_vote_proc(cert) == 0);
+        BOOST_CHECK(cert->certified == 0);
+        BOOST_CHECK(cert->niter > 0);
+        for (uint32_t i = 0; i < nr; i++)
+            BOOST_CHECK_SMALL(cold->rvecs[TC_VOTE_SMOOTHED_REP]->a[i][0]
+                - cert->rvecs[TC_VOTE_SMOOTHED_REP]->a[i][0], 1e-9);
+
+        /* but it is taken without a check if it agrees with a loading
+         * the caller says it has worked out */
+        cert->known = tc_mat_ctr(0, 0);
+        tc_mat_mult_scalar(cert->known, 1.0 / sqrt(tc_mat_norm(cert->cert)), cert->cert);
+        BOOST_CHECK(tc_vote_proc(cert) == 0);
+        BOOST_CHECK(cert->certified == 1);
+        BOOST_CHECK(cert->niter == 0);
+        tc_mat_dtr(cert->known);
+        cert->known = NULL;
+
+        /* nor does a vector which is no eigenvector at all */
+        for (uint32_t j = 0; j < nc; j++)
+            cert->cert->a[j][0] = 0.0;
+        cert->cert->a[0][0] = 1.0;
+        BOOST_CHECK(tc_vote_proc(cert) == 0);
+        BOOST_CHECK(cert->certified == 0);
+
+        tc_vote_dtr(cert);
+        tc_vote_dtr(cold);
+    }
+    tc_mat_dtr(M);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,374 @@
+// Copyright (c) 2015 The Truthcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "marketexport.h"
+
+#include "base58.h"
+#include "clientversion.h"
+#include "primitives/market.h"
+#include "streams.h"
+#include "txdb.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/test/unit_test.hpp>
+
+typedef std::vector<std::pair<uint256, const marketObj *> > marketObjs;
+
+/** A sink that turns down every write */
+class CFailingExportSink : public CExportSink
+{
+public:
+    bool Write(const std::string &str) { return false; }
+};
+
+static std::vector<std::string> SplitLines(const std::string &str)
+{
+    std::vector<std::string> lines;
+    boost::split(lines, str, boost::is_any_of("\n"));
+    return lines;
+}
+
+static std::vector<std::string> SplitFields(const std::string &line)
+{
+    std::vector<std::string> fields;
+    boost::split(fields, line, boost::is_any_of(","));
+    return fields;
+}
+
+/** The CSV form of a value as ExportBallot and ExportOutcome write it */
+static std::string CSVValue(uint64_t value)
+{
+    std::ostringstream ss;
+    ss.setf(std::ios::fixed);
+    ss.precision(8);
+    ss << value * 1e-8;
+    return ss.str();
+}
+
+/**
+ * A branch with a ballot at height 20 on two decisions, and three votes
+ * sealed and revealed in time, one with a decision left NA.
+ */
+struct BallotSetup {
+    marketBranch branch;
+    std::vector<marketDecision> decisions;
+    std::vector<marketVote> votes;
+    std::vector<marketSealedVote> seals;
+    marketObjs vObjs, vSeals, vVotes;
+    uint256 branchid;
+
+    BallotSetup()
+    {
+        branch.name = "export";
+        branch.baseListingFee = 0;
+        branch.freeDecisions = 0;
+        branch.targetDecisions = 0;
+        branch.maxDecisions = 0;
+        branch.minTradingFee = 0;
+        branch.tau = 10;
+        branch.ballotTime = 2;
+        branch.unsealTime = 2;
+        branch.consensusThreshold = 0;
+        branchid = branch.GetHash();
+
+        decisions.resize(2);
+        for(size_t j=0; j < decisions.size(); j++) {
+            marketDecision &decision = decisions[j];
+            decision.branchid = branchid;
+            decision.prompt = std::string("export decision ") + char('a' + j);
+            decision.eventOverBy = 8;
+            decision.isScaled = 0;
+            decision.min = 0;
+            decision.max = 1e8;
+            decision.answerOptionality = 0;
+        }
+        /* the ballot has its decisions in the order of their ids */
+        if (decisions[1].GetHash() < decisions[0].GetHash())
+            std::swap(decisions[0], decisions[1]);
+
+        votes.resize(3);
+        seals.resize(3);
+        for(size_t i=0; i < votes.size(); i++) {
+            marketVote &vote = votes[i];
+            vote.branchid = branchid;
+            vote.height = 20;
+            vote.NA = 1;
+            vote.keyID = CKeyID(uint160(std::vector<unsigned char>(20, 0x40 + i)));
+            for(size_t j=0; j < decisions.size(); j++) {
+                vote.decisionIDs.push_back(decisions[j].GetHash());
+                vote.decisionVotes.push_back(((i + j) % 2)? 1e8: 25000000);
+            }
+            if (i == 2)
+                vote.decisionVotes[1] = vote.NA;
+            seals[i].branchid = branchid;
+            seals[i].height = 20;
+            seals[i].voteid = vote.GetHash();
+        }
+
+        vObjs.push_back(std::make_pair(branchid, (const marketObj *) &branch));
+        for(size_t j=0; j < decisions.size(); j++)
+            vObjs.push_back(std::make_pair(decisions[j].GetHash(), (const marketObj *) &decisions[j]));
+        for(size_t i=0; i < votes.size(); i++) {
+            vSeals.push_back(std::make_pair(seals[i].GetHash(), (const marketObj *) &seals[i]));
+            vVotes.push_back(std::make_pair(votes[i].GetHash(), (const marketObj *) &votes[i]));
+        }
+        BOOST_CHECK(pmarkettree->WriteMarketIndex(vObjs, 1));
+        BOOST_CHECK(pmarkettree->WriteMarketIndex(vSeals, 15));
+        BOOST_CHECK(pmarkettree->WriteMarketIndex(vVotes, 18));
+    }
+
+    ~BallotSetup()
+    {
+        BOOST_CHECK(pmarkettree->DisconnectMarketIndex(vVotes, 18));
+        BOOST_CHECK(pmarkettree->DisconnectMarketIndex(vSeals, 15));
+        BOOST_CHECK(pmarkettree->DisconnectMarketIndex(vObjs, 1));
+    }
+
+    /** The row ExportBallot writes for vote i */
+    std::vector<uint64_t> Row(size_t i) const
+    {
+        std::vector<uint64_t> row(votes[i].decisionVotes);
+        for(size_t j=0; j < row.size(); j++)
+            if (row[j] == votes[i].NA)
+                row[j] = EXPORT_NA;
+        return row;
+    }
+
+    const marketVote *FindVote(const uint256 &voteid) const
+    {
+        for(size_t i=0; i < votes.size(); i++)
+            if (votes[i].GetHash() == voteid)
+                return &votes[i];
+        return NULL;
+    }
+};
+
+/** An outcome of two voters on two decisions with every vector set */
+static marketOutcome TestExportOutcome()
+{
+    marketOutcome outcome;
+    outcome.branchid = uint256(std::vector<unsigned char>(32, 0x51));
+    outcome.NA = 2016;
+    outcome.nDecisions = 2;
+    outcome.nVoters = 2;
+    for(uint32_t j=0; j < 2; j++) {
+        outcome.decisionIDs.push_back(uint256(std::vector<unsigned char>(32, 0x60 + j)));
+        outcome.isScaled.push_back(j);
+        outcome.firstLoading.push_back((uint64_t)(int64_t)((j)? 70710678: -70710678));
+        outcome.decisionsRaw.push_back(10000000 + j);
+        outcome.consensusReward.push_back(20000000 + j);
+        outcome.certainty.push_back(30000000 + j);
+        outcome.NACol.push_back(j);
+        outcome.particCol.push_back(40000000 + j);
+        outcome.authorBonus.push_back(50000000 + j);
+        outcome.decisionsFinal.push_back((j)? 1e8: 0);
+    }
+    for(uint32_t i=0; i < 2; i++) {
+        outcome.voterIDs.push_back(CKeyID(uint160(std::vector<unsigned char>(20, 0x70 + i))));
+        outcome.oldRep.push_back(50000000);
+        outcome.thisRep.push_back(60000000 + i);
+        outcome.smoothedRep.push_back(55000000 + i);
+        outcome.NARow.push_back(i);
+        outcome.particRow.push_back(1e8 - i);
+        outcome.particRel.push_back(50000000 + i);
+        outcome.rowBonus.push_back(45000000 + i);
+    }
+    outcome.voteMatrix.push_back(1e8);
+    outcome.voteMatrix.push_back(0);
+    outcome.voteMatrix.push_back(outcome.NA);
+    outcome.voteMatrix.push_back(1e8);
+    return outcome;
+}
+
+BOOST_AUTO_TEST_SUITE(marketexport_tests)
+
+BOOST_AUTO_TEST_CASE(export_ballot_csv)
+{
+    BallotSetup setup;
+    std::ostringstream ss;
+    CStreamExportSink sink(ss);
+    std::string strError;
+    BOOST_REQUIRE(ExportBallot(setup.branchid, 20, EXPORT_CSV, sink, strError));
+
+    /* a header with the decisions, a row per vote and the final newline */
+    std::vector<std::string> lines = SplitLines(ss.str());
+    BOOST_REQUIRE_EQUAL(lines.size(), 1 + setup.votes.size() + 1);
+    BOOST_CHECK(lines.back().empty());
+    std::vector<std::string> header = SplitFields(lines[0]);
+    BOOST_REQUIRE_EQUAL(header.size(), 2 + setup.decisions.size());
+    BOOST_CHECK((header[0] == "voteid") && (header[1] == "address"));
+    for(size_t j=0; j < setup.decisions.size(); j++)
+        BOOST_CHECK_EQUAL(header[2 + j], setup.decisions[j].GetHash().ToString());
+
+    std::set<uint256> seen;
+    for(size_t i=1; i + 1 < lines.size(); i++) {
+        std::vector<std::string> fields = SplitFields(lines[i]);
+        BOOST_REQUIRE_EQUAL(fields.size(), header.size());
+        uint256 voteid;
+        voteid.SetHex(fields[0]);
+        const marketVote *vote = setup.FindVote(voteid);
+        BOOST_REQUIRE(vote);
+        BOOST_CHECK(seen.insert(voteid).second);
+        BOOST_CHECK_EQUAL(fields[1], CTruthcoinAddress(vote->keyID).ToString());
+        std::vector<uint64_t> row = setup.Row(vote - &setup.votes[0]);
+        for(size_t j=0; j < row.size(); j++)
+            BOOST_CHECK_EQUAL(fields[2 + j], (row[j] == EXPORT_NA)? std::string("NA"): CSVValue(row[j]));
+    }
+    BOOST_CHECK_EQUAL(seen.size(), setup.votes.size());
+}
+
+BOOST_AUTO_TEST_CASE(export_ballot_binary)
+{
+    BallotSetup setup;
+    std::ostringstream ss;
+    CStreamExportSink sink(ss);
+    std::string strError;
+    BOOST_REQUIRE(ExportBallot(setup.branchid, 20, EXPORT_BINARY, sink, strError));
+
+    std::string str = ss.str();
+    CDataStream ssIn(str.data(), str.data() + str.size(), SER_DISK, CLIENT_VERSION);
+    std::pair<std::pair<std::string, std::pair<uint256, uint32_t> >, std::vector<uint256> > header;
+    ssIn >> header;
+    BOOST_CHECK_EQUAL(header.first.first, "ballot");
+    BOOST_CHECK(header.first.second.first == setup.branchid);
+    BOOST_CHECK_EQUAL(header.first.second.second, 20U);
+    BOOST_REQUIRE_EQUAL(header.second.size(), setup.decisions.size());
+    for(size_t j=0; j < setup.decisions.size(); j++)
+        BOOST_CHECK(header.second[j] == setup.decisions[j].GetHash());
+
+    size_t nRows = 0;
+    while (!ssIn.empty()) {
+        std::pair<std::pair<uint256, CKeyID>, std::vector<uint64_t> > row;
+        ssIn >> row;
+        const marketVote *vote = setup.FindVote(row.first.first);
+        BOOST_REQUIRE(vote);
+        BOOST_CHECK(row.first.second == vote->keyID);
+        BOOST_CHECK(row.second == setup.Row(vote - &setup.votes[0]));
+        nRows++;
+    }
+    BOOST_CHECK_EQUAL(nRows, setup.votes.size());
+}
+
+BOOST_AUTO_TEST_CASE(export_outcome_csv)
+{
+    marketOutcome outcome = TestExportOutcome();
+    uint256 outcomeid = outcome.GetHash();
+    marketObjs vOutcome(1, std::make_pair(outcomeid, (const marketObj *) &outcome));
+    BOOST_REQUIRE(pmarkettree->WriteMarketIndex(vOutcome, 30));
+
+    std::ostringstream ss;
+    CStreamExportSink sink(ss);
+    std::string strError;
+    BOOST_REQUIRE(ExportOutcome(outcomeid, EXPORT_CSV, sink, strError));
+
+    /* the decisions, a blank line, then the voters */
+    std::vector<std::string> lines = SplitLines(ss.str());
+    BOOST_REQUIRE_EQUAL(lines.size(), 1 + 2 + 1 + 1 + 2 + 1);
+    BOOST_CHECK(lines[3].empty() && lines.back().empty());
+    BOOST_CHECK_EQUAL(SplitFields(lines[0]).size(), 1U + 9);
+    for(uint32_t j=0; j < 2; j++) {
+        std::vector<std::string> fields = SplitFields(lines[1 + j]);
+        BOOST_REQUIRE_EQUAL(fields.size(), 1U + 9);
+        BOOST_CHECK_EQUAL(fields[0], outcome.decisionIDs[j].ToString());
+        BOOST_CHECK_EQUAL(fields[1], (j)? "1": "0");
+        BOOST_CHECK_EQUAL(fields[2], (j)? "0.70710678": "-0.70710678");
+        BOOST_CHECK_EQUAL(fields[3], CSVValue(outcome.decisionsRaw[j]));
+        BOOST_CHECK_EQUAL(fields[9], CSVValue(outcome.decisionsFinal[j]));
+    }
+    std::vector<std::string> header = SplitFields(lines[4]);
+    BOOST_REQUIRE_EQUAL(header.size(), 1U + 7 + 2);
+    BOOST_CHECK_EQUAL(header[0], "address");
+    BOOST_CHECK_EQUAL(header[8], outcome.decisionIDs[0].ToString());
+    for(uint32_t i=0; i < 2; i++) {
+        std::vector<std::string> fields = SplitFields(lines[5 + i]);
+        BOOST_REQUIRE_EQUAL(fields.size(), header.size());
+        BOOST_CHECK_EQUAL(fields[0], CTruthcoinAddress(outcome.voterIDs[i]).ToString());
+        BOOST_CHECK_EQUAL(fields[2], CSVValue(outcome.thisRep[i]));
+        BOOST_CHECK_EQUAL(fields[7], CSVValue(outcome.rowBonus[i]));
+        for(uint32_t j=0; j < 2; j++) {
+            uint64_t value = outcome.voteMatrix[i*2 + j];
+            BOOST_CHECK_EQUAL(fields[8 + j], (value == outcome.NA)? std::string("NA"): CSVValue(value));
+        }
+    }
+
+    BOOST_CHECK(pmarkettree->DisconnectMarketIndex(vOutcome, 30));
+}
+
+BOOST_AUTO_TEST_CASE(export_outcome_binary)
+{
+    marketOutcome outcome = TestExportOutcome();
+    uint256 outcomeid = outcome.GetHash();
+    marketObjs vOutcome(1, std::make_pair(outcomeid, (const marketObj *) &outcome));
+    BOOST_REQUIRE(pmarkettree->WriteMarketIndex(vOutcome, 30));
+
+    std::ostringstream ss;
+    CStreamExportSink sink(ss);
+    std::string strError;
+    BOOST_REQUIRE(ExportOutcome(outcomeid, EXPORT_BINARY, sink, strError));
+
+    std::string str = ss.str();
+    CDataStream ssIn(str.data(), str.data() + str.size(), SER_DISK, CLIENT_VERSION);
+    std::pair<std::pair<std::string, uint256>, std::vector<uint256> > header;
+    ssIn >> header;
+    BOOST_CHECK_EQUAL(header.first.first, "outcome");
+    BOOST_CHECK(header.first.second == outcomeid);
+    BOOST_CHECK(header.second == outcome.decisionIDs);
+
+    const std::vector<uint64_t> *cVecs[] = {
+        &outcome.isScaled, &outcome.firstLoading, &outcome.decisionsRaw,
+        &outcome.consensusReward, &outcome.certainty, &outcome.NACol,
+        &outcome.particCol, &outcome.authorBonus, &outcome.decisionsFinal,
+    };
+    for(size_t k=0; k < 9; k++) {
+        std::vector<uint64_t> vec;
+        ssIn >> vec;
+        BOOST_CHECK(vec == *cVecs[k]);
+    }
+
+    for(uint32_t i=0; i < 2; i++) {
+        std::pair<CKeyID, std::pair<std::vector<uint64_t>, std::vector<uint64_t> > > row;
+        ssIn >> row;
+        BOOST_CHECK(row.first == outcome.voterIDs[i]);
+        BOOST_REQUIRE_EQUAL(row.second.first.size(), 7U);
+        BOOST_CHECK_EQUAL(row.second.first[0], outcome.oldRep[i]);
+        BOOST_CHECK_EQUAL(row.second.first[6], outcome.rowBonus[i]);
+        std::vector<uint64_t> votes(outcome.voteMatrix.begin() + i*2, outcome.voteMatrix.begin() + i*2 + 2);
+        std::replace(votes.begin(), votes.end(), outcome.NA, EXPORT_NA);
+        BOOST_CHECK(row.second.second == votes);
+    }
+    BOOST_CHECK(ssIn.empty());
+
+    BOOST_CHECK(pmarkettree->DisconnectMarketIndex(vOutcome, 30));
+}
+
+BOOST_AUTO_TEST_CASE(export_errors)
+{
+    BallotSetup setup;
+    std::string strError;
+
+    /* a sink that fails is told apart from a ballot that is not there */
+    CFailingExportSink failing;
+    BOOST_CHECK(!ExportBallot(setup.branchid, 20, EXPORT_CSV, failing, strError));
+    BOOST_CHECK_EQUAL(strError, "write failed");
+
+    std::ostringstream ss;
+    CStreamExportSink sink(ss);
+    BOOST_CHECK(!ExportBallot(setup.branchid, 25, EXPORT_CSV, sink, strError));
+    BOOST_CHECK(strError.find("not a ballot") != std::string::npos);
+    BOOST_CHECK(!ExportBallot(uint256(), 20, EXPORT_CSV, sink, strError));
+    BOOST_CHECK(strError.find("does not exist") != std::string::npos);
+    BOOST_CHECK(!ExportOutcome(uint256(), EXPORT_CSV, sink, strError));
+    BOOST_CHECK(strError.find("does not exist") != std::string::npos);
+    BOOST_CHECK(ss.str().empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,635 @@
+// Copyright (c) 2015 The Truthcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+#include "primitives/market.h"
+#include "txdb.h"
+#include "txmempool.h"
+
+#include <algorithm>
+#include <list>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+typedef std::vector<std::pair<uint256, const marketObj *> > marketObjs;
+
+/** A branch id, key id or the like, distinct for each n */
+static uint256 TestID(unsigned int n)
+{
+    uint256 id;
+    *id.begin() = n & 0xff;
+    *(id.begin() + 1) = (n >> 8) & 0xff;
+    return id;
+}
+
+static CKeyID TestKeyID(unsigned int n)
+{
+    uint256 id = TestID(n);
+    return CKeyID(uint160(std::vector<unsigned char>(id.begin(), id.begin() + 20)));
+}
+
+/** An outcome of the branch giving each voter the reputation rep */
+static marketOutcome *TestOutcome(const uint256 &branchid, const std::vector<CKeyID> &voters, uint64_t rep)
+{
+    marketOutcome *outcome = new marketOutcome();
+    outcome->branchid = branchid;
+    outcome->nVoters = voters.size();
+    outcome->voterIDs = voters;
+    outcome->oldRep.assign(voters.size(), rep / 2);
+    outcome->thisRep.assign(voters.size(), rep);
+    outcome->smoothedRep.assign(voters.size(), rep);
+    outcome->nDecisions = 0;
+    return outcome;
+}
+
+/** A binary decision of the branch whose event is over by eventOverBy */
+static marketDecision *TestDecision(const uint256 &branchid, uint32_t eventOverBy)
+{
+    marketDecision *decision = new marketDecision();
+    decision->keyID = TestKeyID(0);
+    decision->branchid = branchid;
+    decision->prompt = "test decision";
+    decision->eventOverBy = eventOverBy;
+    decision->isScaled = 0;
+    decision->min = 0;
+    decision->max = 1e8;
+    decision->answerOptionality = 0;
+    return decision;
+}
+
+/** A market of the branch on a single decision */
+static marketMarket *TestMarket(const uint256 &branchid, const uint256 &decisionid, uint32_t maturation)
+{
+    marketMarket *market = new marketMarket();
+    market->keyID = TestKeyID(0);
+    market->B = 1e8;
+    market->tradingFee = 0;
+    market->maxCommission = 0;
+    market->title = "test market";
+    market->maturation = maturation;
+    market->branchid = branchid;
+    market->decisionIDs.push_back(decisionid);
+    market->decisionFunctionIDs.push_back(DFID_X1);
+    market->account = 0;
+    market->txPoW = 0;
+    return market;
+}
+
+/** A trade of nShares in the state of the market */
+static marketTrade *TestTrade(const uint256 &marketid, const CKeyID &keyID, bool isBuy, uint64_t nShares, uint32_t decisionState)
+{
+    marketTrade *trade = new marketTrade();
+    trade->keyID = keyID;
+    trade->marketid = marketid;
+    trade->isBuy = isBuy;
+    trade->nShares = nShares;
+    trade->price = 0.5e8;
+    trade->decisionState = decisionState;
+    trade->nonce = 0;
+    trade->blockNum = 0;
+    return trade;
+}
+
+static bool DecisionIDLess(const marketDecision *a, const marketDecision *b)
+{
+    return a->GetHash() < b->GetHash();
+}
+
+BOOST_AUTO_TEST_SUITE(marketindex_tests)
+
+BOOST_AUTO_TEST_CASE(reputation_disconnect)
+{
+    CMarketTreeDB db(1 << 20, true);
+    uint256 branchid = TestID(1);
+    CKeyID a = TestKeyID(2);
+    CKeyID b = TestKeyID(3);
+    marketReputation rep;
+
+    std::vector<CKeyID> voters;
+    voters.push_back(a);
+    voters.push_back(b);
+    marketOutcome *first = TestOutcome(branchid, voters, 100);
+    marketObjs vFirst(1, std::make_pair(first->GetHash(), (const marketObj *) first));
+    BOOST_CHECK(db.WriteMarketIndex(vFirst, 10));
+
+    /* the second outcome has only a as a voter */
+    marketOutcome *second = TestOutcome(branchid, std::vector<CKeyID>(1, a), 200);
+    marketObjs vSecond(1, std::make_pair(second->GetHash(), (const marketObj *) second));
+    BOOST_CHECK(db.WriteMarketIndex(vSecond, 20));
+    BOOST_CHECK(db.GetReputation(branchid, a, rep) && (rep.nHeight == 20) && (rep.smoothedRep == 200));
+    BOOST_CHECK(db.GetReputationHistory(branchid, a).size() == 2);
+
+    /* writing a block again does not lose the entries it replaced */
+    BOOST_CHECK(db.WriteMarketIndex(vSecond, 20));
+
+    BOOST_CHECK(db.DisconnectMarketIndex(vSecond, 20));
+    BOOST_CHECK(db.GetReputation(branchid, a, rep) && (rep.nHeight == 10) && (rep.smoothedRep == 100));
+    BOOST_CHECK(db.GetReputationHistory(branchid, a).size() == 1);
+    BOOST_CHECK(db.GetReputation(branchid, b, rep) && (rep.nHeight == 10));
+
+    BOOST_CHECK(db.DisconnectMarketIndex(vFirst, 10));
+    BOOST_CHECK(!db.GetReputation(branchid, a, rep));
+    BOOST_CHECK(!db.GetReputation(branchid, b, rep));
+    BOOST_CHECK(db.GetReputationHistory(branchid, b).empty());
+
+    delete second;
+    delete first;
+}
+
+BOOST_AUTO_TEST_CASE(settlement_disconnect)
+{
+    CMarketTreeDB db(1 << 20, true);
+    uint256 branchid = TestID(1);
+    uint256 decisionid = TestID(2);
+    CKeyID holder = TestKeyID(3);
+    marketPayout payout;
+
+    marketMarket *market = TestMarket(branchid, decisionid, 100);
+    uint256 marketid = market->GetHash();
+    marketTrade *trade = TestTrade(marketid, holder, true, 10, 1);
+    marketObjs vTrading;
+    vTrading.push_back(std::make_pair(marketid, (const marketObj *) market));
+    vTrading.push_back(std::make_pair(trade->GetHash(), (const marketObj *) trade));
+    BOOST_CHECK(db.WriteMarketIndex(vTrading, 5));
+
+    marketOutcome *outcome = TestOutcome(branchid, std::vector<CKeyID>(), 0);
+    outcome->nDecisions = 1;
+    outcome->decisionIDs.push_back(decisionid);
+    outcome->decisionsFinal.push_back(1e8);
+    marketObjs vOutcome(1, std::make_pair(outcome->GetHash(), (const marketObj *) outcome));
+    BOOST_CHECK(db.WriteMarketIndex(vOutcome, 10));
+    BOOST_CHECK(db.Exists(std::make_pair('e', decisionid)));
+    BOOST_CHECK(db.GetPayout(marketid, holder, payout) && (payout.payout == 10));
+
+    BOOST_CHECK(db.DisconnectMarketIndex(vOutcome, 10));
+    BOOST_CHECK(!db.Exists(std::make_pair('e', decisionid)));
+    BOOST_CHECK(!db.GetPayout(marketid, holder, payout));
+    BOOST_CHECK(db.GetPayouts(marketid).empty());
+
+    delete outcome;
+    delete trade;
+    delete market;
+}
+
+BOOST_AUTO_TEST_CASE(settlement_reorg)
+{
+    CMarketTreeDB db(1 << 20, true);
+    uint256 branchid = TestID(1);
+    uint256 decisionid = TestID(2);
+    CKeyID holder = TestKeyID(3);
+    CKeyID orphan = TestKeyID(4);
+    marketPayout payout;
+
+    /* a market with one trade on the active chain, and a second trade
+     * plus a second market on the decision from a block reorged out */
+    marketMarket *market = TestMarket(branchid, decisionid, 100);
+    uint256 marketid = market->GetHash();
+    marketTrade *trade = TestTrade(marketid, holder, true, 10, 1);
+    marketObjs vTrading;
+    vTrading.push_back(std::make_pair(marketid, (const marketObj *) market));
+    vTrading.push_back(std::make_pair(trade->GetHash(), (const marketObj *) trade));
+    BOOST_CHECK(db.WriteMarketIndex(vTrading, 5));
+
+    marketMarket *stale = TestMarket(branchid, decisionid, 101);
+    uint256 staleid = stale->GetHash();
+    marketTrade *staleTrade = TestTrade(staleid, orphan, true, 7, 1);
+    marketTrade *orphanTrade = TestTrade(marketid, orphan, true, 20, 1);
+    marketObjs vStale;
+    vStale.push_back(std::make_pair(staleid, (const marketObj *) stale));
+    vStale.push_back(std::make_pair(staleTrade->GetHash(), (const marketObj *) staleTrade));
+    vStale.push_back(std::make_pair(orphanTrade->GetHash(), (const marketObj *) orphanTrade));
+    BOOST_CHECK(db.WriteMarketIndex(vStale, 6));
+    BOOST_CHECK(db.DisconnectMarketIndex(vStale, 6));
+    BOOST_CHECK(db.GetTrades(marketid).size() == 2);
+
+    marketOutcome *outcome = TestOutcome(branchid, std::vector<CKeyID>(), 0);
+    outcome->nDecisions = 1;
+    outcome->decisionIDs.push_back(decisionid);
+    outcome->decisionsFinal.push_back(1e8);
+    marketObjs vOutcome(1, std::make_pair(outcome->GetHash(), (const marketObj *) outcome));
+    BOOST_CHECK(db.WriteMarketIndex(vOutcome, 10));
+
+    /* only what is still on the chain is paid out */
+    BOOST_CHECK(db.GetPayout(marketid, holder, payout) && (payout.payout == 10));
+    BOOST_CHECK(!db.GetPayout(marketid, orphan, payout));
+    BOOST_CHECK(db.GetPayouts(marketid).size() == 1);
+    BOOST_CHECK(db.GetPayouts(staleid).empty());
+
+    BOOST_CHECK(db.DisconnectMarketIndex(vOutcome, 10));
+    BOOST_CHECK(db.GetPayouts(marketid).empty());
+
+    delete outcome;
+    delete orphanTrade;
+    delete staleTrade;
+    delete stale;
+    delete trade;
+    delete market;
+}
+
+BOOST_AUTO_TEST_CASE(positions_disconnect)
+{
+    CMarketTreeDB db(1 << 20, true);
+    uint256 marketid = TestID(1);
+    CKeyID holder = TestKeyID(2);
+    marketPosition pos;
+
+    marketTrade *buy = TestTrade(marketid, holder, true, 10, 1);
+    marketObjs vBuy(1, std::make_pair(buy->GetHash(), (const marketObj *) buy));
+    BOOST_CHECK(db.WriteMarketIndex(vBuy, 5));
+
+    marketTrade *sell = TestTrade(marketid, holder, false, 4, 1);
+    marketObjs vSell(1, std::make_pair(sell->GetHash(), (const marketObj *) sell));
+    BOOST_CHECK(db.WriteMarketIndex(vSell, 6));
+    /* a block written twice is counted once */
+    BOOST_CHECK(db.WriteMarketIndex(vSell, 6));
+    BOOST_CHECK(db.GetPosition(holder, marketid, 1, pos));
+    BOOST_CHECK((pos.nShares == 6) && (pos.nTrades == 2));
+    BOOST_CHECK(db.Exists(std::make_pair('u', sell->GetHash())));
+
+    BOOST_CHECK(db.DisconnectMarketIndex(vSell, 6));
+    BOOST_CHECK(db.GetPosition(holder, marketid, 1, pos));
+    BOOST_CHECK((pos.nShares == 10) && (pos.nTrades == 1));
+    BOOST_CHECK(!db.Exists(std::make_pair('u', sell->GetHash())));
+
+    BOOST_CHECK(db.DisconnectMarketIndex(vBuy, 5));
+    BOOST_CHECK(!db.GetPosition(holder, marketid, 1, pos));
+    BOOST_CHECK(db.GetPositions(holder).empty());
+
+    delete sell;
+    delete buy;
+}
+
+BOOST_AUTO_TEST_CASE(seals_disconnect)
+{
+    CMarketTreeDB db(1 << 20, true);
+    uint256 branchid = TestID(1);
+    marketVoteSeal seal;
+
+    marketVote *vote = new marketVote();
+    vote->branchid = branchid;
+    vote->height = 40;
+    vote->NA = 0;
+    vote->keyID = TestKeyID(2);
+    uint256 voteid = vote->GetHash();
+
+    /* two seals of the same vote in one block: the first one counts */
+    marketSealedVote *first = new marketSealedVote();
+    first->branchid = branchid;
+    first->height = 40;
+    first->voteid = voteid;
+    marketSealedVote *second = new marketSealedVote(*first);
+    second->txid = TestID(3);
+    marketObjs vSeals;
+    vSeals.push_back(std::make_pair(first->GetHash(), (const marketObj *) first));
+    vSeals.push_back(std::make_pair(TestID(4), (const marketObj *) second));
+    BOOST_CHECK(db.WriteMarketIndex(vSeals, 41));
+    BOOST_CHECK(db.GetVoteSeal(branchid, 40, voteid, seal));
+    BOOST_CHECK((seal.sealid == first->GetHash()) && (seal.nSealHeight == 41) && !seal.nRevealHeight);
+
+    marketObjs vReveal(1, std::make_pair(voteid, (const marketObj *) vote));
+    BOOST_CHECK(db.WriteMarketIndex(vReveal, 42));
+    BOOST_CHECK(db.GetVoteSeal(branchid, 40, voteid, seal) && (seal.nRevealHeight == 42));
+
+    BOOST_CHECK(db.DisconnectMarketIndex(vReveal, 42));
+    BOOST_CHECK(db.GetVoteSeal(branchid, 40, voteid, seal) && !seal.nRevealHeight);
+    BOOST_CHECK(db.DisconnectMarketIndex(vSeals, 41));
+    BOOST_CHECK(!db.GetVoteSeal(branchid, 40, voteid, seal));
+
+    delete second;
+    delete first;
+    delete vote;
+}
+
+BOOST_AUTO_TEST_CASE(events_disconnect)
+{
+    CMarketTreeDB db(1 << 20, true);
+    uint256 branchid = TestID(1);
+
+    marketDecision *decision = TestDecision(branchid, 300);
+    uint256 decisionid = decision->GetHash();
+    marketMarket *market = TestMarket(branchid, decisionid, 50);
+    uint256 marketid = market->GetHash();
+    marketObjs vObjs;
+    vObjs.push_back(std::make_pair(decisionid, (const marketObj *) decision));
+    vObjs.push_back(std::make_pair(marketid, (const marketObj *) market));
+    BOOST_CHECK(db.WriteMarketIndex(vObjs, 10));
+
+    /* in order of height, whatever the order they were written in */
+    std::vector<marketEvent> events = db.GetEvents(0, 1000);
+    BOOST_CHECK(events.size() == 2);
+    if (events.size() == 2) {
+        BOOST_CHECK((events[0].nHeight == 50) && (events[0].type == MEVT_MARKET_MATURE) && (events[0].objid == marketid));
+        BOOST_CHECK((events[1].nHeight == 300) && (events[1].type == MEVT_DECISION_BALLOT) && (events[1].objid == decisionid));
+    }
+    BOOST_CHECK(db.GetEvents(51, 299).empty());
+
+    BOOST_CHECK(db.DisconnectMarketIndex(vObjs, 10));
+    BOOST_CHECK(db.GetEvents(0, 1000).empty());
+
+    delete market;
+    delete decision;
+}
+
+BOOST_AUTO_TEST_CASE(events_ballot_close)
+{
+    CMarketTreeDB db(1 << 20, true);
+
+    marketBranch *branch = new marketBranch();
+    branch->name = "ballot close";
+    branch->baseListingFee = 0;
+    branch->freeDecisions = 0;
+    branch->targetDecisions = 0;
+    branch->maxDecisions = 0;
+    branch->minTradingFee = 0;
+    branch->tau = 10;
+    branch->ballotTime = 2;
+    branch->unsealTime = 2;
+    branch->consensusThreshold = 0;
+    uint256 branchid = branch->GetHash();
+    marketObjs vBranch(1, std::make_pair(branchid, (const marketObj *) branch));
+    BOOST_CHECK(db.WriteMarketIndex(vBranch, 1));
+
+    /* two decisions in different blocks share the ballot closing at
+     * 310, and one of another branch is in the same window */
+    marketDecision *first = TestDecision(branchid, 300);
+    marketDecision *second = TestDecision(branchid, 303);
+    marketDecision *other = TestDecision(TestID(9), 301);
+    marketObjs vFirst(1, std::make_pair(first->GetHash(), (const marketObj *) first));
+    marketObjs vSecond;
+    vSecond.push_back(std::make_pair(second->GetHash(), (const marketObj *) second));
+    vSecond.push_back(std::make_pair(other->GetHash(), (const marketObj *) other));
+    BOOST_CHECK(db.WriteMarketIndex(vFirst, 10));
+    BOOST_CHECK(db.WriteMarketIndex(vSecond, 11));
+
+    std::vector<marketEvent> events = db.GetEvents(310, 310);
+    BOOST_CHECK((events.size() == 1) && (events[0].type == MEVT_BALLOT_CLOSE) && (events[0].objid == branchid));
+
+    /* the closing stays while a decision of the ballot is left */
+    BOOST_CHECK(db.DisconnectMarketIndex(vSecond, 11));
+    BOOST_CHECK(db.GetEvents(310, 310).size() == 1);
+    BOOST_CHECK(db.GetEvents(301, 303).empty());
+
+    /* and goes with the last one */
+    BOOST_CHECK(db.DisconnectMarketIndex(vFirst, 10));
+    BOOST_CHECK(db.GetEvents(0, 1000).empty());
+
+    /* reconnecting in the other order schedules it again */
+    BOOST_CHECK(db.WriteMarketIndex(vSecond, 10));
+    BOOST_CHECK(db.GetEvents(310, 310).size() == 1);
+    BOOST_CHECK(db.DisconnectMarketIndex(vSecond, 10));
+    BOOST_CHECK(db.GetEvents(0, 1000).empty());
+
+    delete other;
+    delete second;
+    delete first;
+    delete branch;
+}
+
+BOOST_AUTO_TEST_CASE(tokens_disconnect)
+{
+    CMarketTreeDB db(1 << 20, true);
+    uint256 branchid = TestID(1);
+    /* two tokens the same for their first 32 characters */
+    std::string a = "abcdefghijklmnopqrstuvwxyz0123456789a";
+    std::string b = "abcdefghijklmnopqrstuvwxyz0123456789b";
+
+    marketMarket *first = TestMarket(branchid, TestID(2), 100);
+    first->title = "election " + a;
+    marketMarket *second = TestMarket(branchid, TestID(3), 100);
+    second->title = "elections " + b;
+    uint256 firstid = first->GetHash();
+    uint256 secondid = second->GetHash();
+    marketObjs vObjs;
+    vObjs.push_back(std::make_pair(firstid, (const marketObj *) first));
+    vObjs.push_back(std::make_pair(secondid, (const marketObj *) second));
+    BOOST_CHECK(db.WriteMarketIndex(vObjs, 10));
+
+    std::set<uint256> ids = db.GetMarketsByToken(a, false);
+    BOOST_CHECK((ids.size() == 1) && ids.count(firstid));
+    ids = db.GetMarketsByToken(b, false);
+    BOOST_CHECK((ids.size() == 1) && ids.count(secondid));
+    ids = db.GetMarketsByToken(a.substr(0, 32), false);
+    BOOST_CHECK(ids.empty());
+    ids = db.GetMarketsByToken(a.substr(0, 32), true);
+    BOOST_CHECK(ids.size() == 2);
+    ids = db.GetMarketsByToken("election", false);
+    BOOST_CHECK((ids.size() == 1) && ids.count(firstid));
+    ids = db.GetMarketsByToken("election", true);
+    BOOST_CHECK(ids.size() == 2);
+
+    std::vector<std::string> terms;
+    terms.push_back("elect*");
+    terms.push_back(b);
+    std::vector<uint256> found = db.SearchMarkets(terms);
+    BOOST_CHECK((found.size() == 1) && (found[0] == secondid));
+
+    BOOST_CHECK(db.DisconnectMarketIndex(vObjs, 10));
+    BOOST_CHECK(db.GetMarketsByToken("", true).empty());
+
+    delete second;
+    delete first;
+}
+
+BOOST_AUTO_TEST_CASE(branchstats_disconnect)
+{
+    CMarketTreeDB db(1 << 20, true);
+    uint256 branchid = TestID(1);
+    marketBranchStats st;
+
+    marketDecision *decision = TestDecision(branchid, 300);
+    uint256 decisionid = decision->GetHash();
+    marketMarket *market = TestMarket(branchid, decisionid, 12);
+    marketTrade *trade = TestTrade(market->GetHash(), TestKeyID(2), true, 10, 1);
+    marketObjs vTrading;
+    vTrading.push_back(std::make_pair(decisionid, (const marketObj *) decision));
+    vTrading.push_back(std::make_pair(market->GetHash(), (const marketObj *) market));
+    vTrading.push_back(std::make_pair(trade->GetHash(), (const marketObj *) trade));
+    BOOST_CHECK(db.WriteMarketIndex(vTrading, 10));
+    /* a block written twice is counted once */
+    BOOST_CHECK(db.WriteMarketIndex(vTrading, 10));
+    BOOST_CHECK(db.GetBranchStats(branchid, st));
+    BOOST_CHECK((st.nDecisions == 1) && (st.nPendingDecisions == 1));
+    BOOST_CHECK((st.nMarkets == 1) && (st.nOpenMarkets == 1));
+    BOOST_CHECK((st.nTrades == 1) && (st.volume == 5) && (st.openInterest == 10));
+
+    /* the market matures at a block of its own */
+    marketObjs vEmpty;
+    BOOST_CHECK(db.WriteMarketIndex(vEmpty, 12));
+    BOOST_CHECK(db.GetBranchStats(branchid, st) && (st.nOpenMarkets == 0));
+
+    marketOutcome *outcome = TestOutcome(branchid, std::vector<CKeyID>(), 0);
+    outcome->nVoters = 3;
+    outcome->nDecisions = 1;
+    outcome->decisionIDs.push_back(decisionid);
+    outcome->decisionsFinal.push_back(1e8);
+    marketObjs vOutcome(1, std::make_pair(outcome->GetHash(), (const marketObj *) outcome));
+    BOOST_CHECK(db.WriteMarketIndex(vOutcome, 13));
+    BOOST_CHECK(db.GetBranchStats(branchid, st));
+    BOOST_CHECK((st.nOutcomes == 1) && (st.nVoters == 3) && (st.nPendingDecisions == 0));
+
+    BOOST_CHECK(db.DisconnectMarketIndex(vOutcome, 13));
+    BOOST_CHECK(db.GetBranchStats(branchid, st));
+    BOOST_CHECK((st.nOutcomes == 0) && (st.nVoters == 0) && (st.nPendingDecisions == 1));
+    BOOST_CHECK(db.DisconnectMarketIndex(vEmpty, 12));
+    BOOST_CHECK(db.GetBranchStats(branchid, st) && (st.nOpenMarkets == 1));
+    BOOST_CHECK(db.DisconnectMarketIndex(vTrading, 10));
+    BOOST_CHECK(db.GetBranchStats(branchid, st));
+    BOOST_CHECK((st.nDecisions == 0) && (st.nPendingDecisions == 0));
+    BOOST_CHECK((st.nMarkets == 0) && (st.nOpenMarkets == 0));
+    BOOST_CHECK((st.nTrades == 0) && (st.volume == 0) && (st.openInterest == 0));
+    for(size_t i=0; i < vTrading.size(); i++)
+        BOOST_CHECK(!db.Exists(std::make_pair('g', vTrading[i].first)));
+    BOOST_CHECK(!db.Exists(std::make_pair(std::make_pair('g', market->GetHash()), 'm')));
+
+    delete outcome;
+    delete trade;
+    delete market;
+    delete decision;
+}
+
+BOOST_AUTO_TEST_CASE(outcome_inputs)
+{
+    const uint32_t height = 20;
+    const uint32_t nVoters = 4;
+
+    /* the votecoins, found by GetTransaction in the mempool */
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(TestID(900), 0);
+    std::vector<CKeyID> voters;
+    for(uint32_t i=0; i < nVoters; i++) {
+        voters.push_back(TestKeyID(910 + i));
+        CScript script = CScript() << OP_DUP << OP_HASH160 << ToByteVector(voters[i]) << OP_EQUALVERIFY << OP_CHECKSIG;
+        mtx.vout.push_back(CTxOut((i + 1) * COIN / 10, script));
+    }
+    CTransaction tx(mtx);
+    mempool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, 0, 0, 0.0, 1));
+
+    marketBranch *branch = new marketBranch();
+    branch->name = "outcome inputs";
+    branch->baseListingFee = 0;
+    branch->freeDecisions = 0;
+    branch->targetDecisions = 0;
+    branch->maxDecisions = 0;
+    branch->minTradingFee = 0;
+    branch->tau = 10;
+    branch->ballotTime = 2;
+    branch->unsealTime = 2;
+    branch->consensusThreshold = 0;
+    branch->txid = tx.GetHash();
+    uint256 branchid = branch->GetHash();
+
+    /* three decisions in the ballot at height and one in the next */
+    std::vector<marketDecision *> decisions;
+    marketObjs vObjs(1, std::make_pair(branchid, (const marketObj *) branch));
+    for(uint32_t j=0; j < 4; j++) {
+        decisions.push_back(TestDecision(branchid, (j < 3)? 8: 18));
+        decisions[j]->prompt += std::string(1, 'a' + j);
+        vObjs.push_back(std::make_pair(decisions[j]->GetHash(), (const marketObj *) decisions[j]));
+    }
+    BOOST_CHECK(pmarkettree->WriteMarketIndex(vObjs, 1));
+    /* the ballot has its decisions in the order of their ids */
+    std::sort(decisions.begin(), decisions.begin() + 3, DecisionIDLess);
+
+    /* every voter but the last seals a vote in time and reveals it */
+    std::vector<marketVote *> votes;
+    std::vector<marketSealedVote *> seals;
+    marketObjs vSeals, vVotes;
+    for(uint32_t i=0; i + 1 < nVoters; i++) {
+        marketVote *vote = new marketVote();
+        vote->branchid = branchid;
+        vote->height = height;
+        vote->NA = 1;
+        vote->keyID = voters[i];
+        for(uint32_t j=0; j < 3; j++) {
+            vote->decisionIDs.push_back(decisions[j]->GetHash());
+            vote->decisionVotes.push_back(((i + j) % 2)? 1e8: 0);
+        }
+        vote->decisionVotes[2] = (i == 0)? vote->NA: vote->decisionVotes[2];
+        marketSealedVote *seal = new marketSealedVote();
+        seal->branchid = branchid;
+        seal->height = height;
+        seal->voteid = vote->GetHash();
+        votes.push_back(vote);
+        seals.push_back(seal);
+        vSeals.push_back(std::make_pair(seal->GetHash(), (const marketObj *) seal));
+        vVotes.push_back(std::make_pair(vote->GetHash(), (const marketObj *) vote));
+    }
+    BOOST_CHECK(pmarkettree->WriteMarketIndex(vSeals, 15));
+    BOOST_CHECK(pmarkettree->WriteMarketIndex(vVotes, 18));
+
+    /* the outcome as the ballot has it, with the parameters set as in
+     * getOutcomeTx */
+    marketOutcome outcome;
+    outcome.branchid = branchid;
+    outcome.NA = 2016;
+    outcome.alpha = 0.10;
+    outcome.tol = 0.10;
+    outcome.nDecisions = 3;
+    for(uint32_t j=0; j < 3; j++) {
+        outcome.decisionIDs.push_back(decisions[j]->GetHash());
+        outcome.isScaled.push_back(0);
+    }
+    outcome.nVoters = nVoters;
+    outcome.voterIDs = voters;
+    for(uint32_t i=0; i < nVoters; i++) {
+        outcome.oldRep.push_back(tx.vout[i].nValue);
+        for(uint32_t j=0; j < 3; j++) {
+            uint64_t value = outcome.NA;
+            if ((i + 1 < nVoters) && ((i != 0) || (j != 2)))
+                value = votes[i]->decisionVotes[j];
+            outcome.voteMatrix.push_back(value);
+        }
+    }
+    BOOST_CHECK(CheckOutcomeInputs(outcome, height));
+    BOOST_CHECK(outcome.calc() == 0);
+    BOOST_CHECK(outcome.verify() == 0);
+    BOOST_CHECK(CheckOutcomeInputs(outcome, height));
+
+    /* inputs a miner made up, however well the outputs fit them */
+    marketOutcome forged = outcome;
+    forged.oldRep[0] += 1;
+    BOOST_CHECK(!CheckOutcomeInputs(forged, height));
+    forged = outcome;
+    forged.voteMatrix[forged.voteMatrix.size() - 1] = 1e8;
+    BOOST_CHECK(!CheckOutcomeInputs(forged, height));
+    forged = outcome;
+    std::swap(forged.voterIDs[0], forged.voterIDs[1]);
+    BOOST_CHECK(!CheckOutcomeInputs(forged, height));
+    forged = outcome;
+    forged.decisionIDs.pop_back();
+    forged.isScaled.pop_back();
+    forged.nDecisions--;
+    BOOST_CHECK(!CheckOutcomeInputs(forged, height));
+    forged = outcome;
+    forged.alpha = 1;
+    BOOST_CHECK(!CheckOutcomeInputs(forged, height));
+    /* nor is it the outcome of another ballot */
+    BOOST_CHECK(!CheckOutcomeInputs(outcome, height + 10));
+    BOOST_CHECK(!CheckOutcomeInputs(outcome, height + 1));
+
+    /* a vote revealed only at the ballot is not counted */
+    BOOST_CHECK(pmarkettree->DisconnectMarketIndex(vVotes, 18));
+    BOOST_CHECK(pmarkettree->WriteMarketIndex(vVotes, height));
+    BOOST_CHECK(!CheckOutcomeInputs(outcome, height));
+
+    BOOST_CHECK(pmarkettree->DisconnectMarketIndex(vVotes, height));
+    BOOST_CHECK(pmarkettree->DisconnectMarketIndex(vSeals, 15));
+    BOOST_CHECK(pmarkettree->DisconnectMarketIndex(vObjs, 1));
+    std::list<CTransaction> removed;
+    mempool.remove(tx, removed);
+
+    for(size_t i=0; i < votes.size(); i++) {
+        delete seals[i];
+        delete votes[i];
+    }
+    for(size_t j=0; j < decisions.size(); j++)
+        delete decisions[j];
+    delete branch;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
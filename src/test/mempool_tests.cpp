@@ -0,0 +1,106 @@
+// Copyright (c) 2015 The Truthcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+#include "primitives/market.h"
+#include "random.h"
+#include "txdb.h"
+#include "txmempool.h"
+
+#include <list>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+/** A decision of the branch, told apart by its prompt */
+static marketDecision TestDecision(const std::string &prompt)
+{
+    marketDecision decision;
+    decision.branchid = GetRandHash();
+    decision.prompt = prompt;
+    decision.eventOverBy = 1000;
+    decision.isScaled = 0;
+    decision.min = 0;
+    decision.max = 1e8;
+    decision.answerOptionality = 0;
+    return decision;
+}
+
+/** A transaction spending an unknown output and carrying the object */
+static CTransaction TestMarketTx(const marketObj &obj)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = COIN;
+    tx.vout[0].scriptPubKey = obj.GetScript();
+    return tx;
+}
+
+BOOST_AUTO_TEST_SUITE(mempool_tests)
+
+BOOST_AUTO_TEST_CASE(market_duplicates)
+{
+    LOCK(cs_main);
+    CTxMemPool pool(CFeeRate(0));
+    std::list<CTransaction> removed;
+    CValidationState state;
+
+    marketDecision decision = TestDecision("pool");
+    uint256 objid = decision.GetHash();
+    CTransaction first = TestMarketTx(decision);
+    CTransaction second = TestMarketTx(decision);
+    BOOST_CHECK(first.GetHash() != second.GetHash());
+
+    pool.addUnchecked(first.GetHash(), CTxMemPoolEntry(first, 0, GetTime(), 0.0, 1));
+    BOOST_CHECK(pool.existsMarketObj(objid));
+
+    /* another transaction with the same object is turned away */
+    BOOST_CHECK(!AcceptToMemoryPool(pool, state, second, false, NULL));
+    BOOST_CHECK(state.GetRejectCode() == REJECT_DUPLICATE);
+    BOOST_CHECK(state.GetRejectReason() == "market-duplicate");
+    BOOST_CHECK(!pool.exists(second.GetHash()));
+
+    /* and once it is in a block, the pool's one is dropped */
+    pool.removeConflicts(second, removed);
+    BOOST_CHECK((removed.size() == 1) && (removed.front().GetHash() == first.GetHash()));
+    BOOST_CHECK(!pool.existsMarketObj(objid));
+    BOOST_CHECK(pool.mapMarketObj.empty());
+
+    pool.addUnchecked(first.GetHash(), CTxMemPoolEntry(first, 0, GetTime(), 0.0, 1));
+    removed.clear();
+    pool.remove(first, removed);
+    BOOST_CHECK(!pool.existsMarketObj(objid));
+}
+
+BOOST_AUTO_TEST_CASE(market_duplicates_indexed)
+{
+    LOCK(cs_main);
+    CTxMemPool pool(CFeeRate(0));
+
+    marketDecision decision = TestDecision("indexed");
+    uint256 objid = decision.GetHash();
+    CTransaction indexed = TestMarketTx(decision);
+    CTransaction other = TestMarketTx(decision);
+    decision.txid = indexed.GetHash();
+    std::vector<std::pair<uint256, const marketObj *> > vMarketObj;
+    vMarketObj.push_back(std::make_pair(objid, (const marketObj *) &decision));
+    BOOST_CHECK(pmarkettree->WriteMarketIndex(vMarketObj, 1));
+
+    /* the object is in the index from another transaction */
+    CValidationState state;
+    BOOST_CHECK(!AcceptToMemoryPool(pool, state, other, false, NULL));
+    BOOST_CHECK(state.GetRejectReason() == "market-duplicate");
+
+    /* but its own transaction, from a disconnected block, is no
+     * duplicate and gets as far as its inputs */
+    CValidationState stateIndexed;
+    bool fMissingInputs = false;
+    BOOST_CHECK(!AcceptToMemoryPool(pool, stateIndexed, indexed, false, &fMissingInputs));
+    BOOST_CHECK(fMissingInputs);
+    BOOST_CHECK(stateIndexed.GetRejectReason() != "market-duplicate");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -162,4 +162,31 @@ BOOST_AUTO_TEST_CASE(insert_delete)
     BOOST_CHECK_EQUAL(ss.size(), 0);
 }
 
+BOOST_AUTO_TEST_CASE(span_reader)
+{
+    CDataStream ss(SER_DISK, 0);
+    std::string str("span");
+    ss << VARINT(300) << str << (uint32_t)0xdeadbeef;
+
+    CSpanReader spanin(&ss[0], &ss[0] + ss.size(), SER_DISK, 0);
+    int i;
+    spanin >> VARINT(i);
+    BOOST_CHECK_EQUAL(i, 300);
+    std::string strOut;
+    spanin >> strOut;
+    BOOST_CHECK_EQUAL(strOut, str);
+    BOOST_CHECK_EQUAL(spanin.size(), 4U);
+    spanin.ignore(2);
+    uint16_t n;
+    spanin >> n;
+    BOOST_CHECK_EQUAL(n, 0xdeadU);
+    BOOST_CHECK(spanin.empty());
+
+    // Reading past the end of the span throws, without reading anything
+    BOOST_CHECK_THROW(spanin >> n, std::ios_base::failure);
+    CSpanReader spanshort(&ss[0], &ss[0] + 1, SER_DISK, 0);
+    BOOST_CHECK_THROW(spanshort.ignore(2), std::ios_base::failure);
+    BOOST_CHECK_EQUAL(spanshort.size(), 1U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,109 @@
+// Copyright (c) 2015 The Truthcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "script/sigcache.h"
+
+#include "pubkey.h"
+#include "random.h"
+#include "uint256.h"
+#include "util.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+static const std::vector<unsigned char> vchSig(72, 0x30);
+
+BOOST_AUTO_TEST_SUITE(sigcache_tests)
+
+BOOST_AUTO_TEST_CASE(sigcache_insert_lookup)
+{
+    CSignatureCache cache;
+    CPubKey pubkey;
+    BOOST_CHECK_EQUAL(cache.Setup(1 << 20), (size_t)1 << 20);
+
+    std::vector<uint256> hashes;
+    for(int i=0; i < 100; i++) {
+        hashes.push_back(GetRandHash());
+        BOOST_CHECK(!cache.Get(hashes[i], vchSig, pubkey));
+        cache.Set(hashes[i], vchSig, pubkey);
+    }
+    for(int i=0; i < 100; i++)
+        BOOST_CHECK(cache.Get(hashes[i], vchSig, pubkey));
+
+    /* an entry is for its signature hash, signature and key together */
+    std::vector<unsigned char> vchOther(vchSig);
+    vchOther[0] ^= 1;
+    BOOST_CHECK(!cache.Get(hashes[0], vchOther, pubkey));
+    BOOST_CHECK(!cache.Get(GetRandHash(), vchSig, pubkey));
+
+    /* setting it up again empties it */
+    cache.Setup(1 << 20);
+    BOOST_CHECK(!cache.Get(hashes[0], vchSig, pubkey));
+
+    /* and one too small for a bucket keeps nothing */
+    BOOST_CHECK_EQUAL(cache.Setup(SIGCACHE_BUCKET_SIZE * sizeof(uint256) - 1), 0U);
+    cache.Set(hashes[0], vchSig, pubkey);
+    BOOST_CHECK(!cache.Get(hashes[0], vchSig, pubkey));
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_eviction)
+{
+    /* a single bucket, so that every entry lands in it */
+    CSignatureCache cache;
+    CPubKey pubkey;
+    BOOST_CHECK_EQUAL(cache.Setup(SIGCACHE_BUCKET_SIZE * sizeof(uint256)), SIGCACHE_BUCKET_SIZE * sizeof(uint256));
+
+    std::vector<uint256> hashes;
+    for(size_t i=0; i < SIGCACHE_BUCKET_SIZE; i++) {
+        hashes.push_back(GetRandHash());
+        cache.Set(hashes[i], vchSig, pubkey);
+    }
+    for(size_t i=0; i < SIGCACHE_BUCKET_SIZE; i++)
+        BOOST_CHECK(cache.Get(hashes[i], vchSig, pubkey));
+
+    /* setting one already there evicts nothing */
+    cache.Set(hashes[0], vchSig, pubkey);
+    for(size_t i=0; i < SIGCACHE_BUCKET_SIZE; i++)
+        BOOST_CHECK(cache.Get(hashes[i], vchSig, pubkey));
+
+    /* each new one takes the place of exactly one other */
+    for(int n=0; n < 20; n++) {
+        uint256 hash = GetRandHash();
+        cache.Set(hash, vchSig, pubkey);
+        BOOST_CHECK(cache.Get(hash, vchSig, pubkey));
+        hashes.push_back(hash);
+        size_t nFound = 0;
+        for(size_t i=0; i < hashes.size(); i++)
+            nFound += cache.Get(hashes[i], vchSig, pubkey);
+        BOOST_CHECK_EQUAL(nFound, SIGCACHE_BUCKET_SIZE);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_size_args)
+{
+    /* -sigcachesize is in MiB */
+    mapArgs["-sigcachesize"] = "1";
+    BOOST_CHECK_EQUAL(InitSignatureCache(), (size_t)1 << 20);
+    mapArgs["-sigcachesize"] = "0";
+    BOOST_CHECK_EQUAL(InitSignatureCache(), 0U);
+
+    /* the older -maxsigcachesize counts entries, so an old setting of
+     * 50000 is well under 2 MiB rather than 16 GiB */
+    mapArgs.erase("-sigcachesize");
+    mapArgs["-maxsigcachesize"] = "50000";
+    size_t nBytes = InitSignatureCache();
+    BOOST_CHECK(nBytes > 0);
+    BOOST_CHECK(nBytes <= 50000 * sizeof(uint256));
+
+    /* but -sigcachesize wins if both are given */
+    mapArgs["-sigcachesize"] = "2";
+    BOOST_CHECK_EQUAL(InitSignatureCache(), (size_t)2 << 20);
+
+    mapArgs.erase("-maxsigcachesize");
+    mapArgs.erase("-sigcachesize");
+    BOOST_CHECK_EQUAL(InitSignatureCache(), (size_t)DEFAULT_SIG_CACHE_SIZE << 20);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
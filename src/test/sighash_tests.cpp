@@ -142,6 +142,8 @@ BOOST_AUTO_TEST_CASE(sighash_test)
         uint256 sh, sho;
         sho = SignatureHashOld(scriptCode, txTo, nIn, nHashType);
         sh = SignatureHash(scriptCode, txTo, nIn, nHashType);
+        CPrecomputedSigHash precomputed(txTo);
+        BOOST_CHECK(SignatureHash(scriptCode, txTo, nIn, nHashType, &precomputed) == sho);
         #if defined(PRINT_SIGHASH_JSON)
         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
         ss << txTo;
@@ -0,0 +1,194 @@
+// Copyright (c) 2015 The Truthcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "snapshot.h"
+
+#include "hash.h"
+#include "main.h"
+#include "miner.h"
+#include "pow.h"
+#include "test/test_truthcoin.h"
+#include "timedata.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+static std::vector<char> ReadFileBytes(const boost::filesystem::path &path)
+{
+    std::ifstream file(path.string().c_str(), std::ios::binary);
+    return std::vector<char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+static void WriteFileBytes(const boost::filesystem::path &path, const std::vector<char> &bytes)
+{
+    std::ofstream file(path.string().c_str(), std::ios::binary | std::ios::trunc);
+    file.write(&bytes[0], bytes.size());
+}
+
+/** A block on top of pindexPrev, made distinct from any other there by nExtra */
+static CBlock MakeBlockOn(CBlockIndex *pindexPrev, int nExtra)
+{
+    CScript script = CScript() << OP_DUP << OP_HASH160 << ParseHex("0102030405060708090a0b0c0d0e0f1011121314") << OP_EQUALVERIFY << OP_CHECKSIG;
+    CBlockTemplate *pblocktemplate = CreateNewBlock(script);
+    BOOST_REQUIRE(pblocktemplate);
+    CBlock block = pblocktemplate->block;
+    delete pblocktemplate;
+
+    block.hashPrevBlock = pindexPrev->GetBlockHash();
+    block.nTime = std::max(pindexPrev->GetMedianTimePast() + 1, GetAdjustedTime());
+    block.nBits = GetNextWorkRequired(pindexPrev, &block);
+    CMutableTransaction coinbase(block.vtx[0]);
+    coinbase.vin[0].scriptSig = CScript() << (pindexPrev->nHeight + 1) << CScriptNum(nExtra) << OP_0;
+    block.vtx.resize(1);
+    block.vtx[0] = coinbase;
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    while (!CheckProofOfWork(block.GetHash(), block.nBits))
+        block.nNonce++;
+    return block;
+}
+
+/** Mine n blocks on top of pindexPrev, whether or not it is the tip, and return the last */
+static CBlockIndex *MineFork(CBlockIndex *pindexPrev, int n, int nExtra)
+{
+    for (int i = 0; i < n; i++) {
+        CBlock block = MakeBlockOn(pindexPrev, nExtra);
+        CValidationState state;
+        ProcessNewBlock(state, NULL, &block);
+        BOOST_REQUIRE(mapBlockIndex.count(block.GetHash()));
+        pindexPrev = mapBlockIndex[block.GetHash()];
+    }
+    return pindexPrev;
+}
+
+BOOST_AUTO_TEST_SUITE(snapshot_tests)
+
+BOOST_AUTO_TEST_CASE(snapshot_dump_load)
+{
+    boost::filesystem::path path = GetDataDir() / "snapshot.dat";
+    CSnapshotInfo info;
+    CCoinsStats stats;
+    uint256 hashMarket;
+    uint64_t nMarketRecords;
+    {
+        CTestChainstate chainstate;
+        MineBlocks(5);
+        BOOST_CHECK_EQUAL(chainActive.Height(), 5);
+        LOCK(cs_main);
+        BOOST_CHECK(DumpChainstate(path, info));
+        BOOST_CHECK(pcoinsTip->GetStats(stats));
+        BOOST_CHECK(GetMarketIndexHash(stats.hashBlock, hashMarket, nMarketRecords));
+    }
+    BOOST_CHECK_EQUAL(info.nHeight, 5);
+    BOOST_CHECK(info.hashSerialized == stats.hashSerialized);
+    BOOST_CHECK(info.hashMarket == hashMarket);
+    BOOST_CHECK_EQUAL(info.nMarketRecords, nMarketRecords);
+
+    std::vector<char> bytes = ReadFileBytes(path);
+    BOOST_REQUIRE(bytes.size() > 64);
+    CSnapshotInfo loaded;
+
+    /* a file whose contents do not match its hash is turned down, and
+     * the databases are left marked as mid-load */
+    boost::filesystem::path pathBad = GetDataDir() / "snapshot-bad.dat";
+    std::vector<char> bad = bytes;
+    bad[bad.size() / 2] ^= 1;
+    WriteFileBytes(pathBad, bad);
+    {
+        CTestChainstate chainstate;
+        BOOST_CHECK(!LoadChainstate(pathBad, loaded));
+        BOOST_CHECK(IsLoadingChainstate());
+    }
+
+    /* as is one whose coins or market records do not match the hash it
+     * gives for them, even with the file hash made to fit */
+    for (int nOffset = 96; nOffset >= 64; nOffset -= 32) {
+        bad = bytes;
+        bad[bad.size() - nOffset] ^= 1;
+        uint256 hashFile = Hash(bad.begin(), bad.end() - 32);
+        std::copy(hashFile.begin(), hashFile.end(), bad.end() - 32);
+        WriteFileBytes(pathBad, bad);
+        CTestChainstate chainstate;
+        BOOST_CHECK(!LoadChainstate(pathBad, loaded));
+        BOOST_CHECK(IsLoadingChainstate());
+    }
+
+    /* the snapshot itself loads into the chain it was taken of */
+    {
+        CTestChainstate chainstate;
+        BOOST_CHECK(LoadChainstate(path, loaded));
+        BOOST_CHECK(!IsLoadingChainstate());
+        chainstate.Reload();
+        BOOST_CHECK_EQUAL(chainActive.Height(), 5);
+        BOOST_CHECK(chainActive.Tip()->GetBlockHash() == info.hashBlock);
+        CCoinsStats statsLoaded;
+        BOOST_CHECK(pcoinsTip->GetStats(statsLoaded));
+        BOOST_CHECK(statsLoaded.hashSerialized == stats.hashSerialized);
+        BOOST_CHECK(loaded.hashFile == info.hashFile);
+        BOOST_CHECK(loaded.hashMarket == hashMarket);
+        uint256 hashMarketLoaded;
+        BOOST_CHECK(GetMarketIndexHash(statsLoaded.hashBlock, hashMarketLoaded, nMarketRecords));
+        BOOST_CHECK(hashMarketLoaded == hashMarket);
+    }
+
+    boost::filesystem::remove(pathBad);
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_reorg)
+{
+    boost::filesystem::path path = GetDataDir() / "snapshot.dat";
+    CSnapshotInfo info;
+    {
+        CTestChainstate chainstate;
+        MineBlocks(5);
+        LOCK(cs_main);
+        BOOST_CHECK(DumpChainstate(path, info));
+    }
+
+    CTestChainstate chainstate;
+    CSnapshotInfo loaded;
+    BOOST_CHECK(LoadChainstate(path, loaded));
+    chainstate.Reload();
+    BOOST_REQUIRE_EQUAL(chainActive.Height(), 5);
+    CBlockIndex *pindexSnapshot = chainActive.Tip();
+
+    /* a fork from below the snapshot's block with more work would need
+     * blocks that were never downloaded disconnected: it is taken as
+     * invalid, and the chain stays where it is */
+    CBlockIndex *pindexFork = MineFork(chainActive[3], 3, 1);
+    BOOST_CHECK_EQUAL(pindexFork->nHeight, 6);
+    BOOST_CHECK(pindexFork->nChainWork > pindexSnapshot->nChainWork);
+    BOOST_CHECK(chainActive.Tip() == pindexSnapshot);
+    BOOST_CHECK(pindexFork->nStatus & BLOCK_FAILED_MASK);
+    BOOST_CHECK(pindexFork->GetAncestor(4)->nStatus & BLOCK_FAILED_VALID);
+
+    /* and so is whatever builds on it */
+    CBlock block = MakeBlockOn(pindexFork, 1);
+    CValidationState state;
+    ProcessNewBlock(state, NULL, &block);
+    BOOST_CHECK(chainActive.Tip() == pindexSnapshot);
+
+    /* while the chain goes on from the snapshot's block */
+    MineBlocks(2);
+    BOOST_CHECK_EQUAL(chainActive.Height(), 7);
+    BOOST_CHECK(chainActive[5] == pindexSnapshot);
+
+    /* and forks from there on, whose blocks were connected here, are
+     * reorganized to as ever */
+    CBlockIndex *pindexReorg = MineFork(pindexSnapshot, 3, 2);
+    BOOST_CHECK(chainActive.Tip() == pindexReorg);
+    BOOST_CHECK_EQUAL(chainActive.Height(), 8);
+    BOOST_CHECK(chainActive[5] == pindexSnapshot);
+
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,7 @@
 
 #define BOOST_TEST_MODULE Truthcoin Test Suite
 
+#include "crypto/sha256.h"
 #include "main.h"
 #include "random.h"
 #include "txdb.h"
@@ -26,7 +27,6 @@ extern bool fPrintToConsole;
 extern void noui_connect();
 
 struct TestingSetup {
-    CCoinsViewDB *pcoinsdbview;
     boost::filesystem::path pathTemp;
     boost::thread_group threadGroup;
 
@@ -40,9 +40,13 @@ struct TestingSetup {
         pathTemp = GetTempPath() / strprintf("test_truthcoin_%lu_%i", (unsigned long)GetTime(), (int)(GetRand(100000)));
         boost::filesystem::create_directories(pathTemp);
         mapArgs["-datadir"] = pathTemp.string();
+        SHA256AutoDetect();
+        InitSignatureCache();
         pblocktree = new CBlockTreeDB(1 << 20, true);
         pcoinsdbview = new CCoinsViewDB(1 << 23, true);
-        pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+        pmarkettree = new CMarketTreeDB(1 << 20, true);
+        pcoinsflusher = new CCoinsViewFlusher(pcoinsdbview, pblocktree, pmarkettree);
+        pcoinsTip = new CCoinsViewCache(pcoinsflusher);
         InitBlockIndex();
 #ifdef ENABLE_WALLET
         bool fFirstRun;
@@ -65,7 +69,9 @@ struct TestingSetup {
         pwalletMain = NULL;
 #endif
         delete pcoinsTip;
+        delete pcoinsflusher;
         delete pcoinsdbview;
+        delete pmarkettree;
         delete pblocktree;
 #ifdef ENABLE_WALLET
         bitdb.Flush(true);
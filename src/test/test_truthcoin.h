@@ -0,0 +1,87 @@
+// Copyright (c) 2015 The Truthcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef TRUTHCOIN_TEST_TEST_TRUTHCOIN_H
+#define TRUTHCOIN_TEST_TEST_TRUTHCOIN_H
+
+#include "main.h"
+#include "miner.h"
+#include "txdb.h"
+#include "utilstrencodings.h"
+
+#include <boost/test/unit_test.hpp>
+
+/**
+ * A chain of fresh in-memory databases, swapped in for the test suite's
+ * own for as long as it lives.
+ */
+class CTestChainstate
+{
+private:
+    CBlockTreeDB *pblocktreeSaved;
+    CCoinsViewDB *pcoinsdbviewSaved;
+    CMarketTreeDB *pmarkettreeSaved;
+    CCoinsViewFlusher *pcoinsflusherSaved;
+    CCoinsViewCache *pcoinsTipSaved;
+
+public:
+    CTestChainstate()
+    {
+        pblocktreeSaved = pblocktree;
+        pcoinsdbviewSaved = pcoinsdbview;
+        pmarkettreeSaved = pmarkettree;
+        pcoinsflusherSaved = pcoinsflusher;
+        pcoinsTipSaved = pcoinsTip;
+        UnloadBlockIndex();
+        pblocktree = new CBlockTreeDB(1 << 20, true);
+        pcoinsdbview = new CCoinsViewDB(1 << 23, true);
+        pmarkettree = new CMarketTreeDB(1 << 20, true);
+        pcoinsflusher = new CCoinsViewFlusher(pcoinsdbview, pblocktree, pmarkettree);
+        pcoinsTip = new CCoinsViewCache(pcoinsflusher);
+        InitBlockIndex();
+    }
+
+    ~CTestChainstate()
+    {
+        UnloadBlockIndex();
+        delete pcoinsTip;
+        delete pcoinsflusher;
+        delete pmarkettree;
+        delete pcoinsdbview;
+        delete pblocktree;
+        pblocktree = pblocktreeSaved;
+        pcoinsdbview = pcoinsdbviewSaved;
+        pmarkettree = pmarkettreeSaved;
+        pcoinsflusher = pcoinsflusherSaved;
+        pcoinsTip = pcoinsTipSaved;
+        LoadBlockIndex();
+    }
+
+    /** Load the block index again, as after a snapshot is loaded */
+    void Reload()
+    {
+        UnloadBlockIndex();
+        delete pcoinsTip;
+        pcoinsTip = new CCoinsViewCache(pcoinsflusher);
+        LoadBlockIndex();
+    }
+};
+
+/** Mine n blocks on the tip of the active chain */
+static inline void MineBlocks(int n)
+{
+    CScript script = CScript() << OP_DUP << OP_HASH160 << ParseHex("0102030405060708090a0b0c0d0e0f1011121314") << OP_EQUALVERIFY << OP_CHECKSIG;
+    for (int i = 0; i < n; i++) {
+        CBlockTemplate *pblocktemplate = CreateNewBlock(script);
+        BOOST_REQUIRE(pblocktemplate);
+        CBlock *pblock = &pblocktemplate->block;
+        unsigned int nExtraNonce = 0;
+        IncrementExtraNonce(pblock, chainActive.Tip(), nExtraNonce);
+        CValidationState state;
+        BOOST_CHECK(ProcessNewBlock(state, NULL, pblock));
+        delete pblocktemplate;
+    }
+}
+
+#endif // TRUTHCOIN_TEST_TEST_TRUTHCOIN_H
@@ -0,0 +1,188 @@
+// Copyright (c) 2015 The Truthcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+
+#include "coins.h"
+#include "hash.h"
+#include "miner.h"
+#include "streams.h"
+#include "test/test_truthcoin.h"
+#include "undo.h"
+
+#include <stdio.h>
+
+#include <boost/test/unit_test.hpp>
+
+/** Height of the block spending the coinbase of the first */
+static const int nSpendHeight = 10;
+/** Height of the chain, over a window of MAX_VERIFY_BLOCKS_AHEAD */
+static const int nChainHeight = MAX_VERIFY_BLOCKS_AHEAD + 16;
+
+/**
+ * A chain whose first coinbase is spent at nSpendHeight, so that there is
+ * undo data to disconnect, in fresh databases for every test.
+ */
+struct VerifyDBSetup {
+    CTestChainstate chainstate;
+    uint256 hashCoinbase;
+    CBlockIndex *pindexSpend;
+
+    VerifyDBSetup()
+    {
+        CBlockTemplate *pblocktemplate = CreateNewBlock(CScript() << OP_TRUE);
+        BOOST_REQUIRE(pblocktemplate);
+        ProcessBlock(&pblocktemplate->block);
+        hashCoinbase = pblocktemplate->block.vtx[0].GetHash();
+        CAmount nValue = pblocktemplate->block.vtx[0].vout[0].nValue;
+        delete pblocktemplate;
+
+        MineBlocks(nSpendHeight - 2);
+
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(hashCoinbase, 0);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = nValue;
+        tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        pblocktemplate = CreateNewBlock(CScript() << OP_TRUE);
+        BOOST_REQUIRE(pblocktemplate);
+        pblocktemplate->block.vtx.push_back(CTransaction(tx));
+        ProcessBlock(&pblocktemplate->block);
+        delete pblocktemplate;
+        BOOST_REQUIRE_EQUAL(chainActive.Height(), nSpendHeight);
+        pindexSpend = chainActive.Tip();
+        BOOST_REQUIRE_EQUAL(pindexSpend->nTx, 2U);
+
+        MineBlocks(nChainHeight - nSpendHeight);
+        BOOST_REQUIRE_EQUAL(chainActive.Height(), nChainHeight);
+    }
+
+    void ProcessBlock(CBlock *pblock)
+    {
+        unsigned int nExtraNonce = 0;
+        IncrementExtraNonce(pblock, chainActive.Tip(), nExtraNonce);
+        CValidationState state;
+        BOOST_REQUIRE(ProcessNewBlock(state, NULL, pblock));
+    }
+
+    /** Overwrite the byte at nOffset into the block at nSpendHeight */
+    void WriteBlockByte(unsigned int nOffset, unsigned char ch)
+    {
+        CDiskBlockPos pos = pindexSpend->GetBlockPos();
+        pos.nPos += nOffset;
+        FILE *file = OpenBlockFile(pos);
+        BOOST_REQUIRE(file);
+        BOOST_REQUIRE_EQUAL(fwrite(&ch, 1, 1, file), 1U);
+        fclose(file);
+    }
+};
+
+/** Whether VerifyDB passes at nCheckLevel, both on this thread alone and with workers */
+static bool VerifyAtLevel(CCoinsView *coinsview, int nCheckLevel, int nCheckDepth = 0)
+{
+    int nScriptCheckThreadsSaved = nScriptCheckThreads;
+    bool fSerial, fParallel;
+    nScriptCheckThreads = 0;
+    fSerial = CVerifyDB().VerifyDB(coinsview, nCheckLevel, nCheckDepth);
+    nScriptCheckThreads = 4;
+    fParallel = CVerifyDB().VerifyDB(coinsview, nCheckLevel, nCheckDepth);
+    nScriptCheckThreads = nScriptCheckThreadsSaved;
+    BOOST_CHECK_EQUAL(fSerial, fParallel);
+    return fParallel;
+}
+
+BOOST_FIXTURE_TEST_SUITE(verifydb_tests, VerifyDBSetup)
+
+BOOST_AUTO_TEST_CASE(verifydb_clean)
+{
+    for (int nCheckLevel = 0; nCheckLevel <= 4; nCheckLevel++) {
+        BOOST_CHECK(VerifyAtLevel(pcoinsTip, nCheckLevel));
+        BOOST_CHECK(VerifyAtLevel(pcoinsTip, nCheckLevel, 6));
+    }
+    BOOST_CHECK_EQUAL(chainActive.Height(), nChainHeight);
+}
+
+BOOST_AUTO_TEST_CASE(verifydb_level0)
+{
+    /* a transaction count past the end of the block cannot be read */
+    unsigned int nHeaderSize = ::GetSerializeSize(pindexSpend->GetBlockHeader(), SER_DISK, CLIENT_VERSION);
+    WriteBlockByte(nHeaderSize, 0xff);
+    BOOST_CHECK(!VerifyAtLevel(pcoinsTip, 0));
+}
+
+BOOST_AUTO_TEST_CASE(verifydb_level1)
+{
+    /* the lock time of its last transaction changed, the block still
+     * reads but no longer matches its merkle root */
+    CBlock block;
+    BOOST_REQUIRE(ReadBlockFromDisk(block, pindexSpend));
+    unsigned int nSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+    WriteBlockByte(nSize - 1, 0x01);
+    BOOST_CHECK(VerifyAtLevel(pcoinsTip, 0));
+    BOOST_CHECK(!VerifyAtLevel(pcoinsTip, 1));
+}
+
+BOOST_AUTO_TEST_CASE(verifydb_level2)
+{
+    /* undo data that does not match its checksum */
+    CDiskBlockPos pos = pindexSpend->GetUndoPos();
+    BOOST_REQUIRE(!pos.IsNull());
+    FILE *file = OpenUndoFile(pos);
+    BOOST_REQUIRE(file);
+    int ch = fgetc(file);
+    BOOST_REQUIRE(ch != EOF);
+    fseek(file, pos.nPos, SEEK_SET);
+    fputc(ch ^ 0x01, file);
+    fclose(file);
+    BOOST_CHECK(VerifyAtLevel(pcoinsTip, 1));
+    BOOST_CHECK(!VerifyAtLevel(pcoinsTip, 2));
+}
+
+BOOST_AUTO_TEST_CASE(verifydb_level3)
+{
+    /* coins without the outputs of the tip's coinbase do not disconnect
+     * cleanly */
+    CCoinsViewCache coins(pcoinsTip);
+    CBlock block;
+    BOOST_REQUIRE(ReadBlockFromDisk(block, chainActive.Tip()));
+    coins.ModifyCoins(block.vtx[0].GetHash())->Clear();
+    BOOST_CHECK(VerifyAtLevel(&coins, 2));
+    BOOST_CHECK(!VerifyAtLevel(&coins, 3));
+    BOOST_CHECK(VerifyAtLevel(pcoinsTip, 3));
+}
+
+BOOST_AUTO_TEST_CASE(verifydb_level4)
+{
+    /* undo data with a valid checksum, giving the spent coinbase the
+     * height of the block spending it: it disconnects cleanly down to
+     * above the coinbase, but cannot be connected again */
+    CDiskBlockPos pos = pindexSpend->GetUndoPos();
+    CBlockUndo blockundo;
+    {
+        CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(!filein.IsNull());
+        filein >> blockundo;
+    }
+    BOOST_REQUIRE_EQUAL(blockundo.vtxundo.size(), 1U);
+    CTxInUndo &undo = blockundo.vtxundo[0].vprevout[0];
+    BOOST_REQUIRE(undo.fCoinBase);
+    BOOST_REQUIRE_EQUAL(undo.nHeight, 1U);
+    unsigned int nSize = ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION);
+    undo.nHeight = nSpendHeight;
+    BOOST_REQUIRE_EQUAL(::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION), nSize);
+    {
+        CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(!fileout.IsNull());
+        CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+        hasher << pindexSpend->pprev->GetBlockHash() << blockundo;
+        fileout << blockundo << hasher.GetHash();
+    }
+
+    int nCheckDepth = nChainHeight - 2;
+    BOOST_CHECK(VerifyAtLevel(pcoinsTip, 3, nCheckDepth));
+    BOOST_CHECK(!VerifyAtLevel(pcoinsTip, 4, nCheckDepth));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
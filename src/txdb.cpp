@@ -4,8 +4,11 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <algorithm>
+#include <iterator>
 #include <stdint.h>
 #include <boost/thread.hpp>
+#include "crypto/common.h"
 #include "pow.h"
 #include "txdb.h"
 #include "uint256.h"
@@ -45,14 +48,13 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     CLevelDBBatch batch;
     size_t count = 0;
     size_t changed = 0;
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+    // mapCoins is only read, so that CCoinsViewFlusher can serve it while it is written
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
             BatchWriteCoins(batch, it->first, it->second.coins);
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
     }
     if (!hashBlock.IsNull())
         BatchWriteHashBestChain(batch, hashBlock);
@@ -61,6 +63,152 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     return db.WriteBatch(batch);
 }
 
+CCoinsViewFlusher::CCoinsViewFlusher(CCoinsView *viewIn, CBlockTreeDB *blocktreeIn, CMarketTreeDB *markettreeIn) :
+    CCoinsViewBacked(viewIn), blocktree(blocktreeIn), markettree(markettreeIn),
+    fWriting(false), fOk(true), fStop(false), fIndexWriting(false), nLastFileWriting(0),
+    fIndexQueued(false), nLastFileQueued(0),
+    thread(boost::bind(&CCoinsViewFlusher::Thread, this))
+{
+}
+
+CCoinsViewFlusher::~CCoinsViewFlusher()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fStop = true;
+        cond.notify_all();
+    }
+    // The thread finishes the flush it is writing first
+    thread.join();
+}
+
+bool CCoinsViewFlusher::GetCoins(const uint256 &txid, CCoins &coins) const {
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (fWriting) {
+            CCoinsMap::const_iterator it = mapWriting.find(txid);
+            if (it != mapWriting.end()) {
+                coins = it->second.coins;
+                return true;
+            }
+        }
+    }
+    // Not part of the flush being written, so the database has it right
+    return base->GetCoins(txid, coins);
+}
+
+bool CCoinsViewFlusher::HaveCoins(const uint256 &txid) const {
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (fWriting) {
+            CCoinsMap::const_iterator it = mapWriting.find(txid);
+            if (it != mapWriting.end())
+                return !it->second.coins.IsPruned();
+        }
+    }
+    return base->HaveCoins(txid);
+}
+
+uint256 CCoinsViewFlusher::GetBestBlock() const {
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (fWriting && !hashBlockWriting.IsNull())
+            return hashBlockWriting;
+    }
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewFlusher::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (fWriting)
+        cond.wait(lock);
+    if (!fOk)
+        return false;
+    mapWriting.swap(mapCoins);
+    hashBlockWriting = hashBlock;
+    fIndexWriting = fIndexQueued;
+    vFilesWriting.swap(vFilesQueued);
+    nLastFileWriting = nLastFileQueued;
+    vBlocksWriting.swap(vBlocksQueued);
+    fIndexQueued = false;
+    vFilesQueued.clear();
+    vBlocksQueued.clear();
+    fWriting = true;
+    cond.notify_all();
+    return true;
+}
+
+bool CCoinsViewFlusher::GetStats(CCoinsStats &stats) const {
+    if (!Wait())
+        return false;
+    return base->GetStats(stats);
+}
+
+bool CCoinsViewFlusher::ForEachCoins(boost::function<bool (const uint256 &txid, const CCoins &coins)> fn) const {
+    if (!Wait())
+        return false;
+    return base->ForEachCoins(fn);
+}
+
+void CCoinsViewFlusher::QueueBlockIndex(std::vector<std::pair<int, CBlockFileInfo> > &vFiles, int nLastFile, std::vector<CDiskBlockIndex> &vBlocks) {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    vFilesQueued.insert(vFilesQueued.end(), vFiles.begin(), vFiles.end());
+    vBlocksQueued.insert(vBlocksQueued.end(), vBlocks.begin(), vBlocks.end());
+    nLastFileQueued = nLastFile;
+    fIndexQueued = true;
+    vFiles.clear();
+    vBlocks.clear();
+}
+
+bool CCoinsViewFlusher::Wait() const {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (fWriting)
+        cond.wait(lock);
+    return fOk;
+}
+
+bool CCoinsViewFlusher::Write() {
+    int64_t nStart = GetTimeMicros();
+    try {
+        if (fIndexWriting) {
+            if (blocktree && !blocktree->WriteBatchSync(vFilesWriting, nLastFileWriting, vBlocksWriting))
+                return error("%s : failed to write to block index database", __func__);
+            if (markettree && !markettree->WriteBatchSync(vFilesWriting, nLastFileWriting, vBlocksWriting))
+                return error("%s : failed to write to block market database", __func__);
+        }
+        if (!base->BatchWrite(mapWriting, hashBlockWriting))
+            return error("%s : failed to write to coin database", __func__);
+    } catch (const std::runtime_error& e) {
+        return error("%s : %s", __func__, e.what());
+    }
+    LogPrint("bench", "  - Background chainstate write: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
+    return true;
+}
+
+void CCoinsViewFlusher::Thread() {
+    RenameThread("truthcoin-flush");
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (true) {
+        while (!fWriting && !fStop)
+            cond.wait(lock);
+        if (!fWriting)
+            return;
+        // What is being written stays as it is while fWriting is set, so
+        // readers can look into it without holding the lock for the write
+        lock.unlock();
+        bool fWritten = Write();
+        lock.lock();
+        if (!fWritten)
+            fOk = false;
+        mapWriting.clear();
+        hashBlockWriting.SetNull();
+        vFilesWriting.clear();
+        vBlocksWriting.clear();
+        fWriting = false;
+        cond.notify_all();
+    }
+}
+
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
 }
 
@@ -94,7 +242,6 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
     stats.hashBlock = GetBestBlock();
     ss << stats.hashBlock;
-    CAmount nTotalAmount = 0;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
@@ -109,22 +256,8 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
                 ssValue >> coins;
                 uint256 txhash;
                 ssKey >> txhash;
-                ss << txhash;
-                ss << VARINT(coins.nVersion);
-                ss << (coins.fCoinBase ? 'c' : 'n');
-                ss << VARINT(coins.nHeight);
-                stats.nTransactions++;
-                for (unsigned int i=0; i<coins.vout.size(); i++) {
-                    const CTxOut &out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i+1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-                    }
-                }
+                ApplyCoinsStats(stats, ss, txhash, coins);
                 stats.nSerializedSize += 32 + slValue.size();
-                ss << VARINT(0);
             }
             pcursor->Next();
         } catch (const std::exception& e) {
@@ -133,18 +266,44 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
     }
     stats.nHeight = mapBlockIndex.find(GetBestBlock())->second->nHeight;
     stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
     return true;
 }
 
-bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
+bool CCoinsViewDB::ForEachCoins(boost::function<bool (const uint256 &txid, const CCoins &coins)> fn) const {
+    boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
+    pcursor->Seek(std::string(1, 'c'));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            if (slKey.size() == 0 || slKey[0] != 'c')
+                break;
+            CDataStream ssKey(slKey.data()+1, slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            uint256 txhash;
+            ssKey >> txhash;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            CCoins coins;
+            ssValue >> coins;
+            if (!fn(txhash, coins))
+                return false;
+            pcursor->Next();
+        } catch (const std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    return true;
+}
+
+bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, CBlockFileInfo> >& fileInfo, int nLastFile, const std::vector<CDiskBlockIndex>& blockinfo) {
     CLevelDBBatch batch;
-    for (std::vector<std::pair<int, const CBlockFileInfo*> >::const_iterator it=fileInfo.begin(); it != fileInfo.end(); it++) {
-        batch.Write(make_pair('f', it->first), *it->second);
+    for (std::vector<std::pair<int, CBlockFileInfo> >::const_iterator it=fileInfo.begin(); it != fileInfo.end(); it++) {
+        batch.Write(make_pair('f', it->first), it->second);
     }
     batch.Write('l', nLastFile);
-    for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
-        batch.Write(make_pair('b', (*it)->GetBlockHash()), CDiskBlockIndex(*it));
+    for (std::vector<CDiskBlockIndex>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
+        batch.Write(make_pair('b', it->GetBlockHash()), *it);
     }
     return WriteBatch(batch, true);
 }
@@ -248,18 +407,55 @@ bool CMarketTreeDB::ReadLastBlockFile(int &nFile) {
     return Read('l', nFile);
 }
 
-bool CMarketTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
+bool CMarketTreeDB::WriteBatchSync(const std::vector<std::pair<int, CBlockFileInfo> >& fileInfo, int nLastFile, const std::vector<CDiskBlockIndex>& blockinfo) {
     CLevelDBBatch batch;
-    for (std::vector<std::pair<int, const CBlockFileInfo*> >::const_iterator it=fileInfo.begin(); it != fileInfo.end(); it++) {
-        batch.Write(make_pair('f', it->first), *it->second);
+    for (std::vector<std::pair<int, CBlockFileInfo> >::const_iterator it=fileInfo.begin(); it != fileInfo.end(); it++) {
+        batch.Write(make_pair('f', it->first), it->second);
     }
     batch.Write('l', nLastFile);
     return WriteBatch(batch, true);
 }
 
-bool CMarketTreeDB::WriteMarketIndex(const std::vector<std::pair<uint256, const marketObj *> >&vect)
+/* Search tokens are keyed by (('k',token),marketid) with the token
+ * written as its bytes and a terminating zero rather than length-
+ * prefixed, so that tokens sort as strings and those with a given
+ * prefix are adjacent. Tokens are letters and digits, never zero.
+ */
+class CTokenKey
+{
+public:
+    string token;
+
+    CTokenKey(const string &tokenIn = string()) : token(tokenIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s, int, int=0) const
+    {
+        s.write(token.data(), token.size());
+        char c = 0;
+        s.write(&c, 1);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s, int, int=0)
+    {
+        token.clear();
+        char c;
+        for(s.read(&c, 1); c; s.read(&c, 1))
+            token += c;
+    }
+
+    unsigned int GetSerializeSize(int, int=0) const
+    {
+        return token.size() + 1;
+    }
+};
+
+bool CMarketTreeDB::WriteMarketIndex(const std::vector<std::pair<uint256, const marketObj *> >&vect, uint32_t nHeight)
 {
     CLevelDBBatch batch;
+    /* the seals written in this batch, which Exists does not see */
+    set<pair<pair<pair<char,uint256>,uint32_t>,uint256> > sealkeys;
 
     std::vector<std::pair<uint256,const marketObj *> >::const_iterator it;
     for (it=vect.begin(); it != vect.end(); it++) {
@@ -278,6 +474,23 @@ bool CMarketTreeDB::WriteMarketIndex(const std::vector<std::pair<uint256, const
            pair<marketDecision,uint256> value = make_pair(*ptr, obj->txid);
            batch.Write(key, value);
            batch.Write(make_pair(make_pair('d',ptr->branchid),objid), value);
+
+           /* schedule the decision's ballot and its closing */
+           marketEvent event;
+           event.branchid = ptr->branchid;
+           event.type = MEVT_DECISION_BALLOT;
+           event.objid = objid;
+           event.nHeight = ptr->eventOverBy;
+           WriteEvent(batch, event);
+           marketBranch *branch = GetBranch(ptr->branchid);
+           if (branch) {
+               event.type = MEVT_BALLOT_CLOSE;
+               event.objid = ptr->branchid;
+               event.nHeight = marketBallotHeight(*branch, ptr->eventOverBy);
+               if (event.nHeight)
+                   WriteEvent(batch, event);
+               delete branch;
+           }
         }
         else
         if (obj->marketop == 'M') {
@@ -286,6 +499,17 @@ bool CMarketTreeDB::WriteMarketIndex(const std::vector<std::pair<uint256, const
            batch.Write(key, value);
            for(size_t i=0; i < ptr->decisionIDs.size(); i++)
                batch.Write(make_pair(make_pair('m',ptr->decisionIDs[i]),objid), value);
+
+           set<string> tokens = marketTokens(*ptr);
+           for(set<string>::const_iterator tit=tokens.begin(); tit != tokens.end(); tit++)
+               batch.Write(make_pair(make_pair('k',CTokenKey(*tit)),objid), '1');
+
+           marketEvent event;
+           event.branchid = ptr->branchid;
+           event.type = MEVT_MARKET_MATURE;
+           event.objid = objid;
+           event.nHeight = ptr->maturation;
+           WriteEvent(batch, event);
         }
         else
         if (obj->marketop == 'O') {
@@ -293,6 +517,41 @@ bool CMarketTreeDB::WriteMarketIndex(const std::vector<std::pair<uint256, const
            pair<marketOutcome,uint256> value = make_pair(*ptr, obj->txid);
            batch.Write(key, value);
            batch.Write(make_pair(make_pair('o',ptr->branchid),objid), value);
+
+           /* the reputation ledger: 'r' holds the latest entry of each
+            * voter and 'h' all of them by height. The 'r' entries the
+            * outcome replaces are kept under ('x',outcomeid), in the
+            * order of its voters, to put back on disconnect. */
+           pair<char,uint256> undokey = make_pair('x', objid);
+           bool fUndo = !Exists(undokey);
+           vector<marketReputation> undo;
+           for(size_t i=0; i < ptr->voterIDs.size(); i++) {
+               marketReputation rep;
+               rep.nHeight = nHeight;
+               rep.outcomeid = objid;
+               if (i < ptr->oldRep.size())
+                   rep.oldRep = ptr->oldRep[i];
+               if (i < ptr->thisRep.size())
+                   rep.thisRep = ptr->thisRep[i];
+               if (i < ptr->smoothedRep.size())
+                   rep.smoothedRep = ptr->smoothedRep[i];
+               const CKeyID &keyID = ptr->voterIDs[i];
+               if (fUndo) {
+                   marketReputation prior;
+                   Read(make_pair(make_pair('r',ptr->branchid),keyID), prior);
+                   undo.push_back(prior);
+               }
+               batch.Write(make_pair(make_pair('r',ptr->branchid),keyID), rep);
+               batch.Write(make_pair(make_pair(make_pair('h',ptr->branchid),keyID),nHeight), rep);
+           }
+           if (fUndo)
+               batch.Write(undokey, undo);
+
+           /* 'e' holds the final value of each decision, for settling */
+           for(size_t i=0; i < ptr->decisionIDs.size(); i++) {
+               if (i < ptr->decisionsFinal.size())
+                   batch.Write(make_pair('e',ptr->decisionIDs[i]), ptr->decisionsFinal[i]);
+           }
         }
         else
         if (obj->marketop == 'S') {
@@ -300,6 +559,17 @@ bool CMarketTreeDB::WriteMarketIndex(const std::vector<std::pair<uint256, const
            pair<marketSealedVote,uint256> value = make_pair(*ptr, obj->txid);
            batch.Write(key, value);
            batch.Write(make_pair(make_pair(make_pair('s',ptr->branchid),ptr->height),objid), value);
+
+           /* 'c' joins the sealed vote to its reveal, the first seal counting */
+           pair<pair<pair<char,uint256>,uint32_t>,uint256> sealkey
+               = make_pair(make_pair(make_pair('c',ptr->branchid),ptr->height),ptr->voteid);
+           if (!sealkeys.count(sealkey) && !Exists(sealkey)) {
+               sealkeys.insert(sealkey);
+               marketVoteSeal seal;
+               seal.sealid = objid;
+               seal.nSealHeight = nHeight;
+               batch.Write(sealkey, seal);
+           }
         }
         else
         if (obj->marketop == 'T') {
@@ -314,11 +584,599 @@ bool CMarketTreeDB::WriteMarketIndex(const std::vector<std::pair<uint256, const
            pair<marketVote,uint256> value = make_pair(*ptr, obj->txid);
            batch.Write(key, value);
            batch.Write(make_pair(make_pair(make_pair('v',ptr->branchid),ptr->height),objid), value);
+
+           /* a reveal counts in a block after its seal, so not one in this batch */
+           pair<pair<pair<char,uint256>,uint32_t>,uint256> sealkey
+               = make_pair(make_pair(make_pair('c',ptr->branchid),ptr->height),objid);
+           marketVoteSeal seal;
+           if (Read(sealkey, seal) && !seal.nRevealHeight && (seal.nSealHeight < nHeight)) {
+               seal.nRevealHeight = nHeight;
+               batch.Write(sealkey, seal);
+           }
+        }
+    }
+    if (!WriteBatch(batch))
+        return false;
+
+    if (!UpdatePositions(vect, true))
+        return false;
+
+    if (!UpdateBranchStats(vect, nHeight, true))
+        return false;
+
+    /* settle the markets of the outcomes now that their decisions
+     * and trades are all in the index */
+    for (it=vect.begin(); it != vect.end(); it++) {
+        if (it->second->marketop == 'O')
+            if (!SettleOutcome(*(const marketOutcome *)it->second, it->first, nHeight))
+                return false;
+    }
+    return true;
+}
+
+/* the markets with the token, or with a token starting with it */
+set<uint256>
+CMarketTreeDB::GetMarketsByToken(const string &token, bool fPrefix)
+{
+    const char marketop = 'k';
+    ostringstream ss;
+    ::Serialize(ss, make_pair(make_pair(marketop, CTokenKey(token)), uint256()), SER_DISK, CLIENT_VERSION);
+
+    set<uint256> ids;
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    for(pcursor->Seek(ss.str()); pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            pair<pair<char,CTokenKey>,uint256> key;
+            ssKey >> key;
+            if (key.first.first != marketop)
+                break;
+            const string &keytoken = key.first.second.token;
+            if (fPrefix) {
+                if (keytoken.compare(0, token.size(), token))
+                    break;
+            }
+            else
+            if (keytoken != token)
+                break;
+            ids.insert(key.second);
+        } catch (const std::exception& e) {
+            error("%s: %s", __func__, e.what());
+            break;
+        }
+    }
+    return ids;
+}
+
+/* The markets matching all the terms, each a token or, ending in '*',
+ * a token prefix. Prefix terms are scanned and intersected; the exact
+ * terms then only check the remaining markets one key at a time.
+ */
+vector<uint256>
+CMarketTreeDB::SearchMarkets(const vector<string> &terms)
+{
+    vector<string> exact;
+    set<uint256> ids;
+    bool fFirst = true;
+    for(size_t i=0; i < terms.size(); i++) {
+        const string &term = terms[i];
+        if (term.empty() || (term[term.size()-1] != '*')) {
+            exact.push_back(term);
+            continue;
+        }
+        set<uint256> matches = GetMarketsByToken(term.substr(0, term.size()-1), true);
+        if (fFirst)
+            ids.swap(matches);
+        else {
+            set<uint256> both;
+            std::set_intersection(ids.begin(), ids.end(), matches.begin(), matches.end(),
+                std::inserter(both, both.begin()));
+            ids.swap(both);
+        }
+        fFirst = false;
+    }
+    if (fFirst && exact.size()) {
+        ids = GetMarketsByToken(exact.back(), false);
+        exact.pop_back();
+    }
+
+    vector<uint256> vec;
+    for(set<uint256>::const_iterator it=ids.begin(); it != ids.end(); it++) {
+        size_t j=0;
+        for(; j < exact.size(); j++)
+            if (!Exists(make_pair(make_pair('k', CTokenKey(exact[j])), *it)))
+                break;
+        if (j == exact.size())
+            vec.push_back(*it);
+    }
+    return vec;
+}
+
+/* Events are keyed by ((('w',height),type),objid) with the height stored
+ * big-endian, unlike the rest of the index, so that a range of heights is
+ * one forward scan.
+ */
+static uint32_t
+EventKeyHeight(uint32_t nHeight)
+{
+    uint32_t nKey;
+    WriteBE32((unsigned char *)&nKey, nHeight);
+    return nKey;
+}
+
+void
+CMarketTreeDB::WriteEvent(CLevelDBBatch &batch, const marketEvent &event)
+{
+    batch.Write(make_pair(make_pair(make_pair('w', EventKeyHeight(event.nHeight)), event.type), event.objid), event);
+}
+
+void
+CMarketTreeDB::EraseEvent(CLevelDBBatch &batch, const marketEvent &event)
+{
+    batch.Erase(make_pair(make_pair(make_pair('w', EventKeyHeight(event.nHeight)), event.type), event.objid));
+}
+
+/* the events scheduled for heights [nFrom, nTo] */
+vector<marketEvent>
+CMarketTreeDB::GetEvents(uint32_t nFrom, uint32_t nTo)
+{
+    const char marketop = 'w';
+    ostringstream ss;
+    ::Serialize(ss, make_pair(marketop, EventKeyHeight(nFrom)), SER_DISK, CLIENT_VERSION);
+
+    vector<marketEvent> vec;
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    for(pcursor->Seek(ss.str()); pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            pair<char,uint32_t> key;
+            ssKey >> key;
+            if (key.first != marketop)
+                break;
+            if (ReadBE32((const unsigned char *)&key.second) > nTo)
+                break;
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+
+            marketEvent event;
+            ssValue >> event;
+            vec.push_back(event);
+        } catch (const std::exception& e) {
+            error("%s: %s", __func__, e.what());
+            break;
         }
     }
+    return vec;
+}
+
+/* The market index is keyed by object id and is simply rewritten when
+ * a block reconnects. What needs taking back is what is found other
+ * than by id or records the block it is in: the positions, which are
+ * running sums, the reputation ledger and settlements of outcomes, the
+ * seals and reveals of votes, the search tokens of markets and the
+ * events the block scheduled.
+ */
+bool CMarketTreeDB::DisconnectMarketIndex(const std::vector<std::pair<uint256, const marketObj *> >&vect, uint32_t nHeight)
+{
+    CLevelDBBatch batch;
+
+    std::vector<std::pair<uint256,const marketObj *> >::const_iterator it;
+    for (it=vect.begin(); it != vect.end(); it++) {
+        const marketObj *obj = it->second;
+        if (obj->marketop == 'O') {
+            const marketOutcome *ptr = (const marketOutcome *) obj;
+            pair<char,uint256> undokey = make_pair('x', it->first);
+            vector<marketReputation> undo;
+            if (Read(undokey, undo)) {
+                for(size_t i=0; i < ptr->voterIDs.size(); i++) {
+                    const CKeyID &keyID = ptr->voterIDs[i];
+                    batch.Erase(make_pair(make_pair(make_pair('h',ptr->branchid),keyID),nHeight));
+                    if ((i < undo.size()) && !undo[i].outcomeid.IsNull())
+                        batch.Write(make_pair(make_pair('r',ptr->branchid),keyID), undo[i]);
+                    else
+                        batch.Erase(make_pair(make_pair('r',ptr->branchid),keyID));
+                }
+                batch.Erase(undokey);
+            }
+            UnsettleOutcome(batch, *ptr, it->first);
+            continue;
+        }
+        if (obj->marketop == 'M') {
+            set<string> tokens = marketTokens(*(const marketMarket *) obj);
+            for(set<string>::const_iterator tit=tokens.begin(); tit != tokens.end(); tit++)
+                batch.Erase(make_pair(make_pair('k',CTokenKey(*tit)),it->first));
+            continue;
+        }
+        if ((obj->marketop != 'S') && (obj->marketop != 'V'))
+            continue;
+
+        pair<pair<pair<char,uint256>,uint32_t>,uint256> sealkey;
+        if (obj->marketop == 'S') {
+            const marketSealedVote *ptr = (const marketSealedVote *) obj;
+            sealkey = make_pair(make_pair(make_pair('c',ptr->branchid),ptr->height),ptr->voteid);
+        } else {
+            const marketVote *ptr = (const marketVote *) obj;
+            sealkey = make_pair(make_pair(make_pair('c',ptr->branchid),ptr->height),it->first);
+        }
+        marketVoteSeal seal;
+        if (!Read(sealkey, seal))
+            continue;
+        if ((obj->marketop == 'S') && (seal.sealid == it->first) && (seal.nSealHeight == nHeight))
+            batch.Erase(sealkey);
+        else
+        if ((obj->marketop == 'V') && (seal.nRevealHeight == nHeight)) {
+            seal.nRevealHeight = 0;
+            batch.Write(sealkey, seal);
+        }
+    }
+    if (!WriteBatch(batch))
+        return false;
+
+    if (!UpdateBranchStats(vect, nHeight, false))
+        return false;
+
+    /* the events the block's decisions and markets scheduled go after
+     * the branch totals, which count the maturities among them. The
+     * closing of a ballot is the branch's, shared with its other
+     * decisions, and goes below once none of them is left. */
+    CLevelDBBatch eventbatch;
+    set<pair<uint256, uint32_t> > ballots;
+    for (it=vect.begin(); it != vect.end(); it++) {
+        marketEvent event;
+        event.objid = it->first;
+        if (it->second->marketop == 'D') {
+            const marketDecision *ptr = (const marketDecision *) it->second;
+            event.type = MEVT_DECISION_BALLOT;
+            event.nHeight = ptr->eventOverBy;
+            ballots.insert(make_pair(ptr->branchid, ptr->eventOverBy));
+        }
+        else
+        if (it->second->marketop == 'M') {
+            event.type = MEVT_MARKET_MATURE;
+            event.nHeight = ((const marketMarket *) it->second)->maturation;
+        }
+        else
+            continue;
+        EraseEvent(eventbatch, event);
+    }
+    if (!WriteBatch(eventbatch))
+        return false;
+
+    /* a ballot closes at marketBallotHeight for the decisions whose
+     * events are over by [nClose - tau, nClose) less the ballot and
+     * unseal times: its closing goes with the last of them */
+    CLevelDBBatch closebatch;
+    set<pair<uint256, uint32_t> > closings;
+    set<pair<uint256, uint32_t> >::const_iterator bit;
+    for(bit=ballots.begin(); bit != ballots.end(); bit++) {
+        marketBranch *branch = GetBranch(bit->first);
+        if (!branch)
+            continue;
+        uint32_t nClose = marketBallotHeight(*branch, bit->second);
+        uint32_t nDelay = branch->ballotTime + branch->unsealTime;
+        uint32_t nLast = nClose - 1 - nDelay;
+        uint32_t nFirst = (nClose > branch->tau + nDelay)? nClose - branch->tau - nDelay: 0;
+        delete branch;
+        if (!nClose || !closings.insert(make_pair(bit->first, nClose)).second)
+            continue;
+
+        vector<marketEvent> events = GetEvents(nFirst, nLast);
+        size_t i;
+        for(i=0; i < events.size(); i++)
+            if ((events[i].type == MEVT_DECISION_BALLOT) && (events[i].branchid == bit->first))
+                break;
+        if (i < events.size())
+            continue;
+        marketEvent event;
+        event.branchid = bit->first;
+        event.type = MEVT_BALLOT_CLOSE;
+        event.objid = bit->first;
+        event.nHeight = nClose;
+        EraseEvent(closebatch, event);
+    }
+    if (!WriteBatch(closebatch))
+        return false;
+
+    return UpdatePositions(vect, false);
+}
+
+/* Add the trades to (or take them from) their holders' positions under
+ * ((('n',keyID),marketid),decisionState). ('u',tradeid) marks a trade as
+ * counted so that writing a block twice does not count it twice.
+ */
+bool CMarketTreeDB::UpdatePositions(const std::vector<std::pair<uint256, const marketObj *> >&vect, bool fConnect)
+{
+    typedef pair<pair<pair<char,CKeyID>,uint256>,uint32_t> positionKey;
+
+    CLevelDBBatch batch;
+    map<positionKey, marketPosition> positions;
+
+    std::vector<std::pair<uint256,const marketObj *> >::const_iterator it;
+    for (it=vect.begin(); it != vect.end(); it++) {
+        if (it->second->marketop != 'T')
+            continue;
+        const uint256 &tradeid = it->first;
+        const marketTrade *trade = (const marketTrade *) it->second;
+        if (Exists(make_pair('u', tradeid)) == fConnect)
+            continue;
+
+        positionKey key = make_pair(make_pair(make_pair('n', trade->keyID), trade->marketid), trade->decisionState);
+        map<positionKey, marketPosition>::iterator pit = positions.find(key);
+        if (pit == positions.end()) {
+            marketPosition pos;
+            if (!Read(key, pos)) {
+                pos.keyID = trade->keyID;
+                pos.marketid = trade->marketid;
+                pos.decisionState = trade->decisionState;
+            }
+            pit = positions.insert(make_pair(key, pos)).first;
+        }
+        marketPosition &pos = pit->second;
+
+        int64_t nShares = (int64_t)trade->nShares;
+        int64_t cost = (int64_t)(trade->nShares * (trade->price * 1e-8) + 0.5);
+        if (!trade->isBuy) {
+            nShares = -nShares;
+            cost = -cost;
+        }
+        if (fConnect) {
+            pos.nShares += nShares;
+            pos.cost += cost;
+            pos.nTrades++;
+            batch.Write(make_pair('u', tradeid), '1');
+        } else {
+            pos.nShares -= nShares;
+            pos.cost -= cost;
+            pos.nTrades--;
+            batch.Erase(make_pair('u', tradeid));
+        }
+    }
+
+    map<positionKey, marketPosition>::const_iterator pit;
+    for(pit=positions.begin(); pit != positions.end(); pit++) {
+        if (pit->second.nTrades)
+            batch.Write(pit->first, pit->second);
+        else
+            batch.Erase(pit->first);
+    }
+    return WriteBatch(batch);
+}
+
+static marketBranchStats &
+BranchStats(CMarketTreeDB *db, map<uint256, marketBranchStats> &stats, const uint256 &branchid)
+{
+    map<uint256, marketBranchStats>::iterator it = stats.find(branchid);
+    if (it == stats.end()) {
+        marketBranchStats st;
+        db->Read(make_pair('a', branchid), st);
+        it = stats.insert(make_pair(branchid, st)).first;
+    }
+    return it->second;
+}
+
+/* Add the block's objects to (or take them from) the running totals of
+ * their branches under ('a',branchid), and count the markets maturing
+ * at the block. ('g',objid) marks an object as counted, and holds an
+ * outcome's previous voter count to restore on disconnect; the same
+ * for a market's maturity is (('g',marketid),'m').
+ */
+bool CMarketTreeDB::UpdateBranchStats(const std::vector<std::pair<uint256, const marketObj *> >&vect, uint32_t nHeight, bool fConnect)
+{
+    CLevelDBBatch batch;
+    map<uint256, marketBranchStats> stats;
+    int sign = (fConnect)? 1: -1;
+
+    /* on disconnect the maturities go first, being counted last */
+    vector<marketEvent> events = GetEvents(nHeight, nHeight);
+    for(size_t i=0; !fConnect && (i < events.size()); i++) {
+        const marketEvent &event = events[i];
+        pair<pair<char,uint256>,char> key = make_pair(make_pair('g', event.objid), 'm');
+        if ((event.type != MEVT_MARKET_MATURE) || !Exists(key))
+            continue;
+        BranchStats(this, stats, event.branchid).nOpenMarkets++;
+        batch.Erase(key);
+    }
+
+    map<uint256, uint256> marketBranches;
+    std::vector<std::pair<uint256,const marketObj *> >::const_iterator it;
+    for (it=vect.begin(); it != vect.end(); it++)
+        if (it->second->marketop == 'M')
+            marketBranches[it->first] = ((const marketMarket *) it->second)->branchid;
+
+    for (it=vect.begin(); it != vect.end(); it++) {
+        const uint256 &objid = it->first;
+        const marketObj *obj = it->second;
+        if ((obj->marketop != 'D') && (obj->marketop != 'M')
+            && (obj->marketop != 'O') && (obj->marketop != 'T'))
+            continue;
+
+        pair<char,uint256> key = make_pair('g', objid);
+        uint32_t nPrior = 0;
+        if (Read(key, nPrior) == fConnect)
+            continue;
+
+        if (obj->marketop == 'D') {
+            const marketDecision *ptr = (const marketDecision *) obj;
+            marketBranchStats &st = BranchStats(this, stats, ptr->branchid);
+            st.nDecisions += sign;
+            st.nPendingDecisions += sign;
+        }
+        else
+        if (obj->marketop == 'M') {
+            const marketMarket *ptr = (const marketMarket *) obj;
+            marketBranchStats &st = BranchStats(this, stats, ptr->branchid);
+            st.nMarkets += sign;
+            /* one maturing at this block is counted off below */
+            if (ptr->maturation >= nHeight)
+                st.nOpenMarkets += sign;
+        }
+        else
+        if (obj->marketop == 'O') {
+            const marketOutcome *ptr = (const marketOutcome *) obj;
+            marketBranchStats &st = BranchStats(this, stats, ptr->branchid);
+            st.nOutcomes += sign;
+            st.nPendingDecisions -= sign * ptr->decisionIDs.size();
+            if (fConnect) {
+                nPrior = st.nVoters;
+                st.nVoters = ptr->nVoters;
+            } else
+                st.nVoters = nPrior;
+        }
+        else {
+            const marketTrade *ptr = (const marketTrade *) obj;
+            map<uint256, uint256>::const_iterator mit = marketBranches.find(ptr->marketid);
+            if (mit == marketBranches.end()) {
+                marketMarket *market = GetMarket(ptr->marketid);
+                if (!market)
+                    continue;
+                mit = marketBranches.insert(make_pair(ptr->marketid, market->branchid)).first;
+                delete market;
+            }
+            marketBranchStats &st = BranchStats(this, stats, mit->second);
+            int64_t nShares = (int64_t)ptr->nShares;
+            int64_t cost = (int64_t)(ptr->nShares * (ptr->price * 1e-8) + 0.5);
+            st.nTrades += sign;
+            st.volume += sign * cost;
+            st.openInterest += sign * ((ptr->isBuy)? nShares: -nShares);
+        }
+
+        if (fConnect)
+            batch.Write(key, nPrior);
+        else
+            batch.Erase(key);
+    }
+
+    for(size_t i=0; fConnect && (i < events.size()); i++) {
+        const marketEvent &event = events[i];
+        pair<pair<char,uint256>,char> key = make_pair(make_pair('g', event.objid), 'm');
+        if ((event.type != MEVT_MARKET_MATURE) || Exists(key))
+            continue;
+        BranchStats(this, stats, event.branchid).nOpenMarkets--;
+        batch.Write(key, '1');
+    }
+
+    map<uint256, marketBranchStats>::const_iterator sit;
+    for(sit=stats.begin(); sit != stats.end(); sit++)
+        batch.Write(make_pair('a', sit->first), sit->second);
     return WriteBatch(batch);
 }
 
+bool
+CMarketTreeDB::GetBranchStats(const uint256 &branchid, marketBranchStats &stats)
+{
+    return Read(make_pair('a', branchid), stats);
+}
+
+/* Settle every market the outcome completes in a single pass: each
+ * market's trades are read once and netted per holder and state, each
+ * state is valued once from the final values of the market's decisions
+ * and one payout record is written per holder under 'p'. A market
+ * with a decision still outstanding is left for a later outcome.
+ * The primary records outlive the blocks they came in, so only the
+ * markets and trades of the active chain count: those marked under
+ * ('g',marketid) and ('u',tradeid) by UpdateBranchStats and
+ * UpdatePositions.
+ */
+bool
+CMarketTreeDB::SettleOutcome(const marketOutcome &outcome, const uint256 &outcomeid, uint32_t nHeight)
+{
+    CLevelDBBatch batch;
+
+    set<uint256> marketids;
+    for(size_t i=0; i < outcome.decisionIDs.size(); i++) {
+        vector<marketMarket *> markets = GetMarkets(outcome.decisionIDs[i]);
+        for(size_t j=0; j < markets.size(); j++) {
+            const marketMarket *market = markets[j];
+            if (marketids.insert(market->GetHash()).second
+                && Exists(make_pair('g', market->GetHash()))) {
+                vector<double> decisionsFinal;
+                for(size_t k=0; k < market->decisionIDs.size(); k++) {
+                    uint64_t value;
+                    if (!Read(make_pair('e',market->decisionIDs[k]), value))
+                        break;
+                    decisionsFinal.push_back(value*1e-8);
+                }
+                if (decisionsFinal.size() == market->decisionIDs.size())
+                    SettleMarket(batch, *market, decisionsFinal, outcomeid, nHeight);
+            }
+            delete market;
+        }
+    }
+    return WriteBatch(batch);
+}
+
+/* Take back what SettleOutcome wrote: the final values of the
+ * outcome's decisions under 'e' and the payouts it settled under 'p'.
+ */
+void
+CMarketTreeDB::UnsettleOutcome(CLevelDBBatch &batch, const marketOutcome &outcome, const uint256 &outcomeid)
+{
+    set<uint256> marketids;
+    for(size_t i=0; i < outcome.decisionIDs.size(); i++) {
+        batch.Erase(make_pair('e',outcome.decisionIDs[i]));
+        vector<marketMarket *> markets = GetMarkets(outcome.decisionIDs[i]);
+        for(size_t j=0; j < markets.size(); j++) {
+            uint256 marketid = markets[j]->GetHash();
+            delete markets[j];
+            if (!marketids.insert(marketid).second)
+                continue;
+            vector<marketPayout> payouts = GetPayouts(marketid);
+            for(size_t k=0; k < payouts.size(); k++)
+                if (payouts[k].outcomeid == outcomeid)
+                    batch.Erase(make_pair(make_pair('p',marketid),payouts[k].keyID));
+        }
+    }
+}
+
+void
+CMarketTreeDB::SettleMarket(CLevelDBBatch &batch, const marketMarket &market, const vector<double> &decisionsFinal, const uint256 &outcomeid, uint32_t nHeight)
+{
+    uint256 marketid = market.GetHash();
+
+    map<CKeyID, marketPayout> payouts;
+    vector<marketTrade *> trades = GetTrades(marketid);
+    for(size_t i=0; i < trades.size(); i++) {
+        const marketTrade *trade = trades[i];
+        if (!Exists(make_pair('u', trade->GetHash()))) {
+            delete trade;
+            continue;
+        }
+        marketPayout &payout = payouts[trade->keyID];
+        int64_t &nShares = payout.nShares[trade->decisionState];
+        if (trade->isBuy)
+            nShares += (int64_t)trade->nShares;
+        else
+            nShares -= (int64_t)trade->nShares;
+        delete trade;
+    }
+
+    map<uint32_t, double> values;
+    map<CKeyID, marketPayout>::iterator it;
+    for(it=payouts.begin(); it != payouts.end(); it++) {
+        marketPayout &payout = it->second;
+        payout.marketid = marketid;
+        payout.keyID = it->first;
+        payout.nHeight = nHeight;
+        payout.outcomeid = outcomeid;
+
+        double sum = 0.0;
+        map<uint32_t, int64_t>::const_iterator sit;
+        for(sit=payout.nShares.begin(); sit != payout.nShares.end(); sit++) {
+            map<uint32_t, double>::const_iterator vit = values.find(sit->first);
+            if (vit == values.end())
+                vit = values.insert(make_pair(sit->first, marketStateValue(market, decisionsFinal, sit->first))).first;
+            sum += sit->second * vit->second;
+        }
+        payout.payout = (int64_t)((sum < 0.0)? sum - 0.5: sum + 0.5);
+        batch.Write(make_pair(make_pair('p',marketid),payout.keyID), payout);
+    }
+}
+
 bool CMarketTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair('F', name), fValue ? '1' : '0');
 }
@@ -331,6 +1189,29 @@ bool CMarketTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
+/* whether the object is in the index from a transaction other than
+ * txid. A transaction from a disconnected block is not a duplicate of
+ * itself. Each value ends with its txid, so only that is read.
+ */
+bool
+CMarketTreeDB::IsMarketObjDuplicate(char marketop, const uint256 &objid, const uint256 &txid)
+{
+    ostringstream ss;
+    ::Serialize(ss, make_pair(marketop, objid), SER_DISK, CLIENT_VERSION);
+    std::string strKey = ss.str();
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    pcursor->Seek(strKey);
+    if (!pcursor->Valid() || (pcursor->key() != leveldb::Slice(strKey)))
+        return false;
+
+    leveldb::Slice slValue = pcursor->value();
+    uint256 objtxid;
+    if (slValue.size() < objtxid.size())
+        return true;
+    memcpy(objtxid.begin(), slValue.data() + slValue.size() - objtxid.size(), objtxid.size());
+    return (objtxid != txid);
+}
+
 marketBranch *
 CMarketTreeDB::GetBranch(const uint256 &objid)
 {
@@ -771,3 +1652,194 @@ CMarketTreeDB::GetVotes(const uint256 & /* branchid */ id, uint32_t height)
     return vec;
 }
 
+/* hand the ballot's votes to fn one at a time, straight from the
+ * cursor, until fn returns false */
+bool
+CMarketTreeDB::ScanVotes(const uint256 &branchid, uint32_t height, boost::function<bool (const marketVote &)> fn)
+{
+    const char marketop = 'v';
+    ostringstream ss;
+    ::Serialize(ss, make_pair(make_pair(make_pair(marketop, branchid), height), uint256()), SER_DISK, CLIENT_VERSION);
+
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    for(pcursor->Seek(ss.str()); pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            pair<pair<char,uint256>,uint32_t> key;
+            ssKey >> key;
+            if (key.first.first != marketop)
+                break;
+            if (key.first.second != branchid)
+                break;
+            if (key.second != height)
+                break;
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+
+            marketVote vote;
+            ssValue >> vote;
+            ssValue >> vote.txid;
+            if (!fn(vote))
+                return false;
+        } catch (const std::exception& e) {
+            return error("%s: %s", __func__, e.what());
+        }
+    }
+    return true;
+}
+
+bool
+CMarketTreeDB::GetReputation(const uint256 &branchid, const CKeyID &keyID, marketReputation &rep)
+{
+    return Read(make_pair(make_pair('r', branchid), keyID), rep);
+}
+
+static bool
+CompareReputationHeight(const marketReputation &a, const marketReputation &b)
+{
+    return a.nHeight < b.nHeight;
+}
+
+vector<marketReputation>
+CMarketTreeDB::GetReputationHistory(const uint256 &branchid, const CKeyID &keyID)
+{
+    const char marketop = 'h';
+    ostringstream ss;
+    ::Serialize(ss, make_pair(make_pair(make_pair(marketop, branchid), keyID), (uint32_t) 0), SER_DISK, CLIENT_VERSION);
+
+    vector<marketReputation> vec;
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    for(pcursor->Seek(ss.str()); pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            pair<pair<char,uint256>,CKeyID> key;
+            ssKey >> key;
+            if (key.first.first != marketop)
+                break;
+            if (key.first.second != branchid)
+                break;
+            if (key.second != keyID)
+                break;
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+
+            marketReputation rep;
+            ssValue >> rep;
+            vec.push_back(rep);
+        } catch (const std::exception& e) {
+            error("%s: %s", __func__, e.what());
+            break;
+        }
+    }
+
+    /* heights are stored little-endian, so the keys are not in order */
+    std::sort(vec.begin(), vec.end(), CompareReputationHeight);
+    return vec;
+}
+
+bool
+CMarketTreeDB::GetPayout(const uint256 &marketid, const CKeyID &keyID, marketPayout &payout)
+{
+    return Read(make_pair(make_pair('p', marketid), keyID), payout);
+}
+
+vector<marketPayout>
+CMarketTreeDB::GetPayouts(const uint256 & /* marketid */ id)
+{
+    const char marketop = 'p';
+    ostringstream ss;
+    ::Serialize(ss, make_pair(make_pair(marketop, id), CKeyID()), SER_DISK, CLIENT_VERSION);
+
+    vector<marketPayout> vec;
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    for(pcursor->Seek(ss.str()); pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            pair<char,uint256> key;
+            ssKey >> key;
+            if (key.first != marketop)
+                break;
+            if (key.second != id)
+                break;
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+
+            marketPayout payout;
+            ssValue >> payout;
+            vec.push_back(payout);
+        } catch (const std::exception& e) {
+            error("%s: %s", __func__, e.what());
+            break;
+        }
+    }
+    return vec;
+}
+
+bool
+CMarketTreeDB::GetPosition(const CKeyID &keyID, const uint256 &marketid, uint32_t decisionState, marketPosition &pos)
+{
+    return Read(make_pair(make_pair(make_pair('n', keyID), marketid), decisionState), pos);
+}
+
+/* the address's positions, in one market or (with a null marketid) all */
+vector<marketPosition>
+CMarketTreeDB::GetPositions(const CKeyID &keyID, const uint256 &marketid)
+{
+    const char marketop = 'n';
+    ostringstream ss;
+    ::Serialize(ss, make_pair(make_pair(make_pair(marketop, keyID), marketid), (uint32_t) 0), SER_DISK, CLIENT_VERSION);
+
+    vector<marketPosition> vec;
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    for(pcursor->Seek(ss.str()); pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            pair<pair<char,CKeyID>,uint256> key;
+            ssKey >> key;
+            if (key.first.first != marketop)
+                break;
+            if (key.first.second != keyID)
+                break;
+            if (!marketid.IsNull() && (key.second != marketid))
+                break;
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+
+            marketPosition pos;
+            ssValue >> pos;
+            vec.push_back(pos);
+        } catch (const std::exception& e) {
+            error("%s: %s", __func__, e.what());
+            break;
+        }
+    }
+    return vec;
+}
+
+bool
+CMarketTreeDB::GetVoteSeal(const uint256 &branchid, uint32_t height, const uint256 &voteid, marketVoteSeal &seal)
+{
+    return Read(make_pair(make_pair(make_pair('c', branchid), height), voteid), seal);
+}
+
+/* whether the vote was sealed and revealed in time for its ballot */
+bool
+CMarketTreeDB::IsVoteSealed(const marketBranch &branch, const marketVote &vote)
+{
+    marketVoteSeal seal;
+    if (!GetVoteSeal(vote.branchid, vote.height, vote.GetHash(), seal))
+        return false;
+    return marketVoteInTime(branch, vote.height, seal);
+}
@@ -16,7 +16,14 @@
 #include <utility>
 #include <vector>
 
+#include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+class CBlockTreeDB;
 class CCoins;
+class CMarketTreeDB;
 class uint256;
 
 //! -dbcache default (MiB)
@@ -39,6 +46,77 @@ public:
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
     bool GetStats(CCoinsStats &stats) const;
+    bool ForEachCoins(boost::function<bool (const uint256 &txid, const CCoins &coins)> fn) const;
+};
+
+/**
+ * Writes the chainstate to the databases on a thread of its own.
+ *
+ * The coins tip flushes into this view, which takes the entries over,
+ * serves them to readers and has its thread write them, so blocks go on
+ * being connected during the write. The block files and index queued
+ * with QueueBlockIndex go to their databases first, as in a synchronous
+ * flush, and the best block marker is written in one batch with the
+ * coins: a crash part way through leaves the chainstate at the previous
+ * flush, with the index it refers to on disk.
+ *
+ * One flush is written at a time; the next waits for it to finish, so at
+ * most one cache's worth of entries is held here. The view below must
+ * leave the map it is given alone, as CCoinsViewDB does.
+ */
+class CCoinsViewFlusher : public CCoinsViewBacked
+{
+private:
+    CBlockTreeDB *blocktree;
+    CMarketTreeDB *markettree;
+
+    //! Mutex to protect the inner state
+    mutable boost::mutex mutex;
+
+    //! Signalled when a flush is handed over, and when it is written
+    mutable boost::condition_variable cond;
+
+    //! Whether a flush is being written; it does not change until it is
+    bool fWriting;
+    //! Cleared when a write fails, after which every flush fails
+    bool fOk;
+    bool fStop;
+
+    //! The flush being written
+    CCoinsMap mapWriting;
+    uint256 hashBlockWriting;
+    bool fIndexWriting;
+    std::vector<std::pair<int, CBlockFileInfo> > vFilesWriting;
+    int nLastFileWriting;
+    std::vector<CDiskBlockIndex> vBlocksWriting;
+
+    //! The index queued for the next flush
+    bool fIndexQueued;
+    std::vector<std::pair<int, CBlockFileInfo> > vFilesQueued;
+    int nLastFileQueued;
+    std::vector<CDiskBlockIndex> vBlocksQueued;
+
+    boost::thread thread;
+
+    bool Write();
+    void Thread();
+
+public:
+    CCoinsViewFlusher(CCoinsView *viewIn, CBlockTreeDB *blocktreeIn, CMarketTreeDB *markettreeIn);
+    ~CCoinsViewFlusher();
+
+    bool GetCoins(const uint256 &txid, CCoins &coins) const;
+    bool HaveCoins(const uint256 &txid) const;
+    uint256 GetBestBlock() const;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    bool GetStats(CCoinsStats &stats) const;
+    bool ForEachCoins(boost::function<bool (const uint256 &txid, const CCoins &coins)> fn) const;
+
+    /** Queue block files and index entries to be written ahead of the next flush's coins. They are swapped out. */
+    void QueueBlockIndex(std::vector<std::pair<int, CBlockFileInfo> > &vFiles, int nLastFile, std::vector<CDiskBlockIndex> &vBlocks);
+
+    /** Wait until the flush handed over last is written. Returns false if a write failed. */
+    bool Wait() const;
 };
 
 /** Access to the block database (blocks/index/) */
@@ -50,7 +128,7 @@ private:
     CBlockTreeDB(const CBlockTreeDB&);
     void operator=(const CBlockTreeDB&);
 public:
-    bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
+    bool WriteBatchSync(const std::vector<std::pair<int, CBlockFileInfo> >& fileInfo, int nLastFile, const std::vector<CDiskBlockIndex>& blockinfo);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &fileinfo);
     bool ReadLastBlockFile(int &nFile);
     bool WriteReindexing(bool fReindex);
@@ -67,15 +145,17 @@ class CMarketTreeDB : public CLevelDBWrapper
 {
 public:
     CMarketTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
-    bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
+    bool WriteBatchSync(const std::vector<std::pair<int, CBlockFileInfo> >& fileInfo, int nLastFile, const std::vector<CDiskBlockIndex>& blockinfo);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &fileinfo);
     bool ReadLastBlockFile(int &nFile);
     bool WriteReindexing(bool fReindex);
     bool ReadReindexing(bool &fReindex);
-    bool WriteMarketIndex(const std::vector<std::pair<uint256, const marketObj *> > &list);
+    bool WriteMarketIndex(const std::vector<std::pair<uint256, const marketObj *> > &list, uint32_t nHeight);
+    bool DisconnectMarketIndex(const std::vector<std::pair<uint256, const marketObj *> > &list, uint32_t nHeight);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
 
+    bool IsMarketObjDuplicate(char marketop, const uint256 &objid, const uint256 &txid);
     marketBranch *GetBranch(const uint256 &);
     marketDecision *GetDecision(const uint256 &);
     marketMarket *GetMarket(const uint256 &);
@@ -90,6 +170,42 @@ public:
     vector<marketOutcome *> GetOutcomes(const uint256 &);
     vector<marketTrade *> GetTrades(const uint256 &);
     vector<marketVote *> GetVotes(const uint256 &, uint32_t);
+    bool ScanVotes(const uint256 &branchid, uint32_t height, boost::function<bool (const marketVote &)> fn);
+
+    /** The reputation ledger: each voter's latest and past reputations */
+    bool GetReputation(const uint256 &branchid, const CKeyID &keyID, marketReputation &rep);
+    vector<marketReputation> GetReputationHistory(const uint256 &branchid, const CKeyID &keyID);
+
+    /** Settlement: each holder's payout from a market once its decisions are final */
+    bool SettleOutcome(const marketOutcome &outcome, const uint256 &outcomeid, uint32_t nHeight);
+    bool GetPayout(const uint256 &marketid, const CKeyID &keyID, marketPayout &payout);
+    vector<marketPayout> GetPayouts(const uint256 &marketid);
+
+    /** Positions: each address's net shares in each market state */
+    bool GetPosition(const CKeyID &keyID, const uint256 &marketid, uint32_t decisionState, marketPosition &pos);
+    vector<marketPosition> GetPositions(const CKeyID &keyID, const uint256 &marketid = uint256());
+
+    /** Sealed votes joined with the votes revealing them */
+    bool GetVoteSeal(const uint256 &branchid, uint32_t height, const uint256 &voteid, marketVoteSeal &seal);
+    bool IsVoteSealed(const marketBranch &branch, const marketVote &vote);
+
+    /** The scheduler: transitions of decisions, markets and ballots by height */
+    vector<marketEvent> GetEvents(uint32_t nFrom, uint32_t nTo);
+
+    /** Search: markets by the tokens of their titles and tags */
+    set<uint256> GetMarketsByToken(const string &token, bool fPrefix);
+    vector<uint256> SearchMarkets(const vector<string> &terms);
+
+    /** Running totals of each branch */
+    bool GetBranchStats(const uint256 &branchid, marketBranchStats &stats);
+
+private:
+    void WriteEvent(CLevelDBBatch &batch, const marketEvent &event);
+    void EraseEvent(CLevelDBBatch &batch, const marketEvent &event);
+    bool UpdatePositions(const std::vector<std::pair<uint256, const marketObj *> > &list, bool fConnect);
+    bool UpdateBranchStats(const std::vector<std::pair<uint256, const marketObj *> > &list, uint32_t nHeight, bool fConnect);
+    void SettleMarket(CLevelDBBatch &batch, const marketMarket &market, const vector<double> &decisionsFinal, const uint256 &outcomeid, uint32_t nHeight);
+    void UnsettleOutcome(CLevelDBBatch &batch, const marketOutcome &outcome, const uint256 &outcomeid);
 };
 
 #endif // TRUTHCOIN_TXDB_H
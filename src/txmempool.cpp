@@ -8,6 +8,7 @@
 
 #include "clientversion.h"
 #include "main.h"
+#include "primitives/market.h"
 #include "streams.h"
 #include "util.h"
 #include "utilmoneystr.h"
@@ -420,6 +421,21 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
 }
 
 
+void GetMarketObjIds(const CTransaction& tx, std::vector<std::pair<uint256, char> >& vobj)
+{
+    BOOST_FOREACH(const CTxOut& txout, tx.vout) {
+        const CScript& scriptPubKey = txout.scriptPubKey;
+        size_t script_sz = scriptPubKey.size();
+        if ((script_sz < 2) || (scriptPubKey[script_sz-1] != OP_MARKET))
+            continue;
+        marketObj *obj = marketObjCtr(scriptPubKey);
+        if (!obj)
+            continue;
+        vobj.push_back(std::make_pair(obj->GetHash(), obj->marketop));
+        delete obj;
+    }
+}
+
 bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry)
 {
     // Add to memory pool without checking anything.
@@ -431,6 +447,10 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry)
         const CTransaction& tx = mapTx[hash].GetTx();
         for (unsigned int i = 0; i < tx.vin.size(); i++)
             mapNextTx[tx.vin[i].prevout] = CInPoint(&tx, i);
+        std::vector<std::pair<uint256, char> > vobj;
+        GetMarketObjIds(tx, vobj);
+        for (unsigned int i = 0; i < vobj.size(); i++)
+            mapMarketObj[vobj[i].first] = std::make_pair(hash, vobj[i].second);
         nTransactionsUpdated++;
         totalTxSize += entry.GetTxSize();
     }
@@ -462,6 +482,13 @@ void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& rem
             }
             BOOST_FOREACH(const CTxIn& txin, tx.vin)
                 mapNextTx.erase(txin.prevout);
+            std::vector<std::pair<uint256, char> > vobj;
+            GetMarketObjIds(tx, vobj);
+            for (unsigned int i = 0; i < vobj.size(); i++) {
+                std::map<uint256, std::pair<uint256, char> >::iterator it = mapMarketObj.find(vobj[i].first);
+                if ((it != mapMarketObj.end()) && (it->second.first == hash))
+                    mapMarketObj.erase(it);
+            }
 
             removed.push_back(tx);
             totalTxSize -= mapTx[hash].GetTxSize();
@@ -511,6 +538,20 @@ void CTxMemPool::removeConflicts(const CTransaction &tx, std::list<CTransaction>
             }
         }
     }
+
+    // Remove transactions carrying the same market objects as tx
+    std::vector<std::pair<uint256, char> > vobj;
+    GetMarketObjIds(tx, vobj);
+    for (unsigned int i = 0; i < vobj.size(); i++) {
+        std::map<uint256, std::pair<uint256, char> >::const_iterator it = mapMarketObj.find(vobj[i].first);
+        if ((it == mapMarketObj.end()) || (it->second.first == tx.GetHash()))
+            continue;
+        std::map<uint256, CTxMemPoolEntry>::const_iterator it2 = mapTx.find(it->second.first);
+        if (it2 != mapTx.end()) {
+            const CTransaction txConflict = it2->second.GetTx();
+            remove(txConflict, removed, true);
+        }
+    }
 }
 
 /**
@@ -543,6 +584,7 @@ void CTxMemPool::clear()
     LOCK(cs);
     mapTx.clear();
     mapNextTx.clear();
+    mapMarketObj.clear();
     totalTxSize = 0;
     ++nTransactionsUpdated;
 }
@@ -616,9 +658,22 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         assert(it->first == it->second.ptx->vin[it->second.n].prevout);
     }
 
+    for (std::map<uint256, std::pair<uint256, char> >::const_iterator it = mapMarketObj.begin(); it != mapMarketObj.end(); it++)
+        assert(mapTx.count(it->second.first));
+
     assert(totalTxSize == checkTotal);
 }
 
+void CTxMemPool::queryMarketObjs(char marketop, std::vector<std::pair<uint256, uint256> >& vobj)
+{
+    vobj.clear();
+
+    LOCK(cs);
+    for (std::map<uint256, std::pair<uint256, char> >::const_iterator it = mapMarketObj.begin(); it != mapMarketObj.end(); it++)
+        if (!marketop || (it->second.second == marketop))
+            vobj.push_back(std::make_pair(it->first, it->second.first));
+}
+
 void CTxMemPool::queryHashes(vector<uint256>& vtxid)
 {
     vtxid.clear();
@@ -8,6 +8,7 @@
 #define TRUTHCOIN_TXMEMPOOL_H
 
 #include <list>
+#include <vector>
 
 #include "amount.h"
 #include "coins.h"
@@ -61,6 +62,9 @@ public:
 
 class CMinerPolicyEstimator;
 
+/** The market objects carried by a transaction's outputs, as (objid, marketop) */
+void GetMarketObjIds(const CTransaction& tx, std::vector<std::pair<uint256, char> >& vobj);
+
 /** An inpoint - a combination of a transaction and an index n into its vin */
 class CInPoint
 {
@@ -99,6 +103,7 @@ public:
     std::map<uint256, CTxMemPoolEntry> mapTx;
     std::map<COutPoint, CInPoint> mapNextTx;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    std::map<uint256, std::pair<uint256, char> > mapMarketObj; //! market object id -> (txid, marketop)
 
     CTxMemPool(const CFeeRate& _minRelayFee);
     ~CTxMemPool();
@@ -148,6 +153,15 @@ public:
 
     bool lookup(uint256 hash, CTransaction& result) const;
 
+    /** Whether a transaction in the pool carries the market object */
+    bool existsMarketObj(const uint256& objid)
+    {
+        LOCK(cs);
+        return (mapMarketObj.count(objid) != 0);
+    }
+    /** The pool's market objects of one marketop, or all for 0, as (objid, txid) */
+    void queryMarketObjs(char marketop, std::vector<std::pair<uint256, uint256> >& vobj);
+
     /** Estimate fee rate needed to get into the next nBlocks */
     CFeeRate estimateFee(int nBlocks) const;
 